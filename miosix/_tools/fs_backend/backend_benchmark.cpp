@@ -9,6 +9,11 @@
  * 
  * NOTE: this program assumes the SD is larger than 1GByte, and you have
  * 32KByte available in your microcontroller for the disk buffer.
+ *
+ * The metadata test instead goes through the filesystem mounted in /sd and
+ * does not corrupt the SD card. It creates and stats many small files, which
+ * stresses the FAT and directory sector accesses, and prints the hit/miss
+ * statistics of the Fat32Fs sector cache.
  */
 
 #include <cstdio>
@@ -16,7 +21,11 @@
 #include <cassert>
 #include <chrono>
 #include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/ioctl.h>
 #include <miosix.h>
+#include <filesystem/ioctl.h>
 
 using namespace std;
 using namespace std::chrono;
@@ -65,6 +74,42 @@ void testThread(void *)
     delete[] data;
 }
 
+void metadataTest()
+{
+    const int numFiles=64;
+    mkdir("/sd/bench",0755);
+    auto t=system_clock::now();
+    for(int i=0;i<numFiles;i++)
+    {
+        char name[32];
+        sprintf(name,"/sd/bench/f%d.txt",i);
+        int fd=open(name,O_WRONLY|O_CREAT|O_TRUNC,0644);
+        if(fd<0) { perror("open"); return; }
+        write(fd,name,strlen(name));
+        close(fd);
+    }
+    duration<float> d1=system_clock::now()-t;
+    t=system_clock::now();
+    for(int j=0;j<10;j++)
+    {
+        for(int i=0;i<numFiles;i++)
+        {
+            char name[32];
+            sprintf(name,"/sd/bench/f%d.txt",i);
+            struct stat st;
+            if(stat(name,&st)!=0) { perror("stat"); return; }
+        }
+    }
+    duration<float> d2=system_clock::now()-t;
+    printf("create:%0.3fs stat:%0.3fs\n",d1.count(),d2.count());
+    int fd=open("/sd/bench/f0.txt",O_RDONLY);
+    CacheStats stats;
+    if(fd>=0 && ioctl(fd,IOCTL_GET_CACHE_STATS,&stats)==0)
+        printf("cache hits:%u misses:%u writebacks:%u\n",
+               stats.hits,stats.misses,stats.writebacks);
+    if(fd>=0) close(fd);
+}
+
 int main()
 {
     puts("\n====================");
@@ -74,15 +119,26 @@ int main()
     {
         writeAccess=false;
         randomAccess=false;
+        bool metadata=false;
         for(;;)
         {
-            puts("Read or write access, or quit (r/w/q)?");
+            puts("Read or write access, metadata test, or quit (r/w/m/q)?");
             char line[64];
             fgets(line,sizeof(line),stdin);
             if(line[0]=='q') goto quit;
+            if(line[0]=='m')
+            {
+                metadata=true;
+                break;
+            }
             if(line[0]=='w') writeAccess=true;
             if(line[0]=='w' || line[0]=='r') break;
-            puts("Error: insert 'r' or 'w' or 'q'");
+            puts("Error: insert 'r' or 'w' or 'm' or 'q'");
+        }
+        if(metadata)
+        {
+            metadataTest();
+            continue;
         }
         for(;;)
         {
@@ -0,0 +1,393 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+//Test of the asynchronous I/O completion API on a Linux host. Build with
+//CMake, see Readme.txt
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <fcntl.h>
+#include "filesystem/aio.h"
+#include "filesystem/devfs/devfs.h"
+#include "e20/e20.h"
+#include "test_common.h"
+
+using namespace std;
+using namespace miosix;
+
+/**
+ * A file without native asynchronous I/O, that appends writes to a string
+ */
+class StringFile : public FileBase
+{
+public:
+    StringFile() : FileBase(intrusive_ref_ptr<FilesystemBase>()), readPos(0) {}
+
+    virtual ssize_t write(const void *data, size_t len)
+    {
+        this_thread::sleep_for(chrono::microseconds(200));
+        Lock<FastMutex> l(m);
+        writerThread=this_thread::get_id();
+        content.append(reinterpret_cast<const char*>(data),len);
+        return len;
+    }
+
+    virtual ssize_t read(void *data, size_t len)
+    {
+        Lock<FastMutex> l(m);
+        len=min(len,content.size()-readPos);
+        memcpy(data,content.data()+readPos,len);
+        readPos+=len;
+        return len;
+    }
+
+    virtual off_t lseek(off_t pos, int whence) { return -EBADF; }
+
+    virtual int fstat(struct stat *pstat) const { return -EBADF; }
+
+    string content;
+    size_t readPos;
+    thread::id writerThread;
+    FastMutex m;
+};
+
+/**
+ * A block device in RAM, whose transfers can be stalled
+ */
+class RamDevice : public Device
+{
+public:
+    RamDevice() : Device(Device::BLOCK), data(4096,'\0'), stalled(false) {}
+
+    ssize_t readBlock(void *buffer, size_t size, off_t where)
+    {
+        wait();
+        if(where+size>data.size()) return -EIO;
+        memcpy(buffer,data.data()+where,size);
+        return size;
+    }
+
+    ssize_t writeBlock(const void *buffer, size_t size, off_t where)
+    {
+        wait();
+        if(where+size>data.size()) return -EIO;
+        memcpy(&data[where],buffer,size);
+        return size;
+    }
+
+    void stall()
+    {
+        lock_guard<mutex> l(m);
+        stalled=true;
+    }
+
+    void resume()
+    {
+        lock_guard<mutex> l(m);
+        stalled=false;
+        cv.notify_all();
+    }
+
+    string data;
+    thread::id performerThread;
+
+private:
+    void wait()
+    {
+        unique_lock<mutex> l(m);
+        performerThread=this_thread::get_id();
+        while(stalled) cv.wait(l);
+    }
+
+    mutex m;
+    condition_variable cv;
+    bool stalled;
+};
+
+/**
+ * A terminal whose reads block until data is available
+ */
+class BlockingTty : public Device
+{
+public:
+    BlockingTty() : Device(Device::TTY), available(false) {}
+
+    ssize_t readBlock(void *buffer, size_t size, off_t where)
+    {
+        unique_lock<mutex> l(m);
+        while(available==false) cv.wait(l);
+        available=false;
+        memset(buffer,'x',size);
+        return size;
+    }
+
+    void type()
+    {
+        lock_guard<mutex> l(m);
+        available=true;
+        cv.notify_all();
+    }
+
+private:
+    mutex m;
+    condition_variable cv;
+    bool available;
+};
+
+static intrusive_ref_ptr<FileBase> openDevice(intrusive_ref_ptr<Device> dev)
+{
+    intrusive_ref_ptr<FileBase> file;
+    check(dev->open(file,intrusive_ref_ptr<FilesystemBase>(),O_RDWR,0)==0);
+    return file;
+}
+
+/**
+ * Requests using the file pointer complete in order, the semaphore is
+ * signaled once per request, and they are performed by the worker thread
+ */
+static void testSemaphore()
+{
+    intrusive_ref_ptr<StringFile> file(new StringFile);
+    Semaphore sem;
+    AioCompletion completion(sem);
+    const int n=8;
+    char bufs[n][4];
+    vector<AioRequest*> reqs;
+    for(int i=0;i<n;i++)
+    {
+        snprintf(bufs[i],sizeof(bufs[i]),"<%d>",i);
+        reqs.push_back(new AioRequest(3,AioRequest::WRITE,bufs[i],3));
+        aioStart(reqs[i],file,completion);
+    }
+    for(int i=0;i<n;i++) sem.wait();
+    check(sem.tryWait()==false);
+    check(completion.pending()==0);
+    for(int i=0;i<n;i++)
+    {
+        AioRequest *req=completion.poll();
+        check(req==reqs[i]);
+        check(req->completed() && req->result()==3);
+        check(req->getFile()==nullptr); //The file is no longer referenced
+        delete req;
+    }
+    check(completion.poll()==nullptr);
+    check(completion.wait()==nullptr); //Nothing in flight, does not block
+    check(file->content=="<0><1><2><3><4><5><6><7>");
+    check(file->writerThread!=this_thread::get_id());
+}
+
+/**
+ * Requests on block devices are performed by the device, at the file
+ * pointer or at the given offset
+ */
+static void testBlockDevice()
+{
+    intrusive_ref_ptr<RamDevice> dev(new RamDevice);
+    intrusive_ref_ptr<FileBase> file=openDevice(dev);
+    AioCompletion completion;
+    char a[]="hello", b[]="world";
+    AioRequest w1(3,AioRequest::WRITE,a,5,100);
+    AioRequest w2(3,AioRequest::WRITE,b,5); //At the file pointer, 0
+    aioStart(&w1,file,completion);
+    aioStart(&w2,file,completion);
+    //The file pointer moves when the request is started
+    check(file->lseek(0,SEEK_CUR)==5);
+    check(completion.wait()==&w1);
+    check(completion.wait()==&w2);
+    check(w1.result()==5 && w2.result()==5);
+    check(dev->data.compare(100,5,"hello")==0);
+    check(dev->data.compare(0,5,"world")==0);
+    check(dev->performerThread!=this_thread::get_id());
+    char buf[10];
+    AioRequest r(3,AioRequest::READ,buf,10,98);
+    aioStart(&r,file,completion);
+    check(completion.wait()==&r);
+    check(r.result()==10 && memcmp(buf,"\0\0hello\0\0\0",10)==0);
+    //Errors are reported in the result
+    AioRequest bad(3,AioRequest::READ,buf,10,4090);
+    aioStart(&bad,file,completion);
+    check(completion.wait()==&bad && bad.result()==-EIO);
+}
+
+/**
+ * A stalled device does not delay the requests to other files
+ */
+static void testIndependentQueues()
+{
+    intrusive_ref_ptr<RamDevice> dev(new RamDevice);
+    intrusive_ref_ptr<FileBase> devFile=openDevice(dev);
+    intrusive_ref_ptr<StringFile> strFile(new StringFile);
+    AioCompletion completion;
+    char a[]="abc";
+    AioRequest w1(3,AioRequest::WRITE,a,3,0);
+    AioRequest w2(4,AioRequest::WRITE,a,3);
+    dev->stall();
+    aioStart(&w1,devFile,completion);
+    aioStart(&w2,strFile,completion);
+    check(completion.wait()==&w2);
+    check(w1.completed()==false && completion.pending()==1);
+    dev->resume();
+    check(completion.wait()==&w1);
+    check(completion.pending()==0);
+}
+
+/**
+ * A read waiting for data on a terminal does not delay the requests to other
+ * files, including other terminals
+ */
+static void testBlockedStream()
+{
+    intrusive_ref_ptr<BlockingTty> tty1(new BlockingTty);
+    intrusive_ref_ptr<BlockingTty> tty2(new BlockingTty);
+    intrusive_ref_ptr<FileBase> file1=openDevice(tty1);
+    intrusive_ref_ptr<FileBase> file2=openDevice(tty2);
+    intrusive_ref_ptr<StringFile> strFile(new StringFile);
+    AioCompletion completion;
+    char a[]="abc", b[4], c[4];
+    AioRequest r1(3,AioRequest::READ,b,4);
+    AioRequest r2(4,AioRequest::READ,c,4);
+    AioRequest w(5,AioRequest::WRITE,a,3);
+    aioStart(&r1,file1,completion);
+    aioStart(&r2,file2,completion);
+    aioStart(&w,strFile,completion);
+    check(completion.wait()==&w);
+    tty2->type();
+    check(completion.wait()==&r2);
+    check(r1.completed()==false && completion.pending()==1);
+    tty1->type();
+    check(completion.wait()==&r1);
+    check(r1.result()==4 && memcmp(b,"xxxx",4)==0);
+}
+
+/**
+ * Completions are posted to an event queue
+ */
+static void testEventQueue()
+{
+    intrusive_ref_ptr<RamDevice> dev(new RamDevice);
+    intrusive_ref_ptr<FileBase> file=openDevice(dev);
+    EventQueue queue;
+    vector<AioRequest*> done;
+    AioCompletion completion(queue,[&](AioRequest *req){ done.push_back(req); });
+    char a[]="xyz";
+    AioRequest w1(3,AioRequest::WRITE,a,3,10);
+    AioRequest w2(3,AioRequest::WRITE,a,3,20);
+    aioStart(&w1,file,completion);
+    aioStart(&w2,file,completion);
+    queue.runOne();
+    queue.runOne();
+    check(done.size()==2 && done[0]==&w1 && done[1]==&w2);
+    check(completion.poll()==nullptr);
+    check(dev->data.compare(10,3,"xyz")==0 && dev->data.compare(20,3,"xyz")==0);
+}
+
+/**
+ * Closing a device while a request is in flight deletes it only once the
+ * request has completed and the device thread no longer uses it
+ */
+static void testCloseInFlight()
+{
+    for(int i=0;i<100;i++)
+    {
+        intrusive_ref_ptr<RamDevice> dev(new RamDevice);
+        intrusive_ref_ptr<FileBase> file=openDevice(dev);
+        Semaphore sem;
+        AioCompletion completion(sem);
+        char a[]="abc";
+        AioRequest w(3,AioRequest::WRITE,a,3,0);
+        aioStart(&w,file,completion);
+        file.reset();
+        dev.reset();
+        sem.wait();
+        check(w.result()==3);
+    }
+    //Let the last device thread terminate before leaving
+    this_thread::sleep_for(chrono::milliseconds(10));
+}
+
+/**
+ * Non block devices go through the worker thread
+ */
+static void testStreamDevice()
+{
+    intrusive_ref_ptr<Device> dev(new Device(Device::STREAM));
+    intrusive_ref_ptr<FileBase> file=openDevice(dev);
+    AioCompletion completion;
+    char buf[4]={1,2,3,4};
+    AioRequest r(3,AioRequest::READ,buf,4);
+    aioStart(&r,file,completion);
+    check(completion.wait()==&r);
+    check(r.result()==4 && buf[0]==0 && buf[3]==0); //Acts as /dev/zero
+}
+
+/**
+ * Throughput of many small requests through the worker thread
+ */
+static void benchmark()
+{
+    intrusive_ref_ptr<RamDevice> dev(new RamDevice);
+    intrusive_ref_ptr<FileBase> file=openDevice(dev);
+    AioCompletion completion;
+    const int n=20000;
+    const int batch=16;
+    char buf[16];
+    vector<unique_ptr<AioRequest>> reqs;
+    for(int i=0;i<batch;i++)
+        reqs.emplace_back(new AioRequest(3,AioRequest::READ,buf,sizeof(buf),
+                                         i*sizeof(buf)));
+    auto start=chrono::steady_clock::now();
+    for(int i=0;i<n;i+=batch)
+    {
+        for(auto& r : reqs) aioStart(r.get(),file,completion);
+        for(int j=0;j<batch;j++) check(completion.wait());
+    }
+    double s=secondsSince(start);
+    printf("%d requests in batches of %d: %.0f requests/s\n",n,batch,n/s);
+}
+
+int main()
+{
+    testSemaphore();
+    testBlockDevice();
+    testIndependentQueues();
+    testBlockedStream();
+    testEventQueue();
+    testCloseInFlight();
+    testStreamDevice();
+    benchmark();
+    printf("All tests passed\n");
+    return 0;
+}
@@ -0,0 +1,315 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+//Test of the block device request queue on a Linux host. Build with CMake,
+//see Readme.txt
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "filesystem/devfs/ram_disk.h"
+#include "test_common.h"
+
+using namespace std;
+using namespace miosix;
+
+/**
+ * A RamDisk that records the sectors of the requests of each transfer, and
+ * whose transfers can be stalled, so that requests accumulate in the queue
+ */
+class TraceDisk : public RamDisk
+{
+public:
+    TraceDisk() : RamDisk(64), stalled(false), entered(0) {}
+
+    void stall()
+    {
+        lock_guard<std::mutex> l(m);
+        stalled=true;
+    }
+
+    void resume()
+    {
+        lock_guard<std::mutex> l(m);
+        stalled=false;
+        cv.notify_all();
+    }
+
+    /**
+     * Wait until a transfer is stalled
+     */
+    void waitStalled()
+    {
+        unique_lock<std::mutex> l(m);
+        while(entered==0) cv.wait(l);
+    }
+
+    vector<vector<unsigned int>> trace;
+
+protected:
+    virtual void transfer(BlockRequest *list)
+    {
+        {
+            unique_lock<std::mutex> l(m);
+            entered++;
+            cv.notify_all();
+            while(stalled) cv.wait(l);
+            vector<unsigned int> sectors;
+            for(BlockRequest *r=list;r;r=r->next) sectors.push_back(r->sector);
+            trace.push_back(sectors);
+        }
+        RamDisk::transfer(list);
+    }
+
+private:
+    std::mutex m;
+    condition_variable cv;
+    bool stalled;
+    int entered;
+};
+
+/**
+ * A RamDisk where each transfer takes time, like the commands of a real disk
+ */
+class SlowDisk : public RamDisk
+{
+public:
+    SlowDisk(unsigned int sectors) : RamDisk(sectors) {}
+
+protected:
+    virtual void transfer(BlockRequest *list)
+    {
+        this_thread::sleep_for(chrono::microseconds(100));
+        RamDisk::transfer(list);
+    }
+};
+
+/**
+ * Start a thread making a one sector request, and give it the time to enter
+ * the queue
+ */
+static thread request(intrusive_ref_ptr<BlockDevice> dev, BlockRequest::Op op,
+        unsigned int sector)
+{
+    thread t([=]{
+        char buf[512];
+        memset(buf,sector,sizeof(buf));
+        if(op==BlockRequest::READ) check(dev->readBlock(buf,512,sector*512)==512);
+        else check(dev->writeBlock(buf,512,sector*512)==512);
+    });
+    this_thread::sleep_for(chrono::milliseconds(20));
+    return t;
+}
+
+/**
+ * Reads and writes, alignment, the end of the device, and scatter-gather
+ * requests through a file
+ */
+static void testReadWrite()
+{
+    intrusive_ref_ptr<RamDisk> dev(new RamDisk(64));
+    vector<char> a(1024), b(1024);
+    for(int i=0;i<1024;i++) a[i]=i*7;
+    check(dev->writeBlock(a.data(),1024,512)==1024);
+    check(dev->readBlock(b.data(),1024,512)==1024);
+    check(a==b);
+    //Requests must be aligned to the sector size
+    check(dev->readBlock(b.data(),100,0)==-EFAULT);
+    check(dev->writeBlock(a.data(),512,100)==-EFAULT);
+    //The end of the device
+    check(dev->readBlock(b.data(),512,64*512)==0);
+    check(dev->readBlock(b.data(),1024,63*512)==512);
+    check(dev->writeBlock(a.data(),512,64*512)==-ENOSPC);
+    check(dev->writeBlock(a.data(),1024,63*512)==512);
+    struct stat st;
+    check(dev->fstat(&st)==0 && S_ISBLK(st.st_mode) && st.st_size==64*512);
+    check(dev->requests()==4);
+
+    //Scatter-gather requests are a single request, also through a file
+    intrusive_ref_ptr<FileBase> file;
+    check(dev->open(file,intrusive_ref_ptr<FilesystemBase>(),O_RDWR,0)==0);
+    vector<char> c(512,'c'), d(1536,'d');
+    struct iovec iov[3];
+    iov[0].iov_base=c.data(); iov[0].iov_len=c.size();
+    iov[1].iov_base=nullptr;  iov[1].iov_len=0;
+    iov[2].iov_base=d.data(); iov[2].iov_len=d.size();
+    check(file->lseek(4*512,SEEK_SET)==4*512);
+    unsigned int requests=dev->requests();
+    check(file->writev(iov,3)==2048);
+    check(dev->requests()==requests+1);
+    vector<char> e(2048);
+    check(file->pread(e.data(),2048,4*512)==2048);
+    check(memcmp(e.data(),c.data(),512)==0);
+    check(memcmp(e.data()+512,d.data(),1536)==0);
+    //Past the end, the buffers are read one by one up to the end
+    iov[0].iov_base=e.data();      iov[0].iov_len=512;
+    iov[1].iov_base=e.data()+512;  iov[1].iov_len=1024;
+    check(dev->readBlocks(iov,2,62*512)==1024);
+    iov[1].iov_len=100;
+    check(dev->readBlocks(iov,2,0)==-EFAULT);
+}
+
+/**
+ * Requests made while a transfer is in progress are transferred by sector,
+ * continuing in the direction of the sweep, with reads and writes in
+ * different transfers
+ */
+static void testElevator()
+{
+    intrusive_ref_ptr<TraceDisk> dev(new TraceDisk);
+    dev->stall();
+    vector<thread> threads;
+    threads.push_back(request(dev,BlockRequest::WRITE,8));
+    dev->waitStalled();
+    threads.push_back(request(dev,BlockRequest::WRITE,40));
+    threads.push_back(request(dev,BlockRequest::WRITE,10));
+    threads.push_back(request(dev,BlockRequest::READ,35));
+    threads.push_back(request(dev,BlockRequest::WRITE,2));
+    threads.push_back(request(dev,BlockRequest::WRITE,30));
+    threads.push_back(request(dev,BlockRequest::WRITE,11));
+    dev->resume();
+    for(auto& t : threads) t.join();
+    vector<vector<unsigned int>> expected={{8},{10,11,30,40},{2},{35}};
+    check(dev->trace==expected);
+    check(dev->transfers()==4);
+    //Sectors 10 and 11 are adjacent, so one command less than the requests
+    check(dev->requests()==7 && dev->commands()==6);
+    char buf[512];
+    check(dev->readBlock(buf,512,11*512)==512 && buf[0]==11);
+}
+
+/**
+ * A request that waited past its deadline is transferred first
+ */
+static void testDeadline()
+{
+    intrusive_ref_ptr<TraceDisk> dev(new TraceDisk);
+    dev->setDeadlines(1000000,0); //Reads expire after 1ms, writes never
+    dev->stall();
+    vector<thread> threads;
+    threads.push_back(request(dev,BlockRequest::WRITE,8));
+    dev->waitStalled();
+    threads.push_back(request(dev,BlockRequest::WRITE,20));
+    threads.push_back(request(dev,BlockRequest::READ,4));
+    threads.push_back(request(dev,BlockRequest::WRITE,30));
+    dev->resume();
+    for(auto& t : threads) t.join();
+    vector<vector<unsigned int>> expected={{8},{4},{20,30}};
+    check(dev->trace==expected);
+
+    //Without deadlines the read waits for the next sweep
+    intrusive_ref_ptr<TraceDisk> dev2(new TraceDisk);
+    dev2->stall();
+    threads.clear();
+    threads.push_back(request(dev2,BlockRequest::WRITE,8));
+    dev2->waitStalled();
+    threads.push_back(request(dev2,BlockRequest::WRITE,20));
+    threads.push_back(request(dev2,BlockRequest::READ,4));
+    threads.push_back(request(dev2,BlockRequest::WRITE,30));
+    dev2->resume();
+    for(auto& t : threads) t.join();
+    expected={{8},{20,30},{4}};
+    check(dev2->trace==expected);
+}
+
+/**
+ * Threads writing and reading back their own sectors concurrently
+ */
+static void testConcurrent()
+{
+    intrusive_ref_ptr<RamDisk> dev(new RamDisk(256));
+    const int numThreads=4;
+    vector<thread> threads;
+    for(int t=0;t<numThreads;t++)
+    {
+        threads.emplace_back([dev,t]{
+            char w[1024], r[1024];
+            for(int i=0;i<500;i++)
+            {
+                //Sectors of the thread are the ones equal to t modulo 4
+                unsigned int sector=(i*8+t*2)%256;
+                memset(w,t*16+i%16,sizeof(w));
+                if(i%2) w[0]=0; //Not all sectors with the same content
+                check(dev->writeBlock(w,512,sector*512)==512);
+                check(dev->readBlock(r,512,sector*512)==512);
+                check(memcmp(w,r,512)==0);
+            }
+        });
+    }
+    for(auto& t : threads) t.join();
+    check(dev->requests()==numThreads*500*2);
+}
+
+/**
+ * Throughput of threads reading interleaved sectors, that the queue merges,
+ * from a disk whose transfers take 100us
+ */
+static void benchmark()
+{
+    intrusive_ref_ptr<RamDisk> dev(new SlowDisk(4096));
+    const int numThreads=4;
+    const int n=2000;
+    vector<thread> threads;
+    auto start=chrono::steady_clock::now();
+    for(int t=0;t<numThreads;t++)
+    {
+        threads.emplace_back([dev,t]{
+            char buf[512];
+            for(int i=0;i<n;i++)
+            {
+                unsigned int sector=(i*numThreads+t)%4096;
+                check(dev->readBlock(buf,512,sector*512)==512);
+            }
+        });
+    }
+    for(auto& t : threads) t.join();
+    double s=secondsSince(start);
+    printf("%d threads: %.0f requests/s, %.2f requests and %.2f commands "
+           "per transfer\n",numThreads,numThreads*n/s,
+           double(dev->requests())/dev->transfers(),
+           double(dev->commands())/dev->transfers());
+}
+
+int main()
+{
+    testReadWrite();
+    testElevator();
+    testDeadline();
+    testConcurrent();
+    benchmark();
+    printf("All tests passed\n");
+    return 0;
+}
@@ -0,0 +1,242 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+//Test of DevFs on a Linux host. Build with CMake, see Readme.txt
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <chrono>
+#include <fcntl.h>
+#include <dirent.h>
+#include "filesystem/devfs/devfs.h"
+#include "test_common.h"
+
+using namespace std;
+using namespace miosix;
+
+static int openFile(intrusive_ref_ptr<DevFs> fs, const char *name, int flags,
+        intrusive_ref_ptr<FileBase>& file)
+{
+    StringPart sp(name);
+    return fs->open(file,sp,flags,0);
+}
+
+static int statFile(intrusive_ref_ptr<DevFs> fs, const char *name,
+        struct stat *st)
+{
+    StringPart sp(name);
+    return fs->lstat(sp,st);
+}
+
+static intrusive_ref_ptr<Device> newDevice()
+{
+    return intrusive_ref_ptr<Device>(new Device(Device::STREAM));
+}
+
+static vector<string> listDir(intrusive_ref_ptr<DevFs> fs, int bufSize)
+{
+    intrusive_ref_ptr<FileBase> d;
+    check(openFile(fs,"",O_RDONLY,d)==0);
+    vector<string> result;
+    char buf[1024] __attribute__((aligned(8)));
+    for(;;)
+    {
+        int len=d->getdents(buf,bufSize);
+        check(len>=0);
+        if(len==0) break;
+        for(int pos=0;pos<len;)
+        {
+            struct dirent *e=reinterpret_cast<struct dirent*>(buf+pos);
+            if(e->d_reclen==0) break;
+            result.push_back(e->d_name);
+            pos+=e->d_reclen;
+        }
+    }
+    return result;
+}
+
+static void testBasic()
+{
+    intrusive_ref_ptr<DevFs> fs(new DevFs);
+    struct stat st, st2;
+    check(statFile(fs,"null",&st)==0 && statFile(fs,"zero",&st2)==0);
+    check(st.st_ino!=st2.st_ino);
+    check(fs->addDevice("sda",newDevice()));
+    check(fs->addDevice("sda",newDevice())==false);
+    check(fs->addDevice("a/b",newDevice())==false);
+    check(fs->addDevice("",newDevice())==false);
+    intrusive_ref_ptr<FileBase> f;
+    check(openFile(fs,"sda",O_RDWR,f)==0);
+    check(openFile(fs,"sd",O_RDWR,f)==-ENOENT);
+    check(openFile(fs,"sdaa",O_RDWR,f)==-ENOENT);
+    check(openFile(fs,"",O_RDWR,f)==-EACCES);
+
+    //Rename keeps the inode, and replaces the target
+    check(statFile(fs,"sda",&st)==0);
+    StringPart sda("sda"), disk("disk"), zero("zero"), fifo("fifo");
+    check(fs->rename(sda,disk)==0);
+    check(statFile(fs,"sda",&st2)==-ENOENT);
+    check(statFile(fs,"disk",&st2)==0 && st2.st_ino==st.st_ino);
+    check(fs->rename(disk,zero)==0);
+    check(statFile(fs,"zero",&st2)==0 && st2.st_ino==st.st_ino);
+    check(statFile(fs,"disk",&st2)==-ENOENT);
+    check(fs->rename(zero,zero)==0);
+    check(fs->rename(disk,zero)==-ENOENT);
+
+    check(fs->mkfifo(fifo,0644)==0);
+    check(fs->mkfifo(fifo,0644)==-EEXIST);
+    check(statFile(fs,"fifo",&st)==0 && S_ISFIFO(st.st_mode));
+    check(fs->unlink(fifo)==0);
+    check(fs->unlink(fifo)==-ENOENT);
+    check(fs->remove("zero"));
+    check(fs->remove("zero")==false);
+
+    //An open file outlives the removal of its device
+    check(fs->addDevice("dev",newDevice()));
+    check(openFile(fs,"dev",O_RDWR,f)==0);
+    check(fs->remove("dev"));
+    check(f->fstat(&st)==0);
+}
+
+static void testDirectoryListing()
+{
+    intrusive_ref_ptr<DevFs> fs(new DevFs);
+    vector<string> expected={".","..","null","zero"};
+    const int numDevices=300;
+    for(int i=0;i<numDevices;i++)
+    {
+        string name="dev"+to_string(i);
+        check(fs->addDevice(name.c_str(),newDevice()));
+        expected.push_back(name);
+    }
+    sort(expected.begin()+2,expected.end());
+    check(listDir(fs,1024)==expected);
+    check(listDir(fs,96)==expected); //Few entries per call
+    for(int i=0;i<numDevices;i++)
+    {
+        string name="dev"+to_string(i);
+        intrusive_ref_ptr<FileBase> f;
+        check(openFile(fs,name.c_str(),O_RDWR,f)==0);
+    }
+
+    //A directory lists the devices there were when it was opened
+    intrusive_ref_ptr<FileBase> d;
+    check(openFile(fs,"",O_RDONLY,d)==0);
+    for(int i=0;i<numDevices;i++)
+        check(fs->remove(("dev"+to_string(i)).c_str()));
+    char buf[1024] __attribute__((aligned(8)));
+    int total=0;
+    for(int len;(len=d->getdents(buf,sizeof(buf)))>0;)
+        for(int pos=0;pos<len;pos+=reinterpret_cast<dirent*>(buf+pos)->d_reclen)
+        {
+            if(reinterpret_cast<dirent*>(buf+pos)->d_reclen==0) break;
+            total++;
+        }
+    check(total==numDevices+4);
+    check(listDir(fs,1024)==(vector<string>{".","..","null","zero"}));
+}
+
+/**
+ * Threads opening devices while another one adds and removes others
+ */
+static void testConcurrentOpen()
+{
+    intrusive_ref_ptr<DevFs> fs(new DevFs);
+    const int numStable=16;
+    for(int i=0;i<numStable;i++)
+        check(fs->addDevice(("tty"+to_string(i)).c_str(),newDevice()));
+    atomic<bool> quit(false);
+    thread writer([&]{
+        for(int i=0;quit==false;i++)
+        {
+            string name="usb"+to_string(i % 8);
+            if(fs->addDevice(name.c_str(),newDevice())==false)
+                check(fs->remove(name.c_str()));
+        }
+    });
+    const int numThreads=4;
+    vector<thread> readers;
+    for(int t=0;t<numThreads;t++) readers.emplace_back([&,t]{
+        for(int i=0;i<20000;i++)
+        {
+            string name="tty"+to_string((i+t) % numStable);
+            intrusive_ref_ptr<FileBase> f;
+            check(openFile(fs,name.c_str(),O_RDWR,f)==0);
+            struct stat st;
+            check(f->fstat(&st)==0);
+            name="usb"+to_string(i % 8);
+            int result=openFile(fs,name.c_str(),O_RDWR,f);
+            check(result==0 || result==-ENOENT);
+        }
+    });
+    for(auto& r : readers) r.join();
+    quit=true;
+    writer.join();
+}
+
+static void benchmark()
+{
+    intrusive_ref_ptr<DevFs> fs(new DevFs);
+    const int numDevices=32;
+    for(int i=0;i<numDevices;i++)
+        check(fs->addDevice(("tty"+to_string(i)).c_str(),newDevice()));
+    for(int numThreads : {1,4})
+    {
+        const int iterations=200000;
+        auto start=chrono::steady_clock::now();
+        vector<thread> threads;
+        for(int t=0;t<numThreads;t++) threads.emplace_back([&,t]{
+            char name[8];
+            for(int i=0;i<iterations;i++)
+            {
+                snprintf(name,sizeof(name),"tty%d",(i+t) % numDevices);
+                intrusive_ref_ptr<FileBase> f;
+                check(openFile(fs,name,O_RDWR,f)==0);
+            }
+        });
+        for(auto& t : threads) t.join();
+        double s=secondsSince(start);
+        printf("open() with %d threads: %.0f per second\n",numThreads,
+               numThreads*iterations/s);
+    }
+}
+
+int main()
+{
+    testBasic();
+    testDirectoryListing();
+    testConcurrentOpen();
+    benchmark();
+    printf("All tests passed\n");
+    return 0;
+}
@@ -0,0 +1,408 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+//Test and benchmark of LogFs on a Linux host, using RamFlash as the flash
+//device. Build with CMake, see Readme.txt
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <set>
+#include <chrono>
+#include <algorithm>
+#include <fcntl.h>
+#include <dirent.h>
+#include "filesystem/logfs/logfs.h"
+#include "filesystem/logfs/ram_flash.h"
+#include "filesystem/ioctl.h"
+#include "test_common.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace miosix;
+
+//
+// Helper functions
+//
+
+static intrusive_ref_ptr<RamFlash> makeFlash(unsigned int blockSize,
+        unsigned int blockCount)
+{
+    intrusive_ref_ptr<RamFlash> flash(new RamFlash(blockSize,blockCount));
+    check(LogFs::format(flash)==0);
+    return flash;
+}
+
+static intrusive_ref_ptr<LogFs> mount(intrusive_ref_ptr<RamFlash> flash)
+{
+    intrusive_ref_ptr<LogFs> fs(new LogFs(flash));
+    check(fs->mountFailed()==false);
+    return fs;
+}
+
+static int openFile(intrusive_ref_ptr<LogFs> fs, const char *name, int flags,
+        intrusive_ref_ptr<FileBase>& file)
+{
+    StringPart sp(name);
+    return fs->open(file,sp,flags,0644);
+}
+
+static int statFile(intrusive_ref_ptr<LogFs> fs, const char *name,
+        struct stat *st)
+{
+    StringPart sp(name);
+    return fs->lstat(sp,st);
+}
+
+static char pattern(unsigned int i, unsigned int seed)
+{
+    return static_cast<char>((i*31+seed*17+i/509) & 0xff);
+}
+
+static void writeFile(intrusive_ref_ptr<LogFs> fs, const char *name,
+        unsigned int size, unsigned int seed)
+{
+    intrusive_ref_ptr<FileBase> f;
+    check(openFile(fs,name,O_WRONLY | O_CREAT | O_TRUNC,f)==0);
+    char buf[700]; //Not a multiple of the page size
+    for(unsigned int i=0;i<size;i+=sizeof(buf))
+    {
+        unsigned int n=min<unsigned int>(sizeof(buf),size-i);
+        for(unsigned int j=0;j<n;j++) buf[j]=pattern(i+j,seed);
+        check(f->write(buf,n)==n);
+    }
+}
+
+static bool verifyFile(intrusive_ref_ptr<LogFs> fs, const char *name,
+        unsigned int size, unsigned int seed)
+{
+    intrusive_ref_ptr<FileBase> f;
+    if(openFile(fs,name,O_RDONLY,f)) return false;
+    struct stat st;
+    if(f->fstat(&st) || st.st_size!=size) return false;
+    char buf[1000];
+    for(unsigned int i=0;i<size;i+=sizeof(buf))
+    {
+        unsigned int n=min<unsigned int>(sizeof(buf),size-i);
+        if(f->read(buf,n)!=n) return false;
+        for(unsigned int j=0;j<n;j++) if(buf[j]!=pattern(i+j,seed)) return false;
+    }
+    return f->read(buf,1)==0;
+}
+
+static bool verifyPrefix(intrusive_ref_ptr<LogFs> fs, const char *name,
+        unsigned int maxSize, unsigned int seed)
+{
+    struct stat st;
+    if(statFile(fs,name,&st) || st.st_size>maxSize) return false;
+    return verifyFile(fs,name,st.st_size,seed);
+}
+
+static bool verifyPages(intrusive_ref_ptr<LogFs> fs, const char *name,
+        unsigned int size, unsigned int firstSeed, unsigned int lastSeed)
+{
+    intrusive_ref_ptr<FileBase> f;
+    if(openFile(fs,name,O_RDONLY,f)) return false;
+    vector<char> buf(size);
+    if(f->read(buf.data(),size)!=size || f->read(buf.data(),1)!=0) return false;
+    const unsigned int pageSize=LogFs::pageSize;
+    for(unsigned int i=0;i<size;i+=pageSize)
+    {
+        unsigned int n=min(pageSize,size-i);
+        bool match=false;
+        for(unsigned int seed=firstSeed;seed<=lastSeed && !match;seed++)
+        {
+            match=true;
+            for(unsigned int j=i;j<i+n;j++)
+                if(buf[j]!=pattern(j,seed)) match=false;
+        }
+        if(match==false) return false;
+    }
+    return true;
+}
+
+static set<string> listDir(intrusive_ref_ptr<LogFs> fs, const char *name)
+{
+    intrusive_ref_ptr<FileBase> d;
+    check(openFile(fs,name,O_RDONLY,d)==0);
+    set<string> result;
+    char buf[256] __attribute__((aligned(8)));
+    for(;;)
+    {
+        int len=d->getdents(buf,sizeof(buf));
+        check(len>=0);
+        if(len==0) break;
+        for(int pos=0;pos<len;)
+        {
+            struct dirent *e=reinterpret_cast<struct dirent*>(buf+pos);
+            if(e->d_reclen==0) break;
+            result.insert(e->d_name);
+            pos+=e->d_reclen;
+        }
+    }
+    return result;
+}
+
+//
+// Tests
+//
+
+static void testBasic()
+{
+    printf("Basic operations\n");
+    auto flash=makeFlash(4096,32);
+    {
+        auto fs=mount(flash);
+        writeFile(fs,"a.txt",3000,1);
+        check(verifyFile(fs,"a.txt",3000,1));
+        intrusive_ref_ptr<FileBase> f;
+        check(openFile(fs,"a.txt",O_RDONLY | O_CREAT | O_EXCL,f)==-EEXIST);
+        check(openFile(fs,"missing",O_RDONLY,f)==-ENOENT);
+        StringPart dir("dir"), sub("dir/sub"), dir2("dir2"), inner("dir/sub/x");
+        check(fs->mkdir(dir,0755)==0);
+        check(fs->mkdir(dir,0755)==-EEXIST);
+        check(fs->mkdir(sub,0755)==0);
+        writeFile(fs,"dir/sub/b.bin",10000,2);
+        check(listDir(fs,"")==(set<string>{".","..","a.txt","dir"}));
+        check(listDir(fs,"dir")==(set<string>{".","..","sub"}));
+        struct stat st;
+        check(statFile(fs,"dir/sub",&st)==0 && S_ISDIR(st.st_mode));
+        check(statFile(fs,"a.txt/x",&st)==-ENOTDIR);
+        //Rename, also across directories
+        StringPart a("a.txt"), c("dir/c.txt"), b("dir/sub/b.bin");
+        check(fs->rename(a,c)==0);
+        check(statFile(fs,"a.txt",&st)==-ENOENT);
+        check(verifyFile(fs,"dir/c.txt",3000,1));
+        check(fs->rename(c,b)==-EEXIST);
+        check(fs->rename(dir,inner)==-EINVAL); //Directory inside itself
+        check(fs->rename(dir,dir2)==0);
+        check(verifyFile(fs,"dir2/sub/b.bin",10000,2));
+        //Remove
+        StringPart sub2("dir2/sub"), b2("dir2/sub/b.bin");
+        check(fs->rmdir(sub2)==-ENOTEMPTY);
+        check(fs->unlink(sub2)==-EISDIR);
+        check(openFile(fs,"dir2/sub/b.bin",O_RDONLY,f)==0);
+        check(fs->unlink(b2)==-EBUSY); //Open files can't be removed
+        f.reset();
+        check(fs->unlink(b2)==0);
+        check(fs->rmdir(sub2)==0);
+        check(listDir(fs,"dir2")==(set<string>{".","..","c.txt"}));
+    }
+    //Everything persists across a remount
+    auto fs=mount(flash);
+    check(verifyFile(fs,"dir2/c.txt",3000,1));
+    check(listDir(fs,"")==(set<string>{".","..","dir2"}));
+}
+
+static void testHolesAndTruncate()
+{
+    printf("Holes and truncate\n");
+    auto flash=makeFlash(4096,32);
+    auto fs=mount(flash);
+    intrusive_ref_ptr<FileBase> f;
+    check(openFile(fs,"f",O_RDWR | O_CREAT,f)==0);
+    check(f->lseek(100000,SEEK_SET)==100000);
+    check(f->write("end",3)==3);
+    char buf[600];
+    check(f->lseek(99000,SEEK_SET)==99000);
+    check(f->read(buf,sizeof(buf))==sizeof(buf));
+    check(all_of(buf,buf+sizeof(buf),[](char c){ return c==0; }));
+    check(f->ftruncate(700)==0);
+    check(f->ftruncate(2000)==0);
+    check(f->lseek(0,SEEK_SET)==0);
+    check(f->read(buf,sizeof(buf))==sizeof(buf));
+    check(f->lseek(0,SEEK_END)==2000);
+    //Data past the old end of file reads as zeros after extending again
+    check(f->lseek(650,SEEK_SET)==650);
+    check(f->write("x",1)==1);
+    check(f->ftruncate(651)==0);
+    check(f->ftruncate(1000)==0);
+    check(f->lseek(650,SEEK_SET)==650);
+    check(f->read(buf,10)==10);
+    check(buf[0]=='x' && all_of(buf+1,buf+10,[](char c){ return c==0; }));
+    check(f->ioctl(IOCTL_SYNC,nullptr)==0);
+    struct stat st;
+    check(statFile(fs,"f",&st)==0 && st.st_size==1000);
+    //Writes past the maximum file size fail
+    check(f->lseek(LogFs::maxFileSize,SEEK_SET)==LogFs::maxFileSize);
+    check(f->write("x",1)==-EFBIG);
+}
+
+static void testWear()
+{
+    printf("Garbage collection and wear leveling\n");
+    //Internal flash of a microcontroller, 16KB blocks
+    const unsigned int blocks=24;
+    auto flash=makeFlash(16384,blocks);
+    auto fs=mount(flash);
+    //Static files, that are never rewritten
+    const unsigned int staticFiles=20;
+    for(unsigned int i=0;i<staticFiles;i++)
+        writeFile(fs,("static"+to_string(i)).c_str(),8000,i);
+    //Rewrite the same file many times, the filesystem is kept half full, so
+    //the garbage collector has to move pages
+    unsigned long long before=flash->programmedBytes();
+    const unsigned int rewrites=3000;
+    for(unsigned int i=0;i<rewrites;i++)
+    {
+        writeFile(fs,"hot",6000,i);
+        if(i % 500==0) check(verifyFile(fs,"hot",6000,i));
+    }
+    unsigned long long programmed=flash->programmedBytes()-before;
+    check(verifyFile(fs,"hot",6000,rewrites-1));
+    for(unsigned int i=0;i<staticFiles;i++)
+        check(verifyFile(fs,("static"+to_string(i)).c_str(),8000,i));
+    unsigned int minErase=~0, maxErase=0;
+    for(unsigned int i=2;i<blocks;i++)
+    {
+        minErase=min(minErase,flash->eraseCount(i));
+        maxErase=max(maxErase,flash->eraseCount(i));
+    }
+    printf("Erase count min %u max %u, write amplification %.2f\n",
+           minErase,maxErase,static_cast<double>(programmed)/(rewrites*6000.0));
+    //Blocks holding static data are moved, so all blocks are used
+    check(maxErase-minErase<=2*LOGFS_WEAR_THRESHOLD);
+    fs.reset();
+    fs=mount(flash);
+    check(verifyFile(fs,"hot",6000,rewrites-1));
+    for(unsigned int i=0;i<staticFiles;i++)
+        check(verifyFile(fs,("static"+to_string(i)).c_str(),8000,i));
+}
+
+static void testFull()
+{
+    printf("Filesystem full\n");
+    auto flash=makeFlash(4096,16);
+    auto fs=mount(flash);
+    intrusive_ref_ptr<FileBase> f;
+    check(openFile(fs,"big",O_WRONLY | O_CREAT,f)==0);
+    char buf[512];
+    memset(buf,0x55,sizeof(buf));
+    ssize_t result;
+    unsigned int written=0;
+    while((result=f->write(buf,sizeof(buf)))>0) written+=result;
+    check(result==-ENOSPC);
+    f.reset();
+    printf("Wrote %u bytes in %u bytes of flash\n",written,4096*16);
+    //Removing the file makes space available again
+    StringPart big("big");
+    check(fs->unlink(big)==0);
+    writeFile(fs,"small",20000,3);
+    check(verifyFile(fs,"small",20000,3));
+}
+
+static void testPowerFailure()
+{
+    printf("Power failure\n");
+    //Interrupt the sequence of operations at every possible write or erase
+    for(int n=0;;n++)
+    {
+        auto flash=makeFlash(4096,12);
+        {
+            auto fs=mount(flash);
+            //Fill the filesystem so that the garbage collector runs
+            writeFile(fs,"s",12000,0);
+            writeFile(fs,"f",3000,1);
+            writeFile(fs,"g",2000,2);
+            flash->setPowerFailure(n);
+            {
+                intrusive_ref_ptr<FileBase> f;
+                if(openFile(fs,"f",O_WRONLY | O_TRUNC,f)==0)
+                {
+                    char buf[1000];
+                    for(unsigned int i=0;i<sizeof(buf);i++) buf[i]=pattern(i,3);
+                    f->write(buf,sizeof(buf));
+                }
+            }
+            for(unsigned int i=4;i<10;i++)
+            {
+                intrusive_ref_ptr<FileBase> f;
+                if(openFile(fs,"g",O_WRONLY,f)) break;
+                char buf[2000];
+                for(unsigned int j=0;j<sizeof(buf);j++) buf[j]=pattern(j,i);
+                if(f->write(buf,sizeof(buf))!=sizeof(buf)) break;
+            }
+            StringPart g("g"), h("h");
+            fs->rename(g,h);
+        }
+        bool failed=flash->powerFailed();
+        flash->setPowerFailure(-1);
+        auto fs=mount(flash);
+        //The garbage collector commits also files being written, so they may
+        //hold part of a write, but each page is either old or new
+        check(verifyFile(fs,"s",12000,0));
+        check(verifyFile(fs,"f",3000,1) || verifyPrefix(fs,"f",1000,3));
+        check(verifyPages(fs,"g",2000,2,9) || verifyPages(fs,"h",2000,2,9));
+        if(failed) continue;
+        check(verifyFile(fs,"f",1000,3) && verifyFile(fs,"h",2000,9));
+        printf("Interrupted at each of %d writes and erases\n",n);
+        break;
+    }
+}
+
+static void benchmark()
+{
+    printf("Benchmark\n");
+    //Internal flash of a microcontroller, 16KB blocks
+    auto flash=makeFlash(16384,64);
+    auto fs=mount(flash);
+    const unsigned int files=40;
+    auto t0=steady_clock::now();
+    for(unsigned int i=0;i<files;i++)
+        writeFile(fs,("file"+to_string(i)).c_str(),16000,i);
+    auto t1=steady_clock::now();
+    fs.reset();
+    auto t2=steady_clock::now();
+    fs=mount(flash);
+    auto t3=steady_clock::now();
+    for(unsigned int i=0;i<files;i++)
+        check(verifyFile(fs,("file"+to_string(i)).c_str(),16000,i));
+    auto t4=steady_clock::now();
+    auto us=[](steady_clock::duration d)
+    {
+        return duration_cast<microseconds>(d).count();
+    };
+    printf("Write %u files of 16000 bytes: %lldus\n",files,
+           static_cast<long long>(us(t1-t0)));
+    printf("Mount: %lldus\n",static_cast<long long>(us(t3-t2)));
+    printf("Read back: %lldus\n",static_cast<long long>(us(t4-t3)));
+    printf("Flash programmed: %llu bytes\n",flash->programmedBytes());
+}
+
+int main()
+{
+    testBasic();
+    testHolesAndTruncate();
+    testWear();
+    testFull();
+    testPowerFailure();
+    benchmark();
+    printf("All tests passed\n");
+    return 0;
+}
@@ -0,0 +1,598 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+//Test and benchmark of path resolution on a Linux host, comparing it with the
+//previous implementation. Build with CMake, see Readme.txt
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <map>
+#include <vector>
+#include <chrono>
+#include <fcntl.h>
+#include "filesystem/path_resolution.h"
+#include "filesystem/mountpointfs/mountpointfs.h"
+#include "filesystem/tmpfs/tmpfs.h"
+#include "test_common.h"
+
+using namespace std;
+using namespace std::chrono;
+using namespace miosix;
+
+namespace legacy {
+
+using namespace miosix;
+
+//
+// The path resolution code before the mount point trie, for comparison.
+// It copies the path into a std::string, edits it with erase() and looks up
+// every path component in a std::map of mount points
+//
+
+class PathResolution
+{
+public:
+    /**
+     * Constructor
+     * \param fs map of all mounted filesystems
+     */
+    PathResolution(const map<StringPart,intrusive_ref_ptr<FilesystemBase> >& fs)
+            : filesystems(fs) {}
+    
+    /**
+     * The main purpose of this class, resolve a path
+     * \param path inout parameter with the path to resolve. The resolved path
+     * will be modified in-place in this string. The path must be absolute and
+     * start with a "/". The caller is responsible for that.
+     * \param followLastSymlink if true, follow last symlink
+     * \return a resolved path
+     */
+    ResolvedPath resolvePath(string& path, bool followLastSymlink);
+    
+private:
+    /**
+     * Handle a /../ in a path
+     * \param path path string
+     * \param slash path[slash] is the / character after the ..
+     * \return 0 on success, a negative number on error
+     */
+    int upPathComponent(string& path, size_t slash);
+    
+    /**
+     * Handle a normal path component in a path, i.e, a path component
+     * that is neither //, /./ or /../
+     * \param path path string
+     * \param followIfSymlink if true, follow symbolic links
+     * \return 0 on success, or a negative number on error
+     */
+    int normalPathComponent(string& path, bool followIfSymlink);
+    
+    /**
+     * Follow a symbolic link
+     * \param path path string. The relative path into the current filesystem 
+     * must be a symbolic link (verified by the caller).
+     * \return 0 on success, a negative number on failure
+     */
+    int followSymlink(string& path);
+    
+    /**
+     * Find to which filesystem this path belongs
+     * \param path path string.
+     * \return 0 on success, a negative number on failure
+     */
+    int recursiveFindFs(string& path);
+
+    /// Mounted filesystems
+    const map<StringPart,intrusive_ref_ptr<FilesystemBase> >& filesystems;
+    
+    /// Pointer to root filesystem
+    intrusive_ref_ptr<FilesystemBase> root;
+    
+    /// Current filesystem while looking up path
+    intrusive_ref_ptr<FilesystemBase> fs;
+    
+    /// True if current filesystem supports symlinks
+    bool syms;
+    
+    /// path[index] is first unhandled char
+    size_t index;
+    
+    /// path.substr(indexIntoFs) is the relative path to current filesystem
+    size_t indexIntoFs;
+    
+    /// How many components does the relative path have in current fs
+    int depthIntoFs;
+    
+    /// How many symlinks we've found so far
+    int linksFollowed;
+    
+    /// Maximum number of symbolic links to follow (to avoid endless loops)
+    static const int maxLinkToFollow=2;
+};
+
+ResolvedPath PathResolution::resolvePath(string& path, bool followLastSymlink)
+{
+    map<StringPart,intrusive_ref_ptr<FilesystemBase> >::const_iterator it;
+    it=filesystems.find(StringPart("/"));
+    if(it==filesystems.end()) return ResolvedPath(-ENOENT); //should not happen
+    root=fs=it->second;
+    syms=fs->supportsSymlinks();
+    index=1;       //Skip leading /
+    indexIntoFs=1; //NOTE: caller must ensure path[0]=='/'
+    depthIntoFs=1;
+    linksFollowed=0;
+    for(;;)
+    {
+        size_t slash=path.find_first_of('/',index);
+        //cout<<path.substr(0,slash)<<endl;
+        //Last component (no trailing /)
+        if(slash==string::npos) slash=path.length(); //NOTE: one past the last
+
+        if(slash==index)
+        {
+            //Path component is empty, caused by double slash, remove it
+            path.erase(index,1);
+        } else if(slash-index==1 && path[index]=='.')
+        {
+            path.erase(index,2); //Path component is ".", ignore
+        } else if(slash-index==2 && path[index]=='.' && path[index+1]=='.')
+        {
+            int result=upPathComponent(path,slash);
+            if(result<0) return ResolvedPath(result);
+        } else {
+            index=slash+1; //NOTE: if(slash==string::npos) two past the last
+            // follow=followLastSymlink for "/link", but is true for "/link/"
+            bool follow=index>path.length() ? followLastSymlink : true;
+            int result=normalPathComponent(path,follow);
+            if(result<0) return ResolvedPath(result);
+        }
+        //Last component
+        if(index>=path.length())
+        {
+            //Remove trailing /
+            size_t last=path.length()-1;
+            if(path[last]=='/')
+            {
+                path.erase(last,1);
+                //This may happen if the last path component is a fs
+                if(indexIntoFs>path.length()) indexIntoFs=path.length();
+            }
+            return ResolvedPath(fs,indexIntoFs);
+        }
+    }
+}
+
+int PathResolution::upPathComponent(string& path, size_t slash)
+{
+    if(index<=1) return -ENOENT; //root dir has no parent
+    size_t removeStart=path.find_last_of('/',index-2);
+    if(removeStart==string::npos) return -ENOENT; //should not happen
+    path.erase(removeStart,slash-removeStart);
+    index=removeStart+1;
+    //This may happen when merging a path like "/dir/.."
+    if(path.empty()) path='/';
+    //This may happen if the new last path component is a fs, e.g. "/dev/null/.."
+    if(indexIntoFs>path.length()) indexIntoFs=path.length();
+    if(--depthIntoFs>0) return 0;
+    
+    //Depth went to zero, escape current filesystem
+    return recursiveFindFs(path);
+}
+
+int PathResolution::normalPathComponent(string& path, bool followIfSymlink)
+{
+    map<StringPart,intrusive_ref_ptr<FilesystemBase> >::const_iterator it;
+    it=filesystems.find(StringPart(path,index-1));
+    if(it!=filesystems.end())
+    {
+        //Jumped to a new filesystem. Not stat-ing the path as we're
+        //relying on mount not allowing to mount a filesystem on anything
+        //but a directory.
+        fs=it->second;
+        syms=fs->supportsSymlinks();
+        indexIntoFs=index>path.length() ? index-1 : index;
+        depthIntoFs=1;
+        return 0;
+    }
+    depthIntoFs++;
+    if(syms && followIfSymlink)
+    {
+        struct stat st;
+        {
+            StringPart sp(path,index-1,indexIntoFs);
+            if(int res=fs->lstat(sp,&st)<0) return res;
+        }
+        if(S_ISLNK(st.st_mode)) return followSymlink(path);
+        else if(index<=path.length() && !S_ISDIR(st.st_mode)) return -ENOTDIR;
+    }
+    return 0;
+}
+
+int PathResolution::followSymlink(string& path)
+{
+    if(++linksFollowed>=maxLinkToFollow) return -ELOOP;
+    string target;
+    {
+        StringPart sp(path,index-1,indexIntoFs);
+        if(int res=fs->readlink(sp,target)<0) return res;
+    }
+    if(target.empty()) return -ENOENT; //Should not happen
+    if(target[0]=='/')
+    {
+        //Symlink is absolute
+        size_t newPathLen=target.length()+path.length()-index+1;
+        if(newPathLen>PATH_MAX) return -ENAMETOOLONG;
+        string newPath;
+        newPath.reserve(newPathLen);
+        newPath=target;
+        if(index<=path.length())
+            newPath.insert(newPath.length(),path,index-1,string::npos);
+        path.swap(newPath);
+        fs=root;
+        syms=root->supportsSymlinks();
+        index=1;
+        indexIntoFs=1;
+        depthIntoFs=1;
+    } else {
+        //Symlink is relative
+        size_t removeStart=path.find_last_of('/',index-2);
+        size_t newPathLen=path.length()-(index-removeStart-2)+target.length();
+        if(newPathLen>PATH_MAX) return -ENAMETOOLONG;
+        string newPath;
+        newPath.reserve(newPathLen);
+        newPath.insert(0,path,0,removeStart+1);
+        newPath+=target;
+        if(index<=path.length())
+            newPath.insert(newPath.length(),path,index-1,string::npos);
+        path.swap(newPath);
+        index=removeStart+1;
+        depthIntoFs--;
+    }
+    return 0;
+}
+
+int PathResolution::recursiveFindFs(string& path)
+{
+    depthIntoFs=1;
+    size_t backIndex=index;
+    for(;;)
+    {
+        backIndex=path.find_last_of('/',backIndex-1);
+        if(backIndex==string::npos) return -ENOENT; //should not happpen
+        if(backIndex==0)
+        {
+            fs=root;
+            indexIntoFs=1;
+            break;
+        }
+        map<StringPart,intrusive_ref_ptr<FilesystemBase> >::const_iterator it;
+        it=filesystems.find(StringPart(path,backIndex));
+        if(it!=filesystems.end())
+        {
+            fs=it->second;
+            indexIntoFs=backIndex+1;
+            break;
+        }
+        depthIntoFs++;
+    }
+    syms=fs->supportsSymlinks();
+    return 0;
+}
+
+} //namespace legacy
+
+/**
+ * Filesystem with symlinks, whose content is a fixed table
+ */
+class SymlinkFs : public FilesystemBase
+{
+public:
+    int open(intrusive_ref_ptr<FileBase>& file, StringPart& name, int flags,
+             int mode) override { return -ENOENT; }
+    
+    int lstat(StringPart& name, struct stat *pstat) override
+    {
+        const Entry *e=find(name);
+        if(e==0) return -ENOENT;
+        memset(pstat,0,sizeof(struct stat));
+        pstat->st_mode=e->mode;
+        return 0;
+    }
+    
+    int readlink(StringPart& name, string& target) override
+    {
+        const Entry *e=find(name);
+        if(e==0 || !S_ISLNK(e->mode)) return -EINVAL;
+        target=e->target;
+        return 0;
+    }
+    
+    bool supportsSymlinks() const override { return true; }
+    int unlink(StringPart& name) override { return -EROFS; }
+    int rename(StringPart& oldName, StringPart& newName) override { return -EROFS; }
+    int mkdir(StringPart& name, int mode) override { return -EROFS; }
+    int rmdir(StringPart& name) override { return -EROFS; }
+    
+private:
+    struct Entry
+    {
+        const char *name;
+        int mode;
+        const char *target;
+    };
+    
+    const Entry *find(StringPart& name)
+    {
+        static const Entry entries[]=
+        {
+            {"",              S_IFDIR | 0755, ""},
+            {"dev",           S_IFDIR | 0755, ""},
+            {"sd",            S_IFDIR | 0755, ""},
+            {"a",             S_IFDIR | 0755, ""},
+            {"a/b",           S_IFDIR | 0755, ""},
+            {"home",          S_IFDIR | 0755, ""},
+            {"home/user",     S_IFDIR | 0755, ""},
+            {"home/file",     S_IFREG | 0644, ""},
+            {"home/link",     S_IFLNK | 0777, "../dev/null"},
+            {"home/abs",      S_IFLNK | 0777, "/sd/dir"},
+            {"home/mnt",      S_IFLNK | 0777, "/a/b"},
+            {"home/up",       S_IFLNK | 0777, "user/.."},
+            {"home/self",     S_IFLNK | 0777, "self"},
+            {"home/user/rel", S_IFLNK | 0777, "../abs"},
+        };
+        for(auto& e : entries) if(strcmp(name.c_str(),e.name)==0) return &e;
+        return 0;
+    }
+};
+
+/**
+ * The mount points as the FilesystemManager keeps them now, and as it did
+ * before
+ */
+class Mounts
+{
+public:
+    void mount(const char *path, intrusive_ref_ptr<FilesystemBase> fs)
+    {
+        MountPoint *mp=&trie;
+        for(const char *it=path+1;*it;)
+        {
+            const char *end=strchr(it,'/');
+            size_t n=end ? end-it : strlen(it);
+            mp=mp->findOrAdd(it,n);
+            it+=n+(end ? 1 : 0);
+        }
+        mp->fs=fs;
+        map.insert(make_pair(StringPart(path),fs));
+    }
+    
+    MountPoint trie;
+    std::map<StringPart,intrusive_ref_ptr<FilesystemBase> > map;
+};
+
+static intrusive_ref_ptr<TmpFs> makeTmpFs(const char *dir)
+{
+    intrusive_ref_ptr<TmpFs> fs(new TmpFs(64*1024));
+    if(dir[0])
+    {
+        StringPart sp(dir);
+        check(fs->mkdir(sp,0755)==0);
+    }
+    return fs;
+}
+
+/**
+ * Resolve a path with both implementations and check that they agree
+ */
+static void compare(Mounts& m, const char *name, bool follow, int expected)
+{
+    char path[PATH_BUFFER_SIZE];
+    strcpy(path,name);
+    ResolvedPath r1=resolvePath(path,sizeof(path),&m.trie,follow);
+    string legacyPath(name);
+    legacy::PathResolution pr(m.map);
+    ResolvedPath r2=pr.resolvePath(legacyPath,follow);
+    string relative=r2.result==0 ? legacyPath.substr(r2.off) : "";
+    //The previous implementation resolved "/" to an empty string
+    if(legacyPath.empty()) legacyPath="/";
+    if(r1.result!=r2.result || r1.result!=expected || (r1.result==0 &&
+      (r1.fs!=r2.fs || relative!=path+r1.off || legacyPath!=path)))
+    {
+        printf("Mismatch resolving %s follow=%d: new %d %s %zu, old %d %s %zu\n",
+               name,follow,r1.result,path,r1.off,
+               r2.result,legacyPath.c_str(),r2.off);
+        exit(1);
+    }
+}
+
+static void testCompare()
+{
+    printf("Compare with previous implementation\n");
+    Mounts m;
+    intrusive_ref_ptr<FilesystemBase> root(new SymlinkFs);
+    m.mount("/",root);
+    m.mount("/dev",makeTmpFs(""));
+    auto sd=makeTmpFs("dir");
+    m.mount("/sd",sd);
+    m.mount("/sd/disk",makeTmpFs(""));
+    m.mount("/a/b",makeTmpFs(""));
+    const struct { const char *path; int result; } paths[]=
+    {
+        {"/",0}, {"//",0}, {"/.",0}, {"/./",0}, {"/..",-ENOENT},
+        {"/x/../..",-ENOENT}, {"/dev",0}, {"/dev/",0}, {"/dev/null",0},
+        {"/dev/..",0}, {"/dev/../sd",0}, {"/dev/null/..",0},
+        {"/sd/disk/x/../../y",0}, {"/sd/./disk//f",0},
+        {"/sd/disk/../../dev/x",0}, {"/sd//disk/.",0}, {"/a",0}, {"/a/",0},
+        {"/a/b",0}, {"/a/b/c",0}, {"/a/c",0}, {"/a/b/../b/x",0},
+        {"/a/b/../../a/b/x",0}, {"/a/x/../b/y",0}, {"/home/link",0},
+        {"/home/link/",0}, {"/home/link/x",0}, {"/home/abs",0},
+        {"/home/abs/f",0}, {"/home/abs/..",0}, {"/home/abs/../disk/f",0},
+        {"/home/mnt/x",0}, {"/home/mnt/..",0}, {"/home/up/file",0},
+        {"/home/user/../link",0}, {"/home/file/x",-ENOTDIR},
+        {"/home/self",-ELOOP}, {"/home/user/rel",-ELOOP},
+        {"/home/missing/x",0}, {"/home/./user/./../../sd/x",0},
+    };
+    for(auto& p : paths)
+    {
+        compare(m,p.path,true,p.result);
+        //Only the last symlink is not followed
+        int result=p.result;
+        if(strcmp(p.path,"/home/self")==0) result=0;
+        if(strcmp(p.path,"/home/user/rel")==0) result=0;
+        compare(m,p.path,false,result);
+    }
+    //The previous implementation resolved a /../ escaping a filesystem mounted
+    //inside another one to the filesystem below both
+    char path[PATH_BUFFER_SIZE];
+    strcpy(path,"/sd/disk/..");
+    ResolvedPath r=resolvePath(path,sizeof(path),&m.trie,true);
+    check(r.result==0 && r.fs==sd);
+    check(strcmp(path,"/sd")==0 && path[r.off]=='\0');
+}
+
+static void testUmount()
+{
+    printf("Umount\n");
+    Mounts m;
+    intrusive_ref_ptr<FilesystemBase> root(new SymlinkFs);
+    m.mount("/",root);
+    m.mount("/sd",makeTmpFs(""));
+    m.mount("/a/b",makeTmpFs(""));
+    m.mount("/a/b/c",makeTmpFs(""));
+    MountPoint *a=m.trie.find("a",1);
+    check(a && !a->fs && a->pathLen==2);
+    MountPoint *b=a->find("b",1);
+    check(b && b->fs && b->pathLen==4);
+    vector<intrusive_ref_ptr<FilesystemBase> > fsList;
+    b->mountedBelow(fsList);
+    check(fsList.size()==2);
+    //Removing /a/b removes /a/b/c, and /a that is no longer needed
+    b->removeAll();
+    check(m.trie.find("a",1)==0 && m.trie.find("sd",2)!=0);
+    char path[PATH_BUFFER_SIZE];
+    strcpy(path,"/a/b/c/x");
+    ResolvedPath r=resolvePath(path,sizeof(path),&m.trie,true);
+    check(r.result==0 && r.fs==root && r.off==1);
+    m.trie.removeAll();
+    check(m.trie.child==0 && !m.trie.fs);
+}
+
+static void testLongPaths()
+{
+    printf("Long paths\n");
+    Mounts m;
+    intrusive_ref_ptr<FilesystemBase> root(new SymlinkFs);
+    m.mount("/",root);
+    m.mount("/sd",makeTmpFs("dir"));
+    //Symlink expansion must fit in the buffer, "/home/../dev/null/x" does not
+    char path[20];
+    strcpy(path,"/home/link/x");
+    check(resolvePath(path,sizeof(path)-1,&m.trie,true).result==-ENAMETOOLONG);
+    strcpy(path,"/home/link/x");
+    ResolvedPath r=resolvePath(path,sizeof(path),&m.trie,true);
+    check(r.result==0 && r.fs==root);
+    check(strcmp(path,"/dev/null/x")==0);
+    check(strcmp(path+r.off,"dev/null/x")==0);
+}
+
+static void benchmark()
+{
+    printf("Benchmark\n");
+    Mounts m;
+    intrusive_ref_ptr<FilesystemBase> root(new MountpointFs);
+    const char *dirs[]={"dev","sd","tmp"};
+    for(auto d : dirs)
+    {
+        StringPart sp(d);
+        check(root->mkdir(sp,0755)==0);
+    }
+    m.mount("/",root);
+    m.mount("/dev",makeTmpFs(""));
+    m.mount("/tmp",makeTmpFs(""));
+    auto sd=makeTmpFs("dir");
+    m.mount("/sd",sd);
+    {
+        StringPart sub("dir/sub");
+        check(sd->mkdir(sub,0755)==0);
+        const char *files[]={"file.txt","dir/sub/data.bin"};
+        for(auto f : files)
+        {
+            StringPart sp(f);
+            intrusive_ref_ptr<FileBase> file;
+            check(sd->open(file,sp,O_WRONLY | O_CREAT,0644)==0);
+        }
+    }
+    const char *paths[]=
+    {
+        "/sd/file.txt",
+        "/sd/dir/sub/data.bin",
+        "/sd/dir/../dir/sub/./data.bin",
+    };
+    const int iterations=200000;
+    auto opensPerSecond=[](steady_clock::duration d)
+    {
+        return iterations/duration_cast<duration<double>>(d).count();
+    };
+    for(auto p : paths)
+    {
+        auto t0=steady_clock::now();
+        for(int i=0;i<iterations;i++)
+        {
+            string path(p);
+            legacy::PathResolution pr(m.map);
+            ResolvedPath r=pr.resolvePath(path,true);
+            StringPart sp(path,string::npos,r.off);
+            intrusive_ref_ptr<FileBase> file;
+            check(r.fs->open(file,sp,O_RDONLY,0)==0);
+        }
+        auto t1=steady_clock::now();
+        for(int i=0;i<iterations;i++)
+        {
+            char path[PATH_BUFFER_SIZE];
+            strcpy(path,p);
+            ResolvedPath r=resolvePath(path,sizeof(path),&m.trie,true);
+            StringPart sp(path,string::npos,r.off);
+            intrusive_ref_ptr<FileBase> file;
+            check(r.fs->open(file,sp,O_RDONLY,0)==0);
+        }
+        auto t2=steady_clock::now();
+        printf("%s: %.0f opens/s before, %.0f opens/s now\n",p,
+               opensPerSecond(t1-t0),opensPerSecond(t2-t1));
+    }
+}
+
+int main()
+{
+    testCompare();
+    testUmount();
+    testLongPaths();
+    benchmark();
+    printf("All tests passed\n");
+    return 0;
+}
@@ -0,0 +1,341 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+//Test of pipes and FIFOs on a Linux host. Build with CMake, see Readme.txt
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <fcntl.h>
+#include "filesystem/pipe/pipe.h"
+#include "test_common.h"
+
+using namespace std;
+using namespace miosix;
+
+/**
+ * A file that appends writes to a string, and reads from it
+ */
+class StringFile : public FileBase
+{
+public:
+    StringFile(const string& content="")
+        : FileBase(intrusive_ref_ptr<FilesystemBase>()), content(content) {}
+
+    virtual ssize_t write(const void *data, size_t len)
+    {
+        content.append(reinterpret_cast<const char*>(data),len);
+        return len;
+    }
+
+    virtual ssize_t read(void *data, size_t len)
+    {
+        len=min(len,content.size()-readPos);
+        memcpy(data,content.data()+readPos,len);
+        readPos+=len;
+        return len;
+    }
+
+    virtual off_t lseek(off_t pos, int whence) { return -EBADF; }
+    virtual int fstat(struct stat *pstat) const { return -EBADF; }
+
+    string content;
+    size_t readPos=0;
+};
+
+/**
+ * Create the two ends of a pipe
+ */
+static void makePipe(intrusive_ref_ptr<PipeFile>& r,
+        intrusive_ref_ptr<PipeFile>& w, unsigned int size=PIPE_BUFFER_SIZE)
+{
+    intrusive_ref_ptr<PipeBuffer> buffer(new PipeBuffer(size));
+    r=intrusive_ref_ptr<PipeFile>(
+        new PipeFile(intrusive_ref_ptr<FilesystemBase>(),buffer,O_RDONLY));
+    w=intrusive_ref_ptr<PipeFile>(
+        new PipeFile(intrusive_ref_ptr<FilesystemBase>(),buffer,O_WRONLY));
+}
+
+/**
+ * Reads, writes and wraparound, end of file and broken pipe
+ */
+static void testBasic()
+{
+    intrusive_ref_ptr<PipeFile> r, w;
+    makePipe(r,w,16);
+    char buf[32];
+    check(w->write("0123456789",10)==10);
+    check(r->read(buf,6)==6 && memcmp(buf,"012345",6)==0);
+    //Wraps around the end of the buffer
+    check(w->write("abcdefghij",10)==10);
+    check(r->read(buf,sizeof(buf))==14);
+    check(memcmp(buf,"6789abcdefghij",14)==0);
+    //Wrong direction
+    check(r->write("x",1)==-EBADF);
+    check(w->read(buf,1)==-EBADF);
+    check(r->lseek(0,SEEK_SET)==-ESPIPE);
+    struct stat st;
+    check(r->fstat(&st)==0 && S_ISFIFO(st.st_mode));
+    //Data written before the writer closes is read before the end of file
+    check(w->write("xy",2)==2);
+    w.reset();
+    check(r->read(buf,sizeof(buf))==2);
+    check(r->read(buf,sizeof(buf))==0);
+    //Writing with no readers
+    makePipe(r,w,16);
+    r.reset();
+    check(w->write("x",1)==-EPIPE);
+}
+
+/**
+ * A reader and a writer thread moving more data than the buffer size
+ */
+static void testBlocking()
+{
+    intrusive_ref_ptr<PipeFile> r, w;
+    makePipe(r,w,64);
+    const int size=100000;
+    thread writer([&]{
+        vector<char> data(size);
+        for(int i=0;i<size;i++) data[i]=i*7;
+        //Varying sizes, some larger than the buffer
+        for(int i=0,j=1;i<size;j=j%200+1)
+        {
+            int n=min(j,size-i);
+            check(w->write(data.data()+i,n)==n);
+            i+=n;
+        }
+        w.reset();
+    });
+    vector<char> received;
+    char buf[50];
+    for(;;)
+    {
+        ssize_t n=r->read(buf,sizeof(buf));
+        check(n>=0);
+        if(n==0) break;
+        received.insert(received.end(),buf,buf+n);
+    }
+    writer.join();
+    check(received.size()==size);
+    for(int i=0;i<size;i++) check(received[i]==static_cast<char>(i*7));
+}
+
+/**
+ * Writes of concurrent writers are not interleaved
+ */
+static void testAtomicWrites()
+{
+    intrusive_ref_ptr<PipeFile> r, w;
+    makePipe(r,w,256);
+    const int numWriters=4, record=100, count=500;
+    vector<thread> writers;
+    for(int i=0;i<numWriters;i++)
+    {
+        writers.emplace_back([&,i]{
+            char data[record];
+            memset(data,'a'+i,record);
+            for(int j=0;j<count;j++) check(w->write(data,record)==record);
+        });
+    }
+    char buf[record];
+    for(int i=0;i<numWriters*count;i++)
+    {
+        for(int got=0;got<record;)
+        {
+            ssize_t n=r->read(buf+got,record-got);
+            check(n>0);
+            got+=n;
+        }
+        for(int j=1;j<record;j++) check(buf[j]==buf[0]);
+    }
+    for(auto& t : writers) t.join();
+}
+
+/**
+ * O_NONBLOCK set with fcntl
+ */
+static void testNonblock()
+{
+    intrusive_ref_ptr<PipeFile> r, w;
+    makePipe(r,w,16);
+    check(r->fcntl(F_SETFL,O_NONBLOCK)==0);
+    check(w->fcntl(F_SETFL,O_NONBLOCK)==0);
+    check(r->fcntl(F_GETFL,0)==(O_RDONLY | O_NONBLOCK));
+    char buf[32];
+    check(r->read(buf,1)==-EAGAIN);
+    check(w->write("0123456789",10)==10);
+    //Writes that fit in the buffer are not split
+    check(w->write("0123456789",10)==-EAGAIN);
+    //Larger writes are
+    check(w->write("0123456789abcdefghij",20)==6);
+    check(w->write("x",1)==-EAGAIN);
+    check(r->read(buf,sizeof(buf))==16);
+    check(r->read(buf,sizeof(buf))==-EAGAIN);
+}
+
+/**
+ * Readiness and wakeup of the pollers
+ */
+static void testPoll()
+{
+    intrusive_ref_ptr<PipeFile> r, w;
+    makePipe(r,w,16);
+    volatile bool woken=false;
+    WaitQueueEntry entry;
+    entry.woken=&woken;
+    check(r->poll(&entry)==0);
+    check(w->poll(nullptr)==POLLOUT);
+    check(woken==false);
+    check(w->write("0123456789abcdef",16)==16);
+    check(woken);
+    check(r->poll(nullptr)==POLLIN);
+    check(w->poll(nullptr)==0);
+    woken=false;
+    w.reset();
+    check(woken);
+    check(r->poll(nullptr)==(POLLIN | POLLHUP));
+    WaitQueue::remove(&entry);
+    makePipe(r,w,16);
+    r.reset();
+    check(w->poll(nullptr)==POLLERR);
+}
+
+/**
+ * Moving data from a file to a pipe and from a pipe to a file
+ */
+static void testSplice()
+{
+    intrusive_ref_ptr<PipeFile> r, w;
+    makePipe(r,w,64);
+    string content;
+    for(int i=0;i<1000;i++) content+=to_string(i);
+    StringFile in(content), out;
+    thread producer([&]{
+        for(;;)
+        {
+            ssize_t n=w->spliceFrom(&in,100,0);
+            check(n>=0);
+            if(n==0) break;
+        }
+        w.reset();
+    });
+    for(;;)
+    {
+        ssize_t n=r->spliceTo(&out,1000,0);
+        check(n>=0);
+        if(n==0) break;
+    }
+    producer.join();
+    check(out.content==content);
+    makePipe(r,w,64);
+    check(r->spliceTo(&out,10,SPLICE_F_NONBLOCK)==-EAGAIN);
+    check(w->spliceTo(&out,10,0)==-EBADF);
+}
+
+/**
+ * A FIFO does not report end of file before the first writer opens it, and
+ * starts empty when opened again
+ */
+static void testFifo()
+{
+    intrusive_ref_ptr<Device> fifo(new Fifo);
+    intrusive_ref_ptr<FileBase> r, w;
+    check(fifo->open(r,intrusive_ref_ptr<FilesystemBase>(),
+                     O_RDONLY | O_NONBLOCK,0)==0);
+    char buf[16];
+    check(r->read(buf,sizeof(buf))==-EAGAIN);
+    check(fifo->open(w,intrusive_ref_ptr<FilesystemBase>(),O_WRONLY,0)==0);
+    check(w->write("abc",3)==3);
+    check(r->read(buf,sizeof(buf))==3 && memcmp(buf,"abc",3)==0);
+    check(w->write("def",3)==3);
+    w.reset();
+    r.reset();
+    check(fifo->open(r,intrusive_ref_ptr<FilesystemBase>(),
+                     O_RDONLY | O_NONBLOCK,0)==0);
+    check(r->read(buf,sizeof(buf))==-EAGAIN);
+    struct stat st;
+    check(fifo->fstat(&st)==0 && S_ISFIFO(st.st_mode));
+}
+
+/**
+ * Throughput of read and write, and of splice between two files
+ */
+static void benchmark()
+{
+    const int total=64*1024*1024;
+    const int chunk=256;
+    {
+        intrusive_ref_ptr<PipeFile> r, w;
+        makePipe(r,w);
+        auto start=chrono::steady_clock::now();
+        thread writer([&]{
+            char buf[chunk]={0};
+            for(int i=0;i<total;i+=chunk) check(w->write(buf,chunk)==chunk);
+            w.reset();
+        });
+        char buf[chunk];
+        while(r->read(buf,chunk)>0) ;
+        writer.join();
+        double s=secondsSince(start);
+        printf("read/write in %d byte chunks: %.1f MB/s\n",chunk,total/s/1e6);
+    }
+    {
+        intrusive_ref_ptr<PipeFile> r, w;
+        makePipe(r,w);
+        StringFile in(string(total,'x')), out;
+        out.content.reserve(total);
+        auto start=chrono::steady_clock::now();
+        thread producer([&]{
+            while(w->spliceFrom(&in,total,0)>0) ;
+            w.reset();
+        });
+        while(r->spliceTo(&out,total,0)>0) ;
+        producer.join();
+        double s=secondsSince(start);
+        check(out.content.size()==total);
+        printf("splice file to file: %.1f MB/s\n",total/s/1e6);
+    }
+}
+
+int main()
+{
+    testBasic();
+    testBlocking();
+    testAtomicWrites();
+    testNonblock();
+    testPoll();
+    testSplice();
+    testFifo();
+    benchmark();
+    printf("All tests passed\n");
+    return 0;
+}
@@ -0,0 +1,270 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+//Test of RomFs on a Linux host. Build with CMake, see Readme.txt
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <set>
+#include <vector>
+#include <chrono>
+#include <fcntl.h>
+#include <dirent.h>
+#include "filesystem/romfs/romfs.h"
+#include "../mkromfs/romfs_image.h"
+#include "test_common.h"
+
+using namespace std;
+using namespace miosix;
+
+static int openFile(intrusive_ref_ptr<RomFs> fs, const char *name, int flags,
+        intrusive_ref_ptr<FileBase>& file)
+{
+    StringPart sp(name);
+    return fs->open(file,sp,flags,0644);
+}
+
+static int statFile(intrusive_ref_ptr<RomFs> fs, const char *name,
+        struct stat *st)
+{
+    StringPart sp(name);
+    return fs->lstat(sp,st);
+}
+
+static string pattern(unsigned int size, unsigned int seed)
+{
+    string result(size,'\0');
+    for(unsigned int i=0;i<size;i++)
+        result[i]=static_cast<char>((i*31+seed*17+i/509) & 0xff);
+    return result;
+}
+
+static set<string> listDir(intrusive_ref_ptr<RomFs> fs, const char *name,
+        int bufSize)
+{
+    intrusive_ref_ptr<FileBase> d;
+    check(openFile(fs,name,O_RDONLY,d)==0);
+    set<string> result;
+    char buf[1024] __attribute__((aligned(8)));
+    for(;;)
+    {
+        int len=d->getdents(buf,bufSize);
+        check(len>=0);
+        if(len==0) break;
+        for(int pos=0;pos<len;)
+        {
+            struct dirent *e=reinterpret_cast<struct dirent*>(buf+pos);
+            if(e->d_reclen==0) break;
+            check(result.insert(e->d_name).second); //No duplicates
+            pos+=e->d_reclen;
+        }
+    }
+    return result;
+}
+
+/**
+ * Mount an image held in a vector. The vector storage, allocated with new,
+ * is suitably aligned
+ */
+static intrusive_ref_ptr<RomFs> mount(const vector<unsigned char>& image)
+{
+    return intrusive_ref_ptr<RomFs>(new RomFs(image.data()));
+}
+
+static void testBasic()
+{
+    RomFsImage builder;
+    check(builder.addFile("hello.txt","Hello world\n"));
+    check(builder.addFile("empty",""));
+    check(builder.addFile("a/b/big.bin",pattern(10000,1),0600));
+    check(builder.addDirectory("a/c"));
+    check(builder.addFile("a/b",pattern(10,2))==false);  //Exists
+    check(builder.addFile("hello.txt/x","")==false);     //Not a directory
+    check(builder.addFile("a//x","")==false);            //Empty component
+    check(builder.numInodes()==7);
+    vector<unsigned char> image=builder.build();
+    check(image.size() % 4==0);
+    intrusive_ref_ptr<RomFs> fs=mount(image);
+    check(fs->mountFailed()==false);
+
+    intrusive_ref_ptr<FileBase> f;
+    check(openFile(fs,"hello.txt",O_RDONLY,f)==0);
+    char buf[16];
+    check(f->read(buf,sizeof(buf))==12);
+    check(memcmp(buf,"Hello world\n",12)==0);
+    check(f->read(buf,sizeof(buf))==0);
+    check(f->lseek(6,SEEK_SET)==6);
+    check(f->read(buf,5)==5 && memcmp(buf,"world",5)==0);
+    check(f->lseek(-1,SEEK_END)==11);
+    check(f->lseek(100,SEEK_CUR)==111);
+    check(f->read(buf,1)==0);
+    check(f->lseek(-200,SEEK_CUR)==-EINVAL);
+    check(f->pread(buf,5,0)==5 && memcmp(buf,"Hello",5)==0);
+    check(f->lseek(0,SEEK_CUR)==111); //pread does not move the file pointer
+    check(f->write("x",1)==-EBADF);
+
+    //File data is aligned, and mmap points into the image
+    string big=pattern(10000,1);
+    check(openFile(fs,"a/b/big.bin",O_RDONLY,f)==0);
+    const void *addr;
+    check(f->mmap(0,big.size(),&addr)==0);
+    check(reinterpret_cast<uintptr_t>(addr) % 4==0);
+    check(addr>=image.data() && addr<image.data()+image.size());
+    check(memcmp(addr,big.data(),big.size())==0);
+    check(f->mmap(9999,1,&addr)==0);
+    check(f->mmap(9999,2,&addr)==-ENXIO);
+    check(f->mmap(10001,1,&addr)==-ENXIO);
+    vector<char> data(big.size());
+    check(f->read(data.data(),data.size())==static_cast<ssize_t>(big.size()));
+    check(memcmp(data.data(),big.data(),big.size())==0);
+
+    struct stat st;
+    check(f->fstat(&st)==0);
+    check(S_ISREG(st.st_mode) && (st.st_mode & 0777)==0600);
+    check(st.st_size==10000);
+    check(statFile(fs,"empty",&st)==0 && st.st_size==0);
+    check(statFile(fs,"",&st)==0 && S_ISDIR(st.st_mode));
+    check(st.st_ino==RomFs::rootIno);
+    check(statFile(fs,"a/c",&st)==0 && S_ISDIR(st.st_mode));
+
+    //Errors
+    check(openFile(fs,"missing",O_RDONLY,f)==-ENOENT);
+    check(openFile(fs,"a/missing/x",O_RDONLY,f)==-ENOENT);
+    check(openFile(fs,"hello.txt/x",O_RDONLY,f)==-ENOTDIR);
+    check(openFile(fs,"hello.txt",O_WRONLY,f)==-EROFS);
+    check(openFile(fs,"hello.txt",O_RDWR,f)==-EROFS);
+    check(openFile(fs,"new",O_WRONLY | O_CREAT,f)==-EROFS);
+    check(openFile(fs,"hello.txt",O_RDONLY | O_CREAT | O_EXCL,f)==-EEXIST);
+    check(openFile(fs,"a",O_WRONLY,f)==-EISDIR);
+    StringPart sp1("hello.txt"), sp2("other");
+    check(fs->unlink(sp1)==-EROFS);
+    check(fs->rename(sp1,sp2)==-EROFS);
+    check(fs->mkdir(sp2,0755)==-EROFS);
+    check(fs->rmdir(sp2)==-EROFS);
+}
+
+static void testDirectoryListing()
+{
+    //Enough names for hash collisions in the low bits, and for the listing
+    //to need many getdents calls
+    RomFsImage builder;
+    set<string> expected={".",".."};
+    const int numFiles=500;
+    for(int i=0;i<numFiles;i++)
+    {
+        string name="file"+to_string(i);
+        expected.insert(name);
+        check(builder.addFile("dir/"+name,pattern(i % 7,i)));
+    }
+    vector<unsigned char> image=builder.build();
+    intrusive_ref_ptr<RomFs> fs=mount(image);
+    check(fs->mountFailed()==false);
+    check(listDir(fs,"dir",1024)==expected);
+    check(listDir(fs,"dir",96)==expected); //Few entries per call
+    check(listDir(fs,"",1024)==(set<string>{".","..","dir"}));
+    intrusive_ref_ptr<FileBase> d;
+    check(openFile(fs,"dir",O_RDONLY,d)==0);
+    char buf[64];
+    check(d->getdents(buf,8)==-EINVAL);
+
+    //Every file is found and has the right content
+    for(int i=0;i<numFiles;i++)
+    {
+        string name="dir/file"+to_string(i);
+        intrusive_ref_ptr<FileBase> f;
+        check(openFile(fs,name.c_str(),O_RDONLY,f)==0);
+        string content=pattern(i % 7,i);
+        char buf[8];
+        check(f->read(buf,sizeof(buf))==static_cast<ssize_t>(content.size()));
+        check(memcmp(buf,content.data(),content.size())==0);
+    }
+    check(openFile(fs,"dir/file500",O_RDONLY,d)==-ENOENT);
+    check(openFile(fs,"dir/file",O_RDONLY,d)==-ENOENT);
+
+    //Lookup speed
+    auto start=chrono::steady_clock::now();
+    const int iterations=200000;
+    for(int i=0;i<iterations;i++)
+    {
+        string name="dir/file"+to_string(i % numFiles);
+        struct stat st;
+        check(statFile(fs,name.c_str(),&st)==0);
+    }
+    double s=secondsSince(start);
+    printf("lstat in a directory of %d files: %.0f per second\n",numFiles,
+           iterations/s);
+}
+
+static void testCorruptImage()
+{
+    RomFsImage builder;
+    check(builder.addFile("a/b","data"));
+    const vector<unsigned char> good=builder.build();
+    check(mount(good)->mountFailed()==false);
+
+    auto corrupt=[&good](unsigned int offset, uint32_t value) {
+        vector<unsigned char> image=good;
+        memcpy(image.data()+offset,&value,sizeof(value));
+        return mount(image)->mountFailed();
+    };
+    const unsigned int inodes=sizeof(RomFsHeader);
+    const unsigned int rootEntries=inodes+3*sizeof(RomFsInode);
+    check(corrupt(0,0x12345678));                  //Magic
+    check(corrupt(4,romFsVersion+1));              //Version
+    check(corrupt(8,8));                           //Image size too small
+    check(corrupt(12,0));                          //No inodes
+    check(corrupt(12,1000));                       //Inode table too large
+    check(corrupt(inodes,S_IFREG | 0644));         //Root not a directory
+    check(corrupt(inodes+4,2));                    //Misaligned
+    check(corrupt(inodes+8,1000));                 //Too many entries
+    check(corrupt(inodes+2*sizeof(RomFsInode)+8,1000)); //File too large
+    check(corrupt(rootEntries+4,0));               //Entry is the root
+    check(corrupt(rootEntries+4,3));               //Entry past inode table
+    check(corrupt(rootEntries+8,good.size()));     //Name past the image
+    check(corrupt(rootEntries+12,2));              //Name length wrong
+    check(corrupt(rootEntries,0));                 //Hash wrong
+
+    //A mount that failed rejects every operation
+    vector<unsigned char> image=good;
+    image[0]=0;
+    intrusive_ref_ptr<RomFs> fs=mount(image);
+    intrusive_ref_ptr<FileBase> f;
+    struct stat st;
+    check(openFile(fs,"a/b",O_RDONLY,f)==-ENOENT);
+    check(statFile(fs,"",&st)==-ENOENT);
+}
+
+int main()
+{
+    testBasic();
+    testDirectoryListing();
+    testCorruptImage();
+    printf("All tests passed\n");
+    return 0;
+}
@@ -0,0 +1,2 @@
+// Host build of the filesystem code, no architecture specific settings
+#pragma once
@@ -0,0 +1,47 @@
+// Host version of the event queue used by the filesystem code
+
+#pragma once
+
+#include <list>
+#include <functional>
+#include "kernel/sync.h"
+
+namespace miosix {
+
+class EventQueue
+{
+public:
+    EventQueue() {}
+
+    void post(std::function<void ()> event)
+    {
+        Lock<FastMutex> l(m);
+        events.push_back(event);
+        cv.signal();
+    }
+
+    /**
+     * Unlike the kernel one, waits for an event
+     */
+    void runOne()
+    {
+        std::function<void ()> f;
+        {
+            Lock<FastMutex> l(m);
+            while(events.empty()) cv.wait(l);
+            f=events.front();
+            events.pop_front();
+        }
+        f();
+    }
+
+private:
+    EventQueue(const EventQueue&)=delete;
+    EventQueue& operator= (const EventQueue&)=delete;
+
+    std::list<std::function<void ()>> events;
+    FastMutex m;
+    ConditionVariable cv;
+};
+
+} //namespace miosix
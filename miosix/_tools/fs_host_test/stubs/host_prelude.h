@@ -0,0 +1,33 @@
+// Included before every source file of the host build of the filesystem code,
+// provides what newlib and the rest of the kernel provide on the target
+
+#pragma once
+
+#include <fcntl.h>
+#include <cstddef>
+#include <cstring>
+
+// Newlib file flags, as seen by FilesystemBase::open() after flags++
+#define _FREAD   1
+#define _FWRITE  2
+#define _FAPPEND O_APPEND
+#define _FCREAT  O_CREAT
+#define _FTRUNC  O_TRUNC
+#define _FEXCL   O_EXCL
+
+// file.cpp includes file_access.h only for FilesystemManager::getFilesystemId()
+// and, indirectly, StringPart
+#define FILE_ACCESS_H
+#ifdef __cplusplus
+#include "filesystem/stringpart.h"
+#endif
+
+namespace miosix {
+
+class FilesystemManager
+{
+public:
+    static short int getFilesystemId();
+};
+
+} //namespace miosix
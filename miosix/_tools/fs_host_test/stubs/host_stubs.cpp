@@ -0,0 +1,13 @@
+// Host version of the kernel functions used by the filesystem code
+
+#include "filesystem/file.h"
+
+namespace miosix {
+
+short int FilesystemManager::getFilesystemId()
+{
+    static short int id=1;
+    return id++;
+}
+
+} //namespace miosix
@@ -0,0 +1,29 @@
+// Host version of the atomic operations used by the filesystem code
+
+#pragma once
+
+namespace miosix {
+
+inline int atomicSwap(volatile int *p, int v)
+{
+    return __atomic_exchange_n(p,v,__ATOMIC_SEQ_CST);
+}
+
+inline void atomicAdd(volatile int *p, int incr)
+{
+    __atomic_add_fetch(p,incr,__ATOMIC_SEQ_CST);
+}
+
+inline int atomicAddExchange(volatile int *p, int incr)
+{
+    return __atomic_fetch_add(p,incr,__ATOMIC_SEQ_CST);
+}
+
+inline int atomicCompareAndSwap(volatile int *p, int prev, int next)
+{
+    __atomic_compare_exchange_n(p,&prev,next,false,__ATOMIC_SEQ_CST,
+                                __ATOMIC_SEQ_CST);
+    return prev;
+}
+
+} //namespace miosix
@@ -0,0 +1,202 @@
+// Host version of intrusive_ref_ptr, the one of the kernel stores pointers in
+// an int and does not compile on 64 bit machines
+
+#pragma once
+
+#include <cassert>
+#include <mutex>
+#include <type_traits>
+#include "interfaces/atomic_ops.h"
+
+namespace miosix {
+
+template<typename T>
+class intrusive_ref_ptr;
+
+class Intrusive
+{
+protected:
+    union
+    {
+        int referenceCount;
+    } intrusive;
+};
+
+class IntrusiveRefCounted : public Intrusive
+{
+protected:
+    IntrusiveRefCounted() { intrusive.referenceCount=0; }
+    IntrusiveRefCounted(const IntrusiveRefCounted&)
+    {
+        intrusive.referenceCount=0;
+    }
+    IntrusiveRefCounted& operator=(const IntrusiveRefCounted&) { return *this; }
+
+private:
+    template<typename T>
+    friend class intrusive_ref_ptr;
+};
+
+template<typename T>
+class IntrusiveRefCountedSharedFromThis
+{
+public:
+    intrusive_ref_ptr<T> shared_from_this()
+    {
+        T* result=dynamic_cast<T*>(this);
+        assert(result);
+        return intrusive_ref_ptr<T>(result);
+    }
+
+    virtual ~IntrusiveRefCountedSharedFromThis() {}
+};
+
+template<typename T>
+class intrusive_ref_ptr
+{
+public:
+    typedef T element_type;
+
+    intrusive_ref_ptr() : object(nullptr) {}
+    explicit intrusive_ref_ptr(T *o) : object(o) { incrementRefCount(); }
+    template<typename U>
+    explicit intrusive_ref_ptr(U *o) : object(o) { incrementRefCount(); }
+    intrusive_ref_ptr(const intrusive_ref_ptr& rhs) : object(rhs.object)
+    {
+        incrementRefCount();
+    }
+    template<typename U>
+    intrusive_ref_ptr(const intrusive_ref_ptr<U>& rhs) : object(rhs.get())
+    {
+        incrementRefCount();
+    }
+    intrusive_ref_ptr& operator= (const intrusive_ref_ptr& rhs)
+    {
+        intrusive_ref_ptr temp(rhs);
+        std::swap(object,temp.object);
+        return *this;
+    }
+    template<typename U>
+    intrusive_ref_ptr& operator= (const intrusive_ref_ptr<U>& rhs)
+    {
+        intrusive_ref_ptr temp(rhs);
+        std::swap(object,temp.object);
+        return *this;
+    }
+    intrusive_ref_ptr& operator= (T* o) { return *this=intrusive_ref_ptr(o); }
+    ~intrusive_ref_ptr() { reset(); }
+
+    T *get() const { return object; }
+    T& operator*() const { return *object; }
+    T *operator->() const { return object; }
+    explicit operator bool() const { return object!=nullptr; }
+    bool operator!() const { return object==nullptr; }
+
+    void reset()
+    {
+        if(decrementRefCount()) delete object;
+        object=nullptr;
+    }
+
+    int use_count() const { return object ? object->intrusive.referenceCount : 0; }
+
+    intrusive_ref_ptr atomic_load() const
+    {
+        std::lock_guard<std::mutex> l(atomicMutex());
+        return *this;
+    }
+
+    intrusive_ref_ptr atomic_exchange(intrusive_ref_ptr& r)
+    {
+        std::lock_guard<std::mutex> l(atomicMutex());
+        intrusive_ref_ptr result(*this);
+        *this=r;
+        return result;
+    }
+
+private:
+    static std::mutex& atomicMutex()
+    {
+        static std::mutex m;
+        return m;
+    }
+
+    void incrementRefCount()
+    {
+        if(object) atomicAdd(&object->intrusive.referenceCount,1);
+    }
+
+    bool decrementRefCount()
+    {
+        if(object==nullptr) return false;
+        return atomicAddExchange(&object->intrusive.referenceCount,-1)==1;
+    }
+
+    T *object;
+
+    template<typename U>
+    friend class intrusive_ref_ptr;
+};
+
+template<typename T, typename U>
+bool operator==(const intrusive_ref_ptr<T>& a, const intrusive_ref_ptr<U>& b)
+{
+    return a.get()==b.get();
+}
+
+template<typename T, typename U>
+bool operator!=(const intrusive_ref_ptr<T>& a, const intrusive_ref_ptr<U>& b)
+{
+    return a.get()!=b.get();
+}
+
+template<typename T>
+bool operator==(const intrusive_ref_ptr<T>& a, std::nullptr_t)
+{
+    return a.get()==nullptr;
+}
+
+template<typename T>
+bool operator!=(const intrusive_ref_ptr<T>& a, std::nullptr_t)
+{
+    return a.get()!=nullptr;
+}
+
+template<typename T, typename U>
+intrusive_ref_ptr<T> static_pointer_cast(const intrusive_ref_ptr<U>& r)
+{
+    return intrusive_ref_ptr<T>(static_cast<T*>(r.get()));
+}
+
+template<typename T, typename U>
+intrusive_ref_ptr<T> dynamic_pointer_cast(const intrusive_ref_ptr<U>& r)
+{
+    return intrusive_ref_ptr<T>(dynamic_cast<T*>(r.get()));
+}
+
+template<typename T, typename U>
+intrusive_ref_ptr<T> const_pointer_cast(const intrusive_ref_ptr<U>& r)
+{
+    return intrusive_ref_ptr<T>(const_cast<T*>(r.get()));
+}
+
+template<typename T>
+intrusive_ref_ptr<T> atomic_load(const intrusive_ref_ptr<T> *p)
+{
+    return p->atomic_load();
+}
+
+template<typename T>
+void atomic_store(intrusive_ref_ptr<T> *p, intrusive_ref_ptr<T> r)
+{
+    p->atomic_exchange(r);
+}
+
+template<typename T>
+intrusive_ref_ptr<T> atomic_exchange(intrusive_ref_ptr<T> *p,
+        intrusive_ref_ptr<T> r)
+{
+    return p->atomic_exchange(r);
+}
+
+} //namespace miosix
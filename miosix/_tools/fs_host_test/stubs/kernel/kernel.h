@@ -0,0 +1,42 @@
+// Host version of the thread creation used by the filesystem code
+
+#pragma once
+
+#include <thread>
+#include <chrono>
+
+namespace miosix {
+
+class Thread
+{
+public:
+    enum Options
+    {
+        DEFAULT=0,
+        JOINABLE=1<<0
+    };
+
+    /**
+     * Only detached threads are supported
+     */
+    static Thread *create(void *(*startfunc)(void *), unsigned int stacksize,
+            unsigned char priority, void *argv=nullptr,
+            unsigned short options=DEFAULT)
+    {
+        static Thread dummy;
+        std::thread(startfunc,argv).detach();
+        return &dummy;
+    }
+};
+
+/**
+ * \return the time in nanoseconds, from an unspecified starting point
+ */
+inline long long getTime() noexcept
+{
+    using namespace std::chrono;
+    return duration_cast<nanoseconds>(
+        steady_clock::now().time_since_epoch()).count();
+}
+
+} //namespace miosix
@@ -0,0 +1,159 @@
+// Host version of the synchronization primitives used by the filesystem code
+
+#pragma once
+
+#include <mutex>
+#include <condition_variable>
+#include <list>
+#include "kernel/intrusive.h"
+
+namespace miosix {
+
+class FastMutex
+{
+public:
+    enum Options
+    {
+        DEFAULT,
+        RECURSIVE
+    };
+
+    FastMutex(Options opt=DEFAULT) {}
+    void lock() { m.lock(); }
+    bool tryLock() { return m.try_lock(); }
+    void unlock() { m.unlock(); }
+
+private:
+    FastMutex(const FastMutex&)=delete;
+    FastMutex& operator= (const FastMutex&)=delete;
+
+    std::recursive_mutex m;
+};
+
+template<typename T>
+class Lock
+{
+public:
+    explicit Lock(T& m) : m(m) { m.lock(); }
+    ~Lock() { m.unlock(); }
+    T& get() { return m; }
+
+private:
+    Lock(const Lock&)=delete;
+    Lock& operator= (const Lock&)=delete;
+
+    T& m;
+};
+
+template<typename T>
+class Unlock
+{
+public:
+    explicit Unlock(Lock<T>& l) : m(l.get()) { m.unlock(); }
+    ~Unlock() { m.lock(); }
+
+private:
+    Unlock(const Unlock&)=delete;
+    Unlock& operator= (const Unlock&)=delete;
+
+    T& m;
+};
+
+class ConditionVariable
+{
+public:
+    template<typename T>
+    void wait(Lock<T>& l) { cv.wait(l.get()); }
+    void signal() { cv.notify_one(); }
+    void broadcast() { cv.notify_all(); }
+
+private:
+    std::condition_variable_any cv;
+};
+
+class Semaphore
+{
+public:
+    Semaphore(unsigned int initialCount=0) : count(initialCount) {}
+
+    void signal()
+    {
+        std::lock_guard<std::mutex> l(m);
+        count++;
+        cv.notify_one();
+    }
+
+    void wait()
+    {
+        std::unique_lock<std::mutex> l(m);
+        while(count==0) cv.wait(l);
+        count--;
+    }
+
+    bool tryWait()
+    {
+        std::lock_guard<std::mutex> l(m);
+        if(count==0) return false;
+        count--;
+        return true;
+    }
+
+private:
+    Semaphore(const Semaphore&)=delete;
+    Semaphore& operator= (const Semaphore&)=delete;
+
+    std::mutex m;
+    std::condition_variable cv;
+    unsigned int count;
+};
+
+class Thread;
+class WaitQueue;
+
+class WaitQueueEntry
+{
+public:
+    Thread *thread=nullptr;
+    volatile bool *woken=nullptr;
+    WaitQueue *queue=nullptr;
+};
+
+/**
+ * Only sets the woken flag of the entries, there is no IRQ context on the host
+ */
+class WaitQueue
+{
+public:
+    WaitQueue() {}
+
+    void add(WaitQueueEntry *entry)
+    {
+        std::lock_guard<std::mutex> l(m);
+        entry->queue=this;
+        waiting.push_back(entry);
+    }
+
+    static void remove(WaitQueueEntry *entry)
+    {
+        if(entry->queue==nullptr) return;
+        WaitQueue *q=entry->queue;
+        std::lock_guard<std::mutex> l(q->m);
+        q->waiting.remove(entry);
+        entry->queue=nullptr;
+    }
+
+    void wakeAll()
+    {
+        std::lock_guard<std::mutex> l(m);
+        for(auto entry : waiting) *entry->woken=true;
+    }
+
+private:
+    WaitQueue(const WaitQueue&)=delete;
+    WaitQueue& operator= (const WaitQueue&)=delete;
+
+    std::mutex m;
+    std::list<WaitQueueEntry*> waiting;
+};
+
+} //namespace miosix
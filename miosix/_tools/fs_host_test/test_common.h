@@ -0,0 +1,56 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+//Scaffolding shared by the tests in this directory
+
+#ifndef TEST_COMMON_H
+#define TEST_COMMON_H
+
+#include <cstdio>
+#include <cstdlib>
+#include <chrono>
+
+/**
+ * Like assert(), but also enabled in release builds. Prints the failed check
+ * and terminates the test with a nonzero exit code, so that ctest reports it
+ */
+#define check(x) do { if(!(x)) { \
+    printf("%s:%d: check failed: %s\n",__FILE__,__LINE__,#x); \
+    exit(1); } } while(0)
+
+/**
+ * Used by the benchmarks
+ * \param start a time point
+ * \return the time elapsed since start, in seconds
+ */
+inline double secondsSince(std::chrono::steady_clock::time_point start)
+{
+    auto elapsed=std::chrono::steady_clock::now()-start;
+    return std::chrono::duration<double>(elapsed).count();
+}
+
+#endif //TEST_COMMON_H
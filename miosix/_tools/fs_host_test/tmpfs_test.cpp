@@ -0,0 +1,251 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+//Test of TmpFs on a Linux host. Build with CMake, see Readme.txt
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <set>
+#include <algorithm>
+#include <fcntl.h>
+#include <dirent.h>
+#include "filesystem/tmpfs/tmpfs.h"
+#include "filesystem/ioctl.h"
+#include "test_common.h"
+
+using namespace std;
+using namespace miosix;
+
+static int openFile(intrusive_ref_ptr<TmpFs> fs, const char *name, int flags,
+        intrusive_ref_ptr<FileBase>& file)
+{
+    StringPart sp(name);
+    return fs->open(file,sp,flags,0644);
+}
+
+static int statFile(intrusive_ref_ptr<TmpFs> fs, const char *name,
+        struct stat *st)
+{
+    StringPart sp(name);
+    return fs->lstat(sp,st);
+}
+
+static char pattern(unsigned int i, unsigned int seed)
+{
+    return static_cast<char>((i*31+seed*17+i/509) & 0xff);
+}
+
+static void writeFile(intrusive_ref_ptr<TmpFs> fs, const char *name,
+        unsigned int size, unsigned int seed)
+{
+    intrusive_ref_ptr<FileBase> f;
+    check(openFile(fs,name,O_WRONLY | O_CREAT | O_TRUNC,f)==0);
+    char buf[700];
+    for(unsigned int i=0;i<size;i+=sizeof(buf))
+    {
+        unsigned int n=min<unsigned int>(sizeof(buf),size-i);
+        for(unsigned int j=0;j<n;j++) buf[j]=pattern(i+j,seed);
+        check(f->write(buf,n)==n);
+    }
+}
+
+static bool verifyFile(intrusive_ref_ptr<TmpFs> fs, const char *name,
+        unsigned int size, unsigned int seed)
+{
+    intrusive_ref_ptr<FileBase> f;
+    if(openFile(fs,name,O_RDONLY,f)) return false;
+    struct stat st;
+    if(f->fstat(&st) || st.st_size!=size) return false;
+    char buf[1000];
+    for(unsigned int i=0;i<size;i+=sizeof(buf))
+    {
+        unsigned int n=min<unsigned int>(sizeof(buf),size-i);
+        if(f->read(buf,n)!=n) return false;
+        for(unsigned int j=0;j<n;j++) if(buf[j]!=pattern(i+j,seed)) return false;
+    }
+    return f->read(buf,1)==0;
+}
+
+static set<string> listDir(intrusive_ref_ptr<TmpFs> fs, const char *name,
+        int bufSize)
+{
+    intrusive_ref_ptr<FileBase> d;
+    check(openFile(fs,name,O_RDONLY,d)==0);
+    set<string> result;
+    char buf[1024] __attribute__((aligned(8)));
+    for(;;)
+    {
+        int len=d->getdents(buf,bufSize);
+        check(len>=0);
+        if(len==0) break;
+        for(int pos=0;pos<len;)
+        {
+            struct dirent *e=reinterpret_cast<struct dirent*>(buf+pos);
+            if(e->d_reclen==0) break;
+            result.insert(e->d_name);
+            pos+=e->d_reclen;
+        }
+    }
+    return result;
+}
+
+static void testBasic()
+{
+    printf("Basic operations\n");
+    intrusive_ref_ptr<TmpFs> fs(new TmpFs(64*1024));
+    writeFile(fs,"a.txt",3000,1);
+    check(verifyFile(fs,"a.txt",3000,1));
+    intrusive_ref_ptr<FileBase> f;
+    check(openFile(fs,"a.txt",O_RDONLY | O_CREAT | O_EXCL,f)==-EEXIST);
+    check(openFile(fs,"missing",O_RDONLY,f)==-ENOENT);
+    check(openFile(fs,"a.txt/x",O_WRONLY | O_CREAT,f)==-ENOTDIR);
+    StringPart dir("dir"), sub("dir/sub"), dir2("dir2");
+    check(fs->mkdir(dir,0755)==0);
+    check(fs->mkdir(dir,0755)==-EEXIST);
+    check(fs->mkdir(sub,0755)==0);
+    writeFile(fs,"dir/sub/b.bin",10000,2);
+    check(listDir(fs,"",1024)==(set<string>{".","..","a.txt","dir"}));
+    check(listDir(fs,"dir",1024)==(set<string>{".","..","sub"}));
+    struct stat st;
+    check(statFile(fs,"dir/sub",&st)==0 && S_ISDIR(st.st_mode));
+    check(statFile(fs,"dir/sub/b.bin",&st)==0 && st.st_size==10000);
+    //Rename, also across directories and replacing the target
+    StringPart a("a.txt"), c("dir/c.txt"), b("dir/sub/b.bin");
+    check(fs->rename(a,c)==0);
+    check(statFile(fs,"a.txt",&st)==-ENOENT);
+    check(verifyFile(fs,"dir/c.txt",3000,1));
+    check(fs->rename(c,b)==0);
+    check(statFile(fs,"dir/c.txt",&st)==-ENOENT);
+    check(verifyFile(fs,"dir/sub/b.bin",3000,1));
+    check(fs->rename(dir,dir2)==0);
+    check(verifyFile(fs,"dir2/sub/b.bin",3000,1));
+    //A directory can't be moved inside itself
+    StringPart inside("dir2/sub/x"), self("dir2/x");
+    check(fs->rename(dir2,inside)==-EINVAL);
+    check(fs->rename(dir2,self)==-EINVAL);
+    check(statFile(fs,"dir2/sub",&st)==0 && S_ISDIR(st.st_mode));
+    //Remove
+    StringPart sub2("dir2/sub"), b2("dir2/sub/b.bin");
+    check(fs->rmdir(sub2)==-ENOTEMPTY);
+    check(fs->unlink(sub2)==-EISDIR);
+    check(fs->rmdir(b2)==-ENOTDIR);
+    check(fs->unlink(b2)==0);
+    check(fs->rmdir(sub2)==0);
+    check(listDir(fs,"dir2",1024)==(set<string>{".",".."}));
+    check(fs->usedBytes()==0);
+}
+
+static void testOpenUnlinked()
+{
+    printf("Removing open files\n");
+    intrusive_ref_ptr<TmpFs> fs(new TmpFs(64*1024));
+    writeFile(fs,"f",5000,3);
+    unsigned int used=fs->usedBytes();
+    check(used>=5000 && used<2*5000);
+    intrusive_ref_ptr<FileBase> f;
+    check(openFile(fs,"f",O_RDONLY,f)==0);
+    StringPart name("f");
+    check(fs->unlink(name)==0);
+    struct stat st;
+    check(statFile(fs,"f",&st)==-ENOENT);
+    //The data is still there until the file is closed
+    char buf[5000];
+    check(f->read(buf,sizeof(buf))==sizeof(buf));
+    for(unsigned int i=0;i<sizeof(buf);i++) check(buf[i]==pattern(i,3));
+    check(fs->usedBytes()==used);
+    f.reset();
+    check(fs->usedBytes()==0);
+}
+
+static void testTruncateAndFull()
+{
+    printf("Truncate and filesystem full\n");
+    intrusive_ref_ptr<TmpFs> fs(new TmpFs(16*1024));
+    intrusive_ref_ptr<FileBase> f;
+    check(openFile(fs,"f",O_RDWR | O_CREAT,f)==0);
+    //Extending with ftruncate or seeking past the end reads as zeros
+    check(f->ftruncate(100000)==0);
+    check(fs->usedBytes()==0);
+    char buf[600];
+    check(f->lseek(50000,SEEK_SET)==50000);
+    check(f->read(buf,sizeof(buf))==sizeof(buf));
+    check(all_of(buf,buf+sizeof(buf),[](char c){ return c==0; }));
+    check(f->ftruncate(0)==0);
+    check(f->lseek(1000,SEEK_SET)==1000);
+    check(f->write("abc",3)==3);
+    check(f->lseek(0,SEEK_SET)==0);
+    check(f->read(buf,sizeof(buf))==sizeof(buf));
+    check(all_of(buf,buf+sizeof(buf),[](char c){ return c==0; }));
+    //Data past the old end of file reads as zeros after extending again
+    check(f->ftruncate(1001)==0);
+    check(f->ftruncate(2000)==0);
+    check(f->lseek(1000,SEEK_SET)==1000);
+    check(f->read(buf,10)==10);
+    check(buf[0]=='a' && all_of(buf+1,buf+10,[](char c){ return c==0; }));
+    //Writes fail when the filesystem is full, and succeed after freeing space
+    check(f->lseek(0,SEEK_SET)==0);
+    memset(buf,0x55,sizeof(buf));
+    ssize_t result;
+    unsigned int written=0;
+    while((result=f->write(buf,sizeof(buf)))>0) written+=result;
+    check(result==-ENOSPC);
+    check(written==16*1024 && fs->usedBytes()==16*1024);
+    intrusive_ref_ptr<FileBase> g;
+    check(openFile(fs,"g",O_WRONLY | O_CREAT,g)==0);
+    check(g->write(buf,1)==-ENOSPC);
+    check(f->ftruncate(8000)==0);
+    check(g->write(buf,sizeof(buf))==sizeof(buf));
+    check(g->fallocate(0,100000)==-ENOSPC);
+    check(g->ioctl(IOCTL_SYNC,nullptr)==0);
+}
+
+static void testDirectoryListing()
+{
+    printf("Directory listing\n");
+    intrusive_ref_ptr<TmpFs> fs(new TmpFs(64*1024));
+    set<string> expected{".",".."};
+    for(int i=0;i<100;i++)
+    {
+        string name="file"+to_string(i);
+        writeFile(fs,name.c_str(),10,i);
+        expected.insert(name);
+    }
+    //A small buffer takes many calls to list the directory
+    check(listDir(fs,"",300)==expected);
+}
+
+int main()
+{
+    testBasic();
+    testOpenUnlinked();
+    testTruncateAndFull();
+    testDirectoryListing();
+    printf("All tests passed\n");
+    return 0;
+}
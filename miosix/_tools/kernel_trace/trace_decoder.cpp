@@ -0,0 +1,189 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include <iostream>
+#include <fstream>
+#include <set>
+#include <cstdio>
+
+using namespace std;
+
+/**
+ * Header of a trace dump, see miosix/kernel/kernel_trace.cpp
+ */
+struct TraceDumpHeader
+{
+    unsigned int magic;
+    unsigned int version;
+    unsigned int frequency;
+    unsigned int records;
+    unsigned int lost;
+};
+
+/**
+ * A trace record, see miosix/kernel/kernel_trace.h
+ */
+struct Record
+{
+    unsigned int timestamp;
+    unsigned int payload;
+};
+
+enum TraceEvent
+{
+    ContextSwitch=0,
+    IrqEntry=1,
+    IrqExit=2,
+    Wakeup=3,
+    Sleep=4,
+    Wait=5,
+    MutexContention=6,
+    User=7
+};
+
+/// Track used for interrupts, threads are identified by their address
+const unsigned int irqTrack=0;
+
+static bool first=true;
+static set<unsigned int> namedTracks;
+
+/**
+ * Print an event in Chrome trace format
+ * \param name event name
+ * \param ph event phase
+ * \param tid track
+ * \param ts timestamp in microseconds
+ * \param args optional arguments, as a JSON object
+ */
+static void event(const string& name, char ph, unsigned int tid, double ts,
+                  const string& args="")
+{
+    if(namedTracks.insert(tid).second)
+    {
+        char trackName[32];
+        if(tid==irqTrack) snprintf(trackName,sizeof(trackName),"interrupts");
+        else snprintf(trackName,sizeof(trackName),"thread 0x%08x",tid);
+        cout<<(first ? "" : ",\n")<<"{\"name\":\"thread_name\",\"ph\":\"M\","
+            <<"\"pid\":1,\"tid\":"<<tid<<",\"args\":{\"name\":\""<<trackName
+            <<"\"}}";
+        first=false;
+    }
+    char tsString[32];
+    snprintf(tsString,sizeof(tsString),"%.3f",ts);
+    cout<<(first ? "" : ",\n")<<"{\"name\":\""<<name<<"\",\"ph\":\""<<ph
+        <<"\",\"pid\":1,\"tid\":"<<tid<<",\"ts\":"<<tsString;
+    if(ph=='i') cout<<",\"s\":\"t\"";
+    if(args.empty()==false) cout<<",\"args\":"<<args;
+    cout<<"}";
+    first=false;
+}
+
+static string hexArg(const char *name, unsigned int value)
+{
+    char result[64];
+    snprintf(result,sizeof(result),"{\"%s\":\"0x%08x\"}",name,value);
+    return result;
+}
+
+int main(int argc, char *argv[])
+{
+    if(argc!=2)
+    {
+        cerr<<"usage: trace_decoder trace.bin > trace.json"<<endl;
+        return 1;
+    }
+    ifstream in(argv[1],ios::binary);
+    if(!in)
+    {
+        cerr<<"can't open "<<argv[1]<<endl;
+        return 1;
+    }
+    TraceDumpHeader header;
+    if(!in.read(reinterpret_cast<char*>(&header),sizeof(header))
+        || header.magic!=0x5254584d || header.version!=1 || header.frequency==0)
+    {
+        cerr<<"not a valid trace file"<<endl;
+        return 1;
+    }
+    if(header.lost>0) cerr<<header.lost<<" records were lost"<<endl;
+
+    cout<<"{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+    long long time=0;
+    unsigned int lastTimestamp=0;
+    unsigned int running=0; //Thread currently running, zero if unknown
+    double ts=0.0;
+    for(unsigned int i=0;i<header.records;i++)
+    {
+        Record r;
+        if(!in.read(reinterpret_cast<char*>(&r),sizeof(r)))
+        {
+            cerr<<"trace file truncated"<<endl;
+            break;
+        }
+        //Unwrap the 32 bit cycle counter, tolerating slightly out of order
+        //records produced by the lock-free writer
+        if(i>0) time+=static_cast<int>(r.timestamp-lastTimestamp);
+        lastTimestamp=r.timestamp;
+        ts=static_cast<double>(time)*1e6/header.frequency;
+        unsigned int thread=r.payload & ~7;
+        unsigned int value=r.payload>>3;
+        switch(r.payload & 7)
+        {
+            case ContextSwitch:
+                if(running) event("running",'E',running,ts);
+                running=thread;
+                event("running",'B',running,ts);
+                break;
+            case IrqEntry:
+                event("IRQ "+to_string(value),'B',irqTrack,ts);
+                break;
+            case IrqExit:
+                event("IRQ "+to_string(value),'E',irqTrack,ts);
+                break;
+            case Wakeup:
+                event("wakeup",'i',thread,ts);
+                break;
+            case Sleep:
+                event("sleep",'i',thread,ts);
+                break;
+            case Wait:
+                event("wait",'i',thread,ts);
+                break;
+            case MutexContention:
+                if(running==0) break;
+                event("mutex contention",'i',running,ts,hexArg("owner",thread));
+                break;
+            case User:
+                if(running==0) break;
+                event("user",'i',running,ts,"{\"value\":"+to_string(value)+"}");
+                break;
+        }
+    }
+    if(running) event("running",'E',running,ts);
+    cout<<"\n]}"<<endl;
+    return 0;
+}
@@ -0,0 +1,148 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+//Generates a RomFs image from a directory of the host. See Readme.txt
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <dirent.h>
+#include <sys/stat.h>
+#include "romfs_image.h"
+
+using namespace std;
+
+/**
+ * Add the content of a host directory to the image
+ * \param image image
+ * \param hostPath path of the directory on the host
+ * \param path path of the directory in the image, empty for the root
+ * \return false on error
+ */
+static bool addTree(RomFsImage& image, const string& hostPath,
+        const string& path)
+{
+    DIR *d=opendir(hostPath.c_str());
+    if(d==nullptr)
+    {
+        perror(hostPath.c_str());
+        return false;
+    }
+    vector<string> names;
+    while(struct dirent *de=readdir(d))
+    {
+        if(strcmp(de->d_name,".")==0 || strcmp(de->d_name,"..")==0) continue;
+        names.push_back(de->d_name);
+    }
+    closedir(d);
+    sort(names.begin(),names.end()); //For reproducible images
+
+    for(auto& name : names)
+    {
+        string src=hostPath+"/"+name;
+        string dst=path.empty() ? name : path+"/"+name;
+        struct stat st;
+        if(lstat(src.c_str(),&st)!=0)
+        {
+            perror(src.c_str());
+            return false;
+        }
+        if(S_ISDIR(st.st_mode))
+        {
+            if(!image.addDirectory(dst,st.st_mode & 0777)) return false;
+            if(!addTree(image,src,dst)) return false;
+        } else if(S_ISREG(st.st_mode)) {
+            ifstream in(src,ios::binary);
+            stringstream data;
+            data<<in.rdbuf();
+            if(!in)
+            {
+                fprintf(stderr,"%s: read error\n",src.c_str());
+                return false;
+            }
+            if(!image.addFile(dst,data.str(),st.st_mode & 0777)) return false;
+        } else fprintf(stderr,"Warning: %s skipped, not a file or directory\n",
+                       src.c_str());
+    }
+    return true;
+}
+
+/**
+ * Write the image as a C source file that defines the _romfs_start symbol
+ * \param out output file
+ * \param image image
+ */
+static void writeSource(FILE *out, const vector<unsigned char>& image)
+{
+    fprintf(out,"/* RomFs image generated by mkromfs, do not edit */\n\n");
+    fprintf(out,"const unsigned int _romfs_start[] __attribute__((aligned(4)))=\n{");
+    for(unsigned int i=0;i<image.size();i+=4)
+    {
+        unsigned int word=image[i] | image[i+1]<<8 | image[i+2]<<16
+                        | static_cast<unsigned int>(image[i+3])<<24;
+        fprintf(out,"%s0x%08x,",i % 32==0 ? "\n    " : "",word);
+    }
+    fprintf(out,"\n};\n");
+}
+
+int main(int argc, char *argv[])
+{
+    bool source=argc==4 && strcmp(argv[1],"-c")==0;
+    if(argc!=3 && source==false)
+    {
+        fprintf(stderr,"Usage: mkromfs [-c] <directory> <image>\n"
+                "  -c write the image as a C source file\n");
+        return 1;
+    }
+    const char *dir=argv[argc-2];
+    const char *outName=argv[argc-1];
+
+    RomFsImage image;
+    if(!addTree(image,dir,"")) return 1;
+    vector<unsigned char> data=image.build();
+
+    FILE *out=fopen(outName,source ? "w" : "wb");
+    if(out==nullptr)
+    {
+        perror(outName);
+        return 1;
+    }
+    if(source) writeSource(out,data);
+    else fwrite(data.data(),1,data.size(),out);
+    if(fclose(out)!=0)
+    {
+        perror(outName);
+        return 1;
+    }
+    printf("%u files and directories, %u bytes\n",image.numInodes(),
+           static_cast<unsigned int>(data.size()));
+    return 0;
+}
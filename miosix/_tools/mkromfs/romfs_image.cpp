@@ -0,0 +1,217 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "romfs_image.h"
+#include <algorithm>
+#include <tuple>
+#include <sys/stat.h>
+#include "filesystem/romfs/romfs_format.h"
+
+using namespace std;
+using namespace miosix;
+
+/**
+ * Store a 32 bit little endian value in the image
+ * \param image image
+ * \param offset where to store the value
+ * \param value value
+ */
+static void put32(vector<unsigned char>& image, unsigned int offset,
+        uint32_t value)
+{
+    for(int i=0;i<4;i++) image.at(offset+i)=(value>>(8*i)) & 0xff;
+}
+
+/**
+ * \param x a size or offset
+ * \return x rounded up to a multiple of 4
+ */
+static unsigned int align4(unsigned int x)
+{
+    return (x+3) & ~3;
+}
+
+//
+// class RomFsImage
+//
+
+RomFsImage::RomFsImage()
+{
+    root.dir=true;
+    root.mode=0755;
+}
+
+bool RomFsImage::addDirectory(const string& path, unsigned int mode)
+{
+    return add(path,true,mode)!=nullptr;
+}
+
+bool RomFsImage::addFile(const string& path, const string& data,
+        unsigned int mode)
+{
+    Node *node=add(path,false,mode);
+    if(node==nullptr) return false;
+    node->data=data;
+    return true;
+}
+
+vector<unsigned char> RomFsImage::build() const
+{
+    //Number the inodes breadth first, so that the children of a directory
+    //have consecutive numbers, in the order of the map
+    vector<const Node*> nodes;
+    vector<unsigned int> parents, firstChild;
+    nodes.push_back(&root);
+    parents.push_back(0);
+    for(unsigned int i=0;i<nodes.size();i++)
+    {
+        firstChild.push_back(nodes.size());
+        for(auto& child : nodes[i]->children)
+        {
+            nodes.push_back(&child.second);
+            parents.push_back(i);
+        }
+    }
+
+    //Layout, with the same order as described in romfs_format.h
+    vector<unsigned int> offsets(nodes.size());
+    unsigned int offset=sizeof(RomFsHeader)+nodes.size()*sizeof(RomFsInode);
+    for(unsigned int i=0;i<nodes.size();i++)
+    {
+        if(nodes[i]->dir==false) continue;
+        offsets[i]=offset;
+        offset+=nodes[i]->children.size()*sizeof(RomFsDirEntry);
+    }
+    vector<unsigned int> nameOffsets(nodes.size());
+    for(unsigned int i=0;i<nodes.size();i++)
+    {
+        unsigned int child=firstChild[i];
+        for(auto& c : nodes[i]->children)
+        {
+            nameOffsets[child++]=offset;
+            offset+=c.first.length()+1;
+        }
+    }
+    offset=align4(offset);
+    for(unsigned int i=0;i<nodes.size();i++)
+    {
+        if(nodes[i]->dir) continue;
+        offsets[i]=offset;
+        offset=align4(offset+nodes[i]->data.size());
+    }
+
+    vector<unsigned char> image(offset,0);
+    put32(image,0,romFsMagic);
+    put32(image,4,romFsVersion);
+    put32(image,8,image.size());
+    put32(image,12,nodes.size());
+    for(unsigned int i=0;i<nodes.size();i++)
+    {
+        const Node *node=nodes[i];
+        unsigned int inode=sizeof(RomFsHeader)+i*sizeof(RomFsInode);
+        unsigned int type=node->dir ? S_IFDIR : S_IFREG;
+        put32(image,inode,type | (node->mode & 07777));
+        put32(image,inode+4,offsets[i]);
+        put32(image,inode+8,node->dir ? node->children.size()
+                                      : node->data.size());
+        put32(image,inode+12,node->dir ? parents[i] : 0);
+        if(node->dir==false)
+        {
+            copy(node->data.begin(),node->data.end(),
+                 image.begin()+offsets[i]);
+            continue;
+        }
+        //Directory entries sorted by hash, then by name
+        vector<tuple<uint32_t,string,unsigned int>> entries;
+        unsigned int child=firstChild[i];
+        for(auto& c : node->children)
+        {
+            entries.push_back(make_tuple(
+                romFsHash(c.first.c_str(),c.first.length()),c.first,child));
+            copy(c.first.begin(),c.first.end(),
+                 image.begin()+nameOffsets[child]);
+            child++;
+        }
+        sort(entries.begin(),entries.end());
+        unsigned int entry=offsets[i];
+        for(auto& e : entries)
+        {
+            put32(image,entry,get<0>(e));
+            put32(image,entry+4,get<2>(e));
+            put32(image,entry+8,nameOffsets[get<2>(e)]);
+            put32(image,entry+12,get<1>(e).length());
+            entry+=sizeof(RomFsDirEntry);
+        }
+    }
+    return image;
+}
+
+unsigned int RomFsImage::numInodes() const
+{
+    unsigned int result=1;
+    vector<const Node*> stack(1,&root);
+    while(stack.empty()==false)
+    {
+        const Node *node=stack.back();
+        stack.pop_back();
+        result+=node->children.size();
+        for(auto& c : node->children) stack.push_back(&c.second);
+    }
+    return result;
+}
+
+RomFsImage::Node *RomFsImage::add(const string& path, bool dir,
+        unsigned int mode)
+{
+    Node *node=&root;
+    size_t start=0;
+    for(;;)
+    {
+        size_t slash=path.find('/',start);
+        string name=path.substr(start,slash==string::npos ? string::npos
+                                                          : slash-start);
+        if(name.empty() || name=="." || name=="..") return nullptr;
+        auto it=node->children.find(name);
+        if(slash==string::npos)
+        {
+            if(it!=node->children.end()) return nullptr;
+            Node& result=node->children[name];
+            result.dir=dir;
+            result.mode=mode;
+            return &result;
+        }
+        if(it==node->children.end())
+        {
+            Node& parent=node->children[name];
+            parent.dir=true;
+            parent.mode=0755;
+            it=node->children.find(name);
+        } else if(it->second.dir==false) return nullptr;
+        node=&it->second;
+        start=slash+1;
+    }
+}
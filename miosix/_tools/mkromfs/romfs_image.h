@@ -0,0 +1,99 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef ROMFS_IMAGE_H
+#define ROMFS_IMAGE_H
+
+#include <string>
+#include <vector>
+#include <map>
+
+/**
+ * Builds a RomFs image in memory. Used by mkromfs, and by the filesystem
+ * host tests to make images without going through files.
+ */
+class RomFsImage
+{
+public:
+    /**
+     * Constructor, the image initially has only an empty root directory
+     */
+    RomFsImage();
+
+    /**
+     * Add a directory. Missing parent directories are also added
+     * \param path path of the directory, such as "a/b"
+     * \param mode directory permissions
+     * \return false if the path is not valid or already exists
+     */
+    bool addDirectory(const std::string& path, unsigned int mode=0755);
+
+    /**
+     * Add a file. Missing parent directories are also added
+     * \param path path of the file, such as "a/b/c.txt"
+     * \param data file content
+     * \param mode file permissions
+     * \return false if the path is not valid or already exists
+     */
+    bool addFile(const std::string& path, const std::string& data,
+            unsigned int mode=0644);
+
+    /**
+     * \return the image. Its size is a multiple of 4 bytes
+     */
+    std::vector<unsigned char> build() const;
+
+    /**
+     * \return the number of files and directories, including the root
+     */
+    unsigned int numInodes() const;
+
+private:
+    /**
+     * A file or directory
+     */
+    struct Node
+    {
+        bool dir;                              ///< True if directory
+        unsigned int mode;                     ///< Permissions
+        std::string data;                      ///< File content
+        std::map<std::string,Node> children;   ///< Directory content
+    };
+
+    /**
+     * Add a file or directory
+     * \param path path name
+     * \param dir true to add a directory
+     * \param mode permissions
+     * \return the new node, or nullptr on failure
+     */
+    Node *add(const std::string& path, bool dir, unsigned int mode);
+
+    Node root; ///< Root directory
+};
+
+#endif //ROMFS_IMAGE_H
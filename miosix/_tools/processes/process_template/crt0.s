@@ -202,10 +202,210 @@ system:
 	blt  syscallfailed
 	bx   lr
 
+/**
+ * ftruncate, truncate or extend a file
+ * \param fd file descriptor
+ * \param length new file length, passed in r2:r3 and sent to the kernel in r1
+ * \return 0 on success or -1 if errors
+ */
+.section .text.ftruncate
+.global ftruncate
+.type ftruncate, %function
+ftruncate:
+	cmp  r3, #0
+	bne  syscallinval
+	mov  r1, r2
+	movs r3, #23
+	svc  0
+	cmp  r0, #0
+	blt  syscallfailed
+	bx   lr
+
+/**
+ * posix_fallocate, allocate storage for a range of a file
+ * \param fd file descriptor
+ * \param offset start of the range, passed in r2:r3 and sent in r1
+ * \param len length of the range, passed on the stack and sent in r2
+ * \return 0 on success or the error code, errno is not set
+ */
+.section .text.posix_fallocate
+.global posix_fallocate
+.type posix_fallocate, %function
+posix_fallocate:
+	ldr  r12, [sp, #4]
+	orrs r12, r12, r3
+	bne  .L300
+	mov  r1, r2
+	ldr  r2, [sp]
+	movs r3, #24
+	svc  0
+	negs r0, r0
+	bx   lr
+.L300:
+	movs r0, #22 /* EINVAL */
+	bx   lr
+
+/**
+ * readv, read from file into multiple buffers
+ * \param fd file descriptor
+ * \param iov array of buffers
+ * \param iovcnt number of buffers
+ * \return number of read bytes or -1 if errors
+ */
+.section .text.readv
+.global readv
+.type readv, %function
+readv:
+	movs r3, #25
+	svc  0
+	cmp  r0, #0
+	blt  syscallfailed
+	bx   lr
+
+/**
+ * writev, write to file from multiple buffers
+ * \param fd file descriptor
+ * \param iov array of buffers
+ * \param iovcnt number of buffers
+ * \return number of written bytes or -1 if errors
+ */
+.section .text.writev
+.global writev
+.type writev, %function
+writev:
+	movs r3, #26
+	svc  0
+	cmp  r0, #0
+	blt  syscallfailed
+	bx   lr
+
+/**
+ * pread, read from file at a given offset without moving the file pointer
+ * \param fd file descriptor
+ * \param buf data to be read
+ * \param len buffer length
+ * \param pos file offset, passed on the stack and sent to the kernel in r12
+ * \return number of read bytes or -1 if errors
+ */
+.section .text.pread
+.global pread
+.type pread, %function
+pread:
+	ldr  r12, [sp, #4]
+	cmp  r12, #0
+	bne  syscallinval
+	ldr  r12, [sp]
+	movs r3, #27
+	svc  0
+	cmp  r0, #0
+	blt  syscallfailed
+	bx   lr
+
+/**
+ * pwrite, write to file at a given offset without moving the file pointer
+ * \param fd file descriptor
+ * \param buf data to be written
+ * \param len buffer length
+ * \param pos file offset, passed on the stack and sent to the kernel in r12
+ * \return number of written bytes or -1 if errors
+ */
+.section .text.pwrite
+.global pwrite
+.type pwrite, %function
+pwrite:
+	ldr  r12, [sp, #4]
+	cmp  r12, #0
+	bne  syscallinval
+	ldr  r12, [sp]
+	movs r3, #28
+	svc  0
+	cmp  r0, #0
+	blt  syscallfailed
+	bx   lr
+
+/**
+ * poll, wait for events on file descriptors
+ * \param fds array of file descriptors and requested events
+ * \param nfds number of elements in fds
+ * \param timeout timeout in milliseconds, negative to wait forever
+ * \return number of file descriptors with events or -1 if errors
+ */
+.section .text.poll
+.global poll
+.type poll, %function
+poll:
+	movs r3, #29
+	svc  0
+	cmp  r0, #0
+	blt  syscallfailed
+	bx   lr
+
+/**
+ * pipe, create a pipe
+ * \param fds the read end is stored in fds[0], the write end in fds[1]
+ * \return 0 on success or -1 if errors
+ */
+.section .text.pipe
+.global pipe
+.type pipe, %function
+pipe:
+	movs r3, #30
+	svc  0
+	cmp  r0, #0
+	blt  syscallfailed
+	bx   lr
+
+/**
+ * splice, move data between a pipe and a file. Offsets are not supported
+ * \param fdIn input file descriptor
+ * \param offIn must be null
+ * \param fdOut output file descriptor, sent to the kernel in r1
+ * \param offOut must be null
+ * \param len number of bytes, passed on the stack and sent in r2
+ * \param flags passed on the stack and sent in r12
+ * \return number of moved bytes or -1 if errors
+ */
+.section .text.splice
+.global splice
+.type splice, %function
+splice:
+	orrs r1, r1, r3
+	bne  syscallinval
+	mov  r1, r2
+	ldr  r2, [sp]
+	ldr  r12, [sp, #4]
+	movs r3, #31
+	svc  0
+	cmp  r0, #0
+	blt  syscallfailed
+	bx   lr
+
+/**
+ * mkfifo, create a named pipe
+ * \param path fifo name
+ * \param mode access permisions
+ * \return 0 on success or -1 if errors
+ */
+.section .text.mkfifo
+.global mkfifo
+.type mkfifo, %function
+mkfifo:
+	movs r3, #32
+	svc  0
+	cmp  r0, #0
+	blt  syscallfailed
+	bx   lr
+
 .section .text.__seterrno
 /* common jump target for all failing syscalls */
 syscallfailed:
 	/* tail call */
 	b    __seterrno
 
+/* jump target for arguments rejected before the syscall, such as offsets
+   that don't fit in the 32 bit register passed to the kernel */
+syscallinval:
+	mvn  r0, #21 /* -EINVAL */
+	b    __seterrno
+
 .end
@@ -43,6 +43,7 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
+#include <sys/ioctl.h>
 #include <signal.h>
 #include <pthread.h>
 #include <errno.h>
@@ -62,6 +63,9 @@
 #include "e20/e20.h"
 #include "kernel/intrusive.h"
 #include "util/crc16.h"
+#include "filesystem/ioctl.h"
+#include "filesystem/file_access.h"
+#include "filesystem/pipe/pipe.h"
 
 #ifdef WITH_PROCESSES
 #include "kernel/elf_program.h"
@@ -131,6 +135,10 @@ static void test_24();
 static void test_25();
 static void test_26();
 static void test_27();
+static void test_28();
+#ifdef WITH_STACK_PROFILER
+static void test_29();
+#endif //WITH_STACK_PROFILER
 #if defined(_ARCH_CORTEXM7_STM32F7) || defined(_ARCH_CORTEXM7_STM32H7)
 void testCacheAndDMA();
 #endif //_ARCH_CORTEXM7_STM32F7/H7
@@ -140,6 +148,16 @@ static void fs_test_1();
 static void fs_test_2();
 static void fs_test_3();
 static void fs_test_4();
+static void fs_test_5();
+static void fs_test_6();
+static void fs_test_7();
+static void fs_test_8();
+static void fs_test_9();
+static void fs_test_10();
+static void fs_test_11();
+static void fs_test_12();
+static void fs_test_13();
+static void fs_test_14();
 #endif //WITH_FILESYSTEM
 //Benchmark functions
 static void benchmark_1();
@@ -238,6 +256,10 @@ int main()
                 test_25();
                 test_26();
                 test_27();
+                test_28();
+                #ifdef WITH_STACK_PROFILER
+                test_29();
+                #endif //WITH_STACK_PROFILER
                 #if defined(_ARCH_CORTEXM7_STM32F7) || defined(_ARCH_CORTEXM7_STM32H7)
                 testCacheAndDMA();
                 #endif //_ARCH_CORTEXM7_STM32F7/H7
@@ -254,6 +276,16 @@ int main()
                 fs_test_2();
                 fs_test_3();
                 fs_test_4();
+                fs_test_5();
+                fs_test_6();
+                fs_test_7();
+                fs_test_8();
+                fs_test_9();
+                fs_test_10();
+                fs_test_11();
+                fs_test_12();
+                fs_test_13();
+                fs_test_14();
                 #else //WITH_FILESYSTEM
                 iprintf("Error, filesystem support is disabled\n");
                 #endif //WITH_FILESYSTEM
@@ -4290,6 +4322,90 @@ static void test_27()
     pass();
 }
 
+//
+// Test 28
+//
+/*
+tests:
+PeriodicTask class
+*/
+
+static void test_28()
+{
+    test_name("PeriodicTask");
+    const long long period=10000000; //10ms
+    //Releases must not drift, regardless of the time spent in the loop body
+    long long start=getTime()+period;
+    PeriodicTask task(period,PeriodicTask::OverrunPolicy::Skip,start);
+    for(int i=0;i<10;i++)
+    {
+        if(task.waitForNextRelease()==false) fail("unexpected overrun");
+        long long t=getTime();
+        if(t<start+i*period) fail("early release");
+        if(t-(start+i*period)>1000000) fail("release too late");
+        delayUs(2000); //Simulate some work
+    }
+    if(task.getActivationCount()!=10) fail("activation count");
+    if(task.getOverrunCount()!=0 || task.getSkippedCount()!=0)
+        fail("overrun count");
+    //Overrun with Skip policy: the missed releases are skipped
+    Thread::sleep(25);
+    if(task.waitForNextRelease()==true) fail("overrun not detected (1)");
+    if(task.getOverrunCount()!=1 || task.getSkippedCount()!=2)
+        fail("skip policy");
+    if((getTime()-start)%period>1000000) fail("phase not kept");
+    //Overrun with CatchUp policy: the missed releases are executed back to back
+    PeriodicTask task2(period,PeriodicTask::OverrunPolicy::CatchUp);
+    task2.waitForNextRelease();
+    Thread::sleep(25);
+    long long t=getTime();
+    if(task2.waitForNextRelease()==true) fail("overrun not detected (2)");
+    task2.waitForNextRelease();
+    if(getTime()-t>1000000) fail("catch up policy");
+    if(task2.getOverrunCount()!=2 || task2.getSkippedCount()!=0)
+        fail("catch up policy");
+    pass();
+}
+
+#ifdef WITH_STACK_PROFILER
+//
+// Test 29
+//
+/*
+tests:
+StackProfiler::getStackInfo
+StackProfiler::snapshot
+*/
+
+static void t29_p1(void *argv)
+{
+    volatile char buffer[1024];
+    for(unsigned int i=0;i<sizeof(buffer);i++) buffer[i]=0;
+    Thread::sleep(100);
+}
+
+static void test_29()
+{
+    test_name("StackProfiler");
+    Thread *t=Thread::create(t29_p1,2048,1,nullptr,Thread::JOINABLE);
+    //Give the idle thread time to complete the background scan
+    Thread::sleep(50);
+    StackProfiler::Data data;
+    if(StackProfiler::getStackInfo(t,data)==false) fail("getStackInfo (1)");
+    if(data.thread!=t || data.stackSize!=2048) fail("getStackInfo (2)");
+    if(data.scans==0) fail("scan not completed");
+    if(data.absoluteFreeStack>2048-1024) fail("high-water mark");
+    std::vector<StackProfiler::Data> threads;
+    StackProfiler::snapshot(threads);
+    bool found=false;
+    for(auto& d : threads) if(d.thread==t) found=true;
+    if(found==false) fail("snapshot");
+    t->join();
+    if(StackProfiler::getStackInfo(t,data)==true) fail("getStackInfo (3)");
+    pass();
+}
+#endif //WITH_STACK_PROFILER
+
 #if defined(_ARCH_CORTEXM7_STM32F7) || defined(_ARCH_CORTEXM7_STM32H7)
 static Thread *waiting=nullptr; /// Thread waiting on DMA completion IRQ
 
@@ -4974,6 +5090,620 @@ static void fs_test_4()
     int testdirIno=checkInodes("/sd",sdInode,curInode,sdDevice,curDevice);
     if(testdirIno==0) fail("no testdir");
     checkInodes("/sd/testdir",testdirIno,sdInode,sdDevice,sdDevice);
+    
+    //Path resolution with .. across mountpoints and long paths
+    struct stat st1, st2;
+    if(stat("/",&st1) || stat("/sd/testdir/../..//.",&st2)) fail("stat ..");
+    if(st1.st_ino!=st2.st_ino || st1.st_dev!=st2.st_dev) fail("..");
+    if(stat("/sd/testdir",&st1) || stat("/sd/../sd/./testdir/",&st2))
+        fail("stat ..");
+    if(st1.st_ino!=st2.st_ino || st1.st_dev!=st2.st_dev) fail("..");
+    char longPath[PATH_BUFFER_SIZE+1];
+    memset(longPath,'a',sizeof(longPath));
+    longPath[0]='/';
+    longPath[PATH_BUFFER_SIZE]='\0';
+    if(stat(longPath,&st1)==0 || errno!=ENAMETOOLONG) fail("ENAMETOOLONG");
+    pass();
+}
+
+//
+// Filesystem test 5
+//
+/*
+tests:
+ftruncate
+posix_fallocate
+*/
+
+extern "C" int posix_fallocate(int fd, off_t offset, off_t len);
+
+static void fs_test_5()
+{
+    test_name("ftruncate and posix_fallocate");
+    const char name[]="/sd/testdir/alloc.txt";
+    int fd=open(name,O_RDWR | O_CREAT | O_TRUNC,0666);
+    if(fd<0) fail("open");
+    if(write(fd,"abcd",4)!=4) fail("write");
+    //Extending the file fills it with zeros, the file pointer does not move
+    if(ftruncate(fd,3000)) fail("ftruncate 1");
+    struct stat st;
+    if(fstat(fd,&st) || st.st_size!=3000) fail("size 1");
+    if(lseek(fd,0,SEEK_CUR)!=4) fail("file pointer 1");
+    char buf[16];
+    if(lseek(fd,2990,SEEK_SET)!=2990) fail("lseek 1");
+    if(read(fd,buf,10)!=10) fail("read 1");
+    for(int i=0;i<10;i++) if(buf[i]!=0) fail("zero fill");
+    //Shrinking the file moves the file pointer to the end if it was past it
+    if(ftruncate(fd,2)) fail("ftruncate 2");
+    if(fstat(fd,&st) || st.st_size!=2) fail("size 2");
+    if(lseek(fd,0,SEEK_CUR)!=2) fail("file pointer 2");
+    //Preallocating within the file does not change its size
+    if(posix_fallocate(fd,0,1)) fail("posix_fallocate 1");
+    if(fstat(fd,&st) || st.st_size!=2) fail("size 3");
+    if(posix_fallocate(fd,100000,1000)) fail("posix_fallocate 2");
+    if(fstat(fd,&st) || st.st_size!=101000) fail("size 4");
+    if(lseek(fd,0,SEEK_SET)!=0) fail("lseek 2");
+    if(read(fd,buf,4)!=4 || memcmp(buf,"ab\0\0",4)) fail("read 2");
+    if(posix_fallocate(fd,-1,10)!=EINVAL) fail("posix_fallocate 3");
+    if(close(fd)) fail("close");
+    if(stat(name,&st) || st.st_size!=101000) fail("size 5");
+    //Read only files can't be resized
+    fd=open(name,O_RDONLY);
+    if(fd<0) fail("open 2");
+    if(ftruncate(fd,0)==0) fail("ftruncate 3");
+    if(close(fd)) fail("close 2");
+    if(unlink(name)) fail("unlink");
+    pass();
+}
+
+//
+// Filesystem test 6
+//
+/*
+tests:
+lookups of names that are created, renamed and removed
+*/
+
+static bool fs_t6_exists(const char *name)
+{
+    struct stat st;
+    return stat(name,&st)==0;
+}
+
+static void fs_t6_create(const char *name)
+{
+    int fd=open(name,O_WRONLY | O_CREAT | O_EXCL,0666);
+    if(fd<0) fail("open");
+    if(close(fd)) fail("close");
+}
+
+static void fs_test_6()
+{
+    test_name("Repeated lookups");
+    const char a[]="/sd/testdir/lookup_a.txt";
+    const char b[]="/sd/testdir/LOOKUP_B.TXT";
+    const char longName[]="/sd/testdir/a name that is too long to be cached.txt";
+    const char dir[]="/sd/testdir/lookup_dir";
+    const char sub[]="/sd/testdir/lookup_dir/file.txt";
+    for(int i=0;i<2;i++) //Twice, to look up names both cached and not
+    {
+        if(fs_t6_exists(a) || fs_t6_exists(b) || fs_t6_exists(longName))
+            fail("exists 1");
+        fs_t6_create(a);
+        fs_t6_create(longName);
+        if(!fs_t6_exists(a) || !fs_t6_exists(longName)) fail("exists 2");
+        //FAT names are case insensitive
+        if(!fs_t6_exists("/sd/testdir/LOOKUP_A.TXT")) fail("case");
+        if(rename(a,b)) fail("rename");
+        if(fs_t6_exists(a) || !fs_t6_exists(b)) fail("exists 3");
+        if(unlink(b) || unlink(longName)) fail("unlink");
+        if(fs_t6_exists(b) || fs_t6_exists(longName)) fail("exists 4");
+        //Files in a directory that is removed and created again
+        if(mkdir(dir,0755)) fail("mkdir");
+        if(fs_t6_exists(sub)) fail("exists 5");
+        fs_t6_create(sub);
+        if(!fs_t6_exists(sub)) fail("exists 6");
+        if(unlink(sub) || rmdir(dir)) fail("rmdir");
+        if(fs_t6_exists(sub) || fs_t6_exists(dir)) fail("exists 7");
+    }
+    pass();
+}
+
+//
+// Filesystem test 7
+//
+/*
+tests:
+streaming mode, read ahead and write behind
+posix_fadvise
+*/
+
+extern "C" int posix_fadvise(int fd, off_t offset, off_t len, int advice);
+
+static char fs_t7_data(int i)
+{
+    return static_cast<char>(i*7+i/251);
+}
+
+static void fs_test_7()
+{
+    test_name("Streaming mode");
+    const char name[]="/sd/testdir/stream.txt";
+    const int size=20000; //Not a multiple of the buffer size
+    char buf[300];
+    int fd=open(name,O_RDWR | O_CREAT | O_TRUNC,0666);
+    if(fd<0) fail("open");
+    if(posix_fadvise(fd,0,0,POSIX_FADV_SEQUENTIAL)) fail("posix_fadvise 1");
+    for(int i=0;i<size;i+=sizeof(buf))
+    {
+        int n=min<int>(sizeof(buf),size-i);
+        for(int j=0;j<n;j++) buf[j]=fs_t7_data(i+j);
+        if(write(fd,buf,n)!=n) fail("write");
+    }
+    //Seeking waits for the data written behind
+    if(lseek(fd,0,SEEK_END)!=size) fail("lseek 1");
+    struct stat st;
+    if(fstat(fd,&st) || st.st_size!=size) fail("size");
+    if(lseek(fd,0,SEEK_SET)!=0) fail("lseek 2");
+    for(int i=0;i<size;i+=sizeof(buf))
+    {
+        int n=min<int>(sizeof(buf),size-i);
+        if(read(fd,buf,n)!=n) fail("read 1");
+        for(int j=0;j<n;j++) if(buf[j]!=fs_t7_data(i+j)) fail("data 1");
+    }
+    if(read(fd,buf,sizeof(buf))!=0) fail("eof");
+    //Seeking backwards and forwards while reading ahead
+    const int offsets[]={ 10000, 100, 19990, 4095, 0 };
+    for(int off : offsets)
+    {
+        if(lseek(fd,off,SEEK_SET)!=off) fail("lseek 3");
+        int n=min<int>(sizeof(buf),size-off);
+        if(read(fd,buf,sizeof(buf))!=n) fail("read 2");
+        for(int j=0;j<n;j++) if(buf[j]!=fs_t7_data(off+j)) fail("data 2");
+        if(lseek(fd,0,SEEK_CUR)!=off+n) fail("lseek 4");
+    }
+    //Overwriting after reading
+    if(lseek(fd,5000,SEEK_SET)!=5000) fail("lseek 5");
+    memset(buf,'x',sizeof(buf));
+    if(write(fd,buf,sizeof(buf))!=sizeof(buf)) fail("write 2");
+    if(posix_fadvise(fd,0,0,POSIX_FADV_NORMAL)) fail("posix_fadvise 2");
+    if(lseek(fd,0,SEEK_CUR)!=5300) fail("lseek 6");
+    if(lseek(fd,4999,SEEK_SET)!=4999) fail("lseek 7");
+    if(read(fd,buf,2)!=2) fail("read 3");
+    if(buf[0]!=fs_t7_data(4999) || buf[1]!='x') fail("data 3");
+    if(close(fd)) fail("close");
+    if(unlink(name)) fail("unlink");
+    pass();
+}
+
+//
+// Filesystem test 8
+//
+/*
+tests:
+TmpFs mounted on /tmp
+*/
+
+static void fs_test_8()
+{
+    test_name("TmpFs");
+    #ifdef WITH_TMPFS
+    char buf[300];
+    if(mkdir("/tmp/dir",0755)) fail("mkdir");
+    int fd=open("/tmp/dir/a.txt",O_RDWR | O_CREAT | O_TRUNC,0666);
+    if(fd<0) fail("open 1");
+    for(int i=0;i<20;i++)
+    {
+        memset(buf,'0'+i,sizeof(buf));
+        if(write(fd,buf,sizeof(buf))!=sizeof(buf)) fail("write");
+    }
+    struct stat st;
+    if(fstat(fd,&st) || st.st_size!=20*sizeof(buf)) fail("fstat");
+    if(lseek(fd,1000,SEEK_SET)!=1000) fail("lseek");
+    if(read(fd,buf,2)!=2 || buf[0]!='3' || buf[1]!='3') fail("read 1");
+    //Removed while open, the data remains readable until close
+    if(rename("/tmp/dir/a.txt","/tmp/b.txt")) fail("rename");
+    if(rmdir("/tmp/dir")) fail("rmdir");
+    if(unlink("/tmp/b.txt")) fail("unlink");
+    if(stat("/tmp/b.txt",&st)==0) fail("stat");
+    if(read(fd,buf,sizeof(buf))!=sizeof(buf) || buf[197]!='3' || buf[198]!='4')
+        fail("read 2");
+    if(close(fd)) fail("close");
+    //Writes fail when the filesystem is full
+    fd=open("/tmp/full.bin",O_WRONLY | O_CREAT | O_TRUNC,0666);
+    if(fd<0) fail("open 2");
+    int written=0;
+    for(;;)
+    {
+        int result=write(fd,buf,sizeof(buf));
+        if(result<=0) break;
+        written+=result;
+    }
+    if(errno!=ENOSPC || written!=TMPFS_MAX_SIZE) fail("full");
+    if(close(fd) || unlink("/tmp/full.bin")) fail("unlink 2");
+    #else //WITH_TMPFS
+    iprintf("Skipped, TmpFs is disabled\n");
+    #endif //WITH_TMPFS
+    pass();
+}
+
+//
+// Filesystem test 9
+//
+/*
+tests:
+readv
+writev
+pread
+pwrite
+*/
+
+extern "C" ssize_t readv(int fd, const struct iovec *iov, int iovcnt);
+extern "C" ssize_t writev(int fd, const struct iovec *iov, int iovcnt);
+
+static void fs_test_9()
+{
+    test_name("Vectored and positional I/O");
+    const char name[]="/sd/testdir/vector.txt";
+    int fd=open(name,O_RDWR | O_CREAT | O_TRUNC,0666);
+    if(fd<0) fail("open");
+    char a[]="abc", b[]="defgh";
+    struct iovec iov[3];
+    iov[0].iov_base=a;   iov[0].iov_len=3;
+    iov[1].iov_base=0;   iov[1].iov_len=0;
+    iov[2].iov_base=b;   iov[2].iov_len=5;
+    if(writev(fd,iov,3)!=8) fail("writev");
+    //Positional I/O does not move the file pointer
+    char buf[16];
+    if(pread(fd,buf,4,2)!=4 || memcmp(buf,"cdef",4)) fail("pread 1");
+    if(pwrite(fd,"XY",2,1)!=2) fail("pwrite 1");
+    if(lseek(fd,0,SEEK_CUR)!=8) fail("file pointer 1");
+    //Writing past the end of the file zero fills the gap
+    if(pwrite(fd,"Z",1,10)!=1) fail("pwrite 2");
+    if(lseek(fd,0,SEEK_CUR)!=8) fail("file pointer 2");
+    if(pread(fd,buf,sizeof(buf),8)!=3 || memcmp(buf,"\0\0Z",3)) fail("pread 2");
+    if(pread(fd,buf,sizeof(buf),100)!=0) fail("pread 3");
+    if(lseek(fd,0,SEEK_SET)!=0) fail("lseek");
+    char c[2], d[20];
+    iov[0].iov_base=c; iov[0].iov_len=sizeof(c);
+    iov[1].iov_base=d; iov[1].iov_len=sizeof(d);
+    if(readv(fd,iov,2)!=11) fail("readv");
+    if(memcmp(c,"aX",2) || memcmp(d,"Ydefgh\0\0Z",9)) fail("data");
+    if(readv(fd,iov,IOV_MAX+1)!=-1 || errno!=EINVAL) fail("IOV_MAX");
+    if(pread(fd,buf,1,-1)!=-1 || errno!=EINVAL) fail("negative offset");
+    if(close(fd)) fail("close");
+    if(unlink(name)) fail("unlink");
+    //Terminals do not support positional I/O
+    if(pread(STDIN_FILENO,buf,1,0)!=-1 || errno!=ESPIPE) fail("ESPIPE");
+    pass();
+}
+
+//
+// Filesystem test 10
+//
+/*
+tests:
+FileDescriptorTable::aioSubmit()
+AioCompletion with a Semaphore and a completion queue
+*/
+
+static void fs_test_10()
+{
+    test_name("Asynchronous I/O");
+    const char name[]="/sd/testdir/aio.txt";
+    FileDescriptorTable& fdt=getFileDescriptorTable();
+    int fd=open(name,O_RDWR | O_CREAT | O_TRUNC,0666);
+    if(fd<0) fail("open");
+    char a[]="0123456789", b[]="abcdefghij";
+    AioRequest w1(fd,AioRequest::WRITE,a,10,0);
+    AioRequest w2(fd,AioRequest::WRITE,b,10,10);
+    AioRequest *batch[]={ &w1, &w2 };
+    Semaphore sem;
+    {
+        AioCompletion completion(sem);
+        if(fdt.aioSubmit(batch,2,completion)!=2) fail("aioSubmit 1");
+        sem.wait();
+        sem.wait();
+        if(w1.result()!=10 || w2.result()!=10) fail("write");
+        if(completion.poll()==nullptr || completion.poll()==nullptr)
+            fail("poll");
+    }
+    //Requests using the file pointer, in streaming mode they can complete
+    //without the worker thread
+    if(posix_fadvise(fd,0,0,POSIX_FADV_SEQUENTIAL)) fail("posix_fadvise");
+    char c[12], d[12];
+    AioRequest r1(fd,AioRequest::READ,c,12);
+    AioRequest r2(fd,AioRequest::READ,d,12);
+    batch[0]=&r1;
+    batch[1]=&r2;
+    AioCompletion completion;
+    if(fdt.aioSubmit(batch,2,completion)!=2) fail("aioSubmit 2");
+    if(completion.wait()!=&r1 || completion.wait()!=&r2) fail("order");
+    if(completion.wait()!=nullptr) fail("wait");
+    if(r1.result()!=12 || r2.result()!=8) fail("read");
+    if(memcmp(c,"0123456789ab",12) || memcmp(d,"cdefghij",8)) fail("data");
+    //Invalid requests are not started
+    AioRequest bad(-1,AioRequest::READ,c,12);
+    batch[0]=&bad;
+    if(fdt.aioSubmit(batch,1,completion)!=-EBADF) fail("EBADF");
+    batch[0]=&r1;
+    batch[1]=&bad;
+    if(fdt.aioSubmit(batch,2,completion)!=1) fail("aioSubmit 3");
+    if(completion.wait()!=&r1 || r1.result()!=0) fail("eof");
+    if(close(fd)) fail("close");
+    if(unlink(name)) fail("unlink");
+    pass();
+}
+
+//
+// Filesystem test 11
+//
+/*
+tests:
+poll
+select
+WaitQueue
+*/
+
+extern "C" int poll(struct pollfd *fds, nfds_t nfds, int timeout);
+
+static void fs_t11_p1(void *argv)
+{
+    Thread::sleep(20);
+    reinterpret_cast<WaitQueue*>(argv)->wakeAll();
+}
+
+static void fs_test_11()
+{
+    test_name("poll and select");
+    const char name[]="/sd/testdir/poll.txt";
+    int fd=open(name,O_RDWR | O_CREAT | O_TRUNC,0666);
+    if(fd<0) fail("open");
+    //Regular files are always ready, negative fds are ignored
+    struct pollfd fds[3];
+    fds[0].fd=fd; fds[0].events=POLLIN | POLLOUT;
+    fds[1].fd=-1; fds[1].events=POLLIN;
+    fds[2].fd=fd; fds[2].events=POLLOUT;
+    if(poll(fds,3,-1)!=2) fail("poll 1");
+    if(fds[0].revents!=(POLLIN | POLLOUT) || fds[1].revents!=0
+        || fds[2].revents!=POLLOUT) fail("revents 1");
+    fds[1].fd=MAX_OPEN_FILES;
+    if(poll(fds,2,0)!=2 || fds[1].revents!=POLLNVAL) fail("POLLNVAL");
+    if(poll(fds,MAX_OPEN_FILES+1,0)!=-1 || errno!=EINVAL) fail("EINVAL");
+    //With no files poll is a sleep
+    long long start=getTime();
+    if(poll(nullptr,0,50)!=0) fail("poll 2");
+    if(getTime()-start<50000000) fail("timeout");
+    //select is built on top of poll
+    fd_set readSet, writeSet;
+    FD_ZERO(&readSet);
+    FD_ZERO(&writeSet);
+    FD_SET(fd,&readSet);
+    FD_SET(fd,&writeSet);
+    struct timeval tv;
+    tv.tv_sec=0;
+    tv.tv_usec=0;
+    if(select(fd+1,&readSet,&writeSet,nullptr,&tv)!=2) fail("select 1");
+    if(!FD_ISSET(fd,&readSet) || !FD_ISSET(fd,&writeSet)) fail("fd_set");
+    FD_ZERO(&readSet);
+    FD_SET(MAX_OPEN_FILES-1,&readSet);
+    if(select(MAX_OPEN_FILES,&readSet,nullptr,nullptr,&tv)!=-1 || errno!=EBADF)
+        fail("select 2");
+    if(close(fd)) fail("close");
+    if(unlink(name)) fail("unlink");
+    //The wait queue used by drivers wakes the thread and sets the flag
+    WaitQueue queue;
+    volatile bool woken=false;
+    WaitQueueEntry entry;
+    entry.thread=Thread::getCurrentThread();
+    entry.woken=&woken;
+    queue.add(&entry);
+    Thread *t=Thread::create(fs_t11_p1,STACK_SMALL,0,&queue,Thread::JOINABLE);
+    {
+        FastInterruptDisableLock dLock;
+        while(woken==false) Thread::IRQenableIrqAndWait(dLock);
+    }
+    t->join();
+    WaitQueue::remove(&entry);
+    WaitQueue::remove(&entry); //Removing twice is allowed
+    pass();
+}
+
+//
+// Filesystem test 12
+//
+/*
+tests:
+pipe
+mkfifo
+splice
+*/
+
+extern "C" ssize_t splice(int fdIn, off_t *offIn, int fdOut, off_t *offOut,
+                          size_t len, unsigned int flags);
+
+static void *fs_t12_p1(void *argv)
+{
+    int fd=reinterpret_cast<int>(argv);
+    char buf[100];
+    memset(buf,'x',sizeof(buf));
+    //More than the pipe buffer, so the writer blocks
+    for(unsigned int i=0;i<2*PIPE_BUFFER_SIZE;i+=sizeof(buf))
+        if(write(fd,buf,sizeof(buf))!=sizeof(buf)) fail("write in thread");
+    close(fd);
+    return nullptr;
+}
+
+static void fs_test_12()
+{
+    test_name("Pipes and FIFOs");
+    int fds[2];
+    if(pipe(fds)) fail("pipe");
+    char buf[16];
+    if(write(fds[1],"hello",5)!=5) fail("write");
+    struct pollfd pfd;
+    pfd.fd=fds[0];
+    pfd.events=POLLIN;
+    if(poll(&pfd,1,0)!=1 || pfd.revents!=POLLIN) fail("poll");
+    if(read(fds[0],buf,sizeof(buf))!=5 || memcmp(buf,"hello",5)) fail("read");
+    struct stat st;
+    if(fstat(fds[0],&st) || !S_ISFIFO(st.st_mode)) fail("fstat");
+    if(lseek(fds[0],0,SEEK_SET)!=-1 || errno!=ESPIPE) fail("lseek");
+    //Nonblocking reads
+    if(fcntl(fds[0],F_SETFL,O_NONBLOCK)) fail("fcntl");
+    if(read(fds[0],buf,sizeof(buf))!=-1 || errno!=EAGAIN) fail("EAGAIN");
+    if(fcntl(fds[0],F_SETFL,0)) fail("fcntl");
+    //A writer thread that blocks, closing the write end gives end of file
+    pthread_t t;
+    if(pthread_create(&t,NULL,fs_t12_p1,reinterpret_cast<void*>(fds[1])))
+        fail("pthread_create");
+    unsigned int total=0;
+    for(;;)
+    {
+        ssize_t n=read(fds[0],buf,sizeof(buf));
+        if(n<0) fail("read 2");
+        if(n==0) break;
+        total+=n;
+    }
+    pthread_join(t,NULL);
+    if(total!=2*PIPE_BUFFER_SIZE) fail("total");
+    //Closing the read end gives EPIPE
+    if(pipe(fds)) fail("pipe 2");
+    if(close(fds[0])) fail("close");
+    if(write(fds[1],"x",1)!=-1 || errno!=EPIPE) fail("EPIPE");
+    if(close(fds[1])) fail("close");
+    //splice from a file through a pipe to another file
+    const char name1[]="/sd/testdir/splice1.txt";
+    const char name2[]="/sd/testdir/splice2.txt";
+    int in=open(name1,O_RDWR | O_CREAT | O_TRUNC,0666);
+    int out=open(name2,O_RDWR | O_CREAT | O_TRUNC,0666);
+    if(in<0 || out<0) fail("open");
+    if(write(in,"splice test",11)!=11 || lseek(in,0,SEEK_SET)!=0) fail("write");
+    if(pipe(fds)) fail("pipe 3");
+    if(splice(in,nullptr,fds[1],nullptr,100,0)!=11) fail("splice 1");
+    if(splice(fds[0],nullptr,out,nullptr,100,0)!=11) fail("splice 2");
+    if(splice(fds[0],nullptr,out,nullptr,100,SPLICE_F_NONBLOCK)!=-1
+        || errno!=EAGAIN) fail("splice 3");
+    if(splice(in,nullptr,out,nullptr,100,0)!=-1 || errno!=EINVAL)
+        fail("splice 4");
+    if(lseek(out,0,SEEK_SET)!=0 || read(out,buf,sizeof(buf))!=11
+        || memcmp(buf,"splice test",11)) fail("data");
+    close(fds[0]);
+    close(fds[1]);
+    close(in);
+    close(out);
+    if(unlink(name1) || unlink(name2)) fail("unlink");
+    //Named FIFO in /dev
+    if(mkfifo("/dev/testfifo",0660)) fail("mkfifo");
+    if(mkfifo("/dev/testfifo",0660)!=-1 || errno!=EEXIST) fail("EEXIST");
+    if(mkfifo("/sd/testdir/fifo",0660)!=-1 || errno!=EPERM) fail("EPERM");
+    int r=open("/dev/testfifo",O_RDONLY);
+    int w=open("/dev/testfifo",O_WRONLY);
+    if(r<0 || w<0) fail("open fifo");
+    if(stat("/dev/testfifo",&st) || !S_ISFIFO(st.st_mode)) fail("stat");
+    if(write(w,"fifo",4)!=4) fail("write fifo");
+    if(read(r,buf,sizeof(buf))!=4 || memcmp(buf,"fifo",4)) fail("read fifo");
+    close(w);
+    if(read(r,buf,sizeof(buf))!=0) fail("eof fifo");
+    close(r);
+    if(unlink("/dev/testfifo")) fail("unlink fifo");
+    pass();
+}
+
+//
+// Filesystem test 13
+//
+/*
+tests:
+mmap
+munmap
+MemoryDevice
+*/
+
+extern "C" void *mmap(void *addr, size_t len, int prot, int flags, int fd,
+                      off_t offset);
+extern "C" int munmap(void *addr, size_t len);
+
+//In flash, so the mapping does not copy it in RAM
+static const char fs_t13_data[]="Read-only data mapped in place";
+
+static void fs_test_13()
+{
+    test_name("mmap");
+    intrusive_ref_ptr<DevFs> devFs=FilesystemManager::instance().getDevFs();
+    if(!devFs) fail("no DevFs");
+    if(devFs->addDevice("testmem",intrusive_ref_ptr<Device>(
+        new MemoryDevice(fs_t13_data,sizeof(fs_t13_data))))==false)
+        fail("addDevice");
+    int fd=open("/dev/testmem",O_RDONLY);
+    if(fd<0) fail("open");
+    struct stat st;
+    if(fstat(fd,&st) || st.st_size!=sizeof(fs_t13_data)) fail("fstat");
+    void *p=mmap(nullptr,9,PROT_READ,MAP_SHARED,fd,0);
+    if(p!=fs_t13_data) fail("mmap 1");
+    if(munmap(p,9)) fail("munmap");
+    p=mmap(nullptr,4,PROT_READ,MAP_PRIVATE,fd,26);
+    if(p!=fs_t13_data+26 || memcmp(p,"lace",4)) fail("mmap 2");
+    //The mapping remains valid after close
+    if(close(fd)) fail("close");
+    if(memcmp(p,"lace",4)) fail("data");
+    fd=open("/dev/testmem",O_RDONLY);
+    if(fd<0) fail("open");
+    char buf[4];
+    if(lseek(fd,5,SEEK_SET)!=5 || read(fd,buf,4)!=4 || memcmp(buf,"only",4))
+        fail("read");
+    if(mmap(nullptr,sizeof(fs_t13_data)+1,PROT_READ,MAP_SHARED,fd,0)!=MAP_FAILED
+        || errno!=ENXIO) fail("ENXIO");
+    if(mmap(nullptr,4,PROT_READ | PROT_WRITE,MAP_SHARED,fd,0)!=MAP_FAILED
+        || errno!=ENOTSUP) fail("ENOTSUP");
+    if(write(fd,"x",1)!=-1) fail("write");
+    if(close(fd)) fail("close");
+    if(devFs->remove("testmem")==false) fail("remove");
+    //Files on storage that is not memory addressable cannot be mapped
+    const char name[]="/sd/testdir/mmap.txt";
+    fd=open(name,O_RDWR | O_CREAT | O_TRUNC,0666);
+    if(fd<0 || write(fd,"abc",3)!=3) fail("open file");
+    if(mmap(nullptr,3,PROT_READ,MAP_SHARED,fd,0)!=MAP_FAILED || errno!=ENODEV)
+        fail("ENODEV");
+    if(close(fd) || unlink(name)) fail("unlink");
+    pass();
+}
+
+//
+// Filesystem test 14
+//
+/*
+tests:
+file descriptor table growth
+lowest free file descriptor
+ENFILE
+*/
+
+static void fs_test_14()
+{
+    test_name("fd table growth");
+    int fds[MAX_OPEN_FILES];
+    int n=0;
+    for(;;)
+    {
+        int fd=open("/dev/null",O_RDWR);
+        if(fd<0) break;
+        if(n>=MAX_OPEN_FILES) fail("too many");
+        fds[n++]=fd;
+    }
+    if(errno!=ENFILE) fail("ENFILE");
+    //The table grew past its first chunk, up to the maximum
+    if(n<=FD_TABLE_CHUNK || fds[n-1]!=MAX_OPEN_FILES-1) fail("growth");
+    for(int i=1;i<n;i++) if(fds[i]!=fds[i-1]+1) fail("lowest fd");
+    //Free file descriptors are reused, the lowest first
+    int a=fds[n-1], b=fds[n/2];
+    if(close(a) || close(b)) fail("close");
+    if(open("/dev/null",O_RDWR)!=b || open("/dev/null",O_RDWR)!=a)
+        fail("reuse");
+    struct stat st;
+    for(int i=0;i<n;i++)
+        if(fstat(fds[i],&st) || close(fds[i])) fail("close all");
+    if(fstat(a,&st)!=-1 || errno!=EBADF) fail("EBADF");
     pass();
 }
 #endif //WITH_FILESYSTEM
@@ -5117,8 +5847,75 @@ static void benchmark_2()
 tests:
 Fisesystem write speed and latency
 makes a 1MB file and measures time required to read/write it.
+Also measures if reading and writing different files from different threads
+takes less time than doing it one after the other
 */
 
+static const unsigned int b3_size=256*1024;
+static const unsigned int b3_bufsize=4096;
+
+static bool b3_transfer(const char *name, bool write)
+{
+    int fd=write ? open(name,O_WRONLY | O_CREAT | O_TRUNC,0666)
+                 : open(name,O_RDONLY);
+    if(fd<0) return false;
+    char *buf=new char[b3_bufsize];
+    memset(buf,'0',b3_bufsize);
+    bool result=true;
+    for(unsigned int i=0;i<b3_size/b3_bufsize;i++)
+    {
+        ssize_t n=write ? ::write(fd,buf,b3_bufsize) : read(fd,buf,b3_bufsize);
+        if(n!=b3_bufsize) { result=false; break; }
+    }
+    delete[] buf;
+    if(close(fd)) result=false;
+    return result;
+}
+
+static void *b3_writer(void *argv)
+{
+    if(b3_transfer(reinterpret_cast<const char*>(argv),true)==false)
+        return reinterpret_cast<void*>(1);
+    return nullptr;
+}
+
+static void b3_parallel()
+{
+    using namespace std::chrono;
+    const char readName[]="/sd/speed_r.txt";
+    const char writeName[]="/sd/speed_w.txt";
+    if(b3_transfer(readName,true)==false)
+    {
+        iprintf("Filesystem parallel benchmark not made. Can't write file\n");
+        return;
+    }
+    auto t=system_clock::now();
+    bool ok=b3_transfer(writeName,true) && b3_transfer(readName,false);
+    auto serial=duration_cast<milliseconds>(system_clock::now()-t).count();
+    t=system_clock::now();
+    Thread *writer=Thread::create(b3_writer,STACK_DEFAULT_FOR_PTHREAD,
+        Thread::getCurrentThread()->getPriority(),
+        const_cast<char*>(writeName),Thread::JOINABLE);
+    if(writer==nullptr) ok=false;
+    if(b3_transfer(readName,false)==false) ok=false;
+    void *result=nullptr;
+    if(writer) writer->join(&result);
+    if(result) ok=false;
+    auto parallel=duration_cast<milliseconds>(system_clock::now()-t).count();
+    unlink(readName);
+    unlink(writeName);
+    if(ok==false)
+    {
+        iprintf("Filesystem parallel benchmark failed\n");
+        return;
+    }
+    iprintf("Filesystem parallel benchmark\n");
+    iprintf("Write %uKB then read %uKB = %dms\n",b3_size/1024,b3_size/1024,
+            static_cast<int>(serial));
+    iprintf("Write %uKB while reading %uKB from another thread = %dms\n",
+            b3_size/1024,b3_size/1024,static_cast<int>(parallel));
+}
+
 static void benchmark_3()
 {
     using namespace std::chrono;
@@ -5149,12 +5946,17 @@ static void benchmark_3()
         max=std::max(max,static_cast<int>(duration_cast<milliseconds>(d).count()));
     }
     auto d=system_clock::now()-total;
+    CacheStats writeStats;
+    if(ioctl(fileno(f),IOCTL_GET_CACHE_STATS,&writeStats)!=0)
+        memset(&writeStats,0,sizeof(writeStats));
     if(fclose(f)!=0) iprintf("Error in fclose 1\n");
     iprintf("Filesystem write benchmark\n");
     unsigned int writeTime=duration_cast<milliseconds>(d).count();
     unsigned int writeSpeed=static_cast<unsigned int>(1024000.0/writeTime);
     iprintf("Total write time = %dms (%dKB/s)\n",writeTime,writeSpeed);
     iprintf("Max filesystem latency = %dms\n",max);
+    iprintf("Sector cache hits = %u misses = %u writebacks = %u\n",
+            writeStats.hits,writeStats.misses,writeStats.writebacks);
     //Read benchmark
     max=0;
     if((f=fopen(FILENAME,"r"))==NULL)
@@ -5184,13 +5986,44 @@ static void benchmark_3()
     }
     quit:
     d=system_clock::now()-total;
+    CacheStats readStats;
+    if(ioctl(fileno(f),IOCTL_GET_CACHE_STATS,&readStats)!=0)
+        memset(&readStats,0,sizeof(readStats));
     if(fclose(f)!=0) iprintf("Error in fclose 2\n");
     iprintf("Filesystem read test\n");
     unsigned int readTime=duration_cast<milliseconds>(d).count();
     unsigned int readSpeed=static_cast<unsigned int>(1024000.0/readTime);
     iprintf("Total read time = %dms (%dKB/s)\n",readTime,readSpeed);
     iprintf("Max filesystem latency = %dms\n",max);
+    //Statistics are cumulative since mount, print the read test contribution
+    iprintf("Sector cache hits = %u misses = %u writebacks = %u\n",
+            readStats.hits-writeStats.hits,readStats.misses-writeStats.misses,
+            readStats.writebacks-writeStats.writebacks);
+    //Small write benchmark, like appending to a log file. This is where
+    //syncing after every write hurts the most
+    if((f=fopen(FILENAME,"w"))==NULL)
+    {
+        iprintf("Filesystem small write benchmark not made. Can't open file\n");
+        delete[] buf;
+        return;
+    }
+    setbuf(f,NULL);
+    total=system_clock::now();
+    for(i=0;i<1024;i++)
+    {
+        if(fwrite(buf,1,32,f)!=32)
+        {
+            iprintf("Write error\n");
+            break;
+        }
+    }
+    d=system_clock::now()-total;
+    if(fclose(f)!=0) iprintf("Error in fclose 3\n");
+    iprintf("Filesystem small write benchmark\n");
+    iprintf("Total time for 1024 writes of 32 bytes = %dms\n",
+            static_cast<int>(duration_cast<milliseconds>(d).count()));
     delete[] buf;
+    b3_parallel();
 }
 
 //
@@ -124,9 +124,21 @@ void __attribute__((naked)) MemManage_Handler()
 
 void __attribute__((noinline)) MemManage_impl()
 {
-    #if defined(WITH_PROCESSES) || defined(WITH_ERRLOG)
+    #if defined(WITH_PROCESSES) || defined(WITH_ERRLOG) \
+     || defined(WITH_MPU_STACK_GUARD)
     unsigned int cfsr=SCB->CFSR;
-    #endif //WITH_PROCESSES || WITH_ERRLOG
+    #endif //WITH_PROCESSES || WITH_ERRLOG || WITH_MPU_STACK_GUARD
+    #ifdef WITH_MPU_STACK_GUARD
+    if(((cfsr & 0x00000080) && IRQisStackGuardFault(SCB->MMFAR))
+    || ((cfsr & 0x00000010) && IRQisStackGuardStackingFault(__get_PSP())))
+    {
+        #ifdef WITH_ERRLOG
+        IRQerrorLog("\r\n***Stack overflow @ ");
+        printUnsignedInt(getProgramCounter());
+        #endif //WITH_ERRLOG
+        miosix_private::IRQsystemReboot();
+    }
+    #endif //WITH_MPU_STACK_GUARD
     #ifdef WITH_PROCESSES
     int id, arg=0;
     if(cfsr & 0x00000001) id=MP_XN;
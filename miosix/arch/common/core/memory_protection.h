@@ -8,6 +8,8 @@
  || defined(_ARCH_CORTEXM7_STM32F7) || defined(_ARCH_CORTEXM7_STM32H7) \
  || defined(_ARCH_CORTEXM3_EFM32GG) || defined(_ARCH_CORTEXM4_STM32L4)
 #include "mpu_cortexMx.h"
+#elif defined(WITH_MPU_STACK_GUARD)
+#error "WITH_MPU_STACK_GUARD is not supported by this architecture"
 #endif
 
 #endif //MEMORY_PROTECTION_H
@@ -50,6 +50,76 @@ inline void IRQenableMPUatBoot()
     MPU->CTRL=MPU_CTRL_PRIVDEFENA_Msk | MPU_CTRL_ENABLE_Msk;
 }
 
+#ifdef WITH_MPU_STACK_GUARD
+
+/// \internal MPU region used for the stack guard. Regions 6 and 7 are used
+/// by processes, and lower regions by the cache configuration
+const unsigned int STACK_GUARD_REGION=5;
+
+/// \internal Size of the stack guard, the minimum MPU region size
+const unsigned int STACK_GUARD_SIZE=32;
+
+/**
+ * \internal
+ * \param watermark pointer to the watermark area of a thread
+ * \return the base address of the stack guard of that thread, that is the
+ * first STACK_GUARD_SIZE aligned address in the watermark area
+ */
+inline unsigned int stackGuardBase(const unsigned int *watermark)
+{
+    return (reinterpret_cast<unsigned int>(watermark)+STACK_GUARD_SIZE-1)
+         & ~(STACK_GUARD_SIZE-1);
+}
+
+/**
+ * \internal
+ * Called during context switches to move the stack guard below the stack of
+ * the thread that is about to run. Any access to the guard, including by
+ * privileged code, causes a MemManage fault.
+ * \param watermark pointer to the watermark area of the thread that is about
+ * to run
+ */
+inline void IRQsetStackGuard(const unsigned int *watermark)
+{
+    MPU->RBAR=stackGuardBase(watermark) | MPU_RBAR_VALID_Msk
+            | STACK_GUARD_REGION;
+    MPU->RASR=0<<MPU_RASR_AP_Pos //Privileged: no access, unprivileged: no access
+            | MPU_RASR_XN_Msk
+            | 1 //Enable bit
+            | 4<<1; //32 bytes, same as sizeToMpu(STACK_GUARD_SIZE)<<1
+}
+
+/**
+ * \internal
+ * \param address address that caused a MemManage fault
+ * \return true if the address is within the currently configured stack guard
+ */
+inline bool IRQisStackGuardFault(unsigned int address)
+{
+    MPU->RNR=STACK_GUARD_REGION;
+    unsigned int base=MPU->RBAR & MPU_RBAR_ADDR_Msk;
+    return address>=base && address<base+STACK_GUARD_SIZE;
+}
+
+/**
+ * \internal
+ * When the stack overflows while the CPU pushes the exception frame, the fault
+ * is reported with MSTKERR and without a valid fault address.
+ * \param sp process stack pointer at the time of the fault
+ * \return true if an exception frame pushed at sp would overlap the currently
+ * configured stack guard
+ */
+inline bool IRQisStackGuardStackingFault(unsigned int sp)
+{
+    //Largest exception frame, with the FPU context and alignment padding
+    const unsigned int maxFrame=27*4;
+    MPU->RNR=STACK_GUARD_REGION;
+    unsigned int base=MPU->RBAR & MPU_RBAR_ADDR_Msk;
+    return sp+maxFrame>base && sp<base+STACK_GUARD_SIZE+maxFrame;
+}
+
+#endif //WITH_MPU_STACK_GUARD
+
 #ifdef WITH_PROCESSES
 
 /**
@@ -28,6 +28,7 @@
 #include "kernel/kernel.h"
 #include "interfaces/os_timer.h"
 #include "interfaces/arch_registers.h"
+#include "kernel/kernel_trace.h"
 
 namespace miosix {
 
@@ -110,5 +111,7 @@ void __attribute__((naked)) TIM2_IRQHandler()
 
 void __attribute__((used)) osTimerImpl()
 {
+    miosix::IRQtraceIrqEntry(TIM2_IRQn);
     miosix::timer.IRQhandler();
+    miosix::IRQtraceIrqExit(TIM2_IRQn);
 }
@@ -28,6 +28,7 @@
 #include "kernel/kernel.h"
 #include "interfaces/os_timer.h"
 #include "interfaces/arch_registers.h"
+#include "kernel/kernel_trace.h"
 #include "kernel/logging.h"
 
 namespace miosix {
@@ -132,5 +133,7 @@ void __attribute__((naked)) TIM4_IRQHandler()
 
 void __attribute__((used)) osTimerImpl()
 {
+    miosix::IRQtraceIrqEntry(TIM4_IRQn);
     miosix::timer.IRQhandler();
+    miosix::IRQtraceIrqExit(TIM4_IRQn);
 }
@@ -28,6 +28,7 @@
 #include "kernel/kernel.h"
 #include "interfaces/os_timer.h"
 #include "interfaces/arch_registers.h"
+#include "kernel/kernel_trace.h"
 
 namespace miosix {
 
@@ -120,5 +121,7 @@ void __attribute__((naked)) TIM5_IRQHandler()
 
 void __attribute__((used)) osTimerImpl()
 {
+    miosix::IRQtraceIrqEntry(TIM5_IRQn);
     miosix::timer.IRQhandler();
+    miosix::IRQtraceIrqExit(TIM5_IRQn);
 }
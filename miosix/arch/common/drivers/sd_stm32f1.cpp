@@ -31,6 +31,7 @@
 #include "interfaces/delays.h"
 #include "kernel/kernel.h"
 #include "kernel/scheduler/scheduler.h"
+#include "kernel/kernel_trace.h"
 #include "board_settings.h" //For sdVoltage
 #include <cstdio>
 #include <cstring>
@@ -102,6 +103,7 @@ static unsigned int sdioFlags;      ///< \internal SDIO status flags
  */
 void __attribute__((used)) DMA2channel4irqImpl()
 {
+    TracedInterrupt traced;
     dmaFlags=DMA2->ISR;
     if(dmaFlags & DMA_ISR_TEIF4) transferError=true;
     
@@ -120,6 +122,7 @@ void __attribute__((used)) DMA2channel4irqImpl()
  */
 void __attribute__((used)) SDIOirqImpl()
 {
+    TracedInterrupt traced;
     sdioFlags=SDIO->STA;
     if(sdioFlags & (SDIO_STA_STBITERR | SDIO_STA_RXOVERR  |
                     SDIO_STA_TXUNDERR | SDIO_STA_DTIMEOUT | SDIO_STA_DCRCFAIL))
@@ -32,6 +32,7 @@
 #include "kernel/scheduler/scheduler.h"
 #include "interfaces/delays.h"
 #include "kernel/kernel.h"
+#include "kernel/kernel_trace.h"
 #include "board_settings.h" //For sdVoltage and SD_ONE_BIT_DATABUS definitions
 #include <cstdio>
 #include <cstring>
@@ -159,6 +160,7 @@ static unsigned int sdioFlags;      ///< \internal SDIO status flags
  */
 void __attribute__((used)) SDDMAirqImpl()
 {
+    TracedInterrupt traced;
     dmaFlags=DMA2->LISR;
     #if (defined(_ARCH_CORTEXM7_STM32F7) || defined(_ARCH_CORTEXM7_STM32H7)) && SD_SDMMC==2
     if(dmaFlags & (DMA_LISR_TEIF0 | DMA_LISR_DMEIF0 | DMA_LISR_FEIF0))
@@ -191,6 +193,7 @@ void __attribute__((used)) SDDMAirqImpl()
  */
 void __attribute__((used)) SDirqImpl()
 {
+    TracedInterrupt traced;
     sdioFlags=SDIO->STA;
     if(sdioFlags & (SDIO_STA_STBITERR | SDIO_STA_RXOVERR  |
                     SDIO_STA_TXUNDERR | SDIO_STA_DTIMEOUT | SDIO_STA_DCRCFAIL))
@@ -1378,111 +1381,102 @@ static CardType detectCardType()
     }
 }
 
-//
-// class SDIODriver
-//
-
-intrusive_ref_ptr<SDIODriver> SDIODriver::instance()
-{
-    static FastMutex m;
-    static intrusive_ref_ptr<SDIODriver> instance;
-    Lock<FastMutex> l(m);
-    if(!instance) instance=new SDIODriver();
-    return instance;
-}
-
-ssize_t SDIODriver::readBlock(void* buffer, size_t size, off_t where)
+/**
+ * \internal
+ * Transfer a request, with a multiple block command for each run of its
+ * buffers that are adjacent in memory, since the DMA can't gather data from
+ * multiple buffers in a single command.
+ * Card must be selected prior to calling this function.
+ * \param req the request
+ * \return true on success
+ */
+static bool transferRequest(const BlockRequest *req)
 {
-    if(where % 512 || size % 512) return -EFAULT;
-    unsigned int lba=where/512;
-    unsigned int nSectors=size/512;
-    Lock<FastMutex> l(mutex);
-    DBG("SDIODriver::readBlock(): nSectors=%d\n",nSectors);
-    bool goodBuffer=BufferConverter::isGoodBuffer(buffer);
-    if(goodBuffer==false) DBG("Buffer inside CCM\n");
-    
-    for(int i=0;i<ClockController::getRetryCount();i++)
+    unsigned int lba=req->sector;
+    for(int i=0;i<req->iovcnt;)
     {
-        CardSelector selector;
-        if(selector.succeded()==false) continue;
-        bool error=false;
+        unsigned char *buffer=
+            reinterpret_cast<unsigned char*>(req->iov[i].iov_base);
+        size_t size=req->iov[i].iov_len;
+        for(i++;i<req->iovcnt && buffer+size==req->iov[i].iov_base;i++)
+            size+=req->iov[i].iov_len;
+        unsigned int nSectors=size/512;
         
-        if(goodBuffer)
+        if(BufferConverter::isGoodBuffer(buffer))
         {
-            if(multipleBlockRead(reinterpret_cast<unsigned char*>(buffer),
-                nSectors,lba)==false) error=true;
+            if(req->op==BlockRequest::READ)
+            {
+                if(multipleBlockRead(buffer,nSectors,lba)==false) return false;
+            } else {
+                if(multipleBlockWrite(buffer,nSectors,lba)==false) return false;
+            }
         } else {
             //Fallback code to work around CCM
-            unsigned char *tempBuffer=reinterpret_cast<unsigned char*>(buffer);
+            DBG("Buffer inside CCM\n");
             unsigned int tempLba=lba;
             for(unsigned int j=0;j<nSectors;j++)
             {
-                unsigned char* b=BufferConverter::toWordAlignedWithoutCopy(tempBuffer);
-                if(multipleBlockRead(b,1,tempLba)==false)
+                if(req->op==BlockRequest::READ)
                 {
-                    error=true;
-                    break;
+                    unsigned char* b=
+                        BufferConverter::toWordAlignedWithoutCopy(buffer);
+                    if(multipleBlockRead(b,1,tempLba)==false) return false;
+                    BufferConverter::toOriginalBuffer();
+                } else {
+                    const unsigned char* b=BufferConverter::toWordAligned(buffer);
+                    if(multipleBlockWrite(b,1,tempLba)==false) return false;
                 }
-                BufferConverter::toOriginalBuffer();
-                tempBuffer+=512;
+                buffer+=512;
                 tempLba++;
             }
         }
-        
-        if(error==false)
-        {
-            if(i>0) DBGERR("Read: required %d retries\n",i);
-            return size;
-        }
+        lba+=nSectors;
     }
-    return -EBADF;
+    return true;
 }
 
-ssize_t SDIODriver::writeBlock(const void* buffer, size_t size, off_t where)
+//
+// class SDIODriver
+//
+
+intrusive_ref_ptr<SDIODriver> SDIODriver::instance()
+{
+    static FastMutex m;
+    static intrusive_ref_ptr<SDIODriver> instance;
+    Lock<FastMutex> l(m);
+    if(!instance) instance=new SDIODriver();
+    return instance;
+}
+
+void SDIODriver::transfer(BlockRequest *list)
 {
-    if(where % 512 || size % 512) return -EFAULT;
-    unsigned int lba=where/512;
-    unsigned int nSectors=size/512;
     Lock<FastMutex> l(mutex);
-    DBG("SDIODriver::writeBlock(): nSectors=%d\n",nSectors);
-    bool goodBuffer=BufferConverter::isGoodBuffer(buffer);
-    if(goodBuffer==false) DBG("Buffer inside CCM\n");
-    
-    for(int i=0;i<ClockController::getRetryCount();i++)
+    BlockRequest *req=list;
+    int retries=0;
+    while(req)
     {
-        CardSelector selector;
-        if(selector.succeded()==false) continue;
-        bool error=false;
-        
-        if(goodBuffer)
         {
-            if(multipleBlockWrite(reinterpret_cast<const unsigned char*>(buffer),
-                nSectors,lba)==false) error=true;
-        } else {
-            //Fallback code to work around CCM
-            const unsigned char *tempBuffer=
-                reinterpret_cast<const unsigned char*>(buffer);
-            unsigned int tempLba=lba;
-            for(unsigned int j=0;j<nSectors;j++)
+            //The card stays selected for all the requests, unless one fails
+            CardSelector selector;
+            if(selector.succeded())
             {
-                const unsigned char* b=BufferConverter::toWordAligned(tempBuffer);
-                if(multipleBlockWrite(b,1,tempLba)==false)
+                for(;req;req=req->next)
                 {
-                    error=true;
-                    break;
+                    DBG("SDIODriver::transfer(): nSectors=%d\n",req->count);
+                    if(transferRequest(req)==false) break;
+                    if(retries>0) DBGERR("Transfer: required %d retries\n",retries);
+                    retries=0;
+                    req->result=0;
                 }
-                tempBuffer+=512;
-                tempLba++;
+                if(req==nullptr) break;
             }
         }
-        
-        if(error==false)
-        {
-            if(i>0) DBGERR("Write: required %d retries\n",i);
-            return size;
-        }
+        //Retry the failed request, the ones already transferred are not
+        if(++retries<ClockController::getRetryCount()) continue;
+        req->result=-EBADF;
+        req=req->next;
+        retries=0;
     }
-    return -EBADF;
 }
 
 int SDIODriver::ioctl(int cmd, void* arg)
@@ -1495,7 +1489,7 @@ int SDIODriver::ioctl(int cmd, void* arg)
     return waitForCardReady() ? 0 : -EFAULT;
 }
 
-SDIODriver::SDIODriver() : Device(Device::BLOCK)
+SDIODriver::SDIODriver() : BlockDevice(512)
 {
     initSDIOPeripheral();
 
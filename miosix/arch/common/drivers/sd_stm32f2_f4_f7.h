@@ -29,7 +29,7 @@
 #define	SD_STM32F2_F4_H
 
 #include "kernel/sync.h"
-#include "filesystem/devfs/devfs.h"
+#include "filesystem/devfs/block_device.h"
 #include "filesystem/ioctl.h"
 
 namespace miosix {
@@ -37,7 +37,7 @@ namespace miosix {
 /**
  * Driver for the SDIO peripheral in STM32F2 and F4 microcontrollers
  */
-class SDIODriver : public Device
+class SDIODriver : public BlockDevice
 {
 public:
     /**
@@ -45,11 +45,19 @@ public:
      */
     static intrusive_ref_ptr<SDIODriver> instance();
     
-    virtual ssize_t readBlock(void *buffer, size_t size, off_t where);
-    
-    virtual ssize_t writeBlock(const void *buffer, size_t size, off_t where);
-    
     virtual int ioctl(int cmd, void *arg);
+
+protected:
+    /**
+     * Transfer a list of requests, selecting the card once for all of them.
+     * Requests to adjacent sectors are not merged, each request is
+     * transferred with one multiple block command per run of its buffers
+     * that are adjacent in memory, as the DMA can't gather data from multiple
+     * buffers
+     * \param list the requests
+     */
+    virtual void transfer(BlockRequest *list);
+
 private:
     /**
      * Constructor
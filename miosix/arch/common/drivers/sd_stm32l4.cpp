@@ -6,6 +6,7 @@
 #include "kernel/scheduler/scheduler.h"
 #include "interfaces/delays.h"
 #include "kernel/kernel.h"
+#include "kernel/kernel_trace.h"
 #include "board_settings.h" //For sdVoltage and SD_ONE_BIT_DATABUS definitions
 #include <cstdio>
 #include <cstring>
@@ -46,6 +47,7 @@ static unsigned int sdioFlags;      ///< \internal SDIO status flags
  */
 void __attribute__((used)) SDMMCirqImpl()
 {
+    TracedInterrupt traced;
     sdioFlags=SDMMC1->STA;
 
     if(sdioFlags & (SDMMC_STA_RXOVERR  |
@@ -996,6 +998,37 @@ static CardType detectCardType()
     }
 }
 
+/**
+ * \internal
+ * Transfer a request, with a multiple block command for each run of its
+ * buffers that are adjacent in memory, since the DMA can't gather data from
+ * multiple buffers in a single command.
+ * Card must be selected prior to calling this function.
+ * \param req the request
+ * \return true on success
+ */
+static bool transferRequest(const BlockRequest *req)
+{
+    unsigned int lba=req->sector;
+    for(int i=0;i<req->iovcnt;)
+    {
+        unsigned char *buffer=
+            reinterpret_cast<unsigned char*>(req->iov[i].iov_base);
+        size_t size=req->iov[i].iov_len;
+        for(i++;i<req->iovcnt && buffer+size==req->iov[i].iov_base;i++)
+            size+=req->iov[i].iov_len;
+        unsigned int nSectors=size/512;
+        
+        if(req->op==BlockRequest::READ)
+        {
+            if(multipleBlockRead(buffer,nSectors,lba)==false) return false;
+        } else {
+            if(multipleBlockWrite(buffer,nSectors,lba)==false) return false;
+        }
+        lba+=nSectors;
+    }
+    return true;
+}
 
 intrusive_ref_ptr<SDIODriver> SDIODriver::instance()
 {
@@ -1006,54 +1039,35 @@ intrusive_ref_ptr<SDIODriver> SDIODriver::instance()
     return instance;
 }
 
-ssize_t SDIODriver::readBlock(void* buffer, size_t size, off_t where)
+void SDIODriver::transfer(BlockRequest *list)
 {
-    if(where % 512 || size % 512) return -EFAULT;
-    unsigned int lba=where/512;
-    unsigned int nSectors=size/512;
     Lock<FastMutex> l(mutex);
-    DBG("SDIODriver::readBlock(): nSectors=%d\n",nSectors);
-    
-    for(int i=0;i < ClockController::getRetryCount();i++)
+    BlockRequest *req=list;
+    int retries=0;
+    while(req)
     {
-        CardSelector selector;
-        if(selector.succeded()==false) continue;
-        bool error=false;
-        if(multipleBlockRead(reinterpret_cast<unsigned char*>(buffer),
-                nSectors,lba)==false) error=true;
-        
-        if(error==false)
         {
-            if(i>0) DBGERR("Read: required %d retries\n",i);
-            return size;
-        }
-    }
-    return -EBADF;
-}
-
-ssize_t SDIODriver::writeBlock(const void* buffer, size_t size, off_t where)
-{
-    if(where % 512 || size % 512) return -EFAULT;
-    unsigned int lba=where/512;
-    unsigned int nSectors=size/512;
-    Lock<FastMutex> l(mutex);
-    DBG("SDIODriver::writeBlock(): nSectors=%d\n",nSectors);
-    for(int i=0;i<ClockController::getRetryCount();i++)
-    {
-        CardSelector selector;
-        if(selector.succeded()==false) continue;
-        bool error=false;
-
-        if(multipleBlockWrite(reinterpret_cast<const unsigned char*>(buffer),
-            nSectors,lba)==false) error=true;
-        
-        if(error==false)
-        {
-            if(i>0) DBGERR("Write: required %d retries\n",i);
-            return size;
+            //The card stays selected for all the requests, unless one fails
+            CardSelector selector;
+            if(selector.succeded())
+            {
+                for(;req;req=req->next)
+                {
+                    DBG("SDIODriver::transfer(): nSectors=%d\n",req->count);
+                    if(transferRequest(req)==false) break;
+                    if(retries>0) DBGERR("Transfer: required %d retries\n",retries);
+                    retries=0;
+                    req->result=0;
+                }
+                if(req==nullptr) break;
+            }
         }
+        //Retry the failed request, the ones already transferred are not
+        if(++retries<ClockController::getRetryCount()) continue;
+        req->result=-EBADF;
+        req=req->next;
+        retries=0;
     }
-    return -EBADF;
 }
 
 int SDIODriver::ioctl(int cmd, void* arg)
@@ -1066,7 +1080,7 @@ int SDIODriver::ioctl(int cmd, void* arg)
     return waitForCardReady() ? 0 : -EFAULT;
 }
 
-SDIODriver::SDIODriver() : Device(Device::BLOCK)
+SDIODriver::SDIODriver() : BlockDevice(512)
 {
 
     initSDIOPeripheral();
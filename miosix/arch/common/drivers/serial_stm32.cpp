@@ -31,6 +31,7 @@
 #include "serial_stm32.h"
 #include "kernel/sync.h"
 #include "kernel/scheduler/scheduler.h"
+#include "kernel/kernel_trace.h"
 #include "interfaces/portability.h"
 #include "filesystem/ioctl.h"
 #include "core/cache_cortexMx.h"
@@ -67,6 +68,7 @@ static STM32Serial *ports[numPorts]={0};
  */
 void __attribute__((noinline)) usart1irqImpl()
 {
+   TracedInterrupt traced;
    if(ports[0]) ports[0]->IRQhandleInterrupt();
 }
 
@@ -87,6 +89,7 @@ void __attribute__((naked)) USART1_IRQHandler()
  */
 void __attribute__((noinline)) usart2irqImpl()
 {
+   TracedInterrupt traced;
    if(ports[1]) ports[1]->IRQhandleInterrupt();
 }
 
@@ -106,6 +109,7 @@ void __attribute__((naked)) USART2_IRQHandler()
  */
 void __attribute__((noinline)) usart3irqImpl()
 {
+   TracedInterrupt traced;
    if(ports[2]) ports[2]->IRQhandleInterrupt();
 }
 
@@ -137,6 +141,7 @@ void __attribute__((naked)) USART3_4_IRQHandler()
  */
 void __attribute__((noinline)) usart1txDmaImpl()
 {
+    TracedInterrupt traced;
     #if defined(_ARCH_CORTEXM3_STM32F1) || defined (_ARCH_CORTEXM4_STM32F3) \
      || defined(_ARCH_CORTEXM4_STM32L4)
     DMA1->IFCR=DMA_IFCR_CGIF4;
@@ -155,6 +160,7 @@ void __attribute__((noinline)) usart1txDmaImpl()
  */
 void __attribute__((noinline)) usart1rxDmaImpl()
 {
+    TracedInterrupt traced;
     if(ports[0]) ports[0]->IRQhandleDMArx();
 }
 
@@ -211,6 +217,7 @@ void __attribute__((naked)) DMA2_Stream5_IRQHandler()
  */
 void __attribute__((noinline)) usart2txDmaImpl()
 {
+    TracedInterrupt traced;
     #if defined(_ARCH_CORTEXM3_STM32F1) || defined (_ARCH_CORTEXM4_STM32F3) \
      || defined(_ARCH_CORTEXM4_STM32L4)
     DMA1->IFCR=DMA_IFCR_CGIF7;
@@ -229,6 +236,7 @@ void __attribute__((noinline)) usart2txDmaImpl()
  */
 void __attribute__((noinline)) usart2rxDmaImpl()
 {
+    TracedInterrupt traced;
     if(ports[1]) ports[1]->IRQhandleDMArx();
 }
 
@@ -285,6 +293,7 @@ void __attribute__((naked)) DMA1_Stream5_IRQHandler()
  */
 void __attribute__((noinline)) usart3txDmaImpl()
 {
+    TracedInterrupt traced;
     #if defined(_ARCH_CORTEXM3_STM32F1) || defined (_ARCH_CORTEXM4_STM32F3) \
      || defined(_ARCH_CORTEXM4_STM32L4)
     DMA1->IFCR=DMA_IFCR_CGIF2;
@@ -303,6 +312,7 @@ void __attribute__((noinline)) usart3txDmaImpl()
  */
 void __attribute__((noinline)) usart3rxDmaImpl()
 {
+    TracedInterrupt traced;
     if(ports[2]) ports[2]->IRQhandleDMArx();
 }
 
@@ -773,7 +783,27 @@ ssize_t STM32Serial::writeBlock(const void *buffer, size_t size, off_t where)
 {
     Lock<FastMutex> l(txMutex);
     DeepSleepLock dpLock;
-    const char *buf=reinterpret_cast<const char*>(buffer);
+    writeLocked(reinterpret_cast<const char*>(buffer),size);
+    return size;
+}
+
+ssize_t STM32Serial::writeBlocks(const struct iovec *iov, int iovcnt,
+        off_t where)
+{
+    Lock<FastMutex> l(txMutex);
+    DeepSleepLock dpLock;
+    ssize_t total=0;
+    for(int i=0;i<iovcnt;i++)
+    {
+        writeLocked(reinterpret_cast<const char*>(iov[i].iov_base),
+                    iov[i].iov_len);
+        total+=iov[i].iov_len;
+    }
+    return total;
+}
+
+void STM32Serial::writeLocked(const char *buf, size_t size)
+{
     #ifdef SERIAL_DMA
     if(dmaTx)
     {
@@ -802,7 +832,7 @@ ssize_t STM32Serial::writeBlock(const void *buffer, size_t size, off_t where)
             buf+=transferSize;
             remaining-=transferSize;
         }
-        return size;
+        return;
     }
     #endif //SERIAL_DMA
     for(size_t i=0;i<size;i++)
@@ -817,7 +847,6 @@ ssize_t STM32Serial::writeBlock(const void *buffer, size_t size, off_t where)
         port->TDR=*buf++;
         #endif //_ARCH_CORTEXM7_STM32F7/H7
     }
-    return size;
 }
 
 void STM32Serial::IRQwrite(const char *str)
@@ -866,6 +895,13 @@ void STM32Serial::IRQwrite(const char *str)
     if(interrupts) fastEnableInterrupts();
 }
 
+int STM32Serial::poll(WaitQueueEntry *entry)
+{
+    FastInterruptDisableLock dLock;
+    if(entry) rxPollers.IRQadd(entry);
+    return rxQueue.isEmpty() ? POLLOUT : POLLIN | POLLOUT;
+}
+
 int STM32Serial::ioctl(int cmd, void* arg)
 {
     if(reinterpret_cast<unsigned>(arg) & 0b11) return -EFAULT; //Unaligned
@@ -949,6 +985,7 @@ void STM32Serial::IRQhandleInterrupt()
                     Scheduler::IRQfindNextThread();
             rxWaiting=0;
         }
+        if(rxQueue.isEmpty()==false) rxPollers.IRQwakeAll();
     }
 }
 
@@ -967,6 +1004,7 @@ void STM32Serial::IRQhandleDMArx()
 {
     IRQreadDma();
     idle=false;
+    rxPollers.IRQwakeAll();
     if(rxWaiting==0) return;
     rxWaiting->IRQwakeup();
     if(rxWaiting->IRQgetPriority()>Thread::IRQgetCurrentThread()->IRQgetPriority())
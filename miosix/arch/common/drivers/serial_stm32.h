@@ -153,6 +153,25 @@ public:
      */
     ssize_t writeBlock(const void *buffer, size_t size, off_t where);
     
+    /**
+     * Write data from multiple buffers. The data of all the buffers is sent
+     * back to back, without being interleaved with other writes
+     * \param iov buffers where take data to write
+     * \param iovcnt number of buffers
+     * \param where where to write to
+     * \return number of bytes written or a negative number on failure
+     */
+    ssize_t writeBlocks(const struct iovec *iov, int iovcnt, off_t where);
+    
+    /**
+     * Check whether the serial port can be read without blocking. Writes are
+     * always reported as possible, as they block only until the characters
+     * are sent.
+     * \param entry if not nullptr, the entry is woken when data is received
+     * \return POLLOUT, or POLLIN | POLLOUT if there is data to read
+     */
+    int poll(WaitQueueEntry *entry);
+    
     /**
      * Write a string.
      * An extension to the Device interface that adds a new member function,
@@ -210,6 +229,13 @@ private:
     void commonInit(int id, int baudrate, miosix::GpioPin tx, miosix::GpioPin rx,
                     miosix::GpioPin rts, miosix::GpioPin cts);
     
+    /**
+     * Write a block of data, must be called with txMutex locked
+     * \param buf buffer where take data to write
+     * \param size buffer size
+     */
+    void writeLocked(const char *buf, size_t size);
+    
     #ifdef SERIAL_DMA
     /**
      * Wait until a pending DMA TX completes, if any
@@ -262,6 +288,7 @@ private:
     DynUnsyncQueue<char> rxQueue;     ///< Receiving queue
     static const unsigned int rxQueueMin=16; ///< Minimum queue size
     Thread *rxWaiting=0;              ///< Thread waiting for rx, or 0
+    WaitQueue rxPollers;              ///< Threads in poll() waiting for rx
     
     USART_TypeDef *port;              ///< Pointer to USART peripheral
     #ifdef SERIAL_DMA
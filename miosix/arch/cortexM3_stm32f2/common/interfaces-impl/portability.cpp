@@ -220,9 +220,9 @@ void IRQportableStartKernel()
     NVIC_SetPriority(SVCall_IRQn,3);//High priority for SVC (Max=0, min=15)
     NVIC_SetPriority(MemoryManagement_IRQn,2);//Higher priority for MemoryManagement (Max=0, min=15)
 
-    #ifdef WITH_PROCESSES
+    #if defined(WITH_PROCESSES) || defined(WITH_MPU_STACK_GUARD)
     miosix::IRQenableMPUatBoot();
-    #endif //WITH_PROCESSES
+    #endif //WITH_PROCESSES || WITH_MPU_STACK_GUARD
 
     //create a temporary space to save current registers. This data is useless
     //since there's no way to stop the sheduler, but we need to save it anyway.
@@ -184,6 +184,11 @@ inline unsigned int SyscallParameters::getThirdParameter() const
     return registers[2];
 }
 
+inline unsigned int SyscallParameters::getFourthParameter() const
+{
+    return registers[4]; //r12
+}
+
 inline void SyscallParameters::setReturnValue(unsigned int ret)
 {
     registers[0]=ret;
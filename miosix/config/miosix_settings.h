@@ -82,6 +82,38 @@ namespace miosix {
 /// (CPUTimeCounter is disabled).
 //#define WITH_CPU_TIME_COUNTER
 
+/// \def WITH_KERNEL_TRACE
+/// Allows to enable/disable the kernel trace ring buffer, that records context
+/// switches, interrupts, thread wakeups, sleeps and mutex contention with a
+/// cycle-accurate timestamp. Only available on Cortex-M3 and higher CPUs.
+/// By default it is not defined (kernel trace is disabled).
+//#define WITH_KERNEL_TRACE
+
+/// Number of records in the kernel trace ring buffer. Each record takes 8
+/// bytes of RAM. MUST be a power of two.
+const unsigned int KERNEL_TRACE_RECORDS=1024;
+
+/// \def WITH_STACK_PROFILER
+/// Allows to enable/disable StackProfiler, that scans the stacks of all threads
+/// from the idle thread to provide their high-water mark. By default it is not
+/// defined (StackProfiler is disabled).
+//#define WITH_STACK_PROFILER
+
+/// Maximum number of stack words scanned by StackProfiler with the kernel
+/// paused. A high value increases the latency of waking up threads while the
+/// idle thread is scanning.
+const unsigned int STACK_PROFILER_SCAN_STEP=64;
+
+/// Maximum number of scan steps performed by the idle thread every time it
+/// runs, before going to sleep. The remaining steps are performed the next
+/// time the idle thread runs.
+const unsigned int STACK_PROFILER_IDLE_STEPS=16;
+
+/// Number of consecutive stack words still containing the fill value after
+/// which StackProfiler considers the stack below them unused. A local array
+/// larger than this that is left uninitialized hides the stack used below it.
+const unsigned int STACK_PROFILER_MAX_HOLE=32;
+
 //
 // Filesystem options
 //
@@ -95,18 +127,104 @@ namespace miosix {
 /// Allows to enable/disable DevFs support to save code size
 /// By default it is defined (DevFs is enabled)
 #define WITH_DEVFS
+
+/// \def WITH_TMPFS
+/// Allows to enable/disable TmpFs, a filesystem in RAM mounted on /tmp
+/// By default it is defined (TmpFs is enabled)
+#define WITH_TMPFS
+
+/// \def WITH_ROMFS
+/// Allows to enable/disable mounting a RomFs image as /rom at boot. The image
+/// is generated with the mkromfs tool in miosix/_tools/mkromfs, and is found
+/// through the _romfs_start symbol, defined by the generated source file or
+/// by the linker script. If the symbol is not defined, nothing is mounted
+/// By default it is not defined (RomFs is not mounted)
+//#define WITH_ROMFS
     
 /// \def SYNC_AFTER_WRITE
 /// Increases filesystem write robustness. After each write operation the
 /// filesystem is synced so that a power failure happens data is not lost
 /// (unless power failure happens exactly between the write and the sync)
-/// Unfortunately write latency and throughput becomes twice as worse
-/// By default it is defined (slow but safe)
-#define SYNC_AFTER_WRITE
-
-/// Maximum number of open files. Trying to open more will fail.
-/// Cannot be lower than 3, as the first three are stdin, stdout, stderr
-const unsigned char MAX_OPEN_FILES=8;
+/// Unfortunately write latency and throughput becomes twice as worse, and
+/// much worse for small writes.
+/// If not defined, Fat32Fs uses group commit instead: written files are synced
+/// by a background thread, so that a power failure loses at most the data
+/// written in the last FAT32_SYNC_PERIOD_MS milliseconds. fsync() is still
+/// a durability barrier.
+/// By default it is not defined (group commit)
+//#define SYNC_AFTER_WRITE
+
+/// Group commit: maximum time in milliseconds between a write to a Fat32Fs
+/// file and the sync that makes it durable. Zero means sync after every write.
+/// Can be changed per mount with Fat32Fs::setSyncPolicy()
+const unsigned int FAT32_SYNC_PERIOD_MS=500;
+
+/// Group commit: files are synced as soon as this many bytes have been written
+/// to a Fat32Fs mount since the last sync, even if FAT32_SYNC_PERIOD_MS has
+/// not yet elapsed. Can be changed per mount with Fat32Fs::setSyncPolicy()
+const unsigned int FAT32_SYNC_BYTES=64*1024;
+
+/// Default number of 512 byte sectors in the write-back sector cache of each
+/// Fat32Fs mount, used to cache FAT and directory sectors. Can be zero to
+/// disable the cache. Each sector takes 512 bytes of RAM plus a small overhead.
+const unsigned int FAT32_CACHE_SECTORS=8;
+
+/// Default maximum size in bytes of the cluster link map that Fat32Fs files
+/// build when fast seek is enabled with IOCTL_FAST_SEEK. Each fragment of the
+/// file takes 8 bytes, so a non fragmented file needs just 16 bytes.
+const unsigned int FAT32_FASTSEEK_MAX_BYTES=512;
+
+/// Number of names in the directory entry lookup cache of each Fat32Fs mount,
+/// that avoids scanning directories at every open() and stat(). Can be zero to
+/// disable the cache. Each name takes 28 bytes of RAM.
+const unsigned int FAT32_DENTRY_CACHE_SIZE=32;
+
+/// Default size in bytes of each of the two buffers that Fat32Fs files use to
+/// read ahead and write behind in streaming mode, enabled with IOCTL_STREAMING
+/// or posix_fadvise(POSIX_FADV_SEQUENTIAL). Rounded up to a multiple of 512.
+const unsigned int FAT32_STREAM_BUFFER_SIZE=4096;
+
+/// Maximum number of bytes of file data in the TmpFs mounted on /tmp. Memory
+/// is allocated from the heap as files are written, and freed when they are
+/// removed or truncated.
+const unsigned int TMPFS_MAX_SIZE=16*1024;
+
+/// Maximum number of files and directories in a LogFs filesystem. Fixed when
+/// the filesystem is formatted, each file takes 128 bytes of flash.
+const unsigned int LOGFS_MAX_FILES=64;
+
+/// LogFs moves the data that is never rewritten out of a flash block when its
+/// erase count is this much lower than the one of the most erased block.
+const unsigned int LOGFS_WEAR_THRESHOLD=32;
+
+/// Maximum number of open files, per process. Trying to open more will fail.
+/// Cannot be lower than 3, as the first three are stdin, stdout, stderr.
+/// It was 8 when tables were fixed size arrays. Tables now start with
+/// FD_TABLE_CHUNK entries and grow only when files are opened, so a higher
+/// limit costs just one bit per file descriptor in each table, and allows
+/// applications that need many sockets and files at once. It also bounds the
+/// nfds parameter of poll() and select(), larger calls fail with EINVAL
+const unsigned char MAX_OPEN_FILES=64;
+
+/// File descriptor tables are allocated from the heap with room for this
+/// number of files, and grow by this number of files when they are full, up
+/// to MAX_OPEN_FILES. Cannot be lower than 3.
+const unsigned char FD_TABLE_CHUNK=8;
+
+/// Size of the buffer allocated on the stack of the calling thread to resolve
+/// a path in open(), stat(), mkdir() and the other filesystem calls. Longer
+/// paths, including the current directory and the target of symlinks, fail
+/// with ENAMETOOLONG. Cannot be higher than PATH_MAX+1.
+/// This is the real path length limit, and is lower than PATH_MAX (512) to
+/// bound stack usage: filesystem calls need PATH_BUFFER_SIZE bytes of stack,
+/// rename() needs twice that, as both paths are resolved at the same time.
+/// Threads calling them must have a stack large enough.
+const unsigned int PATH_BUFFER_SIZE=256;
+
+/// Size of the ring buffer of pipes and FIFOs, allocated from the heap when
+/// the pipe is created. Writes up to this size are never interleaved with the
+/// data of other writers.
+const unsigned int PIPE_BUFFER_SIZE=512;
 
 /// \def WITH_PROCESSES
 /// If uncommented enables support for processes as well as threads.
@@ -219,10 +337,25 @@ const unsigned int MAX_TIME_SLICE=1000000;
 // Other low level kernel options. There is usually no need to modify these.
 //
 
+/// \def WITH_MPU_STACK_GUARD
+/// If uncommented, stack overflows are detected using the MPU instead of
+/// checking the watermark at every context switch. A 32 byte MPU region within
+/// the watermark of the running thread is made inaccessible, so that a stack
+/// overflow causes a fault as soon as it happens. Only available on Cortex-M3,
+/// M4 and M7 CPUs with an MPU. By default it is not defined.
+//#define WITH_MPU_STACK_GUARD
+
+#ifndef WITH_MPU_STACK_GUARD
 /// \internal Length of wartermark (in bytes) to check stack overflow.
 /// MUST be divisible by 4 and can also be zero.
 /// A high value increases context switch time.
 const unsigned int WATERMARK_LEN=16;
+#else //WITH_MPU_STACK_GUARD
+/// \internal Length of wartermark (in bytes). With the MPU stack guard it is
+/// not checked, but it must be large enough to contain a 32 byte aligned MPU
+/// region regardless of the 8 byte alignment of the thread memory.
+const unsigned int WATERMARK_LEN=56;
+#endif //WITH_MPU_STACK_GUARD
 
 /// \internal Used to fill watermark
 const unsigned int WATERMARK_FILL=0xaaaaaaaa;
@@ -0,0 +1,297 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "aio.h"
+#include <errno.h>
+#include <sys/stat.h>
+#include <new>
+#include "kernel/kernel.h"
+#include "e20/e20.h"
+
+#ifdef WITH_FILESYSTEM
+
+namespace miosix {
+
+//
+// class AioRequest
+//
+
+void AioRequest::complete(ssize_t result)
+{
+    res=result;
+    file.reset();
+    completion->completed(this);
+}
+
+//
+// class AioCompletion
+//
+
+AioRequest *AioCompletion::poll()
+{
+    Lock<FastMutex> l(mutex);
+    AioRequest *req=head;
+    if(req==nullptr) return nullptr;
+    head=req->next;
+    if(head==nullptr) tail=nullptr;
+    return req;
+}
+
+AioRequest *AioCompletion::wait()
+{
+    Lock<FastMutex> l(mutex);
+    while(head==nullptr)
+    {
+        if(inFlight==0) return nullptr;
+        cv.wait(l);
+    }
+    AioRequest *req=head;
+    head=req->next;
+    if(head==nullptr) tail=nullptr;
+    return req;
+}
+
+void AioCompletion::completed(AioRequest *req)
+{
+    //The caller may reuse the request as soon as it sees it completed, so it
+    //is marked completed as the last access to it
+    if(queue)
+    {
+        auto cb=callback;
+        EventQueue *q=queue;
+        {
+            Lock<FastMutex> l(mutex);
+            inFlight--;
+        }
+        req->done=true;
+        q->post([cb,req]{ cb(req); });
+        return;
+    }
+    Semaphore *s=sem; //This object may be deleted as soon as the lock is released
+    {
+        Lock<FastMutex> l(mutex);
+        inFlight--;
+        req->next=nullptr;
+        if(tail) tail->next=req;
+        else head=req;
+        tail=req;
+        req->done=true;
+        cv.broadcast();
+    }
+    if(s) s->signal();
+}
+
+//
+// class AioQueue
+//
+
+void AioQueue::submit(AioRequest *req)
+{
+    {
+        Lock<FastMutex> l(mutex);
+        req->next=nullptr;
+        if(tail) tail->next=req;
+        else head=req;
+        tail=req;
+        if(running) return;
+        if(Thread::create(launcher,STACK_DEFAULT_FOR_PTHREAD,MAIN_PRIORITY,this))
+        {
+            running=true;
+            return;
+        }
+        //The thread was not running, so the queue contained only this request
+        head=tail=nullptr;
+    }
+    req->complete(-EAGAIN);
+}
+
+bool AioQueue::busyWith(FileBase *file) const
+{
+    Lock<FastMutex> l(mutex);
+    if(current==file) return true;
+    for(AioRequest *req=head;req;req=req->next)
+        if(req->file.get()==file) return true;
+    return false;
+}
+
+bool AioQueue::idle() const
+{
+    Lock<FastMutex> l(mutex);
+    return running==false;
+}
+
+void *AioQueue::launcher(void *arg)
+{
+    reinterpret_cast<AioQueue*>(arg)->run();
+    return nullptr;
+}
+
+void AioQueue::run()
+{
+    //Closing the file of the last request may delete this queue, so the
+    //reference to it is released only once the queue is no longer accessed
+    intrusive_ref_ptr<FileBase> keep;
+    for(;;)
+    {
+        AioRequest *req;
+        {
+            Lock<FastMutex> l(mutex);
+            current=nullptr;
+            if(head==nullptr)
+            {
+                running=false;
+                return;
+            }
+            req=head;
+            head=req->next;
+            if(head==nullptr) tail=nullptr;
+            current=req->file.get();
+        }
+        ssize_t result=perform(req);
+        keep=req->file;
+        req->complete(result);
+    }
+}
+
+/**
+ * Queue used for files that do not support asynchronous I/O natively
+ */
+class GenericAioQueue : public AioQueue
+{
+protected:
+    virtual ssize_t perform(AioRequest *req);
+};
+
+ssize_t GenericAioQueue::perform(AioRequest *req)
+{
+    FileBase *file=req->getFile();
+    if(req->op==AioRequest::READ)
+    {
+        if(req->offset<0) return file->read(req->buffer,req->size);
+        return file->pread(req->buffer,req->size,req->offset);
+    } else {
+        if(req->offset<0) return file->write(req->buffer,req->size);
+        return file->pwrite(req->buffer,req->size,req->offset);
+    }
+}
+
+/**
+ * Queue used for a file that may block indefinitely. Queues are not deleted,
+ * once idle they are reused for another file
+ */
+class StreamAioQueue : public GenericAioQueue
+{
+public:
+    StreamAioQueue() : next(nullptr) {}
+    
+    StreamAioQueue *next; ///< Next queue in the list of stream queues
+};
+
+static FastMutex streamMutex;           ///< Protects the stream queue list
+static StreamAioQueue *streamQueues=nullptr; ///< List of stream queues
+
+/**
+ * \param file a file
+ * \return true if the file may block indefinitely, like terminals and pipes
+ */
+static bool isStream(FileBase *file)
+{
+    struct stat st;
+    if(file->fstat(&st)!=0) return false;
+    return S_ISCHR(st.st_mode) || S_ISFIFO(st.st_mode) || S_ISSOCK(st.st_mode);
+}
+
+/**
+ * Must be called with streamMutex locked
+ * \param file a file
+ * \return the stream queue that is performing requests for the file, or
+ * nullptr if there is none
+ */
+static StreamAioQueue *findStreamQueue(FileBase *file)
+{
+    for(StreamAioQueue *q=streamQueues;q;q=q->next)
+        if(q->busyWith(file)) return q;
+    return nullptr;
+}
+
+/**
+ * Queue a request for a file that may block indefinitely, on the queue that
+ * is already performing requests for the same file, or else on an idle queue
+ * \param req request
+ * \return 0 on success, or -ENOMEM if a new queue could not be allocated
+ */
+static int streamSubmit(AioRequest *req)
+{
+    Lock<FastMutex> l(streamMutex);
+    StreamAioQueue *q=findStreamQueue(req->getFile());
+    if(q==nullptr)
+    {
+        for(q=streamQueues;q;q=q->next) if(q->idle()) break;
+        if(q==nullptr)
+        {
+            q=new (std::nothrow) StreamAioQueue;
+            if(q==nullptr) return -ENOMEM;
+            q->next=streamQueues;
+            streamQueues=q;
+        }
+    }
+    //Submitted with the list locked, or an idle queue could be chosen twice
+    q->submit(req);
+    return 0;
+}
+
+void aioStart(AioRequest *req, intrusive_ref_ptr<FileBase> file,
+        AioCompletion& completion)
+{
+    static GenericAioQueue genericQueue;
+    req->file=file;
+    req->completion=&completion;
+    req->done=false;
+    completion.submitted();
+    //If requests on the same file are being performed by the worker, later
+    //ones can't be performed natively, or they could overtake them. The
+    //request may complete within aioSubmit(), file keeps the file open
+    if(isStream(file.get()))
+    {
+        bool busy;
+        {
+            Lock<FastMutex> l(streamMutex);
+            busy=findStreamQueue(file.get())!=nullptr;
+        }
+        if(busy==false && file->aioSubmit(req)==0) return;
+        int result=streamSubmit(req);
+        if(result<0) req->complete(result);
+        return;
+    }
+    if(genericQueue.busyWith(file.get())==false && file->aioSubmit(req)==0)
+        return;
+    genericQueue.submit(req);
+}
+
+} //namespace miosix
+
+#endif //WITH_FILESYSTEM
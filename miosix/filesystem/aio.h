@@ -0,0 +1,311 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef AIO_H
+#define AIO_H
+
+#include <functional>
+#include <sys/types.h>
+#include "file.h"
+#include "kernel/sync.h"
+#include "kernel/intrusive.h"
+#include "config/miosix_settings.h"
+
+#ifdef WITH_FILESYSTEM
+
+namespace miosix {
+
+class AioCompletion;
+class EventQueue;
+class Semaphore;
+class AioRequest;
+
+/**
+ * \internal
+ * Start an asynchronous request, natively if the file supports it, or using
+ * a worker thread that calls read(), write(), pread() or pwrite(). Files that
+ * may block indefinitely, such as terminals and pipes, each have their own
+ * worker thread, so that a read waiting for data does not delay the requests
+ * of other files
+ * \param req request
+ * \param file file the request is performed on
+ * \param completion notified when the request completes
+ */
+void aioStart(AioRequest *req, intrusive_ref_ptr<FileBase> file,
+        AioCompletion& completion);
+
+/**
+ * An asynchronous read or write request, started with
+ * FileDescriptorTable::aioSubmit(). The request and its buffer are owned by
+ * the caller, and must not be accessed nor deallocated until the request
+ * completes.
+ */
+class AioRequest
+{
+public:
+    /**
+     * Request type
+     */
+    enum Operation
+    {
+        READ, ///< Read from the file into the buffer
+        WRITE ///< Write the buffer to the file
+    };
+    
+    /**
+     * Constructor
+     * \param fd file descriptor
+     * \param op READ or WRITE
+     * \param buffer buffer to read into, or with the data to write
+     * \param size buffer size
+     * \param offset offset from the beginning of the file, like pread() and
+     * pwrite(), or -1 to use and move the file pointer, like read() and
+     * write(). Requests using the file pointer on the same file complete in
+     * the order they are submitted.
+     */
+    AioRequest(int fd, Operation op, void *buffer, size_t size, off_t offset=-1)
+            : fd(fd), op(op), buffer(buffer), size(size), offset(offset),
+              userData(nullptr), completion(nullptr), next(nullptr),
+              position(0), res(0), done(false) {}
+    
+    /**
+     * \return true if the request completed
+     */
+    bool completed() const { return done; }
+    
+    /**
+     * \return the number of bytes read or written, or a negative number in
+     * case of errors. Meaningful only once the request completed
+     */
+    ssize_t result() const { return res; }
+    
+    /**
+     * \internal
+     * Called by the code that performs the request, when it completes.
+     * The request must not be accessed anymore after this call.
+     * \param result number of bytes read or written, or a negative number in
+     * case of errors
+     */
+    void complete(ssize_t result);
+    
+    /**
+     * \internal
+     * \return the device offset where the request must be performed, for
+     * requests passed to Device::aioSubmit()
+     */
+    off_t devicePosition() const { return position; }
+    
+    /**
+     * \internal
+     * \return the file the request is performed on, while it is in flight
+     */
+    FileBase *getFile() const { return file.get(); }
+    
+    int fd;          ///< File descriptor
+    Operation op;    ///< READ or WRITE
+    void *buffer;    ///< Buffer to read into, or with the data to write
+    size_t size;     ///< Buffer size
+    off_t offset;    ///< Offset in the file, -1 to use the file pointer
+    void *userData;  ///< Not used by the kernel, free for the caller to use
+    
+    AioRequest(const AioRequest&)=delete;
+    AioRequest& operator= (const AioRequest&)=delete;
+
+private:
+    friend class AioCompletion;
+    friend class AioQueue;
+    friend class DevFsFile;
+    friend void aioStart(AioRequest*, intrusive_ref_ptr<FileBase>, AioCompletion&);
+    
+    intrusive_ref_ptr<FileBase> file; ///< Keeps the file open while in flight
+    AioCompletion *completion;        ///< Notified when the request completes
+    AioRequest *next;                 ///< Next request in a queue
+    off_t position;                   ///< Device offset, for devices
+    ssize_t res;                      ///< Request result
+    volatile bool done;               ///< True once completed
+};
+
+/**
+ * The completion side of asynchronous I/O. Completed requests are notified
+ * in one of three ways, chosen when constructing the object:
+ * - a completion queue, from which completed requests are taken with poll()
+ *   or wait()
+ * - a Semaphore, that is signaled once per completed request, in addition to
+ *   the request being added to the completion queue
+ * - an EventQueue, to which a callback is posted for each completed request
+ *
+ * The object must outlive all the requests submitted with it.
+ */
+class AioCompletion
+{
+public:
+    /**
+     * Constructor, completed requests are taken with poll() or wait()
+     */
+    AioCompletion() : head(nullptr), tail(nullptr), sem(nullptr),
+            queue(nullptr), inFlight(0) {}
+    
+    /**
+     * Constructor, the semaphore is signaled once per completed request, and
+     * the request can then be taken with poll()
+     * \param sem semaphore to signal
+     */
+    explicit AioCompletion(Semaphore& sem) : head(nullptr), tail(nullptr),
+            sem(&sem), queue(nullptr), inFlight(0) {}
+    
+    /**
+     * Constructor, the callback is posted to the event queue for each
+     * completed request, and poll() and wait() are not used
+     * \param queue event queue
+     * \param callback called with the completed request by the thread that
+     * runs the event queue
+     */
+    AioCompletion(EventQueue& queue, std::function<void (AioRequest*)> callback)
+            : head(nullptr), tail(nullptr), sem(nullptr), queue(&queue),
+              callback(callback), inFlight(0) {}
+    
+    /**
+     * \return a completed request, in completion order, or nullptr if no
+     * request completed since the last call. Does not block
+     */
+    AioRequest *poll();
+    
+    /**
+     * Wait until a request completes
+     * \return the completed request, or nullptr if no request is in flight
+     * and no completed request is waiting to be taken
+     */
+    AioRequest *wait();
+    
+    /**
+     * \return the number of requests submitted and not yet completed
+     */
+    unsigned int pending() const
+    {
+        Lock<FastMutex> l(mutex);
+        return inFlight;
+    }
+    
+    AioCompletion(const AioCompletion&)=delete;
+    AioCompletion& operator= (const AioCompletion&)=delete;
+
+private:
+    friend class AioRequest;
+    friend void aioStart(AioRequest*, intrusive_ref_ptr<FileBase>, AioCompletion&);
+    
+    /**
+     * Called when a request is submitted
+     */
+    void submitted()
+    {
+        Lock<FastMutex> l(mutex);
+        inFlight++;
+    }
+    
+    /**
+     * Called when a request completes
+     */
+    void completed(AioRequest *req);
+    
+    mutable FastMutex mutex;
+    ConditionVariable cv;
+    AioRequest *head, *tail;     ///< Completion queue
+    Semaphore *sem;              ///< Semaphore to signal, or nullptr
+    EventQueue *queue;           ///< Event queue to post to, or nullptr
+    std::function<void (AioRequest*)> callback; ///< Event queue callback
+    unsigned int inFlight;       ///< Requests not yet completed
+};
+
+/**
+ * \internal
+ * A queue of asynchronous requests, performed in submission order by a
+ * thread that is started when the first request is queued and terminates
+ * when the queue becomes empty.
+ */
+class AioQueue
+{
+public:
+    /**
+     * Constructor
+     */
+    AioQueue() : head(nullptr), tail(nullptr), current(nullptr),
+            running(false) {}
+    
+    /**
+     * Queue a request
+     * \param req request to perform
+     */
+    void submit(AioRequest *req);
+    
+    /**
+     * \param file a file
+     * \return true if a request for the file is queued or being performed
+     */
+    bool busyWith(FileBase *file) const;
+    
+    /**
+     * \return true if no request is queued or being performed
+     */
+    bool idle() const;
+    
+    /**
+     * Destructor. The queue can be deleted when the file of the last request
+     * is closed, as the thread does not access the queue after that
+     */
+    virtual ~AioQueue() {}
+    
+    AioQueue(const AioQueue&)=delete;
+    AioQueue& operator= (const AioQueue&)=delete;
+
+protected:
+    /**
+     * Perform a request
+     * \param req the request
+     * \return the number of bytes read or written, or a negative number in
+     * case of errors
+     */
+    virtual ssize_t perform(AioRequest *req)=0;
+
+private:
+    static void *launcher(void *arg);
+    
+    /**
+     * Thread main loop
+     */
+    void run();
+    
+    mutable FastMutex mutex;
+    AioRequest *head, *tail; ///< Queued requests
+    FileBase *current;       ///< File of the request being performed
+    bool running;            ///< True if the thread is running
+};
+
+} //namespace miosix
+
+#endif //WITH_FILESYSTEM
+
+#endif //AIO_H
@@ -29,6 +29,8 @@
 #include "filesystem/ioctl.h"
 #include <errno.h>
 #include <termios.h>
+#include <memory>
+#include <new>
 
 using namespace std;
 
@@ -72,6 +74,60 @@ ssize_t TerminalDevice::write(const void *data, size_t length)
     return length;
 }
 
+ssize_t TerminalDevice::writev(const struct iovec *iov, int iovcnt)
+{
+    if(binary) return device->writeBlocks(iov,iovcnt,0);
+    //Same as write(), but the chunks and \r\n are collected and written with
+    //a single call, so the device may keep them from being interleaved with
+    //other writers. The chunks are counted first, as each \n adds up to two
+    const int maxChunks=8;
+    int numChunks=0;
+    ssize_t total=0;
+    for(int i=0;i<iovcnt;i++)
+    {
+        const char *buffer=static_cast<const char*>(iov[i].iov_base);
+        numChunks++;
+        for(size_t j=0;j<iov[i].iov_len;j++) if(buffer[j]=='\n') numChunks+=2;
+        total+=iov[i].iov_len;
+    }
+    struct iovec stackChunks[maxChunks];
+    unique_ptr<struct iovec[]> heapChunks;
+    struct iovec *chunks=stackChunks;
+    if(numChunks>maxChunks)
+    {
+        heapChunks.reset(new (nothrow) struct iovec[numChunks]);
+        if(!heapChunks) return -ENOMEM;
+        chunks=heapChunks.get();
+    }
+    numChunks=0;
+    auto addChunk=[&](const char *start, size_t size)
+    {
+        chunks[numChunks].iov_base=const_cast<char*>(start);
+        chunks[numChunks].iov_len=size;
+        numChunks++;
+    };
+    for(int i=0;i<iovcnt;i++)
+    {
+        const char *buffer=static_cast<const char*>(iov[i].iov_base);
+        const char *end=buffer+iov[i].iov_len;
+        const char *start=buffer;
+        for(;buffer!=end;buffer++)
+        {
+            if(*buffer!='\n') continue;
+            if(buffer>start) addChunk(start,buffer-start);
+            addChunk("\r\n",2);
+            start=buffer+1;
+        }
+        if(buffer>start) addChunk(start,buffer-start);
+    }
+    if(numChunks>0)
+    {
+        ssize_t r=device->writeBlocks(chunks,numChunks,0);
+        if(r<=0) return r;
+    }
+    return total;
+}
+
 ssize_t TerminalDevice::read(void *data, size_t length)
 {
     if(binary)
@@ -93,6 +149,13 @@ ssize_t TerminalDevice::read(void *data, size_t length)
     }
 }
 
+int TerminalDevice::poll(WaitQueueEntry *entry)
+{
+    //NOTE: in canonical mode a read can still block if the device has some
+    //characters but not a complete line
+    return device->poll(entry);
+}
+
 #ifdef WITH_FILESYSTEM
 
 off_t TerminalDevice::lseek(off_t pos, int whence)
@@ -65,6 +65,26 @@ public:
      */
     virtual ssize_t read(void *data, size_t length);
     
+    /**
+     * Write data to the file from multiple buffers. Unlike calling write()
+     * for each buffer, the data is passed to the device with a single call
+     * to writeBlocks(), so devices that write all the buffers without
+     * releasing their lock, like the STM32 serial port, do not interleave it
+     * with the data of other writers.
+     * \param iov buffers with the data to write
+     * \param iovcnt number of buffers
+     * \return the number of written characters, or a negative number in case
+     * of errors
+     */
+    virtual ssize_t writev(const struct iovec *iov, int iovcnt);
+    
+    /**
+     * Check whether the terminal can be read or written without blocking.
+     * \param entry if not nullptr, added to the device wait queue
+     * \return a combination of POLLIN, POLLOUT, POLLERR and POLLHUP
+     */
+    virtual int poll(WaitQueueEntry *entry);
+    
     #ifdef WITH_FILESYSTEM
     
     /**
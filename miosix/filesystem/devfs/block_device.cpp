@@ -0,0 +1,196 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "block_device.h"
+#include <errno.h>
+#include <limits>
+#include <sys/stat.h>
+#include "kernel/kernel.h"
+
+using namespace std;
+
+namespace miosix {
+
+//
+// class BlockDevice
+//
+
+BlockDevice::BlockDevice(unsigned int sectorSize, unsigned int sectors)
+    : Device(Device::BLOCK), sectorSize(sectorSize), sectors(sectors),
+      pending(nullptr), position(0), readExpire(0), writeExpire(0),
+      transferring(false) {}
+
+ssize_t BlockDevice::readBlock(void *buffer, size_t size, off_t where)
+{
+    if(sectors!=0)
+    {
+        off_t end=static_cast<off_t>(sectors)*sectorSize;
+        if(where>=end) return 0;
+        size=min<off_t>(size,end-where);
+    }
+    struct iovec iov;
+    iov.iov_base=buffer;
+    iov.iov_len=size;
+    return perform(BlockRequest::READ,&iov,1,where);
+}
+
+ssize_t BlockDevice::writeBlock(const void *buffer, size_t size, off_t where)
+{
+    if(sectors!=0)
+    {
+        off_t end=static_cast<off_t>(sectors)*sectorSize;
+        if(where>=end) return -ENOSPC;
+        size=min<off_t>(size,end-where);
+    }
+    struct iovec iov;
+    iov.iov_base=const_cast<void*>(buffer);
+    iov.iov_len=size;
+    return perform(BlockRequest::WRITE,&iov,1,where);
+}
+
+ssize_t BlockDevice::readBlocks(const struct iovec *iov, int iovcnt, off_t where)
+{
+    ssize_t result=perform(BlockRequest::READ,iov,iovcnt,where);
+    //Past the end of the device, read buffer by buffer, to stop at the end
+    if(result==-ENOSPC) return Device::readBlocks(iov,iovcnt,where);
+    return result;
+}
+
+ssize_t BlockDevice::writeBlocks(const struct iovec *iov, int iovcnt, off_t where)
+{
+    ssize_t result=perform(BlockRequest::WRITE,iov,iovcnt,where);
+    if(result==-ENOSPC) return Device::writeBlocks(iov,iovcnt,where);
+    return result;
+}
+
+int BlockDevice::fstat(struct stat *pstat) const
+{
+    Device::fstat(pstat);
+    pstat->st_size=static_cast<off_t>(sectors)*sectorSize;
+    return 0;
+}
+
+void BlockDevice::setDeadlines(long long readExpire, long long writeExpire)
+{
+    Lock<FastMutex> l(queueMutex);
+    this->readExpire=readExpire;
+    this->writeExpire=writeExpire;
+}
+
+ssize_t BlockDevice::perform(BlockRequest::Op op, const struct iovec *iov,
+        int iovcnt, off_t where)
+{
+    if(where<0) return -EINVAL;
+    size_t size=0;
+    for(int i=0;i<iovcnt;i++)
+    {
+        if(iov[i].iov_len % sectorSize) return -EFAULT;
+        size+=iov[i].iov_len;
+    }
+    if(where % sectorSize) return -EFAULT;
+    if(size==0) return 0;
+    off_t first=where/sectorSize;
+    off_t count=size/sectorSize;
+    off_t end=sectors!=0 ? sectors : numeric_limits<unsigned int>::max();
+    if(first+count>end) return -ENOSPC;
+    
+    BlockRequest req(op,first,count,iov,iovcnt);
+    Lock<FastMutex> l(queueMutex);
+    long long expire=op==BlockRequest::READ ? readExpire : writeExpire;
+    req.deadline=expire>0 ? getTime()+expire : numeric_limits<long long>::max();
+    //Requests to the same sector are kept in the order they were made
+    BlockRequest **p=&pending;
+    while(*p && (*p)->sector<=req.sector) p=&(*p)->next;
+    req.next=*p;
+    *p=&req;
+    
+    while(req.done==false)
+    {
+        if(transferring)
+        {
+            cv.wait(l);
+            continue;
+        }
+        //The driver is idle, this thread transfers the next requests, which
+        //may or may not include its own
+        transferring=true;
+        BlockRequest *list=nextBatch();
+        {
+            Unlock<FastMutex> u(l);
+            transfer(list);
+        }
+        //The threads that made the requests check done with the mutex locked,
+        //so next is accessed before any of them can return
+        for(BlockRequest *r=list;r;r=r->next)
+        {
+            position=r->sector+r->count;
+            r->done=true;
+        }
+        transferring=false;
+        cv.broadcast();
+    }
+    return req.result<0 ? req.result : size;
+}
+
+BlockRequest *BlockDevice::nextBatch()
+{
+    //Continue the sweep from the sector following the last transferred one,
+    //when no request is left there restart it from the lowest sector
+    BlockRequest *start=nullptr;
+    BlockRequest *oldest=pending;
+    for(BlockRequest *r=pending;r;r=r->next)
+    {
+        if(start==nullptr && r->sector>=position) start=r;
+        if(r->deadline<oldest->deadline) oldest=r;
+    }
+    if(start==nullptr) start=pending;
+    if(oldest->deadline!=numeric_limits<long long>::max()
+        && oldest->deadline<=getTime()) start=oldest;
+    
+    //The list has all the requests of the same operation from start onwards,
+    //the others wait for the next sweep
+    BlockRequest *list=nullptr;
+    BlockRequest **tail=&list;
+    BlockRequest **p=&pending;
+    while(*p!=start) p=&(*p)->next;
+    while(*p)
+    {
+        BlockRequest *r=*p;
+        if(r->op!=start->op)
+        {
+            p=&r->next;
+            continue;
+        }
+        *p=r->next;
+        *tail=r;
+        tail=&r->next;
+    }
+    *tail=nullptr;
+    return list;
+}
+
+} //namespace miosix
@@ -0,0 +1,215 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef BLOCK_DEVICE_H
+#define BLOCK_DEVICE_H
+
+#include "filesystem/devfs/devfs.h"
+#include "kernel/sync.h"
+
+namespace miosix {
+
+/**
+ * A transfer of contiguous sectors of a block device, whose data is scattered
+ * in one or more buffers. Requests are made by BlockDevice, and passed to the
+ * driver in lists.
+ */
+class BlockRequest
+{
+public:
+    /**
+     * Possible operations
+     */
+    enum Op
+    {
+        READ,
+        WRITE
+    };
+    
+    /**
+     * Constructor
+     * \param op operation
+     * \param sector first sector to transfer
+     * \param count number of sectors to transfer
+     * \param iov buffers, each one a multiple of the sector size, whose sizes
+     * add up to count sectors
+     * \param iovcnt number of buffers
+     */
+    BlockRequest(Op op, unsigned int sector, unsigned int count,
+            const struct iovec *iov, int iovcnt) : op(op), sector(sector),
+            count(count), iov(iov), iovcnt(iovcnt), next(nullptr), result(0),
+            deadline(0), done(false) {}
+    
+    const Op op;                     ///< Operation
+    const unsigned int sector;       ///< First sector to transfer
+    const unsigned int count;        ///< Number of sectors to transfer
+    const struct iovec * const iov;  ///< Buffers
+    const int iovcnt;                ///< Number of buffers
+    BlockRequest *next;              ///< Next request in the list
+    int result;                      ///< Set by the driver, 0 or negative error
+    
+private:
+    BlockRequest(const BlockRequest&)=delete;
+    BlockRequest& operator= (const BlockRequest&)=delete;
+    
+    friend class BlockDevice;
+    long long deadline;              ///< Time after which it has priority
+    bool done;                       ///< True once the driver transferred it
+};
+
+/**
+ * Base class for block devices such as SD cards, that puts a request queue
+ * between the filesystems and the driver.
+ * 
+ * readBlock(), writeBlock(), readBlocks() and writeBlocks() make a request,
+ * and wait for it in the queue. While the driver transfers a list of requests,
+ * the requests made by other threads, or by the thread performing the
+ * asynchronous requests of the device, accumulate in the queue. When the
+ * transfer ends, the next list is made by sweeping the queue in the direction
+ * of increasing sectors, as an elevator, so that the requests are sorted by
+ * sector and the ones to adjacent sectors follow each other, and a driver
+ * whose DMA can gather data from multiple buffers can merge them in a single
+ * command. The SD card drivers can't, and issue at least one command per
+ * request. A deadline can be set for reads and
+ * writes, so that a request that waited too long is transferred next even if
+ * the sweep is elsewhere.
+ * 
+ * There is no thread for the queue, the thread that finds the driver idle
+ * does the transfer, also of the requests of other threads.
+ * 
+ * Drivers must subclass BlockDevice and implement transfer().
+ */
+class BlockDevice : public Device
+{
+public:
+    /**
+     * Constructor
+     * \param sectorSize sector size in bytes, reads and writes must be aligned
+     * to it
+     * \param sectors number of sectors of the device, or 0 if unknown
+     */
+    BlockDevice(unsigned int sectorSize=512, unsigned int sectors=0);
+    
+    /**
+     * Read a block of data
+     * \param buffer buffer where read data will be stored
+     * \param size buffer size, a multiple of the sector size
+     * \param where where to read from, a multiple of the sector size
+     * \return number of bytes read or a negative number on failure
+     */
+    virtual ssize_t readBlock(void *buffer, size_t size, off_t where);
+    
+    /**
+     * Write a block of data
+     * \param buffer buffer where take data to write
+     * \param size buffer size, a multiple of the sector size
+     * \param where where to write to, a multiple of the sector size
+     * \return number of bytes written or a negative number on failure
+     */
+    virtual ssize_t writeBlock(const void *buffer, size_t size, off_t where);
+    
+    /**
+     * Read data into multiple buffers with a single request
+     * \param iov buffers where read data will be stored, each one a multiple
+     * of the sector size
+     * \param iovcnt number of buffers
+     * \param where where to read from, a multiple of the sector size
+     * \return number of bytes read or a negative number on failure
+     */
+    virtual ssize_t readBlocks(const struct iovec *iov, int iovcnt, off_t where);
+    
+    /**
+     * Write data from multiple buffers with a single request
+     * \param iov buffers where take data to write, each one a multiple of the
+     * sector size
+     * \param iovcnt number of buffers
+     * \param where where to write to, a multiple of the sector size
+     * \return number of bytes written or a negative number on failure
+     */
+    virtual ssize_t writeBlocks(const struct iovec *iov, int iovcnt, off_t where);
+    
+    /**
+     * Obtain information on the device, st_size is the device size if known
+     * \param pstat file information is stored here
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int fstat(struct stat *pstat) const;
+    
+    /**
+     * Set the deadlines of requests. Deadlines are disabled by default, and
+     * requests are transferred only in the order of the elevator
+     * \param readExpire time in nanoseconds after which a read is transferred
+     * before the others, or 0 for no deadline
+     * \param writeExpire time in nanoseconds after which a write is
+     * transferred before the others, or 0 for no deadline
+     */
+    void setDeadlines(long long readExpire, long long writeExpire);
+    
+protected:
+    /**
+     * Transfer a list of requests. Called by one thread at a time.
+     * The requests are linked by their next field, are all reads or all
+     * writes, and are sorted by sector. The driver must set the result of
+     * each request, and may transfer requests to adjacent sectors together.
+     * \param list the requests
+     */
+    virtual void transfer(BlockRequest *list)=0;
+    
+    const unsigned int sectorSize; ///< Sector size in bytes
+    unsigned int sectors;          ///< Number of sectors, 0 if unknown
+    
+private:
+    /**
+     * Make a request and wait until it is transferred
+     * \param op operation
+     * \param iov buffers
+     * \param iovcnt number of buffers
+     * \param where where to transfer from or to
+     * \return number of bytes transferred or a negative number on failure
+     */
+    ssize_t perform(BlockRequest::Op op, const struct iovec *iov, int iovcnt,
+            off_t where);
+    
+    /**
+     * Remove from the queue the requests to transfer next. Must be called
+     * with the queue mutex locked and a non empty queue
+     * \return the requests, linked by their next field
+     */
+    BlockRequest *nextBatch();
+    
+    FastMutex queueMutex;   ///< Protects the queue
+    ConditionVariable cv;   ///< Signaled when a transfer ends
+    BlockRequest *pending;  ///< Queued requests, sorted by sector
+    unsigned int position;  ///< Sector following the last transferred one
+    long long readExpire;   ///< Deadline of reads, 0 if none
+    long long writeExpire;  ///< Deadline of writes, 0 if none
+    bool transferring;      ///< True while a thread is calling transfer()
+};
+
+} //namespace miosix
+
+#endif //BLOCK_DEVICE_H
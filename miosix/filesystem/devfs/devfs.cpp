@@ -27,9 +27,12 @@
 
 #include "devfs.h"
 #include <string>
+#include <cstring>
+#include <algorithm>
 #include <errno.h>
 #include <fcntl.h>
 #include "filesystem/stringpart.h"
+#include "filesystem/pipe/pipe.h"
 
 using namespace std;
 
@@ -82,6 +85,53 @@ public:
      */
     virtual ssize_t read(void *data, size_t len);
     
+    /**
+     * Write data to the file from multiple buffers, if the file supports
+     * writing.
+     * \param iov buffers with the data to write
+     * \param iovcnt number of buffers
+     * \return the number of written characters, or a negative number in
+     * case of errors
+     */
+    virtual ssize_t writev(const struct iovec *iov, int iovcnt);
+    
+    /**
+     * Read data from the file into multiple buffers, if the file supports
+     * reading.
+     * \param iov buffers to store read data
+     * \param iovcnt number of buffers
+     * \return the number of read characters, or a negative number in
+     * case of errors
+     */
+    virtual ssize_t readv(const struct iovec *iov, int iovcnt);
+    
+    /**
+     * Check whether the file can be read or written without blocking.
+     * \param entry if not nullptr, added to the device wait queue
+     * \return a combination of POLLIN, POLLOUT, POLLERR and POLLHUP
+     */
+    virtual int poll(WaitQueueEntry *entry);
+    
+    /**
+     * Write data at a given position, if the file supports random-access.
+     * \param data the data to write
+     * \param len the number of bytes to write
+     * \param pos offset from the beginning of the file
+     * \return the number of written characters, or a negative number in
+     * case of errors
+     */
+    virtual ssize_t pwrite(const void *data, size_t len, off_t pos);
+    
+    /**
+     * Read data from a given position, if the file supports random-access.
+     * \param data buffer to store read data
+     * \param len the number of bytes to read
+     * \param pos offset from the beginning of the file
+     * \return the number of read characters, or a negative number in
+     * case of errors
+     */
+    virtual ssize_t pread(void *data, size_t len, off_t pos);
+    
     /**
      * Move file pointer, if the file supports random-access.
      * \param pos offset to sum to the beginning of the file, current position
@@ -113,6 +163,34 @@ public:
      * \return the exact return value depends on CMD, -1 is returned on error
      */
     virtual int ioctl(int cmd, void *arg);
+    
+    /**
+     * \return the device, if it is a block device opened for read and write
+     */
+    virtual Device *getBlockDevice();
+    
+    #ifdef WITH_FILESYSTEM
+    
+    /**
+     * Start an asynchronous request through the device, if it supports them.
+     * Requests that use the file pointer move it when they are started, by
+     * the request size.
+     * \param req the request
+     * \return 0 if the request was started, or -EOPNOTSUPP if it must be
+     * performed by the worker thread
+     */
+    virtual int aioSubmit(AioRequest *req);
+    
+    /**
+     * Map a range of the device in memory, if it supports it
+     * \param offset start of the range
+     * \param len size of the range, greater than zero
+     * \param addr the address of the range is stored here
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int mmap(off_t offset, size_t len, const void **addr);
+    
+    #endif //WITH_FILESYSTEM
 
 private:
     intrusive_ref_ptr<Device> dev; ///< Device file
@@ -140,6 +218,47 @@ ssize_t DevFsFile::read(void *data, size_t len)
     return result;
 }
 
+ssize_t DevFsFile::writev(const struct iovec *iov, int iovcnt)
+{
+    if((flags & _FWRITE)==0) return -EINVAL;
+    ssize_t result=dev->writeBlocks(iov,iovcnt,seekPoint);
+    if(result>0 && ((flags & _NOSEEK)==0)) seekPoint+=result;
+    return result;
+}
+
+ssize_t DevFsFile::readv(const struct iovec *iov, int iovcnt)
+{
+    if((flags & _FREAD)==0) return -EINVAL;
+    ssize_t result=dev->readBlocks(iov,iovcnt,seekPoint);
+    if(result>0 && ((flags & _NOSEEK)==0)) seekPoint+=result;
+    return result;
+}
+
+int DevFsFile::poll(WaitQueueEntry *entry)
+{
+    int result=dev->poll(entry);
+    //Report only the directions the file was opened for
+    if((flags & _FREAD)==0) result&=~POLLIN;
+    if((flags & _FWRITE)==0) result&=~POLLOUT;
+    return result;
+}
+
+ssize_t DevFsFile::pwrite(const void *data, size_t len, off_t pos)
+{
+    if((flags & _FWRITE)==0) return -EINVAL;
+    if(flags & _NOSEEK) return -ESPIPE;
+    if(pos+static_cast<off_t>(len)<0) len=numeric_limits<off_t>::max()-pos;
+    return dev->writeBlock(data,len,pos);
+}
+
+ssize_t DevFsFile::pread(void *data, size_t len, off_t pos)
+{
+    if((flags & _FREAD)==0) return -EINVAL;
+    if(flags & _NOSEEK) return -ESPIPE;
+    if(pos+static_cast<off_t>(len)<0) len=numeric_limits<off_t>::max()-pos;
+    return dev->readBlock(data,len,pos);
+}
+
 off_t DevFsFile::lseek(off_t pos, int whence)
 {
     if(flags & _NOSEEK) return -EBADF; //No seek support
@@ -176,6 +295,61 @@ int DevFsFile::ioctl(int cmd, void *arg)
     return dev->ioctl(cmd,arg);
 }
 
+Device *DevFsFile::getBlockDevice()
+{
+    //Bypassing the file must not allow what the open flags would not allow
+    if(dev->isBlock()==false || (flags & _FREAD)==0 || (flags & _FWRITE)==0)
+        return nullptr;
+    return dev.get();
+}
+
+#ifdef WITH_FILESYSTEM
+
+int DevFsFile::aioSubmit(AioRequest *req)
+{
+    //Requests the open flags do not allow fail in the worker thread
+    if((flags & (req->op==AioRequest::READ ? _FREAD : _FWRITE))==0)
+        return -EOPNOTSUPP;
+    //The request may complete before aioSubmit returns, copy what is needed
+    bool useSeekPoint=req->offset<0 && (flags & _NOSEEK)==0;
+    size_t size=req->size;
+    if(flags & _NOSEEK) req->position=0;
+    else req->position=useSeekPoint ? seekPoint : req->offset;
+    int result=dev->aioSubmit(req);
+    if(result==0 && useSeekPoint) seekPoint+=size;
+    return result;
+}
+
+int DevFsFile::mmap(off_t offset, size_t len, const void **addr)
+{
+    if((flags & _FREAD)==0) return -EACCES;
+    return dev->mmap(offset,len,addr);
+}
+
+/**
+ * Performs the asynchronous requests of a block device
+ */
+class DeviceAioQueue : public AioQueue
+{
+public:
+    DeviceAioQueue(Device *dev) : dev(dev) {}
+
+protected:
+    virtual ssize_t perform(AioRequest *req);
+
+private:
+    Device *dev;
+};
+
+ssize_t DeviceAioQueue::perform(AioRequest *req)
+{
+    if(req->op==AioRequest::READ)
+        return dev->readBlock(req->buffer,req->size,req->devicePosition());
+    return dev->writeBlock(req->buffer,req->size,req->devicePosition());
+}
+
+#endif //WITH_FILESYSTEM
+
 //
 // class Device
 //
@@ -212,6 +386,39 @@ ssize_t Device::writeBlock(const void *buffer, size_t size, off_t where)
     return size; //Act as /dev/null
 }
 
+ssize_t Device::readBlocks(const struct iovec *iov, int iovcnt, off_t where)
+{
+    ssize_t total=0;
+    for(int i=0;i<iovcnt;i++)
+    {
+        if(iov[i].iov_len==0) continue;
+        ssize_t result=readBlock(iov[i].iov_base,iov[i].iov_len,where+total);
+        if(result<0) return total>0 ? total : result;
+        total+=result;
+        if(static_cast<size_t>(result)<iov[i].iov_len) break;
+    }
+    return total;
+}
+
+ssize_t Device::writeBlocks(const struct iovec *iov, int iovcnt, off_t where)
+{
+    ssize_t total=0;
+    for(int i=0;i<iovcnt;i++)
+    {
+        if(iov[i].iov_len==0) continue;
+        ssize_t result=writeBlock(iov[i].iov_base,iov[i].iov_len,where+total);
+        if(result<0) return total>0 ? total : result;
+        total+=result;
+        if(static_cast<size_t>(result)<iov[i].iov_len) break;
+    }
+    return total;
+}
+
+int Device::poll(WaitQueueEntry *entry)
+{
+    return POLLIN | POLLOUT;
+}
+
 void Device::IRQwrite(const char *str) {}
 
 int Device::ioctl(int cmd, void *arg)
@@ -219,7 +426,75 @@ int Device::ioctl(int cmd, void *arg)
     return -ENOTTY; //Means the operation does not apply to this descriptor
 }
 
-Device::~Device() {}
+#ifdef WITH_FILESYSTEM
+
+int Device::aioSubmit(AioRequest *req)
+{
+    if(block==false) return -EOPNOTSUPP;
+    {
+        //Only protects the allocation, so can be shared by all devices
+        static FastMutex allocMutex;
+        Lock<FastMutex> l(allocMutex);
+        if(aioQueue==nullptr) aioQueue=new DeviceAioQueue(this);
+    }
+    aioQueue->submit(req);
+    return 0;
+}
+
+int Device::mmap(off_t offset, size_t len, const void **addr)
+{
+    return -ENODEV;
+}
+
+#endif //WITH_FILESYSTEM
+
+Device::~Device()
+{
+    #ifdef WITH_FILESYSTEM
+    delete aioQueue;
+    #endif //WITH_FILESYSTEM
+}
+
+#ifdef WITH_FILESYSTEM
+
+//
+// class MemoryDevice
+//
+
+MemoryDevice::MemoryDevice(const void *base, size_t size)
+    : Device(Device::BLOCK), base(reinterpret_cast<const char*>(base)),
+      size(size) {}
+
+ssize_t MemoryDevice::readBlock(void *buffer, size_t size, off_t where)
+{
+    if(where<0) return -EINVAL;
+    if(where>=static_cast<off_t>(this->size)) return 0;
+    size=min<size_t>(size,this->size-where);
+    memcpy(buffer,base+where,size);
+    return size;
+}
+
+ssize_t MemoryDevice::writeBlock(const void *buffer, size_t size, off_t where)
+{
+    return -EROFS;
+}
+
+int MemoryDevice::mmap(off_t offset, size_t len, const void **addr)
+{
+    if(offset<0 || offset>static_cast<off_t>(size)
+        || len>size-static_cast<size_t>(offset)) return -ENXIO;
+    *addr=base+offset;
+    return 0;
+}
+
+int MemoryDevice::fstat(struct stat *pstat) const
+{
+    Device::fstat(pstat);
+    pstat->st_size=size;
+    return 0;
+}
+
+#endif //WITH_FILESYSTEM
 
 #ifdef WITH_DEVFS
 
@@ -231,22 +506,16 @@ class DevFsDirectory : public DirectoryBase
 public:
     /**
      * \param parent parent filesystem
-     * \param mutex mutex to lock when accessing the file map
-     * \param files file map
+     * \param table device files, as they were when the directory was opened
      * \param currentInode inode of the directory we're listing
      * \param parentInode inode of the parent directory
      */
     DevFsDirectory(intrusive_ref_ptr<FilesystemBase> parent,
-            FastMutex& mutex,
-            map<StringPart,intrusive_ref_ptr<Device> >& files,
+            intrusive_ref_ptr<DevFs::Table> table,
             int currentInode, int parentInode)
-            : DirectoryBase(parent), mutex(mutex), files(files),
+            : DirectoryBase(parent), table(table), index(0),
               currentInode(currentInode), parentInode(parentInode),
-              first(true), last(false)
-    {
-        Lock<FastMutex> l(mutex);
-        if(files.empty()==false) currentItem=files.begin()->first.c_str();
-    }
+              first(true) {}
 
     /**
      * Also directories can be opened as files. In this case, this system
@@ -260,21 +529,18 @@ public:
     virtual int getdents(void *dp, int len);
 
 private:
-    FastMutex& mutex;                 ///< Mutex of parent class
-    map<StringPart,intrusive_ref_ptr<Device> >& files; ///< Directory entries
-    string currentItem;               ///< First unhandled item in directory
-    int currentInode,parentInode;     ///< Inodes of . and ..
+    intrusive_ref_ptr<DevFs::Table> table; ///< Directory entries
+    unsigned int index;           ///< First unhandled entry, size+1 at the end
+    int currentInode,parentInode; ///< Inodes of . and ..
 
     bool first; ///< True if first time getdents is called
-    bool last;  ///< True if directory has ended
 };
 
 int DevFsDirectory::getdents(void *dp, int len)
 {
     if(len<minimumBufferSize) return -EINVAL;
-    if(last) return 0;
+    if(index>table->entries.size()) return 0;
     
-    Lock<FastMutex> l(mutex);
     char *begin=reinterpret_cast<char*>(dp);
     char *buffer=begin;
     char *end=buffer+len;
@@ -283,33 +549,80 @@ int DevFsDirectory::getdents(void *dp, int len)
         first=false;
         addDefaultEntries(&buffer,currentInode,parentInode);
     }
-    if(currentItem.empty()==false)
+    //The table is immutable, so no locking and no need to handle entries
+    //removed between calls
+    for(;index<table->entries.size();index++)
     {
-        map<StringPart,intrusive_ref_ptr<Device> >::iterator it;
-        it=files.find(StringPart(currentItem));
-        //Someone deleted the exact directory entry we had saved (unlikely)
-        if(it==files.end()) return -EBADF;
-        for(;it!=files.end();++it)
-        {
-            struct stat st;
-            it->second->fstat(&st);
-            if(addEntry(&buffer,end,st.st_ino,st.st_mode>>12,it->first)>0)
-                continue;
-            //Buffer finished
-            currentItem=it->first.c_str();
-            return buffer-begin;
-        }
+        const DevFs::Entry& e=table->entries[index];
+        struct stat st;
+        e.dev->fstat(&st);
+        StringPart name(e.name.c_str());
+        if(addEntry(&buffer,end,st.st_ino,st.st_mode>>12,name)<0)
+            return buffer-begin; //Buffer finished
     }
     addTerminatingEntry(&buffer,end);
-    last=true;
+    index++;
     return buffer-begin;
 }
 
+/**
+ * Hash function of device file names (32 bit FNV-1a)
+ * \param name file name, not necessarily NUL terminated
+ * \param len length of the name
+ * \return the hash
+ */
+static unsigned int hashName(const char *name, unsigned int len)
+{
+    unsigned int result=2166136261u;
+    for(unsigned int i=0;i<len;i++)
+    {
+        result^=static_cast<unsigned char>(name[i]);
+        result*=16777619u;
+    }
+    return result;
+}
+
+//
+// class DevFs::Table
+//
+
+DevFs::Table::Table(vector<Entry>&& entries) : entries(std::move(entries))
+{
+    //At least half of the buckets are empty, so that lookups of files that
+    //do not exist end quickly
+    unsigned int size=8;
+    while(size<2*this->entries.size()) size*=2;
+    buckets.resize(size,0);
+    for(unsigned int i=0;i<this->entries.size();i++)
+    {
+        unsigned int b=this->entries[i].hash & (size-1);
+        while(buckets[b]) b=(b+1) & (size-1);
+        buckets[b]=i+1;
+    }
+}
+
+const DevFs::Entry *DevFs::Table::find(const StringPart& name) const
+{
+    const char *s=name.c_str();
+    unsigned int len=name.length();
+    unsigned int hash=hashName(s,len);
+    unsigned int mask=buckets.size()-1;
+    for(unsigned int b=hash & mask;buckets[b];b=(b+1) & mask)
+    {
+        const Entry& e=entries[buckets[b]-1];
+        //Names are compared only if the hash matches
+        if(e.hash==hash && e.name.length()==len && memcmp(e.name.c_str(),s,len)==0)
+            return &e;
+    }
+    return nullptr;
+}
+
 //
 // class DevFs
 //
 
-DevFs::DevFs() : mutex(FastMutex::RECURSIVE), inodeCount(rootDirInode+1)
+DevFs::DevFs() : mutex(FastMutex::RECURSIVE),
+        table(new Table(vector<Entry>())), inodeCount(rootDirInode+1)
 {
     addDevice("null",intrusive_ref_ptr<Device>(new Device(Device::STREAM)));
     addDevice("zero",intrusive_ref_ptr<Device>(new Device(Device::STREAM)));
@@ -321,72 +634,75 @@ bool DevFs::addDevice(const char *name, intrusive_ref_ptr<Device> dev)
     int len=strlen(name);
     for(int i=0;i<len;i++) if(name[i]=='/') return false;
     Lock<FastMutex> l(mutex);
-    bool result=files.insert(make_pair(StringPart(name),dev)).second;
-    //Assign inode to the file
-    if(result) dev->setFileInfo(atomicAddExchange(&inodeCount,1),filesystemId);
-    return result;
+    return addHelper(StringPart(name),dev)==0;
 }
 
 bool DevFs::remove(const char* name)
 {
     if(name==0 || name[0]=='\0') return false;
     Lock<FastMutex> l(mutex);
-    map<StringPart,intrusive_ref_ptr<Device> >::iterator it;
-    it=files.find(StringPart(name));
-    if(it==files.end()) return false;
-    files.erase(StringPart(name));
-    return true;
+    return removeHelper(StringPart(name))==0;
 }
 
 int DevFs::open(intrusive_ref_ptr<FileBase>& file, StringPart& name,
         int flags, int mode)
 {
     if(flags & (O_APPEND | O_EXCL)) return -EACCES;
-    Lock<FastMutex> l(mutex);
+    //Holding a reference to the table keeps the device alive while opening it
+    intrusive_ref_ptr<Table> t=atomic_load(&table);
     if(name.empty()) //Trying to open the root directory of the fs
     {
         if(flags & (O_WRONLY | O_RDWR)) return -EACCES;
         file=intrusive_ref_ptr<FileBase>(
             new DevFsDirectory(shared_from_this(),
-                mutex,files,rootDirInode,parentFsMountpointInode));
+                t,rootDirInode,parentFsMountpointInode));
         return 0;
     }
-    map<StringPart,intrusive_ref_ptr<Device> >::iterator it=files.find(name);
-    if(it==files.end()) return -ENOENT;
-    return it->second->open(file,shared_from_this(),flags,mode);
+    const Entry *e=t->find(name);
+    if(e==nullptr) return -ENOENT;
+    return e->dev->open(file,shared_from_this(),flags,mode);
 }
 
 int DevFs::lstat(StringPart& name, struct stat *pstat)
 {
-    Lock<FastMutex> l(mutex);
     if(name.empty())
     {
         fillStatHelper(pstat,rootDirInode,filesystemId,S_IFDIR | 0755);//drwxr-xr-x
         return 0;
     }
-    map<StringPart,intrusive_ref_ptr<Device> >::iterator it=files.find(name);
-    if(it==files.end()) return -ENOENT;
-    return it->second->fstat(pstat);
+    intrusive_ref_ptr<Table> t=atomic_load(&table);
+    const Entry *e=t->find(name);
+    if(e==nullptr) return -ENOENT;
+    return e->dev->fstat(pstat);
 }
 
 int DevFs::unlink(StringPart& name)
 {
     Lock<FastMutex> l(mutex);
-    if(files.erase(name)==1) return 0;
-    return -ENOENT;
+    return removeHelper(name);
 }
 
 int DevFs::rename(StringPart& oldName, StringPart& newName)
 {
     Lock<FastMutex> l(mutex);
-    map<StringPart,intrusive_ref_ptr<Device> >::iterator it=files.find(oldName);
-    if(it==files.end()) return -ENOENT;
+    const Entry *e=table->find(oldName);
+    if(e==nullptr) return -ENOENT;
     for(unsigned int i=0;i<newName.length();i++)
         if(newName[i]=='/')
             return -EACCES; //DevFs does not support subdirectories
-    files.erase(newName); //If it exists
-    files.insert(make_pair(newName,it->second));
-    files.erase(it);
+    if(e->name==newName.c_str()) return 0;
+    //Done with a single replacement of the table, so that the file is
+    //visible with either name at any time
+    vector<Entry> entries;
+    entries.reserve(table->entries.size());
+    for(auto& it : table->entries)
+    {
+        if(&it==e || it.name==newName.c_str()) continue; //Replaced if exists
+        entries.push_back(it);
+    }
+    Entry renamed=*e;
+    insertSorted(entries,newName,renamed);
+    atomic_store(&table,intrusive_ref_ptr<Table>(new Table(std::move(entries))));
     return 0;
 }
 
@@ -395,6 +711,54 @@ int DevFs::mkdir(StringPart& name, int mode)
     return -EACCES; // No directories support in DevFs yet
 }
 
+int DevFs::mkfifo(StringPart& name, int mode)
+{
+    for(unsigned int i=0;i<name.length();i++)
+        if(name[i]=='/')
+            return -EACCES; //DevFs does not support subdirectories
+    if(name.empty()) return -EEXIST; //The root directory
+    Lock<FastMutex> l(mutex);
+    return addHelper(name,intrusive_ref_ptr<Device>(new Fifo));
+}
+
+int DevFs::addHelper(const StringPart& name, intrusive_ref_ptr<Device> dev)
+{
+    //Only called with mutex locked, the only case in which table is replaced
+    if(table->find(name)) return -EEXIST;
+    //Assign inode to the file before it becomes visible
+    dev->setFileInfo(atomicAddExchange(&inodeCount,1),filesystemId);
+    vector<Entry> entries=table->entries;
+    Entry e;
+    e.dev=dev;
+    insertSorted(entries,name,e);
+    atomic_store(&table,intrusive_ref_ptr<Table>(new Table(std::move(entries))));
+    return 0;
+}
+
+void DevFs::insertSorted(vector<Entry>& entries, const StringPart& name,
+        Entry& e)
+{
+    e.name=name.c_str();
+    e.hash=hashName(e.name.c_str(),e.name.length());
+    auto it=lower_bound(entries.begin(),entries.end(),name,
+        [](const Entry& a, const StringPart& b) {
+            return strcmp(a.name.c_str(),b.c_str())<0;
+        });
+    entries.insert(it,std::move(e));
+}
+
+int DevFs::removeHelper(const StringPart& name)
+{
+    const Entry *e=table->find(name);
+    if(e==nullptr) return -ENOENT;
+    vector<Entry> entries;
+    entries.reserve(table->entries.size()-1);
+    for(auto& it : table->entries) if(&it!=e) entries.push_back(it);
+    //The device is deleted when the last reader releases the previous table
+    atomic_store(&table,intrusive_ref_ptr<Table>(new Table(std::move(entries))));
+    return 0;
+}
+
 int DevFs::rmdir(StringPart& name)
 {
     return -EACCES; // No directories support in DevFs yet
@@ -28,8 +28,10 @@
 #ifndef DEVFS_H
 #define	DEVFS_H
 
-#include <map>
+#include <string>
+#include <vector>
 #include "filesystem/file.h"
+#include "filesystem/aio.h"
 #include "filesystem/stringpart.h"
 #include "kernel/sync.h"
 #include "config/miosix_settings.h"
@@ -71,6 +73,9 @@ public:
      * \param d device type
      */
     Device(DeviceType d) : seekable(d==BLOCK), block(d==BLOCK), tty(d==TTY)
+    #ifdef WITH_FILESYSTEM
+        , aioQueue(nullptr)
+    #endif //WITH_FILESYSTEM
     {}
     
     /**
@@ -81,7 +86,7 @@ public:
      * \param mode file permissions
      * \return 0 on success, or a negative number on failure
      */
-    int open(intrusive_ref_ptr<FileBase>& file,
+    virtual int open(intrusive_ref_ptr<FileBase>& file,
             intrusive_ref_ptr<FilesystemBase> fs, int flags, int mode);
     
     /**
@@ -89,7 +94,7 @@ public:
      * \param pstat file information is stored here
      * \return 0 on success, or a negative number on failure
      */
-    int fstat(struct stat *pstat) const;
+    virtual int fstat(struct stat *pstat) const;
     
     /**
      * Check whether the file refers to a terminal.
@@ -98,6 +103,11 @@ public:
      */
     virtual int isatty() const;
     
+    /**
+     * \return true if this is a block device
+     */
+    bool isBlock() const { return block; }
+    
     #ifdef WITH_DEVFS
     
     /**
@@ -130,6 +140,70 @@ public:
      */
     virtual ssize_t writeBlock(const void *buffer, size_t size, off_t where);
     
+    /**
+     * Read data into multiple buffers, starting from a given position.
+     * This default implementation calls readBlock() for each buffer,
+     * stopping at the first short read.
+     * \param iov buffers where read data will be stored
+     * \param iovcnt number of buffers
+     * \param where where to read from
+     * \return number of bytes read or a negative number on failure
+     */
+    virtual ssize_t readBlocks(const struct iovec *iov, int iovcnt, off_t where);
+    
+    /**
+     * Write data from multiple buffers, starting from a given position.
+     * This default implementation calls writeBlock() for each buffer,
+     * stopping at the first short write. Devices where a single write is
+     * atomic with respect to other writers should override it so that the
+     * data of all the buffers is kept together.
+     * \param iov buffers where take data to write
+     * \param iovcnt number of buffers
+     * \param where where to write to
+     * \return number of bytes written or a negative number on failure
+     */
+    virtual ssize_t writeBlocks(const struct iovec *iov, int iovcnt, off_t where);
+    
+    /**
+     * Check whether the device can be read or written without blocking.
+     * This default implementation reports the device as always ready.
+     * Drivers that can block should override it, keep a WaitQueue, and wake
+     * it from the interrupt that makes data available.
+     * \param entry if not nullptr, a driver that can block must add it to its
+     * WaitQueue. The entry is removed by the caller
+     * \return a combination of POLLIN, POLLOUT, POLLERR and POLLHUP
+     */
+    virtual int poll(WaitQueueEntry *entry);
+    
+    #ifdef WITH_FILESYSTEM
+    
+    /**
+     * Start an asynchronous request at the position returned by the
+     * request's devicePosition(). This default implementation performs the
+     * requests of block devices in submission order with a thread per device,
+     * that calls readBlock() and writeBlock(), so that a slow device does not
+     * delay the requests to other files. Drivers that can transfer data
+     * without the CPU may override it to start the transfer and complete the
+     * request from the interrupt that signals the transfer end.
+     * \param req the request
+     * \return 0 if the request was started, or -EOPNOTSUPP if it must be
+     * performed through the file by the worker thread shared by all files
+     */
+    virtual int aioSubmit(AioRequest *req);
+    
+    /**
+     * Map a range of the device in memory, for devices whose storage is
+     * memory addressable. This default implementation fails.
+     * \param offset start of the range
+     * \param len size of the range, greater than zero
+     * \param addr the address of the range is stored here
+     * \return 0 on success, -ENODEV if the device cannot be mapped, -ENXIO if
+     * the range is past the end of the device
+     */
+    virtual int mmap(off_t offset, size_t len, const void **addr);
+    
+    #endif //WITH_FILESYSTEM
+    
     /**
      * Write a string.
      * An extension to the Device interface that adds a new member function,
@@ -161,8 +235,69 @@ protected:
     const bool seekable; ///< If true, device is seekable
     const bool block;    ///< If true, it is a block device
     const bool tty;      ///< If true, it is a tty
+    #ifdef WITH_FILESYSTEM
+    AioQueue *aioQueue;  ///< Asynchronous requests, allocated on first use
+    #endif //WITH_FILESYSTEM
+};
+
+#ifdef WITH_FILESYSTEM
+
+/**
+ * A read-only block device whose content is a range of memory, such as a
+ * region of the microcontroller flash written together with the firmware.
+ * Its content can be read through the file, or used in place with mmap(),
+ * without copying it in RAM.
+ */
+class MemoryDevice : public Device
+{
+public:
+    /**
+     * Constructor
+     * \param base start of the memory range, must remain valid as long as
+     * the device exists
+     * \param size size of the memory range
+     */
+    MemoryDevice(const void *base, size_t size);
+    
+    /**
+     * Read a block of data
+     * \param buffer buffer where read data will be stored
+     * \param size buffer size
+     * \param where where to read from
+     * \return number of bytes read or a negative number on failure
+     */
+    virtual ssize_t readBlock(void *buffer, size_t size, off_t where);
+    
+    /**
+     * The device is read-only
+     * \return -EROFS
+     */
+    virtual ssize_t writeBlock(const void *buffer, size_t size, off_t where);
+    
+    /**
+     * Map a range of the device in memory
+     * \param offset start of the range
+     * \param len size of the range, greater than zero
+     * \param addr the address of the range is stored here
+     * \return 0 on success, or -ENXIO if the range is past the end of the
+     * device
+     */
+    virtual int mmap(off_t offset, size_t len, const void **addr);
+    
+    /**
+     * Obtain information on the device, st_size is the memory range size
+     * \param pstat file information is stored here
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int fstat(struct stat *pstat) const;
+    
+private:
+    const char *base;  ///< Start of the memory range
+    const size_t size; ///< Size of the memory range
 };
 
+#endif //WITH_FILESYSTEM
+
 #ifdef WITH_DEVFS
 
 /**
@@ -179,6 +314,12 @@ protected:
  * application. What will happen is that the individual files (and
  * DeviceFileGenerators) won't be deleted until the processes that have them
  * opened close them.
+ *
+ * Looking up a device, as done by open() and lstat(), does not lock: the
+ * device files are in an immutable hash table, that adding, removing or
+ * renaming a device replaces with a modified copy. Opening devices from many
+ * threads thus never serializes, while changing the devices is slow, which
+ * is fine as it usually happens only at boot.
  */
 class DevFs : public FilesystemBase
 {
@@ -250,6 +391,14 @@ public:
      */
     virtual int mkdir(StringPart& name, int mode);
     
+    /**
+     * Create a FIFO
+     * \param name FIFO name
+     * \param mode FIFO permissions
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int mkfifo(StringPart& name, int mode);
+    
     /**
      * Remove a directory if empty
      * \param name directory name
@@ -258,9 +407,73 @@ public:
     virtual int rmdir(StringPart& name);
     
 private:
-    
-    FastMutex mutex;
-    std::map<StringPart,intrusive_ref_ptr<Device> > files;
+    friend class DevFsDirectory;
+
+    /**
+     * A device file
+     */
+    struct Entry
+    {
+        std::string name;            ///< File name
+        unsigned int hash;           ///< Hash of the name
+        intrusive_ref_ptr<Device> dev; ///< The device
+    };
+
+    /**
+     * The device files. Once published it is never modified, so it can be
+     * accessed without locking by whoever loaded it with atomic_load()
+     */
+    class Table : public IntrusiveRefCounted
+    {
+    public:
+        /**
+         * Constructor
+         * \param entries device files, sorted by name, moved in the table
+         */
+        explicit Table(std::vector<Entry>&& entries);
+
+        /**
+         * \param name device file name
+         * \return the device file, or nullptr if not found
+         */
+        const Entry *find(const StringPart& name) const;
+
+        /// Device files, sorted by name so that they are listed in order
+        const std::vector<Entry> entries;
+
+    private:
+        /// Open addressing hash table, with the index in entries plus one, or
+        /// zero for empty buckets. The size is a power of two
+        std::vector<unsigned short> buckets;
+    };
+
+    /**
+     * Add a device file. Must be called with mutex locked
+     * \param name file name
+     * \param dev device
+     * \return 0 on success, -EEXIST if the file exists
+     */
+    int addHelper(const StringPart& name, intrusive_ref_ptr<Device> dev);
+
+    /**
+     * Name a device file and insert it in a list sorted by name
+     * \param entries sorted list of device files
+     * \param name file name
+     * \param e device file, its name and hash are set, then it is moved
+     * in the list
+     */
+    static void insertSorted(std::vector<Entry>& entries,
+            const StringPart& name, Entry& e);
+
+    /**
+     * Remove a device file. Must be called with mutex locked
+     * \param name file name
+     * \return 0 on success, -ENOENT if the file does not exist
+     */
+    int removeHelper(const StringPart& name);
+
+    FastMutex mutex; ///< Serializes changes to the device files
+    intrusive_ref_ptr<Table> table; ///< The device files
     int inodeCount;
     static const int rootDirInode=1;
 };
@@ -0,0 +1,88 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "ram_disk.h"
+#include <errno.h>
+#include <cstring>
+#include "filesystem/ioctl.h"
+
+using namespace std;
+
+namespace miosix {
+
+RamDisk::RamDisk(unsigned int sectors, unsigned int sectorSize)
+    : BlockDevice(sectorSize,sectors), memory(static_cast<size_t>(sectors)*sectorSize,0),
+      transferCount(0), commandCount(0), requestCount(0) {}
+
+int RamDisk::ioctl(int cmd, void *arg)
+{
+    if(cmd!=IOCTL_SYNC) return -ENOTTY;
+    return 0; //Writes are never cached
+}
+
+unsigned int RamDisk::transfers() const
+{
+    Lock<FastMutex> l(mutex);
+    return transferCount;
+}
+
+unsigned int RamDisk::commands() const
+{
+    Lock<FastMutex> l(mutex);
+    return commandCount;
+}
+
+unsigned int RamDisk::requests() const
+{
+    Lock<FastMutex> l(mutex);
+    return requestCount;
+}
+
+void RamDisk::transfer(BlockRequest *list)
+{
+    Lock<FastMutex> l(mutex);
+    transferCount++;
+    unsigned int next=0;
+    for(BlockRequest *req=list;req;req=req->next)
+    {
+        if(req==list || req->sector!=next) commandCount++;
+        next=req->sector+req->count;
+        requestCount++;
+        unsigned char *p=memory.data()+static_cast<size_t>(req->sector)*sectorSize;
+        for(int i=0;i<req->iovcnt;i++)
+        {
+            if(req->iov[i].iov_len==0) continue;
+            if(req->op==BlockRequest::READ)
+                memcpy(req->iov[i].iov_base,p,req->iov[i].iov_len);
+            else memcpy(p,req->iov[i].iov_base,req->iov[i].iov_len);
+            p+=req->iov[i].iov_len;
+        }
+        req->result=0;
+    }
+}
+
+} //namespace miosix
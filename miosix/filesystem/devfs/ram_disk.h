@@ -0,0 +1,97 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef RAM_DISK_H
+#define RAM_DISK_H
+
+#include <vector>
+#include "block_device.h"
+
+namespace miosix {
+
+/**
+ * A block device emulated in RAM, that goes through the request queue of
+ * BlockDevice like a real disk. It counts the transfers and the commands a
+ * disk with scatter-gather DMA would need, one for each run of requests to
+ * adjacent sectors, so that the request queue can be tested and benchmarked,
+ * also on a Linux host.
+ *
+ * It is not built with the kernel, it is built by _tools/fs_host_test, and
+ * applications that want it on a board add ram_disk.cpp to their sources.
+ */
+class RamDisk : public BlockDevice
+{
+public:
+    /**
+     * Constructor, the content starts zeroed
+     * \param sectors number of sectors
+     * \param sectorSize sector size in bytes
+     */
+    RamDisk(unsigned int sectors, unsigned int sectorSize=512);
+    
+    /**
+     * Performs device-specific operations
+     * \param cmd specifies the operation to perform
+     * \param arg optional argument that some operation require
+     * \return the exact return value depends on CMD, -1 is returned on error
+     */
+    virtual int ioctl(int cmd, void *arg);
+    
+    /**
+     * \return the number of times the request queue called transfer()
+     */
+    unsigned int transfers() const;
+    
+    /**
+     * \return the number of commands issued, requests to sectors adjacent to
+     * the ones of the previous request in the same transfer need none
+     */
+    unsigned int commands() const;
+    
+    /**
+     * \return the number of requests transferred
+     */
+    unsigned int requests() const;
+    
+protected:
+    /**
+     * Transfer a list of requests
+     * \param list the requests
+     */
+    virtual void transfer(BlockRequest *list);
+    
+private:
+    mutable FastMutex mutex;
+    std::vector<unsigned char> memory; ///< Disk content
+    unsigned int transferCount;        ///< Calls to transfer()
+    unsigned int commandCount;         ///< Commands issued
+    unsigned int requestCount;         ///< Requests transferred
+};
+
+} //namespace miosix
+
+#endif //RAM_DISK_H
@@ -0,0 +1,126 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "dentry_cache.h"
+#include <cstring>
+
+#ifdef WITH_FILESYSTEM
+
+namespace miosix {
+
+//
+// class DentryCache
+//
+
+void DentryCache::resize(unsigned int numEntries)
+{
+    delete[] entries;
+    entries=numEntries>0 ? new Entry[numEntries] : nullptr;
+    this->numEntries=numEntries;
+    clear();
+}
+
+DentryCache::Result DentryCache::lookup(DWORD dir, const WCHAR *name,
+                                        WORD& index)
+{
+    char key[maxNameLen+1];
+    if(numEntries==0 || makeKey(name,key)==false) return MISS;
+    Entry *e=slot(dir,key);
+    if(e->name[0]=='\0' || e->dir!=dir || strcmp(e->name,key)) return MISS;
+    if(e->index==notFound) return NOT_FOUND;
+    index=e->index;
+    return FOUND;
+}
+
+void DentryCache::entryAdded(DWORD dir)
+{
+    //The new name may be one we cached as not found, or, if it was given a
+    //numbered short name, it may collide with a short name we cached as not
+    //found, so drop all negative entries of the directory
+    for(unsigned int i=0;i<numEntries;i++)
+        if(entries[i].dir==dir && entries[i].index==notFound)
+            entries[i].name[0]='\0';
+}
+
+void DentryCache::entryRemoved(DWORD dir, WORD index)
+{
+    for(unsigned int i=0;i<numEntries;i++)
+        if(entries[i].dir==dir && entries[i].index==index)
+            entries[i].name[0]='\0';
+}
+
+void DentryCache::directoryChanged(DWORD dir)
+{
+    for(unsigned int i=0;i<numEntries;i++)
+        if(entries[i].dir==dir) entries[i].name[0]='\0';
+}
+
+void DentryCache::clear()
+{
+    for(unsigned int i=0;i<numEntries;i++) entries[i].name[0]='\0';
+}
+
+DentryCache::~DentryCache()
+{
+    delete[] entries;
+}
+
+bool DentryCache::makeKey(const WCHAR *name, char key[maxNameLen+1])
+{
+    unsigned int i;
+    for(i=0;name[i];i++)
+    {
+        if(i>=maxNameLen || name[i]>=0x80) return false;
+        char c=name[i];
+        key[i]=(c>='a' && c<='z') ? c-'a'+'A' : c;
+    }
+    key[i]='\0';
+    return i>0;
+}
+
+DentryCache::Entry *DentryCache::slot(DWORD dir, const char *key)
+{
+    //FNV-1a hash of directory and name
+    unsigned int hash=2166136261u;
+    for(int i=0;i<4;i++) hash=(hash ^ ((dir>>(8*i)) & 0xff))*16777619u;
+    for(;*key;key++) hash=(hash ^ static_cast<unsigned char>(*key))*16777619u;
+    return &entries[hash % numEntries];
+}
+
+void DentryCache::store(DWORD dir, const WCHAR *name, WORD index)
+{
+    char key[maxNameLen+1];
+    if(numEntries==0 || makeKey(name,key)==false) return;
+    Entry *e=slot(dir,key);
+    e->dir=dir;
+    e->index=index;
+    strcpy(e->name,key);
+}
+
+} //namespace miosix
+
+#endif //WITH_FILESYSTEM
@@ -0,0 +1,182 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef DENTRY_CACHE_H
+#define DENTRY_CACHE_H
+
+#include "integer.h"
+#include "config/miosix_settings.h"
+
+#ifdef WITH_FILESYSTEM
+
+namespace miosix {
+
+/**
+ * \internal
+ * Directory entry lookup cache for FatFs. FAT directories are unsorted tables,
+ * so finding a name requires scanning the directory from the start, and every
+ * path component is looked up again at each open() and stat(). This cache
+ * maps (directory start cluster, name) to the index of the directory entry,
+ * or records that the name does not exist in the directory.
+ *
+ * The cache is direct mapped, so a lookup costs the same irrespective of the
+ * directory size. Positive entries are only a hint, as the caller checks that
+ * the directory entry at the cached index matches the name, while negative
+ * entries are trusted, so they must be invalidated whenever an entry is added
+ * to the directory. Only names of up to maxNameLen ASCII characters are
+ * cached, comparisons are case insensitive like in FAT.
+ *
+ * Not thread safe, FatFs calls are serialized by the filesystem mutex.
+ */
+class DentryCache
+{
+public:
+    /**
+     * Lookup result
+     */
+    enum Result
+    {
+        MISS,     ///< The name is not in the cache
+        FOUND,    ///< The name should be at the returned index
+        NOT_FOUND ///< The name is not in the directory
+    };
+
+    /// Longest name that is cached
+    static const unsigned int maxNameLen=19;
+
+    /**
+     * Constructor, the cache is disabled until resize() is called
+     */
+    DentryCache() {}
+
+    /**
+     * Set the cache size, also clears the cache
+     * \param numEntries number of cached names, 0 to disable the cache
+     */
+    void resize(unsigned int numEntries);
+
+    /**
+     * Look for a name
+     * \param dir start cluster of the directory, 0 for the root directory
+     * \param name name to look for
+     * \param index if FOUND is returned, the index of the first directory
+     * entry of the name, including long file name entries, is stored here
+     * \return the lookup result
+     */
+    Result lookup(DWORD dir, const WCHAR *name, WORD& index);
+
+    /**
+     * Record the position of a name in a directory
+     * \param dir start cluster of the directory
+     * \param name name
+     * \param index index of the first directory entry of the name
+     */
+    void insert(DWORD dir, const WCHAR *name, WORD index)
+    {
+        store(dir,name,index);
+    }
+
+    /**
+     * Record that a name is not in a directory
+     * \param dir start cluster of the directory
+     * \param name name
+     */
+    void insertNotFound(DWORD dir, const WCHAR *name)
+    {
+        store(dir,name,notFound);
+    }
+
+    /**
+     * Call when an entry is added to a directory
+     * \param dir start cluster of the directory
+     */
+    void entryAdded(DWORD dir);
+
+    /**
+     * Call when an entry is removed from a directory
+     * \param dir start cluster of the directory
+     * \param index index of the first directory entry of the removed name
+     */
+    void entryRemoved(DWORD dir, WORD index);
+
+    /**
+     * Call when a cluster becomes the start cluster of a new directory, or
+     * stops being one
+     * \param dir start cluster of the directory
+     */
+    void directoryChanged(DWORD dir);
+
+    /**
+     * Clear the cache
+     */
+    void clear();
+
+    /**
+     * Destructor
+     */
+    ~DentryCache();
+
+    DentryCache(const DentryCache&) = delete;
+    DentryCache& operator=(const DentryCache&) = delete;
+
+private:
+    /**
+     * A cached name
+     */
+    struct Entry
+    {
+        DWORD dir;                 ///< Directory start cluster
+        WORD index;                ///< Entry index, or notFound
+        char name[maxNameLen+1];   ///< Upper case name, empty if entry unused
+    };
+
+    /**
+     * Convert a name to upper case ASCII
+     * \param name name
+     * \param key upper case name is stored here
+     * \return true if the name can be cached
+     */
+    static bool makeKey(const WCHAR *name, char key[maxNameLen+1]);
+
+    /**
+     * \return the entry where the given name is cached
+     */
+    Entry *slot(DWORD dir, const char *key);
+
+    void store(DWORD dir, const WCHAR *name, WORD index);
+
+    static const WORD notFound=0xffff;
+
+    Entry *entries=nullptr;    ///< Cache entries
+    unsigned int numEntries=0; ///< Number of cache entries
+};
+
+} //namespace miosix
+
+#endif //WITH_FILESYSTEM
+
+#endif //DENTRY_CACHE_H
@@ -6,6 +6,7 @@
 #include "diskio.h"
 #include "filesystem/ioctl.h"
 #include "config/miosix_settings.h"
+#include <cstring>
 
 #ifdef WITH_FILESYSTEM
 
@@ -41,20 +42,257 @@ using namespace miosix;
 //    else return STA_NOINIT;
 //}
 
+namespace miosix {
+
+//
+// class FatDisk
+//
+
+void FatDisk::setDevice(intrusive_ref_ptr<FileBase> device,
+                        unsigned int cacheSectors)
+{
+    reset();
+    dev=device;
+    if(dev) blockDev=dev->getBlockDevice();
+    if(cacheSectors==0) return;
+    entries=new Entry[cacheSectors];
+    buffer=new BYTE[cacheSectors*512];
+    numEntries=cacheSectors;
+    for(unsigned int i=0;i<numEntries;i++)
+    {
+        entries[i].sector=0;
+        entries[i].prev=&entries[i==0 ? numEntries-1 : i-1];
+        entries[i].next=&entries[i==numEntries-1 ? 0 : i+1];
+        entries[i].data=buffer+i*512;
+        entries[i].valid=false;
+        entries[i].dirty=false;
+    }
+    mru=&entries[0];
+}
+
+DRESULT FatDisk::read(BYTE *buff, DWORD sector, UINT count)
+{
+    if(count>1) return bulkRead(buff,sector,count);
+    if(numEntries==0) return deviceRead(buff,sector,count);
+    Entry *e=lookup(sector);
+    if(e)
+    {
+        stats.hits++;
+    } else {
+        stats.misses++;
+        e=evict();
+        if(e==nullptr) return RES_ERROR;
+        if(deviceRead(e->data,sector,1)!=RES_OK) return RES_ERROR;
+        e->sector=sector;
+        e->valid=true;
+    }
+    touch(e);
+    memcpy(buff,e->data,512);
+    return RES_OK;
+}
+
+DRESULT FatDisk::write(const BYTE *buff, DWORD sector, UINT count)
+{
+    if(count>1) return bulkWrite(buff,sector,count);
+    if(numEntries==0) return deviceWrite(buff,sector,count);
+    Entry *e=lookup(sector);
+    if(e)
+    {
+        stats.hits++;
+    } else {
+        e=evict();
+        if(e==nullptr) return RES_ERROR;
+        e->sector=sector;
+        e->valid=true;
+    }
+    touch(e);
+    memcpy(e->data,buff,512);
+    e->dirty=true;
+    return RES_OK;
+}
+
+DRESULT FatDisk::sync()
+{
+    if(!dev) return RES_OK;
+    //Write back dirty sectors in ascending order, to be friendly to the device
+    DRESULT result=RES_OK;
+    for(;;)
+    {
+        Entry *next=nullptr;
+        for(unsigned int i=0;i<numEntries;i++)
+        {
+            Entry *e=&entries[i];
+            if(e->dirty && (next==nullptr || e->sector<next->sector)) next=e;
+        }
+        if(next==nullptr) break;
+        if(deviceWrite(next->data,next->sector,1)!=RES_OK)
+        {
+            result=RES_ERROR;
+            break;
+        }
+        next->dirty=false;
+        stats.writebacks++;
+    }
+    if(dev->ioctl(IOCTL_SYNC,0)!=0) result=RES_ERROR;
+    return result;
+}
+
+void FatDisk::reset()
+{
+    sync();
+    dev.reset();
+    blockDev=nullptr;
+    delete[] entries;
+    delete[] buffer;
+    entries=nullptr;
+    buffer=nullptr;
+    mru=nullptr;
+    numEntries=0;
+}
+
+FatDisk::~FatDisk()
+{
+    reset();
+}
+
+DRESULT FatDisk::deviceRead(BYTE *buff, DWORD sector, UINT count)
+{
+    if(blockDev)
+    {
+        ssize_t size=static_cast<ssize_t>(count)*512;
+        off_t where=static_cast<off_t>(sector)*512;
+        return blockDev->readBlock(buff,size,where)==size ? RES_OK : RES_ERROR;
+    }
+    if(dev->lseek(static_cast<off_t>(sector)*512,SEEK_SET)<0) return RES_ERROR;
+    if(dev->read(buff,count*512)!=static_cast<ssize_t>(count)*512) return RES_ERROR;
+    return RES_OK;
+}
+
+DRESULT FatDisk::deviceWrite(const BYTE *buff, DWORD sector, UINT count)
+{
+    if(blockDev)
+    {
+        ssize_t size=static_cast<ssize_t>(count)*512;
+        off_t where=static_cast<off_t>(sector)*512;
+        return blockDev->writeBlock(buff,size,where)==size ? RES_OK : RES_ERROR;
+    }
+    if(dev->lseek(static_cast<off_t>(sector)*512,SEEK_SET)<0) return RES_ERROR;
+    if(dev->write(buff,count*512)!=static_cast<ssize_t>(count)*512) return RES_ERROR;
+    return RES_OK;
+}
+
+DRESULT FatDisk::bulkRead(BYTE *buff, DWORD sector, UINT count)
+{
+    //Bulk file data, bypass the cache. Write back the dirty sectors it holds
+    //first, so that the device has the latest data
+    for(unsigned int i=0;i<numEntries;i++)
+    {
+        Entry *e=&entries[i];
+        if(e->valid==false || e->dirty==false || e->sector-sector>=count)
+            continue;
+        if(deviceWrite(e->data,e->sector,1)!=RES_OK) return RES_ERROR;
+        e->dirty=false;
+        stats.writebacks++;
+    }
+    //Seeking and reading a device file must be done atomically
+    if(blockDev==nullptr || mutex==nullptr || release==false)
+        return deviceRead(buff,sector,count);
+    //Other threads calling FatFs meanwhile may not release the mutex
+    release=false;
+    mutex->unlock();
+    DRESULT result=deviceRead(buff,sector,count);
+    mutex->lock();
+    release=true;
+    if(result!=RES_OK) return result;
+    //The same file opened again may have written sectors of the range in the
+    //cache meanwhile, they are newer than what was read
+    for(unsigned int i=0;i<numEntries;i++)
+    {
+        Entry *e=&entries[i];
+        if(e->valid==false || e->sector-sector>=count) continue;
+        memcpy(buff+(e->sector-sector)*512,e->data,512);
+    }
+    return RES_OK;
+}
+
+DRESULT FatDisk::bulkWrite(const BYTE *buff, DWORD sector, UINT count)
+{
+    //Bulk file data, bypass the cache. The sectors it holds are superseded
+    invalidate(sector,count);
+    if(blockDev==nullptr || mutex==nullptr || release==false)
+        return deviceWrite(buff,sector,count);
+    release=false;
+    mutex->unlock();
+    DRESULT result=deviceWrite(buff,sector,count);
+    mutex->lock();
+    release=true;
+    //The same file opened again may have cached sectors of the range
+    //meanwhile, which the write superseded, or made stale if it failed
+    invalidate(sector,count);
+    return result;
+}
+
+void FatDisk::invalidate(DWORD sector, UINT count)
+{
+    for(unsigned int i=0;i<numEntries;i++)
+    {
+        Entry *e=&entries[i];
+        if(e->valid==false || e->sector-sector>=count) continue;
+        e->valid=false;
+        e->dirty=false;
+    }
+}
+
+FatDisk::Entry *FatDisk::lookup(DWORD sector)
+{
+    //Walk in LRU order, as recently used sectors are more likely to be hit
+    Entry *e=mru;
+    for(unsigned int i=0;i<numEntries;i++,e=e->next)
+        if(e->valid && e->sector==sector) return e;
+    return nullptr;
+}
+
+FatDisk::Entry *FatDisk::evict()
+{
+    Entry *e=mru->prev; //The list is circular, so this is the LRU entry
+    if(e->dirty)
+    {
+        if(deviceWrite(e->data,e->sector,1)!=RES_OK) return nullptr;
+        e->dirty=false;
+        stats.writebacks++;
+    }
+    e->valid=false;
+    return e;
+}
+
+void FatDisk::touch(Entry *e)
+{
+    if(e==mru) return;
+    //Unlink
+    e->prev->next=e->next;
+    e->next->prev=e->prev;
+    //Insert before the current most recently used entry
+    e->next=mru;
+    e->prev=mru->prev;
+    mru->prev->next=e;
+    mru->prev=e;
+    mru=e;
+}
+
+} //namespace miosix
+
 /**
  * \internal
  * Read one or more sectors from drive
  */
 DRESULT disk_read (
-    intrusive_ref_ptr<FileBase> pdrv,		/* Physical drive nmuber (0..) */
+    FatDisk& pdrv,		/* Physical drive nmuber (0..) */
 	BYTE *buff,		/* Data buffer to store read data */
 	DWORD sector,           /* Sector address (LBA) */
 	UINT count		/* Number of sectors to read (1..255) */
 )
 {
-    if(pdrv->lseek(static_cast<off_t>(sector)*512,SEEK_SET)<0) return RES_ERROR;
-    if(pdrv->read(buff,count*512)!=static_cast<ssize_t>(count)*512) return RES_ERROR;
-    return RES_OK;
+    return pdrv.read(buff,sector,count);
 }
 
 /**
@@ -62,15 +300,13 @@ DRESULT disk_read (
  * Write one or more sectors to drive
  */
 DRESULT disk_write (
-    intrusive_ref_ptr<FileBase> pdrv,		/* Physical drive nmuber (0..) */
+    FatDisk& pdrv,		/* Physical drive nmuber (0..) */
 	const BYTE *buff,	/* Data to be written */
 	DWORD sector,		/* Sector address (LBA) */
 	UINT count		/* Number of sectors to write (1..255) */
 )
 {
-    if(pdrv->lseek(static_cast<off_t>(sector)*512,SEEK_SET)<0) return RES_ERROR;
-    if(pdrv->write(buff,count*512)!=static_cast<ssize_t>(count)*512) return RES_ERROR;
-    return RES_OK;
+    return pdrv.write(buff,sector,count);
 }
 
 /**
@@ -78,7 +314,7 @@ DRESULT disk_write (
  * To perform disk functions other thar read/write
  */
 DRESULT disk_ioctl (
-    intrusive_ref_ptr<FileBase> pdrv,		/* Physical drive nmuber (0..) */
+    FatDisk& pdrv,		/* Physical drive nmuber (0..) */
 	BYTE ctrl,		/* Control code */
 	void *buff		/* Buffer to send/receive control data */
 )
@@ -86,7 +322,7 @@ DRESULT disk_ioctl (
     switch(ctrl)
     {
         case CTRL_SYNC:
-            if(pdrv->ioctl(IOCTL_SYNC,0)==0) return RES_OK; else return RES_ERROR;
+            return pdrv.sync();
         case GET_SECTOR_COUNT:
             return RES_ERROR; //unimplemented, so f_mkfs() does not work
         case GET_BLOCK_SIZE:
@@ -14,6 +14,9 @@
 
 #include "integer.h"
 #include <filesystem/file.h>
+#include <filesystem/ioctl.h>
+#include <filesystem/devfs/devfs.h>
+#include <kernel/sync.h>
 #include "config/miosix_settings.h"
 
 #ifdef WITH_FILESYSTEM
@@ -32,17 +35,196 @@ typedef enum {
 } DRESULT;
 
 
+namespace miosix {
+
+/**
+ * \internal
+ * The drive a FatFs volume is mounted on. Wraps the block device and adds a
+ * write-back LRU sector cache, so that the FAT and directory sectors that
+ * FatFs accesses repeatedly do not need to be read from the device every time.
+ *
+ * Single sector accesses, which FatFs uses for the FAT, directories and
+ * partial file sectors, go through the cache. Multi-sector accesses, which
+ * FatFs uses to transfer whole sectors of file data directly from/to the user
+ * buffer, bypass the cache so as not to evict the metadata, but are kept
+ * coherent with it. Dirty sectors are written back when evicted, and all of
+ * them are flushed on CTRL_SYNC, which FatFs issues on f_sync() and f_close().
+ *
+ * If the file the volume is mounted on is a block device, transfers are
+ * passed as a whole to Device::readBlock()/writeBlock(), so that a multi-sector
+ * access results in a single multi-block transfer, without a separate seek.
+ * In this case the filesystem mutex can also be released during multi-sector
+ * transfers, which only access the data sectors of a file, so that other
+ * files can be accessed in the meantime. As the same file may be open more
+ * than once, the sectors of the transfer that were cached meanwhile are made
+ * coherent with it once the mutex is locked again.
+ *
+ * Not thread safe, FatFs calls are serialized by the filesystem mutex.
+ */
+class FatDisk
+{
+public:
+    /**
+     * Constructor, the drive has no device
+     */
+    FatDisk() {}
+
+    /**
+     * Set the device and allocate the cache
+     * \param device block device
+     * \param cacheSectors number of sectors in the cache, 0 to disable it
+     */
+    void setDevice(intrusive_ref_ptr<FileBase> device, unsigned int cacheSectors);
+
+    /**
+     * \param mutex filesystem mutex, locked when FatFs calls read() and write()
+     */
+    void setMutex(FastMutex *mutex) { this->mutex=mutex; }
+
+    /**
+     * Allows multi-sector transfers to release the filesystem mutex while
+     * the object exists. The mutex is recursive, so the thread creating the
+     * object must have locked it exactly once, or releasing it would not let
+     * other threads in. The object must be destroyed with the mutex locked
+     */
+    class AllowRelease
+    {
+    public:
+        /**
+         * \param disk the drive, whose filesystem mutex is locked once
+         */
+        explicit AllowRelease(FatDisk& disk) : disk(disk), prev(disk.release)
+        {
+            disk.release=true;
+        }
+
+        ~AllowRelease() { disk.release=prev; }
+
+        AllowRelease(const AllowRelease&) = delete;
+        AllowRelease& operator=(const AllowRelease&) = delete;
+
+    private:
+        FatDisk& disk;
+        bool prev;
+    };
+
+    /**
+     * Read sectors
+     * \param buff buffer where read data is stored
+     * \param sector first sector to read
+     * \param count number of sectors to read
+     * \return RES_OK on success
+     */
+    DRESULT read(BYTE *buff, DWORD sector, UINT count);
+
+    /**
+     * Write sectors
+     * \param buff data to write
+     * \param sector first sector to write
+     * \param count number of sectors to write
+     * \return RES_OK on success
+     */
+    DRESULT write(const BYTE *buff, DWORD sector, UINT count);
+
+    /**
+     * Write back all dirty sectors and sync the device
+     * \return RES_OK on success
+     */
+    DRESULT sync();
+
+    /**
+     * Sync, then release the device and the cache
+     */
+    void reset();
+
+    /**
+     * \return the cache statistics
+     */
+    CacheStats getStats() const { return stats; }
+
+    /**
+     * \return the underlying device
+     */
+    FileBase *device() const { return dev.get(); }
+
+    /**
+     * Destructor
+     */
+    ~FatDisk();
+
+    FatDisk(const FatDisk&) = delete;
+    FatDisk& operator=(const FatDisk&) = delete;
+
+private:
+    /**
+     * A cached sector
+     */
+    struct Entry
+    {
+        DWORD sector;  ///< Sector number
+        Entry *prev;   ///< Previous entry in LRU order, more recently used
+        Entry *next;   ///< Next entry in LRU order, less recently used
+        BYTE *data;    ///< Sector data
+        bool valid;    ///< True if the entry contains a sector
+        bool dirty;    ///< True if the sector needs to be written back
+    };
+
+    DRESULT deviceRead(BYTE *buff, DWORD sector, UINT count);
+    DRESULT deviceWrite(const BYTE *buff, DWORD sector, UINT count);
+
+    /**
+     * Multi-sector transfers, releasing the filesystem mutex if allowed
+     */
+    DRESULT bulkRead(BYTE *buff, DWORD sector, UINT count);
+    DRESULT bulkWrite(const BYTE *buff, DWORD sector, UINT count);
+
+    /**
+     * Invalidate the cached sectors in a range
+     * \param sector first sector of the range
+     * \param count number of sectors in the range
+     */
+    void invalidate(DWORD sector, UINT count);
+
+    /**
+     * \return the entry caching sector, or nullptr
+     */
+    Entry *lookup(DWORD sector);
+
+    /**
+     * \return the least recently used entry, written back if dirty, or
+     * nullptr on write back failure
+     */
+    Entry *evict();
+
+    /**
+     * Move an entry to the most recently used position
+     */
+    void touch(Entry *e);
+
+    intrusive_ref_ptr<FileBase> dev; ///< Block device
+    Device *blockDev=nullptr;        ///< Device for direct I/O, or nullptr
+    FastMutex *mutex=nullptr;        ///< Filesystem mutex, or nullptr
+    bool release=false;              ///< True if the mutex can be released
+    Entry *entries=nullptr;          ///< Cache entries
+    BYTE *buffer=nullptr;            ///< Sector data of all entries
+    Entry *mru=nullptr;              ///< Most recently used entry
+    unsigned int numEntries=0;       ///< Number of cache entries
+    CacheStats stats={0,0,0};        ///< Cache statistics
+};
+
+} //namespace miosix
+
 /*---------------------------------------*/
 /* Prototypes for disk control functions */
 
 
-DSTATUS disk_initialize (miosix::intrusive_ref_ptr<miosix::FileBase> pdrv);
-DSTATUS disk_status (miosix::intrusive_ref_ptr<miosix::FileBase> pdrv);
-DRESULT disk_read (miosix::intrusive_ref_ptr<miosix::FileBase> pdrv,
+DSTATUS disk_initialize (miosix::FatDisk& pdrv);
+DSTATUS disk_status (miosix::FatDisk& pdrv);
+DRESULT disk_read (miosix::FatDisk& pdrv,
         BYTE*buff, DWORD sector, UINT count);
-DRESULT disk_write (miosix::intrusive_ref_ptr<miosix::FileBase> pdrv,
+DRESULT disk_write (miosix::FatDisk& pdrv,
         const BYTE* buff, DWORD sector, UINT count);
-DRESULT disk_ioctl (miosix::intrusive_ref_ptr<miosix::FileBase> pdrv,
+DRESULT disk_ioctl (miosix::FatDisk& pdrv,
         BYTE cmd, void* buff);
 
 
@@ -35,8 +35,10 @@
 #include <cstring>
 #include <string>
 #include <cstdio>
+#include <algorithm>
 #include "filesystem/stringpart.h"
 #include "filesystem/ioctl.h"
+#include "filesystem/aio.h"
 #include "util/unicode.h"
 
 using namespace std;
@@ -181,6 +183,19 @@ Fat32Directory::~Fat32Directory()
 
 /**
  * Files of the Fat32Fs filesystem
+ *
+ * Each file has its own mutex, that serializes accesses to the file, and is
+ * locked before the parent filesystem's mutex, that serializes the FatFs code
+ * accessing the FAT, directories and the sector cache. The filesystem's mutex
+ * is released while FatFs transfers whole sectors of file data between the
+ * device and the user buffer, see FatDisk, so that a long read or write of a
+ * file does not block accesses to other files.
+ *
+ * In streaming mode, enabled with IOCTL_STREAMING, a worker thread reads
+ * ahead and writes behind using two buffers, so that sequential reads and
+ * writes overlap with the computation of the caller. While streaming, the
+ * FatFs file object is used only by the worker, and the other operations wait
+ * for the worker to finish the pending transfers before accessing it.
  */
 class Fat32File : public FileBase
 {
@@ -188,6 +203,7 @@ public:
     /**
      * Constructor
      * \param parent the filesystem to which this file belongs
+     * \param mutex the parent filesystem's mutex
      */
     Fat32File(intrusive_ref_ptr<FilesystemBase> parent, FastMutex& mutex);
     
@@ -209,6 +225,48 @@ public:
      */
     virtual ssize_t read(void *data, size_t len);
     
+    /**
+     * Write data to the file from multiple buffers. No other operation on
+     * the file can happen between the writes of the buffers.
+     * \param iov buffers with the data to write
+     * \param iovcnt number of buffers
+     * \return the number of written characters, or a negative number in case
+     * of errors
+     */
+    virtual ssize_t writev(const struct iovec *iov, int iovcnt);
+    
+    /**
+     * Read data from the file into multiple buffers. No other operation on
+     * the file can happen between the reads of the buffers.
+     * \param iov buffers to store read data
+     * \param iovcnt number of buffers
+     * \return the number of read characters, or a negative number in case
+     * of errors
+     */
+    virtual ssize_t readv(const struct iovec *iov, int iovcnt);
+    
+    /**
+     * Write data at a given position in the file, without moving the file
+     * pointer. Writing past the end of the file zero fills the gap.
+     * \param data the data to write
+     * \param len the number of bytes to write
+     * \param pos offset from the beginning of the file
+     * \return the number of written characters, or a negative number in case
+     * of errors
+     */
+    virtual ssize_t pwrite(const void *data, size_t len, off_t pos);
+    
+    /**
+     * Read data from a given position in the file, without moving the file
+     * pointer.
+     * \param data buffer to store read data
+     * \param len the number of bytes to read
+     * \param pos offset from the beginning of the file
+     * \return the number of read characters, or a negative number in case
+     * of errors
+     */
+    virtual ssize_t pread(void *data, size_t len, off_t pos);
+    
     /**
      * Move file pointer, if the file supports random-access.
      * \param pos offset to sum to the beginning of the file, current position
@@ -226,14 +284,56 @@ public:
      */
     virtual int fstat(struct stat *pstat) const;
     
+    /**
+     * Truncate or extend the file to a given size. If the file is extended,
+     * the new clusters are allocated contiguously if possible.
+     * \param size new file size
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int ftruncate(off_t size);
+    
+    /**
+     * Allocate a contiguous run of clusters for a range of the file, so that
+     * writing to it does not need to allocate clusters and update the FAT.
+     * \param offset start of the range
+     * \param len length of the range
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int fallocate(off_t offset, off_t len);
+    
     /**
      * Perform various operations on a file descriptor
      * \param cmd specifies the operation to perform
      * \param arg optional argument that some operation require
      * \return the exact return value depends on CMD, -1 is returned on error
+     *
+     * In addition to IOCTL_SYNC, Fat32File supports IOCTL_GET_CACHE_STATS,
+     * with a pointer to a CacheStats as argument, and IOCTL_FAST_SEEK, with
+     * a pointer to an unsigned int as argument, to enable fast seek with the
+     * given memory budget in bytes (FAT32_FASTSEEK_MAX_BYTES if the pointer is
+     * null) or disable it if the budget is zero. With fast seek enabled, the
+     * first seek far from the current position builds a table of the cluster
+     * chain of the file, so that subsequent seeks do not need to follow the
+     * chain through the FAT. IOCTL_STREAMING, with a pointer to an unsigned
+     * int as argument, enables streaming mode with two buffers of the given
+     * size (FAT32_STREAM_BUFFER_SIZE if the pointer is null), or disables it
+     * if the size is zero. Errors of writes done behind are reported by the
+     * next operation on the file, or if the file is closed first by the next
+     * IOCTL_SYNC of a file of the same filesystem, and the size returned by
+     * fstat does not include the data not yet written behind.
      */
     virtual int ioctl(int cmd, void *arg);
     
+    /**
+     * Start an asynchronous request. In streaming mode, requests using the
+     * file pointer that can be served by copying to or from the buffers
+     * complete immediately, the others are performed by the worker thread.
+     * \param req the request
+     * \return 0 if the request was completed, or -EOPNOTSUPP if it must be
+     * performed by the worker thread
+     */
+    virtual int aioSubmit(AioRequest *req);
+    
     /**
      * \return the FatFs FIL object 
      */
@@ -250,9 +350,146 @@ public:
     ~Fat32File();
     
 private:
+    /**
+     * Write data at the file pointer
+     * \param fl lock on fileMutex
+     */
+    ssize_t writeLocked(Lock<FastMutex>& fl, const void *data, size_t len);
+    
+    /**
+     * Read data at the file pointer
+     * \param fl lock on fileMutex
+     */
+    ssize_t readLocked(Lock<FastMutex>& fl, void *data, size_t len);
+    
+    /**
+     * \param pos seek destination
+     * \return true if seeking to pos requires following the cluster chain
+     * from the beginning of the file
+     */
+    bool farSeek(DWORD pos) const;
+
+    /**
+     * Preallocate clusters up to size and fill the file with zeros up to it
+     * \param size new file size, must be greater than the current one
+     * \return 0 on success, or a negative number on failure
+     */
+    int extend(DWORD size);
+
+    /**
+     * Build the cluster link map within the memory budget, if possible
+     */
+    void buildLinkMap();
+
+    /**
+     * Stop using the cluster link map, because the file cluster chain changed
+     */
+    void dropLinkMap();
+
+    /**
+     * Enable, resize or disable streaming mode
+     * \param fl lock on fileMutex
+     * \param bufferSize size of each buffer, 0 to disable streaming mode
+     * \return 0 on success, or a negative number on failure
+     */
+    int setStreaming(Lock<FastMutex>& fl, unsigned int bufferSize);
+
+    /**
+     * Wait for the worker to complete the pending writes, discard the data
+     * read ahead and move the file pointer of the FatFs file object to the
+     * position seen by the caller
+     * \param fl lock on fileMutex
+     * \return 0, or the first error of the writes done behind
+     */
+    int streamDrain(Lock<FastMutex>& fl);
+
+    /**
+     * Read through the read ahead buffers
+     */
+    ssize_t streamRead(Lock<FastMutex>& fl, void *data, size_t len);
+
+    /**
+     * Write through the write behind buffers
+     */
+    ssize_t streamWrite(Lock<FastMutex>& fl, const void *data, size_t len);
+
+    /**
+     * Queue free buffers for reading the data that follows pos
+     */
+    void streamPrefetch(DWORD pos);
+
+    /**
+     * \return true if there is data not yet written to the FatFs file object
+     */
+    bool streamWriting() const;
+
+    /**
+     * \param len number of bytes
+     * \return true if streamRead() can read len bytes without waiting
+     */
+    bool streamCanRead(size_t len) const;
+
+    /**
+     * \param len number of bytes
+     * \return true if streamWrite() can write len bytes without waiting
+     */
+    bool streamCanWrite(size_t len) const;
+
+    static void *streamLauncher(void *arg);
+    void streamWorker();
+
+    /**
+     * State of a streaming buffer
+     */
+    enum BufferState
+    {
+        FREE,     ///< Unused
+        FILLING,  ///< Being filled by write()
+        TO_WRITE, ///< Full, waiting for the worker to write it
+        WRITING,  ///< The worker is writing it
+        TO_READ,  ///< Waiting for the worker to read data into it
+        READING,  ///< The worker is reading data into it
+        READY     ///< Contains data read ahead
+    };
+
+    /**
+     * A streaming buffer
+     */
+    struct StreamBuffer
+    {
+        char *data;        ///< Buffer memory
+        DWORD offset;      ///< File offset of the first byte of the buffer
+        unsigned int size; ///< Bytes written to, or read into the buffer
+        BufferState state; ///< Buffer state
+    };
+
+    /**
+     * Streaming mode state, all fields are protected by fileMutex
+     */
+    struct Stream
+    {
+        Thread *worker;          ///< Worker thread
+        ConditionVariable cv;    ///< Signaled when a buffer changes state
+        StreamBuffer buffers[2]; ///< Double buffers
+        unsigned int bufferSize; ///< Size of each buffer
+        DWORD pos;               ///< File position seen by the caller
+        int error;               ///< First error of the writes done behind
+        bool quit;               ///< Tells the worker to terminate
+    };
+
     FIL file;
-    FastMutex& mutex;
+    FastMutex fileMutex; ///< Mutex serializing accesses to this file
+    FastMutex& mutex;    ///< Parent filesystem's mutex
     int inode;
+    Fat32File *nextWritten; ///< Next file in the parent's list of files to sync
+    bool written;           ///< True if the file is in that list
+    DWORD *linkMap;         ///< Cluster link map, or nullptr
+    unsigned int linkMapSize; ///< Allocated size of linkMap in DWORDs
+    unsigned int linkMapBudget; ///< Link map memory budget, 0 if disabled
+    DWORD linkMapFailedSize; ///< File size when building the map failed
+    Stream *stream;         ///< Streaming mode state, or nullptr
+
+    friend class Fat32Fs; //Needs nextWritten, written, fileMutex
 };
 
 //
@@ -260,22 +497,121 @@ private:
 //
 
 Fat32File::Fat32File(intrusive_ref_ptr<FilesystemBase> parent, FastMutex& mutex)
-        : FileBase(parent), mutex(mutex), inode(0) {}
+        : FileBase(parent), mutex(mutex), inode(0), nextWritten(nullptr),
+          written(false), linkMap(nullptr), linkMapSize(0), linkMapBudget(0),
+          linkMapFailedSize(0xffffffff), stream(nullptr) {}
 
 ssize_t Fat32File::write(const void *data, size_t len)
 {
+    Lock<FastMutex> fl(fileMutex);
+    return writeLocked(fl,data,len);
+}
+
+ssize_t Fat32File::read(void *data, size_t len)
+{
+    Lock<FastMutex> fl(fileMutex);
+    return readLocked(fl,data,len);
+}
+
+ssize_t Fat32File::writev(const struct iovec *iov, int iovcnt)
+{
+    Lock<FastMutex> fl(fileMutex);
+    ssize_t total=0;
+    for(int i=0;i<iovcnt;i++)
+    {
+        if(iov[i].iov_len==0) continue;
+        ssize_t result=writeLocked(fl,iov[i].iov_base,iov[i].iov_len);
+        if(result<0) return total>0 ? total : result;
+        total+=result;
+        if(static_cast<size_t>(result)<iov[i].iov_len) break;
+    }
+    return total;
+}
+
+ssize_t Fat32File::readv(const struct iovec *iov, int iovcnt)
+{
+    Lock<FastMutex> fl(fileMutex);
+    ssize_t total=0;
+    for(int i=0;i<iovcnt;i++)
+    {
+        if(iov[i].iov_len==0) continue;
+        ssize_t result=readLocked(fl,iov[i].iov_base,iov[i].iov_len);
+        if(result<0) return total>0 ? total : result;
+        total+=result;
+        if(static_cast<size_t>(result)<iov[i].iov_len) break;
+    }
+    return total;
+}
+
+ssize_t Fat32File::pwrite(const void *data, size_t len, off_t pos)
+{
+    if(pos+static_cast<off_t>(len)>0xffffffff) return -EFBIG;
+    Lock<FastMutex> fl(fileMutex);
+    //Also drops the data read ahead, that the write may make stale
+    if(stream) if(int result=streamDrain(fl)) return result;
+    Lock<FastMutex> l(mutex);
+    FatDisk::AllowRelease ar(file.fs->drv);
+    if((file.flag & FA_WRITE)==0) return -EBADF;
+    DWORD saved=f_tell(&file);
+    if(pos>static_cast<off_t>(f_size(&file)))
+    {
+        dropLinkMap();
+        if(int result=extend(pos))
+        {
+            f_lseek(&file,saved);
+            return result;
+        }
+    }
+    if(pos+len>f_size(&file)) dropLinkMap();
+    else if(linkMapBudget && file.cltbl==nullptr && farSeek(pos)) buildLinkMap();
+    unsigned int bytesWritten=0;
+    int result=translateError(f_lseek(&file,pos));
+    if(result==0) result=translateError(f_write(&file,data,len,&bytesWritten));
+    f_lseek(&file,saved);
+    if(result) return result;
+    auto fs=static_cast<Fat32Fs*>(getParent().get());
+    if(int res=fs->fileWritten(this,bytesWritten)) return res;
+    return static_cast<int>(bytesWritten);
+}
+
+ssize_t Fat32File::pread(void *data, size_t len, off_t pos)
+{
+    Lock<FastMutex> fl(fileMutex);
+    //The data read ahead is kept, the read does not change it
+    if(stream && streamWriting())
+        if(int result=streamDrain(fl)) return result;
     Lock<FastMutex> l(mutex);
+    FatDisk::AllowRelease ar(file.fs->drv);
+    if(pos>=static_cast<off_t>(f_size(&file))) return 0;
+    if(linkMapBudget && file.cltbl==nullptr && farSeek(pos)) buildLinkMap();
+    DWORD saved=f_tell(&file);
+    unsigned int bytesRead=0;
+    int result=translateError(f_lseek(&file,pos));
+    if(result==0) result=translateError(f_read(&file,data,len,&bytesRead));
+    f_lseek(&file,saved);
+    if(result) return result;
+    return static_cast<int>(bytesRead);
+}
+
+ssize_t Fat32File::writeLocked(Lock<FastMutex>& fl, const void *data, size_t len)
+{
+    if(stream) return streamWrite(fl,data,len);
+    Lock<FastMutex> l(mutex);
+    FatDisk::AllowRelease ar(file.fs->drv);
+    //The link map does not allow to allocate clusters, drop it if extending
+    if(file.cltbl && f_tell(&file)+len>f_size(&file)) dropLinkMap();
     unsigned int bytesWritten;
     if(int res=translateError(f_write(&file,data,len,&bytesWritten))) return res;
-    #ifdef SYNC_AFTER_WRITE
-    if(f_sync(&file)!=FR_OK) return -EIO;
-    #endif //SYNC_AFTER_WRITE    
+    auto fs=static_cast<Fat32Fs*>(getParent().get());
+    if(int res=fs->fileWritten(this,bytesWritten)) return res;
     return static_cast<int>(bytesWritten);
 }
 
-ssize_t Fat32File::read(void *data, size_t len)
+ssize_t Fat32File::readLocked(Lock<FastMutex>& fl, void *data, size_t len)
 {
+    if(stream) return streamRead(fl,data,len);
     Lock<FastMutex> l(mutex);
+    FatDisk::AllowRelease ar(file.fs->drv);
     unsigned int bytesRead;
     if(int res=translateError(f_read(&file,data,len,&bytesRead))) return res;
     return static_cast<int>(bytesRead);
@@ -283,12 +619,16 @@ ssize_t Fat32File::read(void *data, size_t len)
 
 off_t Fat32File::lseek(off_t pos, int whence)
 {
+    Lock<FastMutex> fl(fileMutex);
+    //The data read ahead is kept, as buffers are looked up by file offset
+    if(stream && streamWriting())
+        if(int result=streamDrain(fl)) return result;
     Lock<FastMutex> l(mutex);
     off_t offset;
     switch(whence)
     {
         case SEEK_CUR:
-            offset=static_cast<off_t>(f_tell(&file))+pos;
+            offset=static_cast<off_t>(stream ? stream->pos : f_tell(&file))+pos;
             break;
         case SEEK_SET:
             offset=pos;
@@ -301,6 +641,13 @@ off_t Fat32File::lseek(off_t pos, int whence)
     }
     //We don't support seek past EOF for Fat32
     if(offset<0 || offset>static_cast<off_t>(f_size(&file))) return -EOVERFLOW;
+    if(stream)
+    {
+        //The worker seeks the FatFs file object when needed
+        stream->pos=offset;
+        return offset;
+    }
+    if(linkMapBudget && file.cltbl==nullptr && farSeek(offset)) buildLinkMap();
     if(int result=translateError(
         f_lseek(&file,static_cast<unsigned long>(offset)))) return result;
     return offset;
@@ -319,27 +666,500 @@ int Fat32File::fstat(struct stat *pstat) const
     return 0;
 }
 
+int Fat32File::ftruncate(off_t size)
+{
+    if(size>0xffffffff) return -EFBIG;
+    Lock<FastMutex> fl(fileMutex);
+    if(stream) if(int result=streamDrain(fl)) return result;
+    Lock<FastMutex> l(mutex);
+    if((file.flag & FA_WRITE)==0) return -EBADF;
+    //The link map does not track changes to the cluster chain
+    dropLinkMap();
+    DWORD pos=f_tell(&file);
+    int result;
+    if(size<=f_size(&file))
+    {
+        result=translateError(f_lseek(&file,size));
+        if(result==0) result=translateError(f_truncate(&file));
+        if(result==0)
+            result=static_cast<Fat32Fs*>(getParent().get())->fileWritten(this,0);
+    } else result=extend(size);
+    f_lseek(&file,std::min<DWORD>(pos,f_size(&file)));
+    return result;
+}
+
+int Fat32File::fallocate(off_t offset, off_t len)
+{
+    if(offset+len>0xffffffff) return -EFBIG;
+    Lock<FastMutex> fl(fileMutex);
+    if(stream) if(int result=streamDrain(fl)) return result;
+    Lock<FastMutex> l(mutex);
+    if((file.flag & FA_WRITE)==0) return -EBADF;
+    dropLinkMap();
+    DWORD end=offset+len;
+    if(end<=f_size(&file)) return translateError(f_prealloc(&file,end));
+    DWORD pos=f_tell(&file);
+    int result=extend(end);
+    f_lseek(&file,pos);
+    return result;
+}
+
 int Fat32File::ioctl(int cmd, void *arg)
 {
-    if(cmd!=IOCTL_SYNC) return -ENOTTY;
+    Lock<FastMutex> fl(fileMutex);
+    if(cmd==IOCTL_STREAMING)
+        return setStreaming(fl,arg ? *reinterpret_cast<unsigned int*>(arg)
+                                   : FAT32_STREAM_BUFFER_SIZE);
+    if(stream) if(int result=streamDrain(fl)) return result;
     Lock<FastMutex> l(mutex);
-    return translateError(f_sync(&file));
+    switch(cmd)
+    {
+        case IOCTL_SYNC:
+        {
+            auto fs=static_cast<Fat32Fs*>(getParent().get());
+            fs->fileSynced(this);
+            int result=translateError(f_sync(&file));
+            if(result==0) std::swap(result,fs->closeError);
+            return result;
+        }
+        case IOCTL_GET_CACHE_STATS:
+            if(arg==nullptr) return -EFAULT;
+            *reinterpret_cast<CacheStats*>(arg)=file.fs->drv.getStats();
+            return 0;
+        case IOCTL_FAST_SEEK:
+            dropLinkMap();
+            linkMapBudget=arg ? *reinterpret_cast<unsigned int*>(arg)
+                              : FAT32_FASTSEEK_MAX_BYTES;
+            if(linkMapBudget==0)
+            {
+                delete[] linkMap;
+                linkMap=nullptr;
+                linkMapSize=0;
+            }
+            return 0;
+        default:
+            return -ENOTTY;
+    }
+}
+
+int Fat32File::aioSubmit(AioRequest *req)
+{
+    if(req->offset>=0) return -EOPNOTSUPP;
+    ssize_t result;
+    {
+        Lock<FastMutex> fl(fileMutex);
+        if(stream==nullptr) return -EOPNOTSUPP;
+        if(req->op==AioRequest::READ)
+        {
+            if(streamCanRead(req->size)==false) return -EOPNOTSUPP;
+            result=streamRead(fl,req->buffer,req->size);
+        } else {
+            if(streamCanWrite(req->size)==false) return -EOPNOTSUPP;
+            result=streamWrite(fl,req->buffer,req->size);
+        }
+    }
+    req->complete(result);
+    return 0;
 }
 
 Fat32File::~Fat32File()
 {
+    //The data written behind and the directory entry are flushed here, as
+    //there is no one to return errors to, the first one is recorded in the
+    //filesystem and reported by the next fsync() of one of its files
+    int result=0;
+    if(stream)
+    {
+        Lock<FastMutex> fl(fileMutex);
+        result=setStreaming(fl,0);
+    }
+    auto fs=static_cast<Fat32Fs*>(getParent().get());
+    Lock<FastMutex> l(mutex);
+    fs->fileSynced(this);
+    if(inode)
+    {
+        int closeResult=translateError(f_close(&file));
+        if(result==0) result=closeResult;
+    }
+    if(fs->closeError==0) fs->closeError=result;
+    delete[] linkMap;
+}
+
+int Fat32File::extend(DWORD size)
+{
+    //Allocate all clusters at once, so that they are contiguous, then zero
+    //fill them with multi-sector writes, that bypass the sector cache
+    if(int result=translateError(f_prealloc(&file,size))) return result;
+    if(int result=translateError(f_lseek(&file,f_size(&file)))) return result;
+    const unsigned int zeroSize=4096;
+    char *zeros=new char[zeroSize]();
+    int result=0;
+    DWORD filled=0;
+    while(f_size(&file)<size)
+    {
+        UINT toWrite=std::min<DWORD>(zeroSize,size-f_size(&file));
+        UINT written;
+        result=translateError(f_write(&file,zeros,toWrite,&written));
+        filled+=written;
+        if(result==0 && written!=toWrite) result=-ENOSPC;
+        if(result) break;
+    }
+    delete[] zeros;
+    int syncResult=static_cast<Fat32Fs*>(getParent().get())->fileWritten(this,filled);
+    return result ? result : syncResult;
+}
+
+bool Fat32File::farSeek(DWORD pos) const
+{
+    //Seeking forward within the next cluster is cheap also without link map
+    DWORD clusterSize=file.fs->csize*512;
+    DWORD from=f_tell(&file)/clusterSize;
+    DWORD to=pos/clusterSize;
+    return to<from || to>from+1;
+}
+
+void Fat32File::buildLinkMap()
+{
+    //Don't retry every seek if the map didn't fit, only if the file changed
+    if(f_size(&file)==linkMapFailedSize) return;
+    //Size in DWORDs to give to FatFs. The first element of the map contains
+    //it and is overwritten by FatFs with the required size, so the size of
+    //the allocation is kept in linkMapSize
+    unsigned int size=linkMapSize;
+    const unsigned int maxSize=linkMapBudget/sizeof(DWORD);
+    if(size<4) size=std::min(16u,maxSize);
+    for(;;)
+    {
+        if(size<4) break; //Budget too small even for one fragment
+        if(linkMapSize<size)
+        {
+            delete[] linkMap;
+            linkMap=nullptr;
+            linkMapSize=0;
+            linkMap=new DWORD[size];
+            linkMapSize=size;
+        }
+        linkMap[0]=size;
+        file.cltbl=linkMap;
+        FRESULT res=f_lseek(&file,CREATE_LINKMAP);
+        if(res==FR_OK) return;
+        file.cltbl=nullptr;
+        //FatFs returns the required size in the first element
+        if(res!=FR_NOT_ENOUGH_CORE || linkMap[0]>maxSize) break;
+        size=linkMap[0];
+    }
+    linkMapFailedSize=f_size(&file);
+}
+
+void Fat32File::dropLinkMap()
+{
+    //The allocation is kept, to be reused when rebuilding the map
+    file.cltbl=nullptr;
+    linkMapFailedSize=0xffffffff;
+}
+
+int Fat32File::setStreaming(Lock<FastMutex>& fl, unsigned int bufferSize)
+{
+    //Buffers are whole sectors, so that FatFs can transfer them directly
+    bufferSize=(bufferSize+511) & ~511;
+    if(stream)
+    {
+        if(bufferSize==stream->bufferSize) return 0;
+        int result=streamDrain(fl);
+        stream->quit=true;
+        stream->cv.broadcast();
+        {
+            Unlock<FastMutex> u(fl);
+            stream->worker->join();
+        }
+        delete[] stream->buffers[0].data;
+        delete stream;
+        stream=nullptr;
+        if(result || bufferSize==0) return result;
+    }
+    if(bufferSize==0) return 0;
+    stream=new Stream;
+    stream->buffers[0].data=new char[2*bufferSize];
+    stream->buffers[1].data=stream->buffers[0].data+bufferSize;
+    for(auto& b : stream->buffers) b.state=FREE;
+    stream->bufferSize=bufferSize;
+    stream->pos=f_tell(&file);
+    stream->error=0;
+    stream->quit=false;
+    stream->worker=Thread::create(streamLauncher,STACK_DEFAULT_FOR_PTHREAD,
+                                  MAIN_PRIORITY,this,Thread::JOINABLE);
+    if(stream->worker) return 0;
+    delete[] stream->buffers[0].data;
+    delete stream;
+    stream=nullptr;
+    return -ENOMEM;
+}
+
+int Fat32File::streamDrain(Lock<FastMutex>& fl)
+{
+    for(auto& b : stream->buffers)
+    {
+        if(b.state==FILLING) b.state=b.size>0 ? TO_WRITE : FREE;
+        else if(b.state==TO_READ || b.state==READY) b.state=FREE;
+    }
+    stream->cv.broadcast();
+    for(;;)
+    {
+        bool busy=false;
+        for(auto& b : stream->buffers)
+        {
+            if(b.state==READY) b.state=FREE; //Completed while waiting
+            else if(b.state!=FREE) busy=true;
+        }
+        if(busy==false) break;
+        stream->cv.wait(fl);
+    }
+    int result=stream->error;
+    stream->error=0;
     Lock<FastMutex> l(mutex);
-    if(inode) f_close(&file); //TODO: what to do with error code?
+    if(f_tell(&file)!=stream->pos)
+    {
+        int seekResult=translateError(f_lseek(&file,stream->pos));
+        if(result==0) result=seekResult;
+    }
+    return result;
+}
+
+ssize_t Fat32File::streamRead(Lock<FastMutex>& fl, void *data, size_t len)
+{
+    if(streamWriting()) if(int result=streamDrain(fl)) return result;
+    char *out=reinterpret_cast<char*>(data);
+    size_t done=0;
+    while(done<len && stream->error==0)
+    {
+        DWORD pos=stream->pos;
+        if(pos>=f_size(&file)) break;
+        StreamBuffer *b=nullptr;
+        for(auto& x : stream->buffers)
+        {
+            if(x.state!=TO_READ && x.state!=READING && x.state!=READY) continue;
+            DWORD end=x.offset+(x.state==READY ? x.size : stream->bufferSize);
+            if(pos>=x.offset && pos<end) b=&x;
+        }
+        if(b==nullptr)
+        {
+            //Not read ahead, either the first read or a seek happened. Drop
+            //the data read ahead, and start reading ahead from here
+            bool reading=false;
+            for(auto& x : stream->buffers)
+            {
+                if(x.state==TO_READ || x.state==READY) x.state=FREE;
+                else if(x.state==READING) reading=true;
+            }
+            if(reading) stream->cv.wait(fl);
+            else streamPrefetch(pos);
+            continue;
+        }
+        if(b->state!=READY)
+        {
+            stream->cv.wait(fl);
+            continue;
+        }
+        unsigned int n=std::min<DWORD>(len-done,b->offset+b->size-pos);
+        memcpy(out+done,b->data+(pos-b->offset),n);
+        done+=n;
+        stream->pos+=n;
+        if(stream->pos==b->offset+b->size) b->state=FREE;
+        streamPrefetch(stream->pos);
+    }
+    if(done>0) return done;
+    int result=stream->error;
+    stream->error=0;
+    return result;
+}
+
+ssize_t Fat32File::streamWrite(Lock<FastMutex>& fl, const void *data, size_t len)
+{
+    if(stream->error)
+    {
+        int result=stream->error;
+        stream->error=0;
+        return result;
+    }
+    //Drop the data read ahead, the worker may still be reading, but it only
+    //writes buffers in file order after that
+    for(auto& b : stream->buffers)
+        if(b.state==TO_READ || b.state==READY) b.state=FREE;
+    const char *in=reinterpret_cast<const char*>(data);
+    size_t done=0;
+    while(done<len)
+    {
+        StreamBuffer *b=nullptr;
+        for(auto& x : stream->buffers) if(x.state==FILLING) b=&x;
+        if(b==nullptr)
+        {
+            for(auto& x : stream->buffers)
+            {
+                if(x.state==READY) x.state=FREE; //Read ahead completed late
+                if(x.state==FREE) b=&x;
+            }
+            if(b==nullptr)
+            {
+                stream->cv.wait(fl);
+                continue;
+            }
+            b->state=FILLING;
+            b->offset=stream->pos;
+            b->size=0;
+        }
+        unsigned int n=std::min<size_t>(len-done,stream->bufferSize-b->size);
+        memcpy(b->data+b->size,in+done,n);
+        b->size+=n;
+        done+=n;
+        stream->pos+=n;
+        if(b->size==stream->bufferSize)
+        {
+            b->state=TO_WRITE;
+            stream->cv.broadcast();
+        }
+    }
+    return done;
+}
+
+void Fat32File::streamPrefetch(DWORD pos)
+{
+    //Read ahead after the data that is already being read ahead
+    DWORD next=pos;
+    for(auto& b : stream->buffers)
+    {
+        if(b.state==TO_READ || b.state==READING)
+            next=std::max<DWORD>(next,b.offset+stream->bufferSize);
+        else if(b.state==READY)
+            next=std::max<DWORD>(next,b.offset+b.size);
+    }
+    for(auto& b : stream->buffers)
+    {
+        if(b.state!=FREE || next>=f_size(&file)) continue;
+        b.state=TO_READ;
+        b.offset=next;
+        b.size=0;
+        next+=stream->bufferSize;
+        stream->cv.broadcast();
+    }
+}
+
+bool Fat32File::streamWriting() const
+{
+    for(auto& b : stream->buffers)
+        if(b.state==FILLING || b.state==TO_WRITE || b.state==WRITING)
+            return true;
+    return false;
+}
+
+bool Fat32File::streamCanRead(size_t len) const
+{
+    if(streamWriting()) return false;
+    //Follow the buffers read ahead from the file position, till the end of
+    //the request or of the file
+    DWORD pos=stream->pos;
+    for(;;)
+    {
+        if(pos>=f_size(&file) || pos-stream->pos>=len) return true;
+        const StreamBuffer *b=nullptr;
+        for(auto& x : stream->buffers)
+            if(x.state==READY && pos>=x.offset && pos<x.offset+x.size) b=&x;
+        if(b==nullptr) return false;
+        pos=b->offset+b->size;
+    }
+}
+
+bool Fat32File::streamCanWrite(size_t len) const
+{
+    //Data read ahead is dropped when writing, so those buffers count as free
+    size_t room=0;
+    for(auto& b : stream->buffers)
+    {
+        if(b.state==FILLING) room+=stream->bufferSize-b.size;
+        else if(b.state==FREE || b.state==TO_READ || b.state==READY)
+            room+=stream->bufferSize;
+    }
+    return room>=len;
+}
+
+void *Fat32File::streamLauncher(void *arg)
+{
+    reinterpret_cast<Fat32File*>(arg)->streamWorker();
+    return nullptr;
+}
+
+void Fat32File::streamWorker()
+{
+    Lock<FastMutex> fl(fileMutex);
+    for(;;)
+    {
+        //Write buffers in file order, and before reading
+        StreamBuffer *b=nullptr;
+        for(auto& x : stream->buffers)
+        {
+            if(x.state!=TO_WRITE) continue;
+            if(b==nullptr || x.offset<b->offset) b=&x;
+        }
+        if(b==nullptr)
+            for(auto& x : stream->buffers) if(x.state==TO_READ) b=&x;
+        if(b==nullptr)
+        {
+            if(stream->quit) break;
+            stream->cv.wait(fl);
+            continue;
+        }
+        bool write=b->state==TO_WRITE;
+        b->state=write ? WRITING : READING;
+        int result;
+        UINT transferred=0;
+        {
+            //The caller does not access the FatFs file object while streaming,
+            //so release fileMutex to let it use the other buffer meanwhile
+            Unlock<FastMutex> u(fl);
+            Lock<FastMutex> l(mutex);
+            FatDisk::AllowRelease ar(file.fs->drv);
+            if(linkMapBudget && file.cltbl==nullptr && farSeek(b->offset))
+                buildLinkMap();
+            if(write && file.cltbl && b->offset+b->size>f_size(&file))
+                dropLinkMap();
+            result=translateError(f_lseek(&file,b->offset));
+            if(result==0 && write)
+            {
+                result=translateError(f_write(&file,b->data,b->size,&transferred));
+                auto fs=static_cast<Fat32Fs*>(getParent().get());
+                if(int res=fs->fileWritten(this,transferred))
+                    if(result==0) result=res;
+                if(result==0 && transferred!=b->size) result=-ENOSPC;
+            } else if(result==0) {
+                result=translateError(f_read(&file,b->data,stream->bufferSize,
+                                             &transferred));
+            }
+        }
+        if(write) b->state=FREE;
+        else {
+            b->size=result ? 0 : transferred;
+            b->state=READY;
+        }
+        if(result && stream->error==0) stream->error=result;
+        stream->cv.broadcast();
+    }
 }
 
 //
 // class Fat32Fs
 //
 
-Fat32Fs::Fat32Fs(intrusive_ref_ptr<FileBase> disk)
-        : mutex(FastMutex::RECURSIVE), failed(true)
+Fat32Fs::Fat32Fs(intrusive_ref_ptr<FileBase> disk, unsigned int cacheSectors)
+        : mutex(FastMutex::RECURSIVE),
+          #ifdef SYNC_AFTER_WRITE
+          syncPeriodMs(0), syncBytes(0),
+          #else //SYNC_AFTER_WRITE
+          syncPeriodMs(FAT32_SYNC_PERIOD_MS), syncBytes(FAT32_SYNC_BYTES),
+          #endif //SYNC_AFTER_WRITE
+          failed(true)
 {
-    filesystem.drv=disk;
+    filesystem.drv.setDevice(disk,cacheSectors);
+    filesystem.drv.setMutex(&mutex);
+    filesystem.dcache.resize(FAT32_DENTRY_CACHE_SIZE);
     failed=f_mount(&filesystem,1,false)!=FR_OK;
 }
 
@@ -355,19 +1175,12 @@ int Fat32Fs::open(intrusive_ref_ptr<FileBase>& file, StringPart& name,
     //      ok      |      ok      |    ok     | _FWRITE
     //      ok      |      ok      |    ok     | _FWRITE | _FCREAT
     
-    struct stat st;
-    bool statFailed=false;
-    if(int result=lstat(name,&st))
+    //Files are opened without looking them up first, as that would scan the
+    //directory twice. f_open fails on directories, so they are looked up only
+    //when it fails
+    FRESULT openResult=FR_NO_FILE;
+    if(name.empty()==false)
     {
-        //If _FCREAT the file may not yet exist as we are asked to create it
-        if((flags & (_FWRITE | _FCREAT)) != (_FWRITE | _FCREAT)) return result;
-        else statFailed=true;
-    }
-        
-    //Using if short circuit, as st is not initialized if statFailed
-    if(statFailed || !S_ISDIR(st.st_mode))
-    {
-        //About to open a file
         BYTE openflags=0;
         if(flags & _FREAD)  openflags|=FA_READ;
         if(flags & _FWRITE) openflags|=FA_WRITE;
@@ -377,56 +1190,60 @@ int Fat32Fs::open(intrusive_ref_ptr<FileBase>& file, StringPart& name,
 
         intrusive_ref_ptr<Fat32File> f(new Fat32File(shared_from_this(),mutex));
         Lock<FastMutex> l(mutex);
-        if(int res=translateError(f_open(&filesystem,f->fil(),name.c_str(),openflags)))
-            return res;
-        if(statFailed)
+        openResult=f_open(&filesystem,f->fil(),name.c_str(),openflags);
+        if(openResult==FR_OK)
         {
-            //If we didn't stat before, stat now to get the inode
-            if(int result=lstat(name,&st)) return result;
-        }
-        f->setInode(st.st_ino);
+            //f_open sets the inode, also of a created file
+            f->setInode(f->fil()->inode);
 
-        //Can't open files larger than INT_MAX
-        if(static_cast<int>(f_size(f->fil()))<0) return -EOVERFLOW;
+            //Can't open files larger than INT_MAX
+            if(static_cast<int>(f_size(f->fil()))<0) return -EOVERFLOW;
 
-        #ifdef SYNC_AFTER_WRITE
-        if(f_sync(f->fil())!=FR_OK) return -EFAULT;
-        #endif //SYNC_AFTER_WRITE
+            #ifdef SYNC_AFTER_WRITE
+            if(f_sync(f->fil())!=FR_OK) return -EFAULT;
+            #endif //SYNC_AFTER_WRITE
 
-        //If file opened for appending, seek to end of file
-        if(flags & _FAPPEND)
-            if(f_lseek(f->fil(),f_size(f->fil()))!=FR_OK) return -EFAULT;
+            //If file opened for appending, seek to end of file
+            if(flags & _FAPPEND)
+                if(f_lseek(f->fil(),f_size(f->fil()))!=FR_OK) return -EFAULT;
 
-        file=f;
-        return 0;
-    } else {
-        //About to open a directory
-        if(flags & (_FWRITE | _FAPPEND | _FCREAT | _FTRUNC)) return -EISDIR;
-        
-        int parentInode;
-        if(name.empty()==false)
-        {
-            unsigned int lastSlash=name.findLastOf('/');
-            if(lastSlash!=string::npos)
-            {
-                StringPart parent(name,lastSlash);
-                struct stat st2;
-                if(int result=lstat(parent,&st2)) return result;
-                parentInode=st2.st_ino;
-            } else parentInode=1; //Asked to list subdir of root
-        } else parentInode=parentFsMountpointInode; //Asked to list root dir
-        
-        
-        intrusive_ref_ptr<Fat32Directory> d(
-            new Fat32Directory(shared_from_this(),mutex,st.st_ino,parentInode));
-         
-        Lock<FastMutex> l(mutex);
-        if(int res=translateError(f_opendir(&filesystem,d->directory(),name.c_str())))
-            return res;
-         
-         file=d;
-         return 0;
+            file=f;
+            return 0;
+        }
+        //Opening a directory fails with FR_NO_FILE, or FR_DENIED for writing
+        if(openResult!=FR_NO_FILE && openResult!=FR_DENIED)
+            return translateError(openResult);
     }
+
+    struct stat st;
+    if(int result=lstat(name,&st)) return result;
+    if(!S_ISDIR(st.st_mode)) return translateError(openResult);
+
+    //About to open a directory
+    if(flags & (_FWRITE | _FAPPEND | _FCREAT | _FTRUNC)) return -EISDIR;
+    
+    int parentInode;
+    if(name.empty()==false)
+    {
+        unsigned int lastSlash=name.findLastOf('/');
+        if(lastSlash!=string::npos)
+        {
+            StringPart parent(name,lastSlash);
+            struct stat st2;
+            if(int result=lstat(parent,&st2)) return result;
+            parentInode=st2.st_ino;
+        } else parentInode=1; //Asked to list subdir of root
+    } else parentInode=parentFsMountpointInode; //Asked to list root dir
+    
+    intrusive_ref_ptr<Fat32Directory> d(
+        new Fat32Directory(shared_from_this(),mutex,st.st_ino,parentInode));
+    
+    Lock<FastMutex> l(mutex);
+    if(int res=translateError(f_opendir(&filesystem,d->directory(),name.c_str())))
+        return res;
+    
+    file=d;
+    return 0;
 }
 
 int Fat32Fs::lstat(StringPart& name, struct stat *pstat)
@@ -486,10 +1303,129 @@ int Fat32Fs::rmdir(StringPart& name)
 
 Fat32Fs::~Fat32Fs()
 {
+    if(flusher)
+    {
+        {
+            Lock<FastMutex> l(mutex);
+            quit=true;
+            flusherCv.signal();
+        }
+        flusher->join();
+    }
     if(failed) return;
     f_mount(&filesystem,0,true); //TODO: what to do with error code?
-    filesystem.drv->ioctl(IOCTL_SYNC,0);
-    filesystem.drv.reset();
+    filesystem.drv.reset(); //Also writes back the sector cache
+}
+
+CacheStats Fat32Fs::getCacheStats()
+{
+    Lock<FastMutex> l(mutex);
+    return filesystem.drv.getStats();
+}
+
+void Fat32Fs::setSyncPolicy(unsigned int periodMs, unsigned int maxDirtyBytes)
+{
+    Lock<FastMutex> l(mutex);
+    syncPeriodMs=periodMs;
+    syncBytes=maxDirtyBytes;
+    //Sync what was written with the old policy, and make the flusher thread
+    //recompute its deadline
+    syncWrittenFiles();
+    flusherCv.signal();
+}
+
+int Fat32Fs::fileWritten(Fat32File *file, unsigned int bytes)
+{
+    if(syncPeriodMs==0) return translateError(f_sync(file->fil()));
+    if(flusher==nullptr)
+    {
+        flusher=Thread::create(flusherLauncher,STACK_DEFAULT_FOR_PTHREAD,
+                               MAIN_PRIORITY,this,Thread::JOINABLE);
+        //Can't have a background sync, so sync now
+        if(flusher==nullptr) return translateError(f_sync(file->fil()));
+    }
+    if(file->written==false)
+    {
+        file->written=true;
+        file->nextWritten=writtenFiles;
+        writtenFiles=file;
+    }
+    if(writtenBytes==0) firstWriteTime=getTime();
+    unsigned int oldBytes=writtenBytes;
+    writtenBytes+=bytes;
+    //Wake the flusher on the first write to start the timeout, and when the
+    //size threshold is reached
+    if(oldBytes==0 || (oldBytes<syncBytes && writtenBytes>=syncBytes))
+        flusherCv.signal();
+    return 0;
+}
+
+void Fat32Fs::fileSynced(Fat32File *file)
+{
+    if(file->written==false) return;
+    for(Fat32File **walk=&writtenFiles;*walk;walk=&(*walk)->nextWritten)
+    {
+        if(*walk!=file) continue;
+        *walk=file->nextWritten;
+        break;
+    }
+    file->written=false;
+    file->nextWritten=nullptr;
+}
+
+void Fat32Fs::syncWrittenFiles()
+{
+    //A file must be synced holding its mutex, as a thread accessing it may
+    //have released the filesystem mutex during a transfer. Files being
+    //accessed are left in the list, as waiting for their mutex would invert
+    //the lock order, and retried after another period
+    Fat32File *busy=nullptr;
+    while(writtenFiles)
+    {
+        Fat32File *file=writtenFiles;
+        writtenFiles=file->nextWritten;
+        if(file->fileMutex.tryLock()==false)
+        {
+            file->nextWritten=busy;
+            busy=file;
+            continue;
+        }
+        file->written=false;
+        file->nextWritten=nullptr;
+        //NOTE: there is nobody to report errors to, the error will be reported
+        //to the application by the next fsync() or close()
+        f_sync(file->fil());
+        file->fileMutex.unlock();
+    }
+    writtenFiles=busy;
+    writtenBytes=0;
+    if(busy) firstWriteTime=getTime();
+}
+
+void Fat32Fs::flusherLauncher(void *argv)
+{
+    reinterpret_cast<Fat32Fs*>(argv)->flusherThread();
+}
+
+void Fat32Fs::flusherThread()
+{
+    Lock<FastMutex> l(mutex);
+    for(;;)
+    {
+        while(quit==false && writtenBytes==0 && writtenFiles==nullptr)
+            flusherCv.wait(l);
+        if(quit) return;
+        long long deadline=firstWriteTime+syncPeriodMs*1000000LL;
+        //Files left in the list because they were busy wait for the deadline
+        //also past the size threshold, so that the mutex is released
+        if((writtenBytes==0 || writtenBytes<syncBytes) && getTime()<deadline)
+        {
+            //Woken by a write, a threshold or a change of policy, recheck
+            flusherCv.timedWait(l,deadline);
+            continue;
+        }
+        syncWrittenFiles();
+    }
 }
 
 int Fat32Fs::unlinkRmdirHelper(StringPart& name, bool delDir)
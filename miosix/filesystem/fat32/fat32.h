@@ -37,6 +37,8 @@ namespace miosix {
     
 #ifdef WITH_FILESYSTEM
 
+class Fat32File; //Forward declaration
+
 /**
  * Fat32 Filesystem.
  */
@@ -45,8 +47,11 @@ class Fat32Fs : public FilesystemBase
 public:
     /**
      * Constructor
+     * \param disk block device on which the filesystem is stored
+     * \param cacheSectors number of sectors in the sector cache, 0 disables it
      */
-    Fat32Fs(intrusive_ref_ptr<FileBase> disk);
+    Fat32Fs(intrusive_ref_ptr<FileBase> disk,
+            unsigned int cacheSectors=FAT32_CACHE_SECTORS);
     
     /**
      * Open a file
@@ -103,6 +108,25 @@ public:
      * \return true if the filesystem failed to mount 
      */
     bool mountFailed() const { return failed; }
+
+    /**
+     * \return the statistics of the sector cache
+     */
+    CacheStats getCacheStats();
+
+    /**
+     * Set the durability window of written data, by default it is
+     * FAT32_SYNC_PERIOD_MS and FAT32_SYNC_BYTES, or zero if SYNC_AFTER_WRITE
+     * is defined.
+     * Written files are synced by a background thread when either periodMs
+     * have elapsed since the first unsynced write, or when maxDirtyBytes have
+     * been written, whichever comes first. Explicit fsync() calls sync
+     * immediately regardless of this setting.
+     * \param periodMs maximum time in milliseconds before written data is
+     * synced, or zero to sync after every write
+     * \param maxDirtyBytes maximum number of bytes written before syncing
+     */
+    void setSyncPolicy(unsigned int periodMs, unsigned int maxDirtyBytes);
     
     /**
      * Destructor
@@ -112,10 +136,48 @@ public:
 private:
     
     int unlinkRmdirHelper(StringPart& name, bool delDir);
+
+    /**
+     * Called by Fat32File with the mutex locked after writing to a file, to
+     * add the file to the list of files to be synced
+     * \param file the written file
+     * \param bytes number of bytes written
+     * \return 0 on success, or a negative number on failure
+     */
+    int fileWritten(Fat32File *file, unsigned int bytes);
+
+    /**
+     * Called by Fat32File with the mutex locked when a file is synced or
+     * closed, to remove it from the list of files to be synced
+     * \param file the file
+     */
+    void fileSynced(Fat32File *file);
+
+    /**
+     * Sync all written files, to be called with the mutex locked
+     */
+    void syncWrittenFiles();
+
+    /**
+     * Entry point of the background thread that syncs written files
+     */
+    static void flusherLauncher(void *argv);
+    void flusherThread();
     
     FATFS filesystem;
     FastMutex mutex;
+    ConditionVariable flusherCv;    ///< To wake the flusher thread
+    Thread *flusher=nullptr;        ///< Flusher thread, created on first write
+    Fat32File *writtenFiles=nullptr;///< List of files to be synced
+    long long firstWriteTime=0;     ///< Time of first write since last sync
+    unsigned int writtenBytes=0;    ///< Bytes written since last sync
+    unsigned int syncPeriodMs;      ///< Group commit period
+    unsigned int syncBytes;         ///< Group commit size threshold
+    int closeError=0;               ///< First error of a closed file
+    bool quit=false;                ///< To stop the flusher thread
     bool failed; ///< Failed to mount
+
+    friend class Fat32File; //Needs fileWritten(), fileSynced(), closeError
 };
 
 #endif //WITH_FILESYSTEM
@@ -1494,8 +1494,9 @@ BYTE sum_sfn (
 /*-----------------------------------------------------------------------*/
 
 static
-FRESULT dir_find (
-	DIR_* dp			/* Pointer to the directory object linked to the file name */
+FRESULT dir_scan (
+	DIR_* dp,			/* Pointer to the directory object linked to the file name */
+	UINT nent			/* Maximum number of entries to scan */
 )
 {
 	FRESULT res;
@@ -1504,13 +1505,11 @@ FRESULT dir_find (
 	BYTE a, ord, sum;
 #endif
 
-	res = dir_sdi(dp, 0);			/* Rewind directory object */
-	if (res != FR_OK) return res;
-
 #if _USE_LFN
 	ord = sum = 0xFF;
 #endif
 	do {
+		if (!nent--) { res = FR_NO_FILE; break; }	/* Scanned enough entries */
 		res = move_window(dp->fs, dp->sect);
 		if (res != FR_OK) break;
 		dir = dp->dir;					/* Ptr to the directory entry of current index */
@@ -1547,6 +1546,48 @@ FRESULT dir_find (
 	return res;
 }
 
+//By TFT: directory lookups go through the dentry cache. SFN only lookups,
+//used to generate numbered names, bypass it. A cached index is checked by
+//scanning the entries of one name, an LFN takes at most 20 entries plus the SFN
+static
+FRESULT dir_find (
+	DIR_* dp			/* Pointer to the directory object linked to the file name */
+)
+{
+	FRESULT res;
+#if _USE_LFN
+	WORD idx;
+
+	if (dp->lfn) {
+		switch (dp->fs->dcache.lookup(dp->sclust, dp->lfn, idx)) {
+		case miosix::DentryCache::NOT_FOUND:
+			return FR_NO_FILE;
+		case miosix::DentryCache::FOUND:
+			res = dir_sdi(dp, idx);
+			if (res == FR_OK) res = dir_scan(dp, 21);
+			if (res == FR_OK) return res;
+			break;					/* Stale entry, do a full scan */
+		default:
+			break;
+		}
+	}
+#endif
+
+	res = dir_sdi(dp, 0);			/* Rewind directory object */
+	if (res == FR_OK) res = dir_scan(dp, 0xFFFFFFFF);
+
+#if _USE_LFN
+	if (dp->lfn) {
+		if (res == FR_OK)
+			dp->fs->dcache.insert(dp->sclust, dp->lfn,
+				dp->lfn_idx == 0xFFFF ? dp->index : dp->lfn_idx);
+		else if (res == FR_NO_FILE)
+			dp->fs->dcache.insertNotFound(dp->sclust, dp->lfn);
+	}
+#endif
+	return res;
+}
+
 
 
 
@@ -1680,6 +1721,9 @@ FRESULT dir_register (	/* FR_OK:Successful, FR_DENIED:No free entry or too many
 		}
 	}
 
+#if _USE_LFN
+	dp->fs->dcache.entryAdded(dp->sclust);	/* By TFT: drop negative entries */
+#endif
 	return res;
 }
 #endif /* !_FS_READONLY */
@@ -1697,6 +1741,10 @@ FRESULT dir_remove (	/* FR_OK: Successful, FR_DISK_ERR: A disk error */
 )
 {
 	FRESULT res;
+#if _USE_LFN
+	dp->fs->dcache.entryRemoved(dp->sclust,	/* By TFT: forget the entry */
+		(dp->lfn_idx == 0xFFFF) ? dp->index : dp->lfn_idx);
+#endif
 #if _USE_LFN	/* LFN configuration */
 	WORD i;
 
@@ -2317,6 +2365,7 @@ FRESULT find_volume (	/* FR_OK(0): successful, !=0: any error occurred */
 #endif
 	fs->fs_type = fmt;	/* FAT sub-type */
 	fs->id = miosix::atomicAddExchange(&Fsid,1)/*++Fsid*/;	/* File system mount ID */
+	fs->dcache.clear();	/* By TFT: the volume may have changed */
 #if _FS_RPATH
 	fs->cdir = 0;		/* Current directory (root dir) */
 #endif
@@ -2531,6 +2580,7 @@ FRESULT f_open (
 		if (res == FR_OK) {
 			fp->flag = mode;					/* File access mode */
 			fp->err = 0;						/* Clear error flag */
+			fp->inode = INODE((&dj));			/* By TFT: support inodes */
 			fp->sclust = ld_clust(dj.fs, dir);	/* File start cluster */
 			fp->fsize = LD_DWORD(dir+DIR_FileSize);	/* File size */
 			fp->fptr = 0;						/* File pointer */
@@ -3415,11 +3465,13 @@ FRESULT f_truncate (
 		}
 	}
 	if (res == FR_OK) {
-		if (fp->fsize > fp->fptr) {
+		//By TFT: also truncate at end of file, to release clusters that
+		//f_prealloc() allocated past the file size
+		if (fp->fsize >= fp->fptr) {
 			fp->fsize = fp->fptr;	/* Set file size to current R/W point */
 			fp->flag |= FA__WRITTEN;
 			if (fp->fptr == 0) {	/* When set file size to zero, remove entire cluster chain */
-				res = remove_chain(fp->fs, fp->sclust);
+				if (fp->sclust) res = remove_chain(fp->fs, fp->sclust);
 				fp->sclust = 0;
 			} else {				/* When truncate a part of the file, remove remaining clusters */
 				ncl = get_fat(fp->fs, fp->clust);
@@ -3449,6 +3501,106 @@ FRESULT f_truncate (
 
 
 
+/*-----------------------------------------------------------------------*/
+/* Preallocate a Contiguous Cluster Chain                                */
+/*-----------------------------------------------------------------------*/
+//By TFT: not part of FatFs. Stretch the cluster chain of the file so that it
+//covers fsz bytes, allocating the new clusters as a single contiguous run if
+//possible. The file size is not changed, f_write() follows the preallocated
+//chain when writing past the end of file, and f_truncate() releases it.
+
+FRESULT f_prealloc (
+	FIL* fp,	/* Pointer to the file object */
+	DWORD fsz	/* Number of bytes the cluster chain has to cover */
+)
+{
+	FRESULT res;
+	FATFS *fs;
+	DWORD csz, ncl, n, last, clst, cs, start, run, i;
+
+
+	res = validate(fp);						/* Check validity of the object */
+	if (res == FR_OK) {
+		if (fp->err) {						/* Check error */
+			res = (FRESULT)fp->err;
+		} else {
+			if (!(fp->flag & FA_WRITE))		/* Check access mode */
+				res = FR_DENIED;
+		}
+	}
+	if (res != FR_OK) LEAVE_FF(fp->fs, res);
+	fs = fp->fs;
+	csz = (DWORD)fs->csize * SS(fs);
+	ncl = fsz / csz + (fsz % csz ? 1 : 0);	/* Clusters needed */
+
+	/* Follow the existing chain */
+	n = 0; last = 0; clst = fp->sclust;
+	while (clst && n < ncl) {
+		last = clst; n++;
+		clst = get_fat(fs, clst);
+		if (clst == 1) ABORT(fs, FR_INT_ERR);
+		if (clst == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
+		if (clst >= fs->n_fatent) clst = 0;	/* End of chain */
+	}
+	if (n >= ncl) LEAVE_FF(fs, FR_OK);		/* Already allocated */
+	ncl -= n;
+
+	/* Look for a run of ncl free clusters, starting after the chain */
+	clst = last ? last : fs->last_clust;
+	if (clst < 2 || clst >= fs->n_fatent) clst = 1;
+	start = 0; run = 0;
+	for (i = 2; i < fs->n_fatent; i++) {
+		if (++clst >= fs->n_fatent) {		/* Wrap around, runs can't */
+			clst = 2; run = 0;
+		}
+		cs = get_fat(fs, clst);
+		if (cs == 1) ABORT(fs, FR_INT_ERR);
+		if (cs == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
+		if (cs != 0) {
+			run = 0;
+		} else {
+			if (run++ == 0) start = clst;
+			if (run == ncl) break;
+		}
+	}
+
+	if (run == ncl) {						/* Link the run to the chain */
+		for (i = 0; i < ncl && res == FR_OK; i++)
+			res = put_fat(fs, start + i, i == ncl - 1 ? 0x0FFFFFFF : start + i + 1);
+		if (res == FR_OK) {
+			if (last) {
+				res = put_fat(fs, last, start);
+			} else {
+				fp->sclust = start;
+				fp->flag |= FA__WRITTEN;
+			}
+		}
+		if (res != FR_OK) ABORT(fs, res);
+		fs->last_clust = start + ncl - 1;	/* Update FSINFO */
+		if (fs->free_clust != 0xFFFFFFFF) {
+			fs->free_clust -= ncl;
+			fs->fsi_flag |= 1;
+		}
+	} else {								/* Fragmented, allocate one by one */
+		while (ncl--) {
+			clst = create_chain(fs, last);
+			if (clst == 0) LEAVE_FF(fs, FR_DENIED);	/* Disk full */
+			if (clst == 1) ABORT(fs, FR_INT_ERR);
+			if (clst == 0xFFFFFFFF) ABORT(fs, FR_DISK_ERR);
+			if (!last) {
+				fp->sclust = clst;
+				fp->flag |= FA__WRITTEN;
+			}
+			last = clst;
+		}
+	}
+
+	LEAVE_FF(fs, FR_OK);
+}
+
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Delete a File or Directory                                            */
 /*-----------------------------------------------------------------------*/
@@ -3489,6 +3641,7 @@ FRESULT f_unlink (
 				if (dclst < 2) {
 					res = FR_INT_ERR;
 				} else {
+					dj.fs->dcache.directoryChanged(dclst);	/* By TFT: forget its entries */
 					mem_cpy(&sdj, &dj, sizeof (DIR_));	/* Check if the sub-directory is empty or not */
 					sdj.sclust = dclst;
 					res = dir_sdi(&sdj, 2);		/* Exclude dot entries */
@@ -3552,6 +3705,8 @@ FRESULT f_mkdir (
 			if (dcl == 0) res = FR_DENIED;		/* No space to allocate a new cluster */
 			if (dcl == 1) res = FR_INT_ERR;
 			if (dcl == 0xFFFFFFFF) res = FR_DISK_ERR;
+			if (res == FR_OK)					/* By TFT: the cluster may have been a directory */
+				dj.fs->dcache.directoryChanged(dcl);
 			if (res == FR_OK)					/* Flush FAT */
 				res = sync_window(dj.fs);
 			if (res == FR_OK) {					/* Initialize the new directory table */
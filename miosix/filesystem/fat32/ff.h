@@ -36,6 +36,8 @@
 //#endif
 
 #include <filesystem/file.h>
+#include "diskio.h"
+#include "dentry_cache.h"
 #include "config/miosix_settings.h"
 
 #include "integer.h"	/* Basic integer types */
@@ -143,7 +145,8 @@ struct FATFS {
 #if _FS_LOCK
     FILESEM	Files[_FS_LOCK];/* Open object lock semaphores */
 #endif
-    miosix::intrusive_ref_ptr<miosix::FileBase> drv; /* drive device */
+    miosix::FatDisk drv;	/* drive device and sector cache */
+    miosix::DentryCache dcache;	/* directory entry lookup cache */
 };
 
 
@@ -170,6 +173,7 @@ typedef struct {
 #if _FS_LOCK
 	UINT	lockid;			/* File lock ID (index of file semaphore table Files[]) */
 #endif
+    unsigned int inode; //By TFT: support inodes
 #if !_FS_TINY
 	BYTE	buf[_MAX_SS];	/* File data read/write buffer */
 #endif
@@ -253,6 +257,7 @@ FRESULT f_write (FIL* fp, const void* buff, UINT btw, UINT* bw);	/* Write data t
 FRESULT f_forward (FIL* fp, UINT(*func)(const BYTE*,UINT), UINT btf, UINT* bf);	/* Forward data to the stream */
 FRESULT f_lseek (FIL* fp, DWORD ofs);								/* Move file pointer of a file object */
 FRESULT f_truncate (FIL* fp);										/* Truncate file */
+FRESULT f_prealloc (FIL* fp, DWORD fsz);							/* Preallocate clusters for a file */
 FRESULT f_sync (FIL* fp);											/* Flush cached data of a writing file */
 FRESULT f_opendir (FATFS *fs, DIR_* dp, const /*TCHAR*/char *path);						/* Open a directory */
 FRESULT f_closedir (DIR_* dp);										/* Close an open directory */
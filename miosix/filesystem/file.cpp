@@ -48,8 +48,64 @@ FileBase::FileBase(intrusive_ref_ptr<FilesystemBase> parent) : parent(parent)
     if(parent) parent->newFileOpened();
 }
 
+ssize_t FileBase::writev(const struct iovec *iov, int iovcnt)
+{
+    ssize_t total=0;
+    for(int i=0;i<iovcnt;i++)
+    {
+        if(iov[i].iov_len==0) continue;
+        ssize_t result=write(iov[i].iov_base,iov[i].iov_len);
+        //Errors after some data was written are reported by the next call
+        if(result<0) return total>0 ? total : result;
+        total+=result;
+        if(static_cast<size_t>(result)<iov[i].iov_len) break;
+    }
+    return total;
+}
+
+ssize_t FileBase::readv(const struct iovec *iov, int iovcnt)
+{
+    ssize_t total=0;
+    for(int i=0;i<iovcnt;i++)
+    {
+        if(iov[i].iov_len==0) continue;
+        ssize_t result=read(iov[i].iov_base,iov[i].iov_len);
+        if(result<0) return total>0 ? total : result;
+        total+=result;
+        if(static_cast<size_t>(result)<iov[i].iov_len) break;
+    }
+    return total;
+}
+
+int FileBase::poll(WaitQueueEntry *entry)
+{
+    return POLLIN | POLLOUT;
+}
+
 #ifdef WITH_FILESYSTEM
 
+ssize_t FileBase::pwrite(const void *data, size_t len, off_t pos)
+{
+    off_t saved=lseek(0,SEEK_CUR);
+    if(saved<0) return -ESPIPE;
+    off_t result=lseek(pos,SEEK_SET);
+    if(result<0) return result;
+    ssize_t written=write(data,len);
+    lseek(saved,SEEK_SET);
+    return written;
+}
+
+ssize_t FileBase::pread(void *data, size_t len, off_t pos)
+{
+    off_t saved=lseek(0,SEEK_CUR);
+    if(saved<0) return -ESPIPE;
+    off_t result=lseek(pos,SEEK_SET);
+    if(result<0) return result;
+    ssize_t bytesRead=read(data,len);
+    lseek(saved,SEEK_SET);
+    return bytesRead;
+}
+
 int FileBase::isatty() const
 {
     return 0;
@@ -73,6 +129,36 @@ int FileBase::getdents(void *dp, int len)
     return -EBADF;
 }
 
+int FileBase::ftruncate(off_t size)
+{
+    return -EINVAL; //Means the file is not a regular file
+}
+
+int FileBase::fallocate(off_t offset, off_t len)
+{
+    return -ENODEV; //Means the file is not a regular file
+}
+
+Device *FileBase::getBlockDevice()
+{
+    return nullptr;
+}
+
+PipeFile *FileBase::getPipe()
+{
+    return nullptr;
+}
+
+int FileBase::mmap(off_t offset, size_t len, const void **addr)
+{
+    return -ENODEV;
+}
+
+int FileBase::aioSubmit(AioRequest *req)
+{
+    return -EOPNOTSUPP;
+}
+
 #endif //WITH_FILESYSTEM
 
 FileBase::~FileBase()
@@ -170,6 +256,11 @@ int FilesystemBase::readlink(StringPart& name, string& target)
     return -EINVAL; //Default implementation, for filesystems without symlinks
 }
 
+int FilesystemBase::mkfifo(StringPart& name, int mode)
+{
+    return -EPERM; //Default implementation, for filesystems without FIFOs
+}
+
 bool FilesystemBase::supportsSymlinks() const { return false; }
 
 void FilesystemBase::newFileOpened() { atomicAdd(&openFileCount,1); }
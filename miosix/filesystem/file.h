@@ -26,6 +26,7 @@
  ***************************************************************************/
 
 #include <dirent.h>
+#include <limits.h>
 #include <sys/stat.h>
 #include "kernel/intrusive.h"
 #include "config/miosix_settings.h"
@@ -33,11 +34,69 @@
 #ifndef FILE_H
 #define	FILE_H
 
+#if __has_include(<sys/uio.h>)
+#include <sys/uio.h>
+#else //__has_include(<sys/uio.h>)
+/**
+ * A buffer of readv() and writev(), as newlib does not provide sys/uio.h
+ */
+struct iovec
+{
+    void *iov_base; ///< Start of the buffer
+    size_t iov_len; ///< Size of the buffer
+};
+#endif //__has_include(<sys/uio.h>)
+
+#ifndef IOV_MAX
+/// Maximum number of buffers passed to readv() and writev()
+#define IOV_MAX 16
+#endif //IOV_MAX
+
+#if __has_include(<poll.h>)
+#include <poll.h>
+#else //__has_include(<poll.h>)
+#define POLLIN   0x001 ///< Data can be read without blocking
+#define POLLPRI  0x002 ///< Urgent data can be read, never reported
+#define POLLOUT  0x004 ///< Data can be written without blocking
+#define POLLERR  0x008 ///< Error condition, only reported in revents
+#define POLLHUP  0x010 ///< Hang up, only reported in revents
+#define POLLNVAL 0x020 ///< Invalid file descriptor, only reported in revents
+
+/// Number of file descriptors passed to poll()
+typedef unsigned int nfds_t;
+
+/**
+ * A file descriptor passed to poll(), as newlib does not provide poll.h
+ */
+struct pollfd
+{
+    int fd;        ///< File descriptor, negative values are ignored
+    short events;  ///< Requested events
+    short revents; ///< Returned events
+};
+#endif //__has_include(<poll.h>)
+
+#if __has_include(<sys/mman.h>)
+#include <sys/mman.h>
+#else //__has_include(<sys/mman.h>)
+#define PROT_NONE   0x0 ///< Mapping cannot be accessed
+#define PROT_READ   0x1 ///< Mapping can be read
+#define PROT_WRITE  0x2 ///< Mapping can be written, never supported
+#define PROT_EXEC   0x4 ///< Mapping can be executed
+#define MAP_SHARED  0x1 ///< Mapping of the file content
+#define MAP_PRIVATE 0x2 ///< Private copy of the file content
+#define MAP_FAILED  ((void *)-1) ///< Returned by mmap() on failure
+#endif //__has_include(<sys/mman.h>)
+
 namespace miosix {
 
 // Forward decls
 class FilesystemBase;
 class StringPart;
+class Device;
+class AioRequest;
+class WaitQueueEntry;
+class PipeFile;
 
 /**
  * The unix file abstraction. Also some device drivers are seen as files.
@@ -71,8 +130,69 @@ public:
      */
     virtual ssize_t read(void *data, size_t len)=0;
     
+    /**
+     * Write data to the file from multiple buffers, in order. This default
+     * implementation calls write() for each buffer, stopping at the first
+     * short write. Files that can do better, such as writing all the buffers
+     * while other writers are kept out, override it.
+     * \param iov buffers with the data to write
+     * \param iovcnt number of buffers
+     * \return the number of written characters, or a negative number in case
+     * of errors
+     */
+    virtual ssize_t writev(const struct iovec *iov, int iovcnt);
+    
+    /**
+     * Read data from the file into multiple buffers, in order. This default
+     * implementation calls read() for each buffer, stopping at the first
+     * short read.
+     * \param iov buffers to store read data
+     * \param iovcnt number of buffers
+     * \return the number of read characters, or a negative number in case
+     * of errors
+     */
+    virtual ssize_t readv(const struct iovec *iov, int iovcnt);
+    
+    /**
+     * Check whether the file can be read or written without blocking, used
+     * to implement poll() and select(). This default implementation reports
+     * the file as always ready, which is correct for regular files. Files
+     * that can block override it.
+     * \param entry if not nullptr, a file that can block must add it to a
+     * WaitQueue that is woken when the file becomes ready. The entry is
+     * removed by the caller
+     * \return a combination of POLLIN, POLLOUT, POLLERR and POLLHUP
+     */
+    virtual int poll(WaitQueueEntry *entry);
+    
     #ifdef WITH_FILESYSTEM
     
+    /**
+     * Write data at a given position in the file, without changing the file
+     * pointer. This default implementation moves the file pointer with
+     * lseek() and then moves it back, so a concurrent read(), write() or
+     * lseek() on the same file sees the temporary position. Files that
+     * support random-access should override it.
+     * \param data the data to write
+     * \param len the number of bytes to write
+     * \param pos offset from the beginning of the file
+     * \return the number of written characters, or a negative number in case
+     * of errors, -ESPIPE if the file does not support random-access
+     */
+    virtual ssize_t pwrite(const void *data, size_t len, off_t pos);
+    
+    /**
+     * Read data from a given position in the file, without changing the file
+     * pointer. This default implementation has the same limitation as the
+     * one of pwrite().
+     * \param data buffer to store read data
+     * \param len the number of bytes to read
+     * \param pos offset from the beginning of the file
+     * \return the number of read characters, or a negative number in case
+     * of errors, -ESPIPE if the file does not support random-access
+     */
+    virtual ssize_t pread(void *data, size_t len, off_t pos);
+    
     /**
      * Move file pointer, if the file supports random-access.
      * \param pos offset to sum to the beginning of the file, current position
@@ -124,6 +244,66 @@ public:
      */
     virtual int getdents(void *dp, int len);
     
+    /**
+     * Truncate or extend the file to a given size. If the file is extended,
+     * the new part reads as zeros. The file pointer is not changed.
+     * \param size new file size
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int ftruncate(off_t size);
+    
+    /**
+     * Allocate storage for a range of the file, so that subsequent writes to
+     * that range do not fail for lack of space. If the range extends past the
+     * end of file, the file is extended and the new part reads as zeros.
+     * \param offset start of the range
+     * \param len length of the range
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int fallocate(off_t offset, off_t len);
+    
+    /**
+     * Filesystems mounted on a block device file can use this to transfer
+     * sectors by calling the device directly, without going through the file
+     * seek point. The device remains valid as long as the file is open.
+     * \return the block device this file refers to, or nullptr if the file
+     * is not a block device
+     */
+    virtual Device *getBlockDevice();
+    
+    /**
+     * Used by splice() to find which of the files is a pipe.
+     * \return this file if it is a pipe or FIFO, or nullptr
+     */
+    virtual PipeFile *getPipe();
+    
+    /**
+     * Map a range of the file in memory, for files whose storage is memory
+     * addressable, like a filesystem image in the microcontroller flash.
+     * The mapping is a pointer to the storage, so it reads data without
+     * copying it in RAM, and remains valid after the file is closed, for as
+     * long as the storage is, such as until the filesystem is unmounted.
+     * This default implementation fails, as files are not memory addressable.
+     * \param offset start of the range, from the beginning of the file
+     * \param len size of the range, greater than zero
+     * \param addr the address of the range is stored here
+     * \return 0 on success, -ENODEV if the file cannot be mapped, -ENXIO if
+     * the range is past the end of the file, or another negative number in
+     * case of errors
+     */
+    virtual int mmap(off_t offset, size_t len, const void **addr);
+    
+    /**
+     * Start an asynchronous request without going through the worker thread
+     * that performs the requests of files that do not override this member
+     * function. The request must be completed by calling its complete()
+     * member function, which can also happen before this function returns.
+     * \param req the request
+     * \return 0 if the request was started, or -EOPNOTSUPP if it must be
+     * performed by the worker thread
+     */
+    virtual int aioSubmit(AioRequest *req);
+    
     /**
      * \return a pointer to the parent filesystem
      */
@@ -300,6 +480,15 @@ public:
      */
     virtual int mkdir(StringPart& name, int mode)=0;
     
+    /**
+     * Create a FIFO. This default implementation fails, as FIFOs are only
+     * supported by filesystems that keep them in RAM, like DevFs
+     * \param name FIFO name
+     * \param mode FIFO permissions
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int mkfifo(StringPart& name, int mode);
+    
     /**
      * Remove a directory if empty
      * \param name directory name
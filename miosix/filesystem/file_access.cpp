@@ -32,6 +32,9 @@
 #include "console/console_device.h"
 #include "mountpointfs/mountpointfs.h"
 #include "fat32/fat32.h"
+#include "tmpfs/tmpfs.h"
+#include "romfs/romfs.h"
+#include "pipe/pipe.h"
 #include "kernel/logging.h"
 #ifdef WITH_PROCESSES
 #include "kernel/process.h"
@@ -39,6 +42,11 @@
 
 using namespace std;
 
+#ifdef WITH_ROMFS
+/// Start of the RomFs image, null if the application has none
+extern "C" const unsigned int _romfs_start[] __attribute__((weak));
+#endif //WITH_ROMFS
+
 #ifdef WITH_FILESYSTEM
 
 namespace miosix {
@@ -73,66 +81,164 @@ namespace miosix {
 // class FileDescriptorTable
 //
 
+static_assert(MAX_OPEN_FILES>=3 && FD_TABLE_CHUNK>=3,
+              "The file descriptor table must hold stdin, stdout, stderr");
+
+//
+// class FileDescriptorTable::Slots
+//
+
+FileDescriptorTable::Slots::Slots(int size, const Slots *rhs)
+    : size(size), owners(1), files(new intrusive_ref_ptr<FileBase>[size])
+{
+    memset(bitmap,0,sizeof(bitmap));
+    if(rhs==nullptr) return;
+    memcpy(bitmap,rhs->bitmap,sizeof(bitmap));
+    for(int i=0;i<rhs->size;i++) files[i]=atomic_load(&rhs->files[i]);
+}
+
+int FileDescriptorTable::Slots::findFree(int first) const
+{
+    for(int i=first/32;i<(size+31)/32;i++)
+    {
+        unsigned int free=~bitmap[i];
+        if(i==first/32) free&=0xffffffffu>>(first % 32);
+        if(free==0) continue;
+        int fd=i*32+__builtin_clz(free);
+        return fd<size ? fd : -1;
+    }
+    return -1;
+}
+
+//
+// class FileDescriptorTable
+//
+
 FileDescriptorTable::FileDescriptorTable()
-    : mutex(FastMutex::RECURSIVE), cwd("/")
+    : mutex(FastMutex::RECURSIVE), cwd("/"),
+      slots(new Slots(FD_TABLE_CHUNK,nullptr))
 {
     FilesystemManager::instance().addFileDescriptorTable(this);
-    files[0]=files[1]=files[2]=intrusive_ref_ptr<FileBase>(
+    intrusive_ref_ptr<FileBase> terminal(
         new TerminalDevice(DefaultConsole::instance().get()));
+    for(int i=0;i<3;i++) install(i,terminal);
 }
 
 FileDescriptorTable::FileDescriptorTable(const FileDescriptorTable& rhs)
-    : mutex(FastMutex::RECURSIVE), cwd(rhs.cwd)
+    : mutex(FastMutex::RECURSIVE)
 {
-    //No need to lock the mutex since we are in a constructor and there can't
-    //be pointers to this in other threads yet
-    for(int i=0;i<MAX_OPEN_FILES;i++) this->files[i]=atomic_load(&rhs.files[i]);
+    //No need to lock our mutexes since we are in a constructor and there
+    //can't be pointers to this in other threads yet
+    *this=rhs;
     FilesystemManager::instance().addFileDescriptorTable(this);
 }
 
 FileDescriptorTable& FileDescriptorTable::operator=(
         const FileDescriptorTable& rhs)
 {
-    Lock<FastMutex> l(mutex);
-    for(int i=0;i<MAX_OPEN_FILES;i++)
-        atomic_store(&this->files[i],atomic_load(&rhs.files[i]));
+    if(this==&rhs) return *this;
+    {
+        Lock<FastMutex> l(rhs.mutex);
+        cwd=rhs.cwd;
+    }
+    intrusive_ref_ptr<Slots> shared;
+    {
+        //Locking rhs.slotsMutex ensures rhs does not modify the file
+        //descriptors in place after checking they are not shared
+        Lock<FastMutex> l(rhs.slotsMutex);
+        shared=rhs.slots;
+        atomicAdd(&shared->owners,1);
+    }
+    Lock<FastMutex> l(slotsMutex);
+    if(slots) atomicAdd(&slots->owners,-1);
+    //The previous file descriptors, if no longer referenced, are deleted when
+    //shared goes out of scope, after unlocking the mutex
+    shared=atomic_exchange(&slots,shared);
     return *this;
 }
 
 int FileDescriptorTable::open(const char* name, int flags, int mode)
 {
     if(name==0 || name[0]=='\0') return -EFAULT;
+    //Only open() and pipe() allocate file descriptors, and they lock mutex,
+    //so the file descriptor remains free while the file is opened
     Lock<FastMutex> l(mutex);
-    for(int i=3;i<MAX_OPEN_FILES;i++)
+    int fd;
     {
-        if(files[i]) continue;
-        //Found an empty file descriptor
-        string path=absolutePath(name);
-        if(path.empty()) return -ENAMETOOLONG;
-        ResolvedPath openData=FilesystemManager::instance().resolvePath(path);
-        if(openData.result<0) return openData.result;
-        StringPart sp(path,string::npos,openData.off);
-        int result=openData.fs->open(files[i],sp,flags,mode);
-        if(result==0) return i; //The file descriptor
-        else return result; //The error code
+        Lock<FastMutex> l2(slotsMutex);
+        fd=findFree(3);
     }
-    return -ENFILE;
+    if(fd<0) return fd;
+    char path[PATH_BUFFER_SIZE];
+    if(int result=absolutePath(path,name)) return result;
+    ResolvedPath openData=
+        FilesystemManager::instance().resolvePath(path,sizeof(path));
+    if(openData.result<0) return openData.result;
+    StringPart sp(path,string::npos,openData.off);
+    intrusive_ref_ptr<FileBase> file;
+    if(int result=openData.fs->open(file,sp,flags,mode)) return result;
+    Lock<FastMutex> l2(slotsMutex);
+    install(fd,file);
+    return fd;
 }
 
 int FileDescriptorTable::close(int fd)
 {
-    //No need to lock the mutex when deleting
-    if(fd<0 || fd>=MAX_OPEN_FILES) return -EBADF;
+    //Declared before the lock, so that the file is closed after unlocking it
     intrusive_ref_ptr<FileBase> toClose;
-    toClose=atomic_exchange(files+fd,intrusive_ref_ptr<FileBase>());
-    if(!toClose) return -EBADF; //File entry was not open
+    Lock<FastMutex> l(slotsMutex);
+    if(fd<0 || fd>=slots->size || !slots->files[fd]) return -EBADF;
+    Slots *s=writableSlots(0);
+    s->setUsed(fd,false);
+    toClose=atomic_exchange(&s->files[fd],intrusive_ref_ptr<FileBase>());
     return 0;
 }
 
 void FileDescriptorTable::closeAll()
 {
-    for(int i=0;i<MAX_OPEN_FILES;i++)
-        atomic_exchange(files+i,intrusive_ref_ptr<FileBase>());
+    intrusive_ref_ptr<Slots> empty(new Slots(FD_TABLE_CHUNK,nullptr));
+    Lock<FastMutex> l(slotsMutex);
+    atomicAdd(&slots->owners,-1);
+    //The files are closed when empty goes out of scope, after unlocking
+    empty=atomic_exchange(&slots,empty);
+}
+
+int FileDescriptorTable::pipe(int fds[2])
+{
+    if(fds==nullptr) return -EFAULT;
+    intrusive_ref_ptr<PipeBuffer> buffer(new PipeBuffer);
+    intrusive_ref_ptr<FileBase> readEnd(
+        new PipeFile(intrusive_ref_ptr<FilesystemBase>(),buffer,O_RDONLY));
+    intrusive_ref_ptr<FileBase> writeEnd(
+        new PipeFile(intrusive_ref_ptr<FilesystemBase>(),buffer,O_WRONLY));
+    Lock<FastMutex> l(mutex);
+    Lock<FastMutex> l2(slotsMutex);
+    int readFd=findFree(3);
+    if(readFd<0) return readFd;
+    int writeFd=findFree(readFd+1);
+    if(writeFd<0) return writeFd;
+    install(readFd,readEnd);
+    install(writeFd,writeEnd);
+    fds[0]=readFd;
+    fds[1]=writeFd;
+    return 0;
+}
+
+ssize_t FileDescriptorTable::splice(int fdIn, int fdOut, size_t len,
+        unsigned int flags)
+{
+    //Important, since len is unsigned, but the return value has to be signed
+    if(static_cast<ssize_t>(len)<0) return -EINVAL;
+    if(flags & ~SPLICE_F_NONBLOCK) return -EINVAL;
+    intrusive_ref_ptr<FileBase> in=getFile(fdIn);
+    intrusive_ref_ptr<FileBase> out=getFile(fdOut);
+    if(!in || !out) return -EBADF;
+    PipeFile *inPipe=in->getPipe();
+    PipeFile *outPipe=out->getPipe();
+    if(inPipe && outPipe && inPipe->samePipe(outPipe)) return -EINVAL;
+    if(inPipe) return inPipe->spliceTo(out.get(),len,flags);
+    if(outPipe) return outPipe->spliceFrom(in.get(),len,flags);
+    return -EINVAL; //Neither is a pipe
 }
 
 int FileDescriptorTable::getcwd(char *buf, size_t len)
@@ -150,49 +256,60 @@ int FileDescriptorTable::getcwd(char *buf, size_t len)
 int FileDescriptorTable::chdir(const char* name)
 {
     if(name==0 || name[0]=='\0') return -EFAULT;
-    size_t len=strlen(name);
-    if(name[len-1]!='/') len++; //Reserve room for trailing slash
     Lock<FastMutex> l(mutex);
-    if(name[0]!='/') len+=cwd.length();
-    if(len>PATH_MAX) return -ENAMETOOLONG;
-    
-    string newCwd;
-    newCwd.reserve(len);
-    if(name[0]=='/') newCwd=name;
-    else {
-        newCwd=cwd;
-        newCwd+=name;
-    }
-    ResolvedPath openData=FilesystemManager::instance().resolvePath(newCwd);
+    char newCwd[PATH_BUFFER_SIZE];
+    if(int result=absolutePath(newCwd,name)) return result;
+    ResolvedPath openData=
+        FilesystemManager::instance().resolvePath(newCwd,sizeof(newCwd));
     if(openData.result<0) return openData.result;
     struct stat st;
-    StringPart sp(newCwd,string::npos,openData.off);
-    if(int result=openData.fs->lstat(sp,&st)) return result;
+    {
+        StringPart sp(newCwd,string::npos,openData.off);
+        if(int result=openData.fs->lstat(sp,&st)) return result;
+    }
     if(!S_ISDIR(st.st_mode)) return -ENOTDIR;
+    //Reserve room for the trailing slash, as paths relative to cwd are
+    //appended to it, and for at least one more char
+    size_t len=strlen(newCwd);
+    if(len+2>=PATH_BUFFER_SIZE) return -ENAMETOOLONG;
     //NOTE: put after resolvePath() as it strips trailing /
     //Also put after lstat() as it fails if path has a trailing slash
-    newCwd+='/';
     cwd=newCwd;
+    if(len>1) cwd+='/';
     return 0;
 }
 
 int FileDescriptorTable::mkdir(const char *name, int mode)
 {
     if(name==0 || name[0]=='\0') return -EFAULT;
-    string path=absolutePath(name);
-    if(path.empty()) return -ENAMETOOLONG;
-    ResolvedPath openData=FilesystemManager::instance().resolvePath(path,true);
+    char path[PATH_BUFFER_SIZE];
+    if(int result=absolutePath(path,name)) return result;
+    ResolvedPath openData=
+        FilesystemManager::instance().resolvePath(path,sizeof(path),true);
     if(openData.result<0) return openData.result;
     StringPart sp(path,string::npos,openData.off);
     return openData.fs->mkdir(sp,mode);
 }
 
+int FileDescriptorTable::mkfifo(const char *name, int mode)
+{
+    if(name==0 || name[0]=='\0') return -EFAULT;
+    char path[PATH_BUFFER_SIZE];
+    if(int result=absolutePath(path,name)) return result;
+    ResolvedPath openData=
+        FilesystemManager::instance().resolvePath(path,sizeof(path),true);
+    if(openData.result<0) return openData.result;
+    StringPart sp(path,string::npos,openData.off);
+    return openData.fs->mkfifo(sp,mode);
+}
+
 int FileDescriptorTable::rmdir(const char *name)
 {
     if(name==0 || name[0]=='\0') return -EFAULT;
-    string path=absolutePath(name);
-    if(path.empty()) return -ENAMETOOLONG;
-    ResolvedPath openData=FilesystemManager::instance().resolvePath(path,true);
+    char path[PATH_BUFFER_SIZE];
+    if(int result=absolutePath(path,name)) return result;
+    ResolvedPath openData=
+        FilesystemManager::instance().resolvePath(path,sizeof(path),true);
     if(openData.result<0) return openData.result;
     StringPart sp(path,string::npos,openData.off);
     return openData.fs->rmdir(sp);
@@ -201,8 +318,8 @@ int FileDescriptorTable::rmdir(const char *name)
 int FileDescriptorTable::unlink(const char *name)
 {
     if(name==0 || name[0]=='\0') return -EFAULT;
-    string path=absolutePath(name);
-    if(path.empty()) return -ENAMETOOLONG;
+    char path[PATH_BUFFER_SIZE];
+    if(int result=absolutePath(path,name)) return result;
     return FilesystemManager::instance().unlinkHelper(path);
 }
 
@@ -210,288 +327,183 @@ int FileDescriptorTable::rename(const char *oldName, const char *newName)
 {
     if(oldName==0 || oldName[0]=='\0') return -EFAULT;
     if(newName==0 || newName[0]=='\0') return -EFAULT;
-    string oldPath=absolutePath(oldName);
-    string newPath=absolutePath(newName);
-    if(oldPath.empty() || newPath.empty()) return -ENAMETOOLONG;
+    //The only call that needs two path buffers, as both paths are resolved
+    //while holding the filesystem manager mutex
+    char oldPath[PATH_BUFFER_SIZE];
+    char newPath[PATH_BUFFER_SIZE];
+    if(int result=absolutePath(oldPath,oldName)) return result;
+    if(int result=absolutePath(newPath,newName)) return result;
     return FilesystemManager::instance().renameHelper(oldPath,newPath);
 }
 
 int FileDescriptorTable::statImpl(const char* name, struct stat* pstat, bool f)
 {
     if(name==0 || name[0]=='\0' || pstat==0) return -EFAULT;
-    string path=absolutePath(name);
-    if(path.empty()) return -ENAMETOOLONG;
+    char path[PATH_BUFFER_SIZE];
+    if(int result=absolutePath(path,name)) return result;
     return FilesystemManager::instance().statHelper(path,pstat,f);
 }
 
 FileDescriptorTable::~FileDescriptorTable()
 {
     FilesystemManager::instance().removeFileDescriptorTable(this);
+    atomicAdd(&slots->owners,-1);
     //There's no need to lock the mutex and explicitly close files eventually
     //left open, because if there are other threads accessing this while we are
     //being deleted we have bigger problems anyway
 }
 
-string FileDescriptorTable::absolutePath(const char* path)
+int FileDescriptorTable::findFree(int first) const
 {
-    size_t len=strlen(path);
-    if(len>PATH_MAX) return "";
-    if(path[0]=='/') return path;
-    Lock<FastMutex> l(mutex);
-    if(len+cwd.length()>PATH_MAX) return "";
-    return cwd+path;
+    int fd=slots->findFree(first);
+    if(fd<0) fd=max(first,slots->size); //Table full, it will grow
+    return fd<MAX_OPEN_FILES ? fd : -ENFILE;
 }
 
-/**
- * This class implements the path resolution logic
- */
-class PathResolution
-{
-public:
-    /**
-     * Constructor
-     * \param fs map of all mounted filesystems
-     */
-    PathResolution(const map<StringPart,intrusive_ref_ptr<FilesystemBase> >& fs)
-            : filesystems(fs) {}
-    
-    /**
-     * The main purpose of this class, resolve a path
-     * \param path inout parameter with the path to resolve. The resolved path
-     * will be modified in-place in this string. The path must be absolute and
-     * start with a "/". The caller is responsible for that.
-     * \param followLastSymlink if true, follow last symlink
-     * \return a resolved path
-     */
-    ResolvedPath resolvePath(string& path, bool followLastSymlink);
-    
-private:
-    /**
-     * Handle a /../ in a path
-     * \param path path string
-     * \param slash path[slash] is the / character after the ..
-     * \return 0 on success, a negative number on error
-     */
-    int upPathComponent(string& path, size_t slash);
-    
-    /**
-     * Handle a normal path component in a path, i.e, a path component
-     * that is neither //, /./ or /../
-     * \param path path string
-     * \param followIfSymlink if true, follow symbolic links
-     * \return 0 on success, or a negative number on error
-     */
-    int normalPathComponent(string& path, bool followIfSymlink);
-    
-    /**
-     * Follow a symbolic link
-     * \param path path string. The relative path into the current filesystem 
-     * must be a symbolic link (verified by the caller).
-     * \return 0 on success, a negative number on failure
-     */
-    int followSymlink(string& path);
-    
-    /**
-     * Find to which filesystem this path belongs
-     * \param path path string.
-     * \return 0 on success, a negative number on failure
-     */
-    int recursiveFindFs(string& path);
-
-    /// Mounted filesystems
-    const map<StringPart,intrusive_ref_ptr<FilesystemBase> >& filesystems;
-    
-    /// Pointer to root filesystem
-    intrusive_ref_ptr<FilesystemBase> root;
-    
-    /// Current filesystem while looking up path
-    intrusive_ref_ptr<FilesystemBase> fs;
-    
-    /// True if current filesystem supports symlinks
-    bool syms;
-    
-    /// path[index] is first unhandled char
-    size_t index;
-    
-    /// path.substr(indexIntoFs) is the relative path to current filesystem
-    size_t indexIntoFs;
-    
-    /// How many components does the relative path have in current fs
-    int depthIntoFs;
-    
-    /// How many symlinks we've found so far
-    int linksFollowed;
-    
-    /// Maximum number of symbolic links to follow (to avoid endless loops)
-    static const int maxLinkToFollow=2;
-};
-
-ResolvedPath PathResolution::resolvePath(string& path, bool followLastSymlink)
-{
-    map<StringPart,intrusive_ref_ptr<FilesystemBase> >::const_iterator it;
-    it=filesystems.find(StringPart("/"));
-    if(it==filesystems.end()) return ResolvedPath(-ENOENT); //should not happen
-    root=fs=it->second;
-    syms=fs->supportsSymlinks();
-    index=1;       //Skip leading /
-    indexIntoFs=1; //NOTE: caller must ensure path[0]=='/'
-    depthIntoFs=1;
-    linksFollowed=0;
-    for(;;)
-    {
-        size_t slash=path.find_first_of('/',index);
-        //cout<<path.substr(0,slash)<<endl;
-        //Last component (no trailing /)
-        if(slash==string::npos) slash=path.length(); //NOTE: one past the last
-
-        if(slash==index)
-        {
-            //Path component is empty, caused by double slash, remove it
-            path.erase(index,1);
-        } else if(slash-index==1 && path[index]=='.')
-        {
-            path.erase(index,2); //Path component is ".", ignore
-        } else if(slash-index==2 && path[index]=='.' && path[index+1]=='.')
-        {
-            int result=upPathComponent(path,slash);
-            if(result<0) return ResolvedPath(result);
-        } else {
-            index=slash+1; //NOTE: if(slash==string::npos) two past the last
-            // follow=followLastSymlink for "/link", but is true for "/link/"
-            bool follow=index>path.length() ? followLastSymlink : true;
-            int result=normalPathComponent(path,follow);
-            if(result<0) return ResolvedPath(result);
-        }
-        //Last component
-        if(index>=path.length())
-        {
-            //Remove trailing /
-            size_t last=path.length()-1;
-            if(path[last]=='/')
-            {
-                path.erase(last,1);
-                //This may happen if the last path component is a fs
-                if(indexIntoFs>path.length()) indexIntoFs=path.length();
-            }
-            return ResolvedPath(fs,indexIntoFs);
-        }
-    }
+FileDescriptorTable::Slots *FileDescriptorTable::writableSlots(int minSize)
+{
+    //Only this member function replaces slots, and slotsMutex is locked, so
+    //no need for atomic_load()
+    if(slots->owners==1 && slots->size>=minSize) return slots.get();
+    int size=max<int>(slots->size,
+        (minSize+FD_TABLE_CHUNK-1)/FD_TABLE_CHUNK*FD_TABLE_CHUNK);
+    size=min<int>(size,MAX_OPEN_FILES);
+    intrusive_ref_ptr<Slots> copy(new Slots(size,slots.get()));
+    atomicAdd(&slots->owners,-1);
+    atomic_store(&slots,copy);
+    return copy.get();
 }
 
-int PathResolution::upPathComponent(string& path, size_t slash)
+void FileDescriptorTable::install(int fd, intrusive_ref_ptr<FileBase> file)
 {
-    if(index<=1) return -ENOENT; //root dir has no parent
-    size_t removeStart=path.find_last_of('/',index-2);
-    if(removeStart==string::npos) return -ENOENT; //should not happen
-    path.erase(removeStart,slash-removeStart);
-    index=removeStart+1;
-    //This may happen when merging a path like "/dir/.."
-    if(path.empty()) path='/';
-    //This may happen if the new last path component is a fs, e.g. "/dev/null/.."
-    if(indexIntoFs>path.length()) indexIntoFs=path.length();
-    if(--depthIntoFs>0) return 0;
-    
-    //Depth went to zero, escape current filesystem
-    return recursiveFindFs(path);
+    Slots *s=writableSlots(fd+1);
+    s->setUsed(fd,true);
+    atomic_store(&s->files[fd],file);
 }
 
-int PathResolution::normalPathComponent(string& path, bool followIfSymlink)
+static_assert(PATH_BUFFER_SIZE<=PATH_MAX+1,"PATH_BUFFER_SIZE is too large");
+
+int FileDescriptorTable::absolutePath(char *buffer, const char* path)
 {
-    map<StringPart,intrusive_ref_ptr<FilesystemBase> >::const_iterator it;
-    it=filesystems.find(StringPart(path,index-1));
-    if(it!=filesystems.end())
+    size_t len=strlen(path);
+    if(len>=PATH_BUFFER_SIZE) return -ENAMETOOLONG;
+    if(path[0]=='/')
     {
-        //Jumped to a new filesystem. Not stat-ing the path as we're
-        //relying on mount not allowing to mount a filesystem on anything
-        //but a directory.
-        fs=it->second;
-        syms=fs->supportsSymlinks();
-        indexIntoFs=index>path.length() ? index-1 : index;
-        depthIntoFs=1;
+        memcpy(buffer,path,len+1);
         return 0;
     }
-    depthIntoFs++;
-    if(syms && followIfSymlink)
-    {
-        struct stat st;
-        {
-            StringPart sp(path,index-1,indexIntoFs);
-            if(int res=fs->lstat(sp,&st)<0) return res;
-        }
-        if(S_ISLNK(st.st_mode)) return followSymlink(path);
-        else if(index<=path.length() && !S_ISDIR(st.st_mode)) return -ENOTDIR;
-    }
+    Lock<FastMutex> l(mutex);
+    if(len+cwd.length()>=PATH_BUFFER_SIZE) return -ENAMETOOLONG;
+    memcpy(buffer,cwd.c_str(),cwd.length());
+    memcpy(buffer+cwd.length(),path,len+1);
     return 0;
 }
 
-int PathResolution::followSymlink(string& path)
+int FileDescriptorTable::aioSubmit(AioRequest *const *reqs, int count,
+        AioCompletion& completion)
 {
-    if(++linksFollowed>=maxLinkToFollow) return -ELOOP;
-    string target;
+    if(count<0) return -EINVAL;
+    for(int i=0;i<count;i++)
+    {
+        AioRequest *req=reqs[i];
+        int result=0;
+        intrusive_ref_ptr<FileBase> file;
+        if(req==nullptr || (req->buffer==nullptr && req->size>0)) result=-EFAULT;
+        else if(static_cast<ssize_t>(req->size)<0) result=-EINVAL;
+        else if(req->op!=AioRequest::READ && req->op!=AioRequest::WRITE)
+            result=-EINVAL;
+        else if(!(file=getFile(req->fd))) result=-EBADF;
+        if(result<0) return i>0 ? i : result;
+        aioStart(req,file,completion);
+    }
+    return count;
+}
+
+int FileDescriptorTable::poll(struct pollfd *fds, nfds_t nfds,
+        long long timeoutNs)
+{
+    if(nfds>MAX_OPEN_FILES) return -EINVAL;
+    if(fds==nullptr && nfds>0) return -EFAULT;
+    long long deadline=timeoutNs>0 ? getTime()+timeoutNs : timeoutNs;
+    //The files are kept open until poll returns, so that the entries can be
+    //removed from their wait queues even if the fd is concurrently closed.
+    //Most calls poll a few files, so only larger ones allocate memory
+    intrusive_ref_ptr<FileBase> stackFiles[FD_TABLE_CHUNK];
+    WaitQueueEntry stackEntries[FD_TABLE_CHUNK];
+    unique_ptr<intrusive_ref_ptr<FileBase>[]> heapFiles;
+    unique_ptr<WaitQueueEntry[]> heapEntries;
+    intrusive_ref_ptr<FileBase> *pollFiles=stackFiles;
+    WaitQueueEntry *entries=stackEntries;
+    if(nfds>FD_TABLE_CHUNK)
     {
-        StringPart sp(path,index-1,indexIntoFs);
-        if(int res=fs->readlink(sp,target)<0) return res;
+        heapFiles.reset(new intrusive_ref_ptr<FileBase>[nfds]);
+        heapEntries.reset(new WaitQueueEntry[nfds]);
+        pollFiles=heapFiles.get();
+        entries=heapEntries.get();
     }
-    if(target.empty()) return -ENOENT; //Should not happen
-    if(target[0]=='/')
+    volatile bool woken;
+    for(nfds_t i=0;i<nfds;i++)
     {
-        //Symlink is absolute
-        size_t newPathLen=target.length()+path.length()-index+1;
-        if(newPathLen>PATH_MAX) return -ENAMETOOLONG;
-        string newPath;
-        newPath.reserve(newPathLen);
-        newPath=target;
-        if(index<=path.length())
-            newPath.insert(newPath.length(),path,index-1,string::npos);
-        path.swap(newPath);
-        fs=root;
-        syms=root->supportsSymlinks();
-        index=1;
-        indexIntoFs=1;
-        depthIntoFs=1;
-    } else {
-        //Symlink is relative
-        size_t removeStart=path.find_last_of('/',index-2);
-        size_t newPathLen=path.length()-(index-removeStart-2)+target.length();
-        if(newPathLen>PATH_MAX) return -ENAMETOOLONG;
-        string newPath;
-        newPath.reserve(newPathLen);
-        newPath.insert(0,path,0,removeStart+1);
-        newPath+=target;
-        if(index<=path.length())
-            newPath.insert(newPath.length(),path,index-1,string::npos);
-        path.swap(newPath);
-        index=removeStart+1;
-        depthIntoFs--;
+        pollFiles[i]=getFile(fds[i].fd);
+        entries[i].thread=Thread::getCurrentThread();
+        entries[i].woken=&woken;
     }
-    return 0;
+    int result;
+    for(bool first=true;;first=false)
+    {
+        woken=false;
+        result=0;
+        for(nfds_t i=0;i<nfds;i++)
+        {
+            fds[i].revents=0;
+            if(fds[i].fd<0) continue;
+            if(!pollFiles[i]) fds[i].revents=POLLNVAL;
+            else {
+                //Entries are added only once, and stay in the wait queues
+                //until poll returns
+                bool add=first && timeoutNs!=0;
+                int ready=pollFiles[i]->poll(add ? entries+i : nullptr);
+                fds[i].revents=ready & (fds[i].events | POLLERR | POLLHUP);
+            }
+            if(fds[i].revents) result++;
+        }
+        if(result>0 || timeoutNs==0) break;
+        FastInterruptDisableLock dLock;
+        if(woken) continue; //A file became ready while polling the others
+        if(deadline<0) Thread::IRQenableIrqAndWait(dLock);
+        else if(Thread::IRQenableIrqAndTimedWait(dLock,deadline)
+                ==TimedWaitResult::Timeout && woken==false) break;
+    }
+    for(nfds_t i=0;i<nfds;i++) WaitQueue::remove(entries+i);
+    return result;
+}
+
+int FileDescriptorTable::mmap(const void **addr, size_t len, int prot,
+        int flags, int fd, off_t offset)
+{
+    if(len==0 || offset<0) return -EINVAL;
+    if(flags!=MAP_SHARED && flags!=MAP_PRIVATE) return -EINVAL;
+    //Writable mappings would need the file content in RAM
+    if(prot & PROT_WRITE) return -ENOTSUP;
+    if((prot & PROT_READ)==0) return -EACCES;
+    intrusive_ref_ptr<FileBase> file=getFile(fd);
+    if(!file) return -EBADF;
+    return file->mmap(offset,len,addr);
 }
 
-int PathResolution::recursiveFindFs(string& path)
+int FileDescriptorTable::checkIovec(const struct iovec *iov, int iovcnt)
 {
-    depthIntoFs=1;
-    size_t backIndex=index;
-    for(;;)
+    if(iovcnt<0 || iovcnt>IOV_MAX) return -EINVAL;
+    if(iov==0 && iovcnt>0) return -EFAULT;
+    size_t total=0;
+    for(int i=0;i<iovcnt;i++)
     {
-        backIndex=path.find_last_of('/',backIndex-1);
-        if(backIndex==string::npos) return -ENOENT; //should not happpen
-        if(backIndex==0)
-        {
-            fs=root;
-            indexIntoFs=1;
-            break;
-        }
-        map<StringPart,intrusive_ref_ptr<FilesystemBase> >::const_iterator it;
-        it=filesystems.find(StringPart(path,backIndex));
-        if(it!=filesystems.end())
-        {
-            fs=it->second;
-            indexIntoFs=backIndex+1;
-            break;
-        }
-        depthIntoFs++;
+        if(iov[i].iov_base==0 && iov[i].iov_len>0) return -EFAULT;
+        //Like for read and write, the total has to fit in the return value
+        total+=iov[i].iov_len;
+        if(total<iov[i].iov_len || static_cast<ssize_t>(total)<0)
+            return -EINVAL;
     }
-    syms=fs->supportsSymlinks();
     return 0;
 }
 
@@ -510,41 +522,58 @@ int FilesystemManager::kmount(const char* path, intrusive_ref_ptr<FilesystemBase
     if(path==0 || path[0]=='\0' || !fs) return -EFAULT;
     Lock<FastMutex> l(mutex);
     size_t len=strlen(path);
-    if(len>PATH_MAX) return -ENAMETOOLONG;
-    string temp(path);
-    if(!(temp=="/" && filesystems.empty())) //Skip check when mounting /
+    if(len>=PATH_BUFFER_SIZE) return -ENAMETOOLONG;
+    char temp[PATH_BUFFER_SIZE];
+    memcpy(temp,path,len+1);
+    //Skip check when mounting /
+    if(!(strcmp(temp,"/")==0 && !mounts.fs && !mounts.child))
     {
         struct stat st;
         if(int result=statHelper(temp,&st,false)) return result;
         if(!S_ISDIR(st.st_mode)) return -ENOTDIR;
-        string parent=temp+"/..";
-        if(int result=statHelper(parent,&st,false)) return result;
+        //temp is now in canonical form, so its parent is found by cutting the
+        //last component in place, that resolves to the same path, instead of
+        //using a second buffer for temp+"/.."
+        char *cut=strrchr(temp,'/');
+        if(cut==temp) cut++; //Parent is /
+        char saved=*cut;
+        *cut='\0';
+        int result=statHelper(temp,&st,false);
+        *cut=saved;
+        if(result) return result;
         fs->setParentFsMountpointInode(st.st_ino);
     }
-    if(filesystems.insert(make_pair(StringPart(temp),fs)).second==false)
-        return -EBUSY; //Means already mounted
-    else
-        return 0;
+    //After statHelper() so temp is in canonical form
+    MountPoint *mp=&mounts;
+    for(char *it=temp+1;*it;)
+    {
+        char *end=strchr(it,'/');
+        size_t n=end ? end-it : strlen(it);
+        mp=mp->findOrAdd(it,n);
+        it+=n+(end ? 1 : 0);
+    }
+    if(mp->fs) return -EBUSY; //Means already mounted
+    mp->fs=fs;
+    return 0;
 }
 
 int FilesystemManager::umount(const char* path, bool force)
 {
     typedef
-    typename map<StringPart,intrusive_ref_ptr<FilesystemBase> >::iterator fsIt;
+    typename vector<intrusive_ref_ptr<FilesystemBase> >::iterator fsIt;
     
     if(path==0 || path[0]=='\0') return -ENOENT;
     size_t len=strlen(path);
     if(len>PATH_MAX) return -ENAMETOOLONG;
     Lock<FastMutex> l(mutex); //A reader-writer lock would be better
-    fsIt it=filesystems.find(StringPart(path));
-    if(it==filesystems.end()) return -EINVAL;
+    MountPoint *mp=findMountPoint(path);
+    if(mp==0 || !mp->fs) return -EINVAL;
     
     //This finds all the filesystems that have to be recursively umounted
     //to umount the required filesystem. For example, if /path and /path/path2
     //are filesystems, umounting /path must umount also /path/path2
-    vector<fsIt> fsToUmount;
-    for(fsIt it2=filesystems.begin();it2!=filesystems.end();++it2)
-        if(it2->first.startsWith(it->first)) fsToUmount.push_back(it2);
+    vector<intrusive_ref_ptr<FilesystemBase> > fsToUmount;
+    mp->mountedBelow(fsToUmount);
     
     //Now look into all file descriptor tables if there are open files in the
     //filesystems to umount. If there are, return busy. This is an heavy
@@ -561,10 +590,10 @@ int FilesystemManager::umount(const char* path, bool force)
         {
             intrusive_ref_ptr<FileBase> file=(*it3)->getFile(i);
             if(!file) continue;
-            vector<fsIt>::iterator it4;
+            fsIt it4;
             for(it4=fsToUmount.begin();it4!=fsToUmount.end();++it4)
             {
-                if(file->getParent()!=(*it4)->second) continue;
+                if(file->getParent()!=*it4) continue;
                 if(force==false) return -EBUSY;
                 (*it3)->close(i); //If forced umount, close the file
             }
@@ -575,10 +604,10 @@ int FilesystemManager::umount(const char* path, bool force)
     {
         intrusive_ref_ptr<FileBase> file=getFileDescriptorTable().getFile(i);
         if(!file) continue;
-        vector<fsIt>::iterator it4;
+        fsIt it4;
         for(it4=fsToUmount.begin();it4!=fsToUmount.end();++it4)
         {
-            if(file->getParent()!=(*it4)->second) continue;
+            if(file->getParent()!=*it4) continue;
             if(force==false) return -EBUSY;
             getFileDescriptorTable().close(i);//If forced umount, close the file
         }
@@ -593,14 +622,14 @@ int FilesystemManager::umount(const char* path, bool force)
     //happen in case of a forced umount. In such a case there is no entry in
     //the descriptor table (as close was called) but the operation is still
     //ongoing.
-    vector<fsIt>::iterator it5;
+    fsIt it5;
     const int maxRetry=3; //Retry up to three times
     for(int i=0;i<maxRetry;i++)
     { 
         bool failed=false;
         for(it5=fsToUmount.begin();it5!=fsToUmount.end();++it5)
         {
-            if((*it5)->second->areAllFilesClosed()) continue;
+            if((*it5)->areAllFilesClosed()) continue;
             if(force==false) return -EBUSY;
             failed=true;
             break;
@@ -611,8 +640,7 @@ int FilesystemManager::umount(const char* path, bool force)
     }
     
     //It is now safe to umount all filesystems
-    for(it5=fsToUmount.begin();it5!=fsToUmount.end();++it5)
-        filesystems.erase(*it5);
+    mp->removeAll();
     return 0;
 }
 
@@ -625,57 +653,69 @@ void FilesystemManager::umountAll()
     #else //WITH_PROCESSES
     getFileDescriptorTable().closeAll();
     #endif //WITH_PROCESSES
-    filesystems.clear();
+    mounts.removeAll();
 }
 
-ResolvedPath FilesystemManager::resolvePath(string& path, bool followLastSymlink)
+ResolvedPath FilesystemManager::resolvePath(char *path, size_t size,
+        bool followLastSymlink)
 {
-    //see man path_resolution. This code supports arbitrarily mounted
-    //filesystems, symbolic links resolution, but no hardlinks to directories
-    if(path.length()>PATH_MAX) return ResolvedPath(-ENAMETOOLONG);
-    if(path.empty() || path[0]!='/') return ResolvedPath(-ENOENT);
+    if(path[0]!='/') return ResolvedPath(-ENOENT);
+    if(strlen(path)>=size) return ResolvedPath(-ENAMETOOLONG);
 
     Lock<FastMutex> l(mutex);
-    PathResolution pr(filesystems);
-    return pr.resolvePath(path,followLastSymlink);
+    return miosix::resolvePath(path,size,&mounts,followLastSymlink);
 }
 
-int FilesystemManager::unlinkHelper(string& path)
+ResolvedPath FilesystemManager::resolvePath(string& path, bool followLastSymlink)
+{
+    if(path.length()>=PATH_BUFFER_SIZE) return ResolvedPath(-ENAMETOOLONG);
+    if(path.empty()) return ResolvedPath(-ENOENT);
+    char temp[PATH_BUFFER_SIZE];
+    memcpy(temp,path.c_str(),path.length()+1);
+    ResolvedPath result=resolvePath(temp,sizeof(temp),followLastSymlink);
+    if(result.result==0) path=temp;
+    return result;
+}
+
+int FilesystemManager::unlinkHelper(char *path)
 {
     //Do everything while keeping the mutex locked to prevent someone to
     //concurrently mount a filesystem on the directory we're unlinking
     Lock<FastMutex> l(mutex);
-    ResolvedPath openData=resolvePath(path,true);
+    ResolvedPath openData=resolvePath(path,PATH_BUFFER_SIZE,true);
     if(openData.result<0) return openData.result;
     //After resolvePath() so path is in canonical form and symlinks are followed
-    if(filesystems.find(StringPart(path))!=filesystems.end()) return -EBUSY;
+    MountPoint *mp=findMountPoint(path);
+    if(mp && mp->fs) return -EBUSY;
     StringPart sp(path,string::npos,openData.off);
     return openData.fs->unlink(sp);
 }
 
-int FilesystemManager::statHelper(string& path, struct stat *pstat, bool f)
+int FilesystemManager::statHelper(char *path, struct stat *pstat, bool f)
 {
-    ResolvedPath openData=resolvePath(path,f);
+    ResolvedPath openData=resolvePath(path,PATH_BUFFER_SIZE,f);
     if(openData.result<0) return openData.result;
     StringPart sp(path,string::npos,openData.off);
     return openData.fs->lstat(sp,pstat);
 }
 
-int FilesystemManager::renameHelper(string& oldPath, string& newPath)
+int FilesystemManager::renameHelper(char *oldPath, char *newPath)
 {
     //Do everything while keeping the mutex locked to prevent someone to
     //concurrently mount a filesystem on the directory we're renaming
     Lock<FastMutex> l(mutex);
-    ResolvedPath oldOpenData=resolvePath(oldPath,true);
+    ResolvedPath oldOpenData=resolvePath(oldPath,PATH_BUFFER_SIZE,true);
     if(oldOpenData.result<0) return oldOpenData.result;
-    ResolvedPath newOpenData=resolvePath(newPath,true);
+    ResolvedPath newOpenData=resolvePath(newPath,PATH_BUFFER_SIZE,true);
     if(newOpenData.result<0) return newOpenData.result;
     
     if(oldOpenData.fs!=newOpenData.fs) return -EXDEV; //Can't rename across fs
     
     //After resolvePath() so path is in canonical form and symlinks are followed
-    if(filesystems.find(StringPart(oldPath))!=filesystems.end()) return -EBUSY;
-    if(filesystems.find(StringPart(newPath))!=filesystems.end()) return -EBUSY;
+    MountPoint *oldMp=findMountPoint(oldPath);
+    if(oldMp && oldMp->fs) return -EBUSY;
+    MountPoint *newMp=findMountPoint(newPath);
+    if(newMp && newMp->fs) return -EBUSY;
     
     StringPart oldSp(oldPath,string::npos,oldOpenData.off);
     StringPart newSp(newPath,string::npos,newOpenData.off);
@@ -685,6 +725,19 @@ int FilesystemManager::renameHelper(string& oldPath, string& newPath)
     return oldOpenData.fs->rename(oldSp,newSp);
 }
 
+MountPoint *FilesystemManager::findMountPoint(const char *path)
+{
+    MountPoint *mp=&mounts;
+    for(const char *it=path;*it && mp;)
+    {
+        const char *end=strchr(it,'/');
+        size_t n=end ? end-it : strlen(it);
+        if(n>0) mp=mp->find(it,n); //Skip empty path components
+        it+=n+(end ? 1 : 0);
+    }
+    return mp;
+}
+
 short int FilesystemManager::getFilesystemId()
 {
     return atomicAddExchange(&devCount,1);
@@ -742,6 +795,28 @@ basicFilesystemSetup(intrusive_ref_ptr<Device> dev)
     }
     bootlog(fat32failed==0 ? "Ok\n" : "Failed\n");
     
+    #ifdef WITH_TMPFS
+    bootlog("Mounting TmpFs as /tmp ... ");
+    StringPart tmp("tmp");
+    int r3=rootFs->mkdir(tmp,0755);
+    intrusive_ref_ptr<TmpFs> tmpfs(new TmpFs);
+    int r4=fsm.kmount("/tmp",tmpfs);
+    bootlog(r3==0 && r4==0 ? "Ok\n" : "Failed\n");
+    #endif //WITH_TMPFS
+    
+    #ifdef WITH_ROMFS
+    if(_romfs_start)
+    {
+        bootlog("Mounting RomFs as /rom ... ");
+        StringPart rom("rom");
+        int r5=rootFs->mkdir(rom,0755);
+        intrusive_ref_ptr<RomFs> romfs(new RomFs(_romfs_start));
+        bool romFsOk=r5==0 && romfs->mountFailed()==false
+                  && fsm.kmount("/rom",romfs)==0;
+        bootlog(romFsOk ? "Ok\n" : "Failed\n");
+    }
+    #endif //WITH_ROMFS
+    
     #ifdef WITH_DEVFS
     return devfs;
     #endif //WITH_DEVFS
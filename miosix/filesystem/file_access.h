@@ -28,13 +28,15 @@
 #ifndef FILE_ACCESS_H
 #define FILE_ACCESS_H
 
-#include <map>
 #include <list>
 #include <string>
+#include <memory>
 #include <errno.h>
 #include <sys/stat.h>
 #include "file.h"
+#include "aio.h"
 #include "stringpart.h"
+#include "path_resolution.h"
 #include "devfs/devfs.h"
 #include "kernel/sync.h"
 #include "kernel/intrusive.h"
@@ -44,42 +46,15 @@
 
 namespace miosix {
 
-/**
- * The result of resolvePath().
- */
-class ResolvedPath
-{
-public:
-    /**
-     * Constructor
-     */
-    ResolvedPath() : result(-EINVAL), fs(0), off(0) {}
-    
-    /**
-     * Constructor
-     * \param result error code
-     */
-    explicit ResolvedPath(int result) : result(result), fs(0), off(0) {}
-    
-    /**
-     * Constructor
-     * \param fs filesystem
-     * \param off offset into path where the subpath relative to the current
-     * filesystem starts
-     */
-    ResolvedPath(intrusive_ref_ptr<FilesystemBase> fs, size_t offset)
-            : result(0), fs(fs), off(offset) {}
-    
-    int result; ///< 0 on success, a negative number on failure
-    intrusive_ref_ptr<FilesystemBase> fs; ///< pointer to the filesystem to which the file belongs
-    /// path.c_str()+off is a string containing the relative path into the
-    /// filesystem for the looked up file
-    size_t off;
-};
-
 /**
  * This class maps file descriptors to file objects, allowing to
  * perform file operations
+ *
+ * The table starts with room for FD_TABLE_CHUNK file descriptors, and grows
+ * in chunks of that size as files are opened, up to MAX_OPEN_FILES. Free
+ * file descriptors are found with a bitmap. The table of a process started
+ * by another process is shared with the parent, and copied by the first of
+ * the two that opens or closes a file (copy on write).
  */
 class FileDescriptorTable
 {
@@ -96,7 +71,8 @@ public:
     FileDescriptorTable(const FileDescriptorTable& rhs);
     
     /**
-     * Operator=
+     * Operator=. The file descriptors are shared until one of the two tables
+     * is modified, the current directory is copied
      * \param rhs object to copy from
      * \return *this 
      */
@@ -123,6 +99,27 @@ public:
      */
     void closeAll();
     
+    /**
+     * Create a pipe
+     * \param fds the file descriptor of the read end is stored in fds[0], the
+     * one of the write end in fds[1]
+     * \return 0 on success, or a negative number on failure
+     */
+    int pipe(int fds[2]);
+    
+    /**
+     * Move data between a pipe and a file, without copying it to an
+     * intermediate buffer. One of the two file descriptors must be a pipe
+     * or FIFO, the other any file, including another pipe.
+     * \param fdIn file descriptor to read from
+     * \param fdOut file descriptor to write to
+     * \param len maximum number of bytes to move
+     * \param flags SPLICE_F_NONBLOCK to not block on the pipe, or 0
+     * \return the number of bytes moved, 0 if there is nothing more to read,
+     * or a negative number on failure
+     */
+    ssize_t splice(int fdIn, int fdOut, size_t len, unsigned int flags);
+    
     /**
      * Write data to the file, if the file supports writing.
      * \param data the data to write
@@ -159,6 +156,119 @@ public:
         return file->read(data,len);
     }
     
+    /**
+     * Write data to the file from multiple buffers, if the file supports
+     * writing.
+     * \param iov buffers with the data to write
+     * \param iovcnt number of buffers, at most IOV_MAX
+     * \return the number of written characters, or a negative number in case
+     * of errors
+     */
+    ssize_t writev(int fd, const struct iovec *iov, int iovcnt)
+    {
+        int result=checkIovec(iov,iovcnt);
+        if(result<0) return result;
+        intrusive_ref_ptr<FileBase> file=getFile(fd);
+        if(!file) return -EBADF;
+        return file->writev(iov,iovcnt);
+    }
+    
+    /**
+     * Read data from the file into multiple buffers, if the file supports
+     * reading.
+     * \param iov buffers to store read data
+     * \param iovcnt number of buffers, at most IOV_MAX
+     * \return the number of read characters, or a negative number in case
+     * of errors
+     */
+    ssize_t readv(int fd, const struct iovec *iov, int iovcnt)
+    {
+        int result=checkIovec(iov,iovcnt);
+        if(result<0) return result;
+        intrusive_ref_ptr<FileBase> file=getFile(fd);
+        if(!file) return -EBADF;
+        return file->readv(iov,iovcnt);
+    }
+    
+    /**
+     * Write data at a given position in the file, without moving the file
+     * pointer.
+     * \param data the data to write
+     * \param len the number of bytes to write
+     * \param pos offset from the beginning of the file
+     * \return the number of written characters, or a negative number in case
+     * of errors
+     */
+    ssize_t pwrite(int fd, const void *data, size_t len, off_t pos)
+    {
+        if(data==0) return -EFAULT;
+        if(static_cast<ssize_t>(len)<0 || pos<0) return -EINVAL;
+        intrusive_ref_ptr<FileBase> file=getFile(fd);
+        if(!file) return -EBADF;
+        return file->pwrite(data,len,pos);
+    }
+    
+    /**
+     * Read data from a given position in the file, without moving the file
+     * pointer.
+     * \param data buffer to store read data
+     * \param len the number of bytes to read
+     * \param pos offset from the beginning of the file
+     * \return the number of read characters, or a negative number in case
+     * of errors
+     */
+    ssize_t pread(int fd, void *data, size_t len, off_t pos)
+    {
+        if(data==0) return -EFAULT;
+        if(static_cast<ssize_t>(len)<0 || pos<0) return -EINVAL;
+        intrusive_ref_ptr<FileBase> file=getFile(fd);
+        if(!file) return -EBADF;
+        return file->pread(data,len,pos);
+    }
+    
+    /**
+     * Start a batch of asynchronous read and write requests. Requests on
+     * block devices and files that support it natively are performed without
+     * going through the worker thread that performs all the others
+     * \param reqs array of pointers to the requests
+     * \param count number of requests
+     * \param completion notified when each request completes
+     * \return the number of requests started, or a negative number if the
+     * first request could not be started
+     */
+    int aioSubmit(AioRequest *const *reqs, int count, AioCompletion& completion);
+    
+    /**
+     * Wait until one of a set of files can be read or written without
+     * blocking.
+     * \param fds files to wait for and requested events. On return, revents
+     * is set to the events that occurred, POLLNVAL for invalid file
+     * descriptors. Entries with a negative fd are ignored
+     * \param nfds number of entries in fds, at most MAX_OPEN_FILES. The
+     * bookkeeping of up to FD_TABLE_CHUNK entries is on the stack, larger
+     * calls allocate it on the heap
+     * \param timeoutNs maximum time to wait in nanoseconds, 0 to return
+     * immediately, or a negative number to wait indefinitely
+     * \return the number of entries with a nonzero revents, 0 on timeout,
+     * or a negative number in case of errors
+     */
+    int poll(struct pollfd *fds, nfds_t nfds, long long timeoutNs);
+    
+    /**
+     * Map a range of a file in memory. Only read-only mappings of files whose
+     * storage is memory addressable are supported, the returned pointer
+     * points directly into the storage.
+     * \param addr the address of the mapping is stored here
+     * \param len size of the range
+     * \param prot PROT_READ, optionally with PROT_EXEC
+     * \param flags MAP_SHARED or MAP_PRIVATE
+     * \param fd file descriptor
+     * \param offset start of the range, from the beginning of the file
+     * \return 0 on success, or a negative number on failure
+     */
+    int mmap(const void **addr, size_t len, int prot, int flags, int fd,
+             off_t offset);
+    
     /**
      * Move file pointer, if the file supports random-access.
      * \param pos offset to sum to the beginning of the file, current position
@@ -174,6 +284,35 @@ public:
         return file->lseek(pos,whence);
     }
     
+    /**
+     * Truncate or extend a file to a given size
+     * \param fd file descriptor
+     * \param size new file size
+     * \return 0 on success, or a negative number on failure
+     */
+    int ftruncate(int fd, off_t size)
+    {
+        if(size<0) return -EINVAL;
+        intrusive_ref_ptr<FileBase> file=getFile(fd);
+        if(!file) return -EBADF;
+        return file->ftruncate(size);
+    }
+    
+    /**
+     * Allocate storage for a range of a file
+     * \param fd file descriptor
+     * \param offset start of the range
+     * \param len length of the range
+     * \return 0 on success, or a negative number on failure
+     */
+    int fallocate(int fd, off_t offset, off_t len)
+    {
+        if(offset<0 || len<=0) return -EINVAL;
+        intrusive_ref_ptr<FileBase> file=getFile(fd);
+        if(!file) return -EBADF;
+        return file->fallocate(offset,len);
+    }
+    
     /**
      * Return file information.
      * \param pstat pointer to stat struct
@@ -288,6 +427,14 @@ public:
      */
     int mkdir(const char *name, int mode);
     
+    /**
+     * Create a FIFO
+     * \param name FIFO to create
+     * \param mode FIFO permissions
+     * \return 0 on success, or a negative number on failure
+     */
+    int mkfifo(const char *name, int mode);
+    
     /**
      * Remove a directory if empty
      * \param name directory to create
@@ -319,8 +466,9 @@ public:
      */
     intrusive_ref_ptr<FileBase> getFile(int fd) const
     {
-        if(fd<0 || fd>=MAX_OPEN_FILES) return intrusive_ref_ptr<FileBase>();
-        return atomic_load(files+fd);
+        intrusive_ref_ptr<Slots> s=atomic_load(&slots);
+        if(fd<0 || fd>=s->size) return intrusive_ref_ptr<FileBase>();
+        return atomic_load(&s->files[fd]);
     }
     
     /**
@@ -329,13 +477,92 @@ public:
     ~FileDescriptorTable();
     
 private:
+    /**
+     * The file descriptors of a table. The table replaces them with a larger
+     * copy when it grows, and with a copy when it modifies them while they are
+     * shared with other tables, so that threads that are reading them while
+     * this happens can keep using the previous ones
+     */
+    class Slots : public IntrusiveRefCounted
+    {
+    public:
+        /**
+         * Constructor
+         * \param size number of file descriptors
+         * \param rhs if not null, the file descriptors are copied from here
+         */
+        Slots(int size, const Slots *rhs);
+
+        /**
+         * \param first lowest file descriptor to consider
+         * \return the lowest free file descriptor not lower than first, or -1
+         * if there is none
+         */
+        int findFree(int first) const;
+
+        /**
+         * Mark a file descriptor as used or free
+         * \param fd file descriptor
+         * \param used true if used
+         */
+        void setUsed(int fd, bool used)
+        {
+            unsigned int bit=0x80000000u>>(fd % 32);
+            if(used) bitmap[fd/32]|=bit; else bitmap[fd/32]&=~bit;
+        }
+
+        const int size;      ///< Number of file descriptors
+        volatile int owners; ///< Number of tables sharing these slots
+        /// Bit set if the file descriptor is used, MSB first so that the free
+        /// one with the lowest number is found with a count leading zeros
+        unsigned int bitmap[(MAX_OPEN_FILES+31)/32];
+        /// Holds the mapping between fd and file objects
+        std::unique_ptr<intrusive_ref_ptr<FileBase>[]> files;
+    };
+
+    /**
+     * Find a free file descriptor, that may be past the end of the table if
+     * it is full. Must be called with slotsMutex locked
+     * \param first lowest file descriptor to consider
+     * \return the file descriptor, or -ENFILE if the table has reached
+     * MAX_OPEN_FILES
+     */
+    int findFree(int first) const;
+
+    /**
+     * Make the file descriptors writable, by copying them if they are shared
+     * with another table or growing them if needed. Must be called with
+     * slotsMutex locked
+     * \param minSize the table is grown to have at least this size
+     * \return the file descriptors, that can be modified
+     */
+    Slots *writableSlots(int minSize);
+
+    /**
+     * Store a file in a free file descriptor. Must be called with slotsMutex
+     * locked
+     * \param fd file descriptor, returned by findFree()
+     * \param file file to store
+     */
+    void install(int fd, intrusive_ref_ptr<FileBase> file);
+
     /**
      * Append cwd to path if it is not an absolute path
+     * \param buffer the absolute path is written here, must be
+     * PATH_BUFFER_SIZE bytes
      * \param path an absolute or relative path, must not be null
-     * \return an absolute path, or an empty string if the path would exceed
-     * PATH_MAX
+     * \return 0 on success, or -ENAMETOOLONG if the path does not fit in
+     * the buffer
      */
-    std::string absolutePath(const char *path);
+    int absolutePath(char *buffer, const char *path);
+    
+    /**
+     * Validate the buffer list passed to readv() or writev()
+     * \param iov buffers
+     * \param iovcnt number of buffers
+     * \return 0 if the list is valid, or a negative number otherwise
+     */
+    static int checkIovec(const struct iovec *iov, int iovcnt);
     
     /**
      * Return file information (implements both stat and lstat)
@@ -347,12 +574,15 @@ private:
      */
     int statImpl(const char *name, struct stat *pstat, bool f);
     
-    FastMutex mutex; ///< Locks on writes to file object pointers, not on accesses
+    /// Locks cwd, and open() and pipe() while they run
+    mutable FastMutex mutex;
+    /// Locks on writes to the file descriptors, not on accesses. Never held
+    /// while calling other code, so close() can be called also from umount
+    mutable FastMutex slotsMutex;
     
     std::string cwd; ///< Current working directory
     
-    /// Holds the mapping between fd and file objects
-    intrusive_ref_ptr<FileBase> files[MAX_OPEN_FILES];
+    intrusive_ref_ptr<Slots> slots; ///< The file descriptors
 };
 
 /**
@@ -409,7 +639,8 @@ public:
     
     /**
      * Resolve a path to identify the filesystem it belongs
-     * \param path an absolute path name, that must start with '/'. Note that
+     * \param path an absolute path name, that must start with '/', in a
+     * buffer of size bytes. Note that
      * this is an inout parameter, the string is modified so as to return the
      * full resolved path. In particular, the returned string differs from the
      * passed one by not containing useless path components, such as "/./" and
@@ -419,6 +650,22 @@ public:
      * the number of copies of the path string, optimizing for speed and size
      * in the common case, but also means that a copy of the original string
      * needs to be made if the original has to be used later.
+     * \param size size of the buffer holding path. Symlinks encountered during
+     * name resolution are expanded in the buffer, failing with -ENAMETOOLONG
+     * if the resulting path does not fit
+     * \param followLastSymlink true if the symlink in the last path component
+     *(the one that does not end with a /, if it exists, has to be followed)
+     * \return the resolved path
+     */
+    ResolvedPath resolvePath(char *path, size_t size,
+            bool followLastSymlink=true);
+    
+    /**
+     * Resolve a path to identify the filesystem it belongs. Same as the
+     * other overload, but the path is copied to a buffer of PATH_BUFFER_SIZE
+     * bytes on the stack and then back into the string
+     * \param path an absolute path name, that must start with '/'. This is
+     * an inout parameter
      * \param followLastSymlink true if the symlink in the last path component
      *(the one that does not end with a /, if it exists, has to be followed)
      * \return the resolved path
@@ -429,32 +676,36 @@ public:
      * \internal
      * Helper function to unlink a file or directory. Only meant to be used by
      * FileDescriptorTable::unlink()
-     * \param path path of file or directory to unlink
+     * \param path path of file or directory to unlink, in a buffer of
+     * PATH_BUFFER_SIZE bytes
      * \return 0 on success, or a neagtive number on failure
      */
-    int unlinkHelper(std::string& path);
+    int unlinkHelper(char *path);
     
     /**
      * \internal
      * Helper function to stat a file or directory. Only meant to be used by
      * FileDescriptorTable::statImpl()
-     * \param path path of file or directory to stat
+     * \param path path of file or directory to stat, in a buffer of
+     * PATH_BUFFER_SIZE bytes
      * \param pstat pointer to stat struct
      * \param f f true to follow last synlink (stat),
      * false to not follow it (lstat)
      * \return 0 on success, or a negative number on failure
      */
-    int statHelper(std::string& path, struct stat *pstat, bool f);
+    int statHelper(char *path, struct stat *pstat, bool f);
     
     /**
      * \internal
      * Helper function to unlink a file or directory. Only meant to be used by
      * FileDescriptorTable::unlink()
-     * \param oldPath path of file or directory to unlink
-     * \param newPath path of file or directory to unlink
+     * \param oldPath path of file or directory to unlink, in a buffer of
+     * PATH_BUFFER_SIZE bytes
+     * \param newPath path of file or directory to unlink, in a buffer of
+     * PATH_BUFFER_SIZE bytes
      * \return 0 on success, or a neagtive number on failure
      */
-    int renameHelper(std::string& oldPath, std::string& newPath);
+    int renameHelper(char *oldPath, char *newPath);
     
     /**
      * \internal
@@ -505,10 +756,18 @@ private:
     FilesystemManager(const FilesystemManager&);
     FilesystemManager& operator=(const FilesystemManager&);
     
+    /**
+     * \param path a path name, not necessarily canonical
+     * \return the node of the trie of mount points corresponding to the path,
+     * or null if there is none. The returned node is not necessarily a mount
+     * point, check if its fs is null
+     */
+    MountPoint *findMountPoint(const char *path);
+    
     FastMutex mutex; ///< To protect against concurrent access
     
-    /// Mounted filesystem
-    std::map<StringPart,intrusive_ref_ptr<FilesystemBase> > filesystems;
+    /// Trie of the mount points of all the mounted filesystems
+    MountPoint mounts;
     
     #ifdef WITH_PROCESSES
     std::list<FileDescriptorTable*> fileTables; ///< Process file tables
@@ -37,9 +37,49 @@ enum Ioctl
     IOCTL_TCSETATTR_NOW=102,
     IOCTL_TCSETATTR_FLUSH=103,
     IOCTL_TCSETATTR_DRAIN=104,
-    IOCTL_FLUSH=105
+    IOCTL_FLUSH=105,
+    IOCTL_GET_CACHE_STATS=106,
+    IOCTL_FAST_SEEK=107,
+    IOCTL_STREAMING=108,
+    IOCTL_FLASH_GET_INFO=109,
+    IOCTL_FLASH_ERASE=110
+};
+
+/**
+ * Argument of IOCTL_GET_CACHE_STATS, statistics of the sector cache of the
+ * filesystem to which a file belongs
+ */
+struct CacheStats
+{
+    unsigned int hits;       ///< Sector reads and writes served by the cache
+    unsigned int misses;     ///< Sector reads that required a device access
+    unsigned int writebacks; ///< Dirty sectors written back to the device
+};
+
+/**
+ * Argument of IOCTL_FLASH_GET_INFO, geometry of a flash device. Flash devices
+ * read with readBlock() at any offset, program with writeBlock() at offsets
+ * and sizes that are multiple of programSize, and can only change bits from
+ * one to zero. IOCTL_FLASH_ERASE, with a pointer to an unsigned int block
+ * number as argument, sets all the bytes of a block to 0xff
+ */
+struct FlashInfo
+{
+    unsigned int blockSize;   ///< Erase block size in bytes
+    unsigned int blockCount;  ///< Number of erase blocks
+    unsigned int programSize; ///< Programming granularity in bytes
 };
 
 }
 
+// Advice values of posix_fadvise(), missing from some newlib versions
+#ifndef POSIX_FADV_NORMAL
+#define POSIX_FADV_NORMAL     0
+#define POSIX_FADV_RANDOM     1
+#define POSIX_FADV_SEQUENTIAL 2
+#define POSIX_FADV_WILLNEED   3
+#define POSIX_FADV_DONTNEED   4
+#define POSIX_FADV_NOREUSE    5
+#endif //POSIX_FADV_NORMAL
+
 #endif //IOCTL_H
@@ -0,0 +1,1213 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "logfs.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <cstring>
+#include <algorithm>
+#include "filesystem/stringpart.h"
+#include "filesystem/ioctl.h"
+
+using namespace std;
+
+namespace miosix {
+
+#ifdef WITH_FILESYSTEM
+
+/*
+ * Flash layout
+ *
+ * Blocks 0 and 1 start with a SuperHeader followed by commit records, written
+ * one after the other. When a block is full, the other one is erased and
+ * used. The commit record with the highest sequence number and a valid crc is
+ * the current state of the filesystem. A commit record contains the address
+ * of the pages holding the file table, LOGFS_MAX_FILES entries of 128 bytes.
+ *
+ * All other blocks are divided in 512 byte pages. The first page holds a
+ * BlockHeader, the other ones file table pages, index pages and data pages.
+ * Page addresses are numbered from the start of the flash, noPage marks holes.
+ */
+
+static const unsigned int superMagic=0x5353464c;  ///< "LFSS"
+static const unsigned int blockMagic=0x4253464c;  ///< "LFSB"
+static const unsigned int commitMagic=0x4353464c; ///< "LFSC"
+static const unsigned int headerSize=16; ///< Header space in each block
+
+/**
+ * Header at the start of each block, written after erasing it
+ */
+struct BlockHeader
+{
+    unsigned int magic;      ///< superMagic or blockMagic
+    unsigned int eraseCount; ///< Number of times the block was erased
+    unsigned int unused[2];  ///< Left erased
+};
+
+static_assert(sizeof(BlockHeader)==headerSize,"");
+
+/**
+ * Compute the CRC32 of a commit record
+ */
+static unsigned int crc32(const unsigned int *data, unsigned int words)
+{
+    unsigned int crc=0xffffffff;
+    const unsigned char *p=reinterpret_cast<const unsigned char*>(data);
+    for(unsigned int i=0;i<words*4;i++)
+    {
+        crc^=p[i];
+        for(int j=0;j<8;j++) crc=(crc>>1) ^ (0xedb88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+/**
+ * Read the geometry of a flash device, and check that LogFs can use it
+ */
+static int getGeometry(intrusive_ref_ptr<Device> flash, FlashInfo& info)
+{
+    if(!flash || flash->ioctl(IOCTL_FLASH_GET_INFO,&info)!=0) return -ENODEV;
+    //At least two superblocks, the log head and the blocks for the garbage
+    //collector, plus one block for data
+    if(info.blockSize<2*LogFs::pageSize ||
+       info.blockCount<4+LogFs::gcBlocks) return -EINVAL;
+    if(info.blockSize % LogFs::pageSize) return -EINVAL;
+    if(info.programSize==0 || headerSize % info.programSize) return -EINVAL;
+    return 0;
+}
+
+/**
+ * Directory class for LogFs
+ */
+class LogFsDirectory : public DirectoryBase
+{
+public:
+    /**
+     * \param parent parent filesystem
+     * \param currentInode inode of the directory we're listing
+     * \param parentInode inode of the parent directory
+     */
+    LogFsDirectory(intrusive_ref_ptr<FilesystemBase> parent,
+            unsigned int currentInode, unsigned int parentInode)
+            : DirectoryBase(parent), currentInode(currentInode),
+              parentInode(parentInode), nextSlot(0), first(true), last(false)
+    {}
+
+    /**
+     * Also directories can be opened as files. In this case, this system call
+     * allows to retrieve directory entries.
+     * \param dp pointer to a memory buffer where one or more struct dirent
+     * will be placed. dp must be four words aligned.
+     * \param len memory buffer size.
+     * \return the number of bytes read on success, or a negative number on
+     * failure.
+     */
+    virtual int getdents(void *dp, int len);
+
+private:
+    unsigned int currentInode,parentInode; ///< Inodes of . and ..
+    unsigned int nextSlot; ///< First file table slot not yet listed
+    bool first;            ///< True if first time getdents is called
+    bool last;             ///< True if directory has ended
+};
+
+int LogFsDirectory::getdents(void *dp, int len)
+{
+    if(len<minimumBufferSize) return -EINVAL;
+    if(last) return 0;
+
+    LogFs *fs=static_cast<LogFs*>(getParent().get());
+    Lock<FastMutex> l(fs->mutex);
+    char *begin=reinterpret_cast<char*>(dp);
+    char *buffer=begin;
+    char *end=buffer+len;
+    if(first)
+    {
+        first=false;
+        addDefaultEntries(&buffer,currentInode,parentInode);
+    }
+    for(;nextSlot<LOGFS_MAX_FILES;nextSlot++)
+    {
+        LogFs::Entry e;
+        if(int result=fs->readEntry(nextSlot,e)) return result;
+        if(e.used()==false || e.parent!=currentInode) continue;
+        if(addEntry(&buffer,end,nextSlot+2,S_ISDIR(e.mode) ? DT_DIR : DT_REG,
+                StringPart(e.name))<0) return buffer-begin; //Buffer finished
+    }
+    addTerminatingEntry(&buffer,end);
+    last=true;
+    return buffer-begin;
+}
+
+/**
+ * Files of the LogFs filesystem
+ */
+class LogFsFile : public FileBase
+{
+public:
+    /**
+     * Constructor
+     * \param parent the filesystem to which this file belongs
+     * \param oi open file state
+     * \param flags file open flags (_FREAD, _FWRITE, ...)
+     */
+    LogFsFile(intrusive_ref_ptr<FilesystemBase> parent, LogFs::OpenInode *oi,
+            int flags) : FileBase(parent), oi(oi), pos(0), flags(flags) {}
+
+    /**
+     * Write data to the file, if the file supports writing.
+     * \param data the data to write
+     * \param len the number of bytes to write
+     * \return the number of written characters, or a negative number in
+     * case of errors
+     */
+    virtual ssize_t write(const void *data, size_t len);
+
+    /**
+     * Read data from the file, if the file supports reading.
+     * \param data buffer to store read data
+     * \param len the number of bytes to read
+     * \return the number of read characters, or a negative number in
+     * case of errors
+     */
+    virtual ssize_t read(void *data, size_t len);
+
+    /**
+     * Move file pointer, if the file supports random-access.
+     * \param pos offset to sum to the beginning of the file, current position
+     * or end of file, depending on whence
+     * \param whence SEEK_SET, SEEK_CUR or SEEK_END
+     * \return the offset from the beginning of the file if the operation
+     * completed, or a negative number in case of errors
+     */
+    virtual off_t lseek(off_t pos, int whence);
+
+    /**
+     * Return file information.
+     * \param pstat pointer to stat struct
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int fstat(struct stat *pstat) const;
+
+    /**
+     * Perform various operations on a file descriptor
+     * \param cmd specifies the operation to perform
+     * \param arg optional argument that some operation require
+     * \return the exact return value depends on CMD, -1 is returned on error
+     *
+     * IOCTL_SYNC commits the data written to the file.
+     */
+    virtual int ioctl(int cmd, void *arg);
+
+    /**
+     * Truncate or extend the file, the extended part reads as zeros
+     * \param size new file size
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int ftruncate(off_t size);
+
+    /**
+     * Destructor, commits the data written to the file
+     */
+    ~LogFsFile();
+
+private:
+    LogFs *fs() const { return static_cast<LogFs*>(getParent().get()); }
+
+    LogFs::OpenInode *oi; ///< Open file state, shared with other LogFsFile
+    off_t pos;            ///< File position
+    int flags;            ///< File open flags
+};
+
+ssize_t LogFsFile::write(const void *data, size_t len)
+{
+    if((flags & _FWRITE)==0) return -EBADF;
+    LogFs *f=fs();
+    Lock<FastMutex> l(f->mutex);
+    if(flags & _FAPPEND) pos=oi->entry.size;
+    if(pos>=LogFs::maxFileSize) return len>0 ? -EFBIG : 0;
+    len=min<off_t>(len,LogFs::maxFileSize-pos);
+    ssize_t result=f->writeFile(oi,reinterpret_cast<const char*>(data),pos,len);
+    if(result>0) pos+=result;
+    return result;
+}
+
+ssize_t LogFsFile::read(void *data, size_t len)
+{
+    if((flags & _FREAD)==0) return -EBADF;
+    LogFs *f=fs();
+    Lock<FastMutex> l(f->mutex);
+    if(pos>=oi->entry.size) return 0;
+    len=min<off_t>(len,oi->entry.size-pos);
+    ssize_t result=f->readFile(oi,reinterpret_cast<char*>(data),pos,len);
+    if(result>0) pos+=result;
+    return result;
+}
+
+off_t LogFsFile::lseek(off_t pos, int whence)
+{
+    LogFs *f=fs();
+    Lock<FastMutex> l(f->mutex);
+    off_t offset;
+    switch(whence)
+    {
+        case SEEK_CUR:
+            offset=this->pos+pos;
+            break;
+        case SEEK_SET:
+            offset=pos;
+            break;
+        case SEEK_END:
+            offset=static_cast<off_t>(oi->entry.size)+pos;
+            break;
+        default:
+            return -EINVAL;
+    }
+    //Seek past the end of file is allowed, writing there leaves a hole
+    if(offset<0) return -EINVAL;
+    if(offset>LogFs::maxFileSize) return -EOVERFLOW;
+    this->pos=offset;
+    return offset;
+}
+
+int LogFsFile::fstat(struct stat *pstat) const
+{
+    LogFs *f=fs();
+    Lock<FastMutex> l(f->mutex);
+    memset(pstat,0,sizeof(struct stat));
+    pstat->st_dev=f->getFsId();
+    pstat->st_ino=oi->slot+2;
+    pstat->st_mode=oi->entry.mode;
+    pstat->st_nlink=1;
+    pstat->st_size=oi->entry.size;
+    pstat->st_blksize=LogFs::pageSize;
+    pstat->st_blocks=(static_cast<off_t>(oi->entry.size)+511)/512;
+    return 0;
+}
+
+int LogFsFile::ioctl(int cmd, void *arg)
+{
+    if(cmd!=IOCTL_SYNC) return -ENOTTY;
+    LogFs *f=fs();
+    Lock<FastMutex> l(f->mutex);
+    return f->commit();
+}
+
+int LogFsFile::ftruncate(off_t size)
+{
+    if((flags & _FWRITE)==0) return -EBADF;
+    if(size<0) return -EINVAL;
+    if(size>LogFs::maxFileSize) return -EFBIG;
+    LogFs *f=fs();
+    Lock<FastMutex> l(f->mutex);
+    return f->truncateFile(oi,size);
+}
+
+LogFsFile::~LogFsFile()
+{
+    LogFs *f=fs();
+    Lock<FastMutex> l(f->mutex);
+    f->closeFile(oi); //TODO: what to do with error code?
+}
+
+//
+// class LogFs
+//
+
+LogFs::LogFs(intrusive_ref_ptr<Device> flash) : flash(flash),
+        logBlock(noPage), pinnedCount(0), wearCheck(true), failed(true)
+{
+    FlashInfo info;
+    if(getGeometry(flash,info)) return;
+    blockSize=info.blockSize;
+    blockCount=info.blockCount;
+    programSize=info.programSize;
+    pagesPerBlock=blockSize/pageSize;
+    logPage=pagesPerBlock; //No log block, the first allocation erases one
+    unsigned int chunkCount=(LOGFS_MAX_FILES+entriesPerPage-1)/entriesPerPage;
+    commitSize=((chunkCount+4)*4+headerSize-1)/headerSize*headerSize;
+    eraseCounts.resize(blockCount,0);
+    usedMap.resize((blockCount*pagesPerBlock+7)/8,0);
+    pinnedMap.resize(usedMap.size(),0);
+
+    //Find the last commit, a power failure may have left a partially written
+    //one that is skipped as its crc does not match
+    vector<unsigned int> record(commitSize/4);
+    bool found=false;
+    for(unsigned int b=0;b<2;b++)
+    {
+        BlockHeader header;
+        if(flash->readBlock(&header,sizeof(header),b*blockSize)!=sizeof(header))
+            return;
+        if(header.magic!=superMagic) continue;
+        eraseCounts[b]=header.eraseCount;
+        for(unsigned int off=headerSize;off+commitSize<=blockSize;off+=commitSize)
+        {
+            if(flash->readBlock(record.data(),commitSize,b*blockSize+off)!=
+                static_cast<ssize_t>(commitSize)) return;
+            if(all_of(record.begin(),record.end(),
+                [](unsigned int x){ return x==0xffffffff; })) break;
+            if(record[0]!=commitMagic || record[2]!=chunkCount) continue;
+            if(record[3+chunkCount]!=crc32(record.data(),3+chunkCount)) continue;
+            if(found && record[1]<=sequence) continue;
+            found=true;
+            sequence=record[1];
+            commitBlock=b;
+            chunks.assign(&record[3],&record[3+chunkCount]);
+        }
+    }
+    if(found==false) return;
+    //Commits are appended after the last written record, even if partially
+    //written, as its space can't be programmed again
+    commitOffset=headerSize;
+    for(unsigned int off=headerSize;off+commitSize<=blockSize;off+=commitSize)
+    {
+        if(flash->readBlock(record.data(),commitSize,commitBlock*blockSize+off)!=
+            static_cast<ssize_t>(commitSize)) return;
+        if(all_of(record.begin(),record.end(),
+            [](unsigned int x){ return x==0xffffffff; })) break;
+        commitOffset=off+commitSize;
+    }
+
+    //Erase counts of the other blocks, that are not valid if a power failure
+    //happened right after erasing a block
+    for(unsigned int b=2;b<blockCount;b++)
+    {
+        BlockHeader header;
+        if(flash->readBlock(&header,sizeof(header),b*blockSize)!=sizeof(header))
+            return;
+        if(header.magic==blockMagic) eraseCounts[b]=header.eraseCount;
+    }
+
+    //Mark the pages used by the file table, index pages and data pages
+    for(auto chunk : chunks)
+    {
+        if(chunk==noPage) continue;
+        if(isDataPage(chunk)==false || readPage(chunk,chunkBuf)) return;
+        setBit(usedMap,chunk);
+        for(auto& e : chunkBuf)
+        {
+            if(e.used()==false) continue;
+            for(auto index : e.index)
+            {
+                if(index==noPage) continue;
+                if(isDataPage(index)==false || readPage(index,indexBuf)) return;
+                setBit(usedMap,index);
+                for(auto page : indexBuf)
+                {
+                    if(page==noPage) continue;
+                    if(isDataPage(page)==false) return;
+                    setBit(usedMap,page);
+                }
+            }
+        }
+    }
+    failed=false;
+}
+
+int LogFs::format(intrusive_ref_ptr<Device> flash)
+{
+    FlashInfo info;
+    if(int result=getGeometry(flash,info)) return result;
+    //Erase both superblocks, so that no commit of a previous filesystem is
+    //found, keeping the erase count of the blocks
+    for(unsigned int b=0;b<2;b++)
+    {
+        BlockHeader header;
+        if(flash->readBlock(&header,sizeof(header),b*info.blockSize)!=
+            sizeof(header)) return -EIO;
+        header.eraseCount=header.magic==superMagic ? header.eraseCount+1 : 1;
+        header.magic=superMagic;
+        if(flash->ioctl(IOCTL_FLASH_ERASE,&b)!=0) return -EIO;
+        if(flash->writeBlock(&header,sizeof(header),b*info.blockSize)!=
+            sizeof(header)) return -EIO;
+    }
+    //Empty file table, other blocks are erased when the log needs them
+    unsigned int chunkCount=(LOGFS_MAX_FILES+entriesPerPage-1)/entriesPerPage;
+    unsigned int commitSize=((chunkCount+4)*4+headerSize-1)/headerSize*headerSize;
+    vector<unsigned int> record(commitSize/4,0xffffffff);
+    record[0]=commitMagic;
+    record[1]=1;
+    record[2]=chunkCount;
+    record[3+chunkCount]=crc32(record.data(),3+chunkCount);
+    if(flash->writeBlock(record.data(),commitSize,headerSize)!=
+        static_cast<ssize_t>(commitSize)) return -EIO;
+    return 0;
+}
+
+int LogFs::open(intrusive_ref_ptr<FileBase>& file, StringPart& name,
+        int flags, int mode)
+{
+    if(failed) return -ENOENT;
+    flags++; //To convert from O_RDONLY, O_WRONLY, ... to _FREAD, _FWRITE, ...
+    Lock<FastMutex> l(mutex);
+    if(name.empty())
+    {
+        if(flags & (_FWRITE | _FAPPEND | _FCREAT | _FTRUNC)) return -EISDIR;
+        file=intrusive_ref_ptr<FileBase>(new LogFsDirectory(
+            shared_from_this(),rootInode,parentFsMountpointInode));
+        return 0;
+    }
+    unsigned int slot;
+    Entry e;
+    int result=lookup(name.c_str(),slot,e);
+    if(result==-ENOENT && (flags & (_FWRITE | _FCREAT))==(_FWRITE | _FCREAT))
+    {
+        //Create the file
+        const char *last;
+        if(int result=lookupParent(name.c_str(),e.parent,last)) return result;
+        if(strlen(last)>maxNameLen) return -ENAMETOOLONG;
+        if(int result=allocSlot(slot)) return result;
+        if(int result=reserve(1)) return result;
+        e.mode=S_IFREG | 0755; //-rwxr-xr-x
+        e.size=0;
+        for(auto& index : e.index) index=noPage;
+        memset(e.name,0,sizeof(e.name));
+        strcpy(e.name,last);
+        if(int result=writeEntry(slot,e)) return result;
+        if(int result=commit()) return result;
+    } else if(result) return result;
+    else if((flags & (_FCREAT | _FEXCL))==(_FCREAT | _FEXCL)) return -EEXIST;
+
+    if(S_ISDIR(e.mode))
+    {
+        if(flags & (_FWRITE | _FAPPEND | _FCREAT | _FTRUNC)) return -EISDIR;
+        file=intrusive_ref_ptr<FileBase>(
+            new LogFsDirectory(shared_from_this(),slot+2,e.parent));
+        return 0;
+    }
+
+    OpenInode *oi=findOpen(slot);
+    if(oi==nullptr)
+    {
+        oi=new OpenInode;
+        oi->slot=slot;
+        oi->refcount=0;
+        oi->dirty=false;
+        oi->indexDirty=false;
+        oi->indexNumber=-1;
+        oi->entry=e;
+        openInodes.push_back(oi);
+    }
+    oi->refcount++;
+    if((flags & (_FWRITE | _FTRUNC))==(_FWRITE | _FTRUNC) && oi->entry.size>0)
+    {
+        if(int result=truncateFile(oi,0))
+        {
+            closeFile(oi);
+            return result;
+        }
+    }
+    file=intrusive_ref_ptr<FileBase>(
+        new LogFsFile(shared_from_this(),oi,flags));
+    return 0;
+}
+
+int LogFs::lstat(StringPart& name, struct stat *pstat)
+{
+    if(failed) return -ENOENT;
+    memset(pstat,0,sizeof(struct stat));
+    pstat->st_dev=filesystemId;
+    pstat->st_nlink=1;
+    pstat->st_blksize=pageSize;
+    if(name.empty())
+    {
+        pstat->st_ino=rootInode;
+        pstat->st_mode=S_IFDIR | 0755; //drwxr-xr-x
+        return 0;
+    }
+    Lock<FastMutex> l(mutex);
+    unsigned int slot;
+    Entry e;
+    if(int result=lookup(name.c_str(),slot,e)) return result;
+    pstat->st_ino=slot+2;
+    pstat->st_mode=e.mode;
+    pstat->st_size=e.size;
+    pstat->st_blocks=(static_cast<off_t>(e.size)+511)/512;
+    return 0;
+}
+
+int LogFs::unlink(StringPart& name)
+{
+    return unlinkRmdirHelper(name,false);
+}
+
+int LogFs::rename(StringPart& oldName, StringPart& newName)
+{
+    if(failed) return -ENOENT;
+    if(oldName.empty() || newName.empty()) return -EBUSY; //Root directory
+    Lock<FastMutex> l(mutex);
+    unsigned int slot;
+    Entry e;
+    if(int result=lookup(oldName.c_str(),slot,e)) return result;
+    unsigned int parent;
+    const char *last;
+    if(int result=lookupParent(newName.c_str(),parent,last)) return result;
+    if(strlen(last)>maxNameLen) return -ENAMETOOLONG;
+    unsigned int otherSlot;
+    Entry other;
+    int result=findInDir(parent,last,otherSlot,other);
+    if(result==0) return otherSlot==slot ? 0 : -EEXIST;
+    if(result!=-ENOENT) return result;
+    //A directory can't be moved inside itself
+    for(unsigned int ino=parent;ino!=rootInode;ino=other.parent)
+    {
+        if(ino==slot+2) return -EINVAL;
+        if(int result=readEntry(ino-2,other)) return result;
+    }
+    if(int result=reserve(1)) return result;
+    e.parent=parent;
+    memset(e.name,0,sizeof(e.name));
+    strcpy(e.name,last);
+    if(int result=writeEntry(slot,e)) return result;
+    return commit();
+}
+
+int LogFs::mkdir(StringPart& name, int mode)
+{
+    if(failed) return -ENOENT;
+    if(name.empty()) return -EEXIST;
+    Lock<FastMutex> l(mutex);
+    Entry e;
+    const char *last;
+    if(int result=lookupParent(name.c_str(),e.parent,last)) return result;
+    if(strlen(last)>maxNameLen) return -ENAMETOOLONG;
+    unsigned int slot;
+    Entry other;
+    int result=findInDir(e.parent,last,slot,other);
+    if(result==0) return -EEXIST;
+    if(result!=-ENOENT) return result;
+    if(int result=allocSlot(slot)) return result;
+    if(int result=reserve(1)) return result;
+    e.mode=S_IFDIR | 0755; //drwxr-xr-x
+    e.size=0;
+    for(auto& index : e.index) index=noPage;
+    memset(e.name,0,sizeof(e.name));
+    strcpy(e.name,last);
+    if(int result=writeEntry(slot,e)) return result;
+    return commit();
+}
+
+int LogFs::rmdir(StringPart& name)
+{
+    return unlinkRmdirHelper(name,true);
+}
+
+unsigned long long LogFs::freeBytes()
+{
+    Lock<FastMutex> l(mutex);
+    unsigned long long result=0;
+    for(unsigned int b=2;b<blockCount;b++)
+        result+=pagesPerBlock-1-usedPages(b);
+    return result*pageSize;
+}
+
+LogFs::~LogFs()
+{
+    //All files are closed, so they are already committed
+    for(auto oi : openInodes) delete oi;
+}
+
+ssize_t LogFs::readFile(OpenInode *oi, char *data, unsigned int pos,
+        unsigned int len)
+{
+    unsigned int done=0;
+    while(done<len)
+    {
+        unsigned int number=(pos+done)/pageSize;
+        unsigned int offset=(pos+done)%pageSize;
+        unsigned int n=min(pageSize-offset,len-done);
+        unsigned int page;
+        int result=pageAddress(oi,number,page);
+        if(result==0)
+        {
+            if(page==noPage) memset(data+done,0,n); //Hole
+            else result=readPage(page,data+done,offset,n);
+        }
+        if(result) return done>0 ? static_cast<ssize_t>(done) : result;
+        done+=n;
+    }
+    return done;
+}
+
+ssize_t LogFs::writeFile(OpenInode *oi, const char *data, unsigned int pos,
+        unsigned int len)
+{
+    unsigned int done=0;
+    while(done<len)
+    {
+        unsigned int number=(pos+done)/pageSize;
+        unsigned int offset=(pos+done)%pageSize;
+        unsigned int n=min(pageSize-offset,len-done);
+        //The data page, the index page if the write moves to another one, and
+        //the pages the commit writes, so that a full filesystem can still
+        //commit what was written before
+        int result=reserve(2+commitPages());
+        if(result==0) result=loadIndex(oi,number/(pageSize/4));
+        if(result==0)
+        {
+            unsigned int& slot=oi->indexBuf[number%(pageSize/4)];
+            if(n<pageSize)
+            {
+                if(slot==noPage) memset(pageBuf,0,pageSize);
+                else result=readPage(slot,pageBuf);
+            }
+            memcpy(pageBuf+offset,data+done,n);
+            unsigned int page;
+            if(result==0) result=writePage(page,pageBuf);
+            if(result==0)
+            {
+                if(slot!=noPage) releasePage(slot);
+                slot=page;
+                oi->indexDirty=true;
+            }
+        }
+        if(result) return done>0 ? static_cast<ssize_t>(done) : result;
+        done+=n;
+        oi->entry.size=max(oi->entry.size,pos+done);
+        oi->dirty=true;
+    }
+    return done;
+}
+
+int LogFs::truncateFile(OpenInode *oi, unsigned int size)
+{
+    if(size<oi->entry.size)
+    {
+        //Cached index page, index page rewritten when cutting it in the
+        //middle, and the page with the new end of file, zeroed past the end
+        if(int result=reserve(3+commitPages())) return result;
+        if(int result=flushIndex(oi)) return result;
+        oi->indexNumber=-1;
+        unsigned int first=(size+pageSize-1)/pageSize;
+        if(int result=releaseFilePages(oi->entry,first)) return result;
+        if(size % pageSize)
+        {
+            unsigned int number=size/pageSize;
+            if(int result=loadIndex(oi,number/(pageSize/4))) return result;
+            unsigned int& slot=oi->indexBuf[number%(pageSize/4)];
+            if(slot!=noPage)
+            {
+                if(int result=readPage(slot,pageBuf)) return result;
+                memset(pageBuf+size%pageSize,0,pageSize-size%pageSize);
+                unsigned int page;
+                if(int result=writePage(page,pageBuf)) return result;
+                releasePage(slot);
+                slot=page;
+                oi->indexDirty=true;
+            }
+        }
+    }
+    //Extending the file only changes its size, the new part is a hole
+    oi->entry.size=size;
+    oi->dirty=true;
+    return 0;
+}
+
+int LogFs::closeFile(OpenInode *oi)
+{
+    if(--oi->refcount>0) return 0;
+    int result=0;
+    if(oi->dirty || oi->indexDirty) result=commit();
+    //If the commit failed the changes are lost, the filesystem on flash is
+    //still consistent, and pages written to the file are reclaimed at mount
+    openInodes.erase(find(openInodes.begin(),openInodes.end(),oi));
+    delete oi;
+    return result;
+}
+
+int LogFs::lookup(const char *path, unsigned int& slot, Entry& entry)
+{
+    unsigned int dir=rootInode;
+    for(;;)
+    {
+        if(int result=findInDir(dir,path,slot,entry)) return result;
+        const char *slash=strchr(path,'/');
+        if(slash==nullptr || slash[1]=='\0') return 0;
+        if(!S_ISDIR(entry.mode)) return -ENOTDIR;
+        dir=slot+2;
+        path=slash+1;
+    }
+}
+
+int LogFs::lookupParent(const char *path, unsigned int& parent,
+        const char*& name)
+{
+    const char *slash=strrchr(path,'/');
+    if(slash==nullptr)
+    {
+        parent=rootInode;
+        name=path;
+    } else {
+        string dir(path,slash-path);
+        unsigned int slot;
+        Entry e;
+        if(int result=lookup(dir.c_str(),slot,e)) return result;
+        if(!S_ISDIR(e.mode)) return -ENOTDIR;
+        parent=slot+2;
+        name=slash+1;
+    }
+    return name[0]=='\0' ? -ENOENT : 0;
+}
+
+int LogFs::findInDir(unsigned int parent, const char *name,
+        unsigned int& slot, Entry& entry)
+{
+    unsigned int len=strcspn(name,"/");
+    if(len>maxNameLen) return -ENAMETOOLONG;
+    for(unsigned int c=0;c<chunks.size();c++)
+    {
+        if(chunks[c]==noPage) continue;
+        if(int result=readPage(chunks[c],chunkBuf)) return result;
+        for(unsigned int i=0;i<entriesPerPage;i++)
+        {
+            slot=c*entriesPerPage+i;
+            if(slot>=LOGFS_MAX_FILES) break;
+            //Open files may have changes that are not yet on flash
+            if(OpenInode *oi=findOpen(slot)) entry=oi->entry;
+            else entry=chunkBuf[i];
+            if(entry.used()==false || entry.parent!=parent) continue;
+            if(strncmp(entry.name,name,len)==0 && entry.name[len]=='\0')
+                return 0;
+        }
+    }
+    return -ENOENT;
+}
+
+int LogFs::allocSlot(unsigned int& slot)
+{
+    for(slot=0;slot<LOGFS_MAX_FILES;slot++)
+    {
+        Entry e;
+        if(int result=readEntry(slot,e)) return result;
+        if(e.used()==false) return 0;
+    }
+    return -ENOSPC;
+}
+
+int LogFs::readEntry(unsigned int slot, Entry& entry)
+{
+    if(OpenInode *oi=findOpen(slot))
+    {
+        entry=oi->entry;
+        return 0;
+    }
+    unsigned int chunk=chunks[slot/entriesPerPage];
+    if(chunk==noPage)
+    {
+        entry.mode=0;
+        return 0;
+    }
+    return readPage(chunk,&entry,(slot%entriesPerPage)*sizeof(Entry),
+                    sizeof(Entry));
+}
+
+int LogFs::writeEntry(unsigned int slot, const Entry& entry)
+{
+    if(OpenInode *oi=findOpen(slot))
+    {
+        oi->entry=entry;
+        oi->dirty=true;
+        return 0;
+    }
+    unsigned int& chunk=chunks[slot/entriesPerPage];
+    if(chunk==noPage) memset(chunkBuf,0xff,sizeof(chunkBuf));
+    else if(int result=readPage(chunk,chunkBuf)) return result;
+    chunkBuf[slot%entriesPerPage]=entry;
+    unsigned int page;
+    if(int result=writePage(page,chunkBuf)) return result;
+    if(chunk!=noPage) releasePage(chunk);
+    chunk=page;
+    return 0;
+}
+
+int LogFs::releaseFilePages(Entry& entry, unsigned int first)
+{
+    const unsigned int perIndex=pageSize/4;
+    for(unsigned int i=0;i<indexPages;i++)
+    {
+        if(entry.index[i]==noPage || (i+1)*perIndex<=first) continue;
+        if(int result=readPage(entry.index[i],indexBuf)) return result;
+        unsigned int from=first>i*perIndex ? first-i*perIndex : 0;
+        for(unsigned int j=from;j<perIndex;j++)
+        {
+            if(indexBuf[j]==noPage) continue;
+            releasePage(indexBuf[j]);
+            indexBuf[j]=noPage;
+        }
+        unsigned int page=noPage;
+        if(from>0 && any_of(indexBuf,indexBuf+from,
+            [](unsigned int x){ return x!=noPage; }))
+        {
+            if(int result=writePage(page,indexBuf)) return result;
+        }
+        releasePage(entry.index[i]);
+        entry.index[i]=page;
+    }
+    return 0;
+}
+
+LogFs::OpenInode *LogFs::findOpen(unsigned int slot)
+{
+    for(auto oi : openInodes) if(oi->slot==slot) return oi;
+    return nullptr;
+}
+
+int LogFs::pageAddress(OpenInode *oi, unsigned int number, unsigned int& page)
+{
+    const unsigned int perIndex=pageSize/4;
+    unsigned int i=number/perIndex;
+    if(oi->indexNumber==static_cast<int>(i))
+    {
+        page=oi->indexBuf[number%perIndex];
+        return 0;
+    }
+    //Not cached, read without replacing the cached index page, as flushing
+    //it would require writing
+    if(oi->entry.index[i]==noPage)
+    {
+        page=noPage;
+        return 0;
+    }
+    return readPage(oi->entry.index[i],&page,(number%perIndex)*4,4);
+}
+
+int LogFs::loadIndex(OpenInode *oi, unsigned int number)
+{
+    if(oi->indexNumber==static_cast<int>(number)) return 0;
+    if(int result=flushIndex(oi)) return result;
+    oi->indexNumber=-1;
+    if(oi->entry.index[number]==noPage)
+        memset(oi->indexBuf,0xff,sizeof(oi->indexBuf));
+    else if(int result=readPage(oi->entry.index[number],oi->indexBuf))
+        return result;
+    oi->indexNumber=number;
+    return 0;
+}
+
+int LogFs::flushIndex(OpenInode *oi, bool gc)
+{
+    if(oi->indexDirty==false) return 0;
+    unsigned int page;
+    if(int result=writePage(page,oi->indexBuf,gc)) return result;
+    unsigned int& index=oi->entry.index[oi->indexNumber];
+    if(index!=noPage) releasePage(index);
+    index=page;
+    oi->indexDirty=false;
+    oi->dirty=true;
+    return 0;
+}
+
+int LogFs::commit(bool gc)
+{
+    //Each open file may need its index page and file table page written
+    if(gc==false)
+        if(int result=reserve(commitPages())) return result;
+    for(auto oi : openInodes)
+        if(int result=flushIndex(oi,gc)) return result;
+    for(unsigned int c=0;c<chunks.size();c++)
+    {
+        bool dirty=false;
+        for(auto oi : openInodes)
+            if(oi->dirty && oi->slot/entriesPerPage==c) dirty=true;
+        if(dirty==false) continue;
+        if(chunks[c]==noPage) memset(chunkBuf,0xff,sizeof(chunkBuf));
+        else if(int result=readPage(chunks[c],chunkBuf)) return result;
+        for(auto oi : openInodes)
+            if(oi->dirty && oi->slot/entriesPerPage==c)
+                chunkBuf[oi->slot%entriesPerPage]=oi->entry;
+        unsigned int page;
+        if(int result=writePage(page,chunkBuf,gc)) return result;
+        if(chunks[c]!=noPage) releasePage(chunks[c]);
+        chunks[c]=page;
+        for(auto oi : openInodes)
+            if(oi->slot/entriesPerPage==c) oi->dirty=false;
+    }
+
+    if(commitOffset+commitSize>blockSize)
+    {
+        //Superblock full, continue in the other one. Erasing it is safe, as
+        //the last commit is in this one
+        if(int result=eraseBlock(1-commitBlock)) return result;
+        commitBlock=1-commitBlock;
+        commitOffset=headerSize;
+    }
+    unsigned int chunkCount=chunks.size();
+    vector<unsigned int> record(commitSize/4,0xffffffff);
+    record[0]=commitMagic;
+    record[1]=sequence+1;
+    record[2]=chunkCount;
+    copy(chunks.begin(),chunks.end(),&record[3]);
+    record[3+chunkCount]=crc32(record.data(),3+chunkCount);
+    ssize_t written=flash->writeBlock(record.data(),commitSize,
+                                      commitBlock*blockSize+commitOffset);
+    //A failed write may have programmed part of the record
+    commitOffset+=commitSize;
+    if(written!=static_cast<ssize_t>(commitSize)) return -EIO;
+    sequence++;
+    //The pages the previous commit used are no longer needed
+    fill(pinnedMap.begin(),pinnedMap.end(),0);
+    pinnedCount=0;
+    return 0;
+}
+
+int LogFs::unlinkRmdirHelper(StringPart& name, bool delDir)
+{
+    if(failed) return -ENOENT;
+    if(name.empty()) return -EBUSY; //Root directory
+    Lock<FastMutex> l(mutex);
+    unsigned int slot;
+    Entry e;
+    if(int result=lookup(name.c_str(),slot,e)) return result;
+    if(delDir)
+    {
+        if(!S_ISDIR(e.mode)) return -ENOTDIR;
+        for(unsigned int i=0;i<LOGFS_MAX_FILES;i++)
+        {
+            Entry child;
+            if(int result=readEntry(i,child)) return result;
+            if(child.used() && child.parent==slot+2) return -ENOTEMPTY;
+        }
+    } else if(S_ISDIR(e.mode)) return -EISDIR;
+    if(findOpen(slot)) return -EBUSY;
+    if(int result=reserve(1)) return result;
+    if(int result=releaseFilePages(e,0)) return result;
+    e.mode=0;
+    if(int result=writeEntry(slot,e)) return result;
+    return commit();
+}
+
+int LogFs::reserve(unsigned int pages)
+{
+    if(wearCheck)
+    {
+        //Static wear leveling, move data out of the least erased block, so that
+        //it is reused
+        wearCheck=false;
+        unsigned int maxCount=maxEraseCount();
+        int victim=-1;
+        for(unsigned int b=2;b<blockCount;b++)
+        {
+            if(b==logBlock || usedPages(b)==0) continue;
+            if(victim<0 || eraseCounts[b]<eraseCounts[victim]) victim=b;
+        }
+        if(victim>=0 && maxCount-eraseCounts[victim]>LOGFS_WEAR_THRESHOLD)
+            collect({static_cast<unsigned int>(victim)}); //No free space is ok
+    }
+    //Moving pages also rewrites the index pages and file table pages pointing
+    //to them, so collecting a block may not free space right away. Give up
+    //only after collecting as many blocks as the flash has
+    for(unsigned int attempts=0;;)
+    {
+        if(availablePages()>=pages) return 0;
+        if(pinnedCount>0)
+        {
+            //Pages used by the last commit become free with a new commit
+            if(int result=commit(true)) return result;
+            continue;
+        }
+        //Garbage collection, choosing the blocks with fewest used pages
+        vector<unsigned int> victims;
+        for(unsigned int b=2;b<blockCount;b++)
+        {
+            unsigned int used=usedPages(b);
+            if(b==logBlock || used==0 || used==pagesPerBlock-1) continue;
+            auto it=victims.begin();
+            while(it!=victims.end() && usedPages(*it)<=used) ++it;
+            victims.insert(it,b);
+            if(victims.size()>gcBlocks) victims.pop_back();
+        }
+        if(victims.empty() || ++attempts>blockCount) return -ENOSPC;
+        if(int result=collect(victims)) return result;
+    }
+}
+
+unsigned int LogFs::availablePages() const
+{
+    //Some free blocks are kept for the garbage collector. When it has used
+    //them, the log head is in one of them and isn't available either
+    unsigned int count;
+    freeBlock(count);
+    unsigned int result=pagesPerBlock-logPage+count*(pagesPerBlock-1);
+    unsigned int kept=gcBlocks*(pagesPerBlock-1);
+    return result>kept ? result-kept : 0;
+}
+
+int LogFs::allocPage(unsigned int& page, bool gc)
+{
+    if(logPage>=pagesPerBlock)
+    {
+        unsigned int count;
+        int block=freeBlock(count);
+        if(block<0 || (gc==false && count<=gcBlocks)) return -ENOSPC;
+        if(int result=eraseBlock(block)) return result;
+        logBlock=block;
+        logPage=1;
+    }
+    page=logBlock*pagesPerBlock+logPage++;
+    setBit(usedMap,page);
+    return 0;
+}
+
+int LogFs::writePage(unsigned int& page, const void *data, bool gc)
+{
+    if(int result=allocPage(page,gc)) return result;
+    if(flash->writeBlock(data,pageSize,page*pageSize)==pageSize) return 0;
+    clearBit(usedMap,page); //Never part of a commit, no need to pin it
+    return -EIO;
+}
+
+int LogFs::readPage(unsigned int page, void *data, unsigned int offset,
+        unsigned int size)
+{
+    ssize_t result=flash->readBlock(data,size,
+        static_cast<off_t>(page)*pageSize+offset);
+    return result==static_cast<ssize_t>(size) ? 0 : -EIO;
+}
+
+void LogFs::releasePage(unsigned int page)
+{
+    clearBit(usedMap,page);
+    if(testBit(pinnedMap,page)) return;
+    setBit(pinnedMap,page);
+    pinnedCount++;
+}
+
+int LogFs::eraseBlock(unsigned int block)
+{
+    if(flash->ioctl(IOCTL_FLASH_ERASE,&block)!=0) return -EIO;
+    BlockHeader header;
+    memset(&header,0xff,sizeof(header));
+    header.magic=block<2 ? superMagic : blockMagic;
+    header.eraseCount=++eraseCounts[block];
+    if(flash->writeBlock(&header,sizeof(header),block*blockSize)!=
+        sizeof(header)) return -EIO;
+    //A new most erased block may make static wear leveling necessary
+    if(block>=2 && header.eraseCount>=maxEraseCount()) wearCheck=true;
+    return 0;
+}
+
+int LogFs::collect(const vector<unsigned int>& victims)
+{
+    auto inVictim=[&](unsigned int page)
+    {
+        return page!=noPage && find(victims.begin(),victims.end(),
+                                    page/pagesPerBlock)!=victims.end();
+    };
+    //Walk the whole filesystem looking for pages in the victim block, as
+    //there is no reverse mapping from pages to the files using them
+    for(unsigned int c=0;c<chunks.size();c++)
+    {
+        if(chunks[c]==noPage) continue;
+        if(int result=readPage(chunks[c],chunkBuf)) return result;
+        bool chunkChanged=inVictim(chunks[c]);
+        for(unsigned int i=0;i<entriesPerPage;i++)
+        {
+            //Open files are changed in RAM, commit() writes them
+            OpenInode *oi=findOpen(c*entriesPerPage+i);
+            if(oi)
+            {
+                if(int result=flushIndex(oi,true)) return result;
+                oi->indexNumber=-1;
+            }
+            Entry& e=oi ? oi->entry : chunkBuf[i];
+            if(e.used()==false) continue;
+            bool entryChanged=false;
+            for(auto& index : e.index)
+            {
+                if(index==noPage) continue;
+                if(int result=readPage(index,indexBuf)) return result;
+                bool indexChanged=inVictim(index);
+                for(auto& page : indexBuf)
+                {
+                    if(inVictim(page)==false) continue;
+                    unsigned int moved;
+                    if(int result=readPage(page,pageBuf)) return result;
+                    if(int result=writePage(moved,pageBuf,true)) return result;
+                    releasePage(page);
+                    page=moved;
+                    indexChanged=true;
+                }
+                if(indexChanged==false) continue;
+                unsigned int moved;
+                if(int result=writePage(moved,indexBuf,true)) return result;
+                releasePage(index);
+                index=moved;
+                entryChanged=true;
+            }
+            if(entryChanged==false) continue;
+            if(oi) oi->dirty=true;
+            else chunkChanged=true;
+        }
+        if(chunkChanged==false) continue;
+        unsigned int moved;
+        if(int result=writePage(moved,chunkBuf,true)) return result;
+        releasePage(chunks[c]);
+        chunks[c]=moved;
+    }
+    return commit(true);
+}
+
+unsigned int LogFs::usedPages(unsigned int block) const
+{
+    unsigned int result=0;
+    for(unsigned int i=1;i<pagesPerBlock;i++)
+    {
+        unsigned int page=block*pagesPerBlock+i;
+        if(testBit(usedMap,page) || testBit(pinnedMap,page)) result++;
+    }
+    return result;
+}
+
+int LogFs::freeBlock(unsigned int& count) const
+{
+    int result=-1;
+    count=0;
+    for(unsigned int b=2;b<blockCount;b++)
+    {
+        if(b==logBlock || usedPages(b)>0) continue;
+        count++;
+        if(result<0 || eraseCounts[b]<eraseCounts[result]) result=b;
+    }
+    return result;
+}
+
+unsigned int LogFs::maxEraseCount() const
+{
+    return *max_element(eraseCounts.begin()+2,eraseCounts.end());
+}
+
+bool LogFs::isDataPage(unsigned int page) const
+{
+    return page<blockCount*pagesPerBlock && page/pagesPerBlock>=2
+        && page%pagesPerBlock!=0;
+}
+
+#endif //WITH_FILESYSTEM
+
+} //namespace miosix
@@ -0,0 +1,458 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef LOGFS_H
+#define LOGFS_H
+
+#include <vector>
+#include "filesystem/file.h"
+#include "filesystem/devfs/devfs.h"
+#include "kernel/sync.h"
+#include "config/miosix_settings.h"
+
+namespace miosix {
+
+#ifdef WITH_FILESYSTEM
+
+class LogFsFile;      //Forward declaration
+class LogFsDirectory; //Forward declaration
+
+/**
+ * LogFs is a log-structured filesystem for NOR and microcontroller internal
+ * flash memories, where FAT would wear out the blocks holding the FAT and
+ * directories, and would be corrupted by a power failure.
+ *
+ * The flash is accessed through a Device implementing IOCTL_FLASH_GET_INFO
+ * and IOCTL_FLASH_ERASE. Its first two erase blocks hold the commit records,
+ * the other ones are divided in 512 byte pages, except the first page of each
+ * block that holds the block erase count.
+ *
+ * Pages are never overwritten, every change writes new pages at the head of
+ * the log, including the index pages of the file and the file table pages
+ * that point to them (copy-on-write). Changes become visible on flash with a
+ * commit record pointing to the new file table, so a power failure always
+ * leaves the filesystem as it was at the last commit. Metadata operations
+ * commit immediately, writes to files commit when the file is synced or
+ * closed, or when the garbage collector commits, so a file that was being
+ * written may hold part of the last write, but never a partly written page.
+ *
+ * Blocks whose pages are no longer used are erased when the log needs a new
+ * block, choosing the least erased one, and the garbage collector moves the
+ * used pages out of the other blocks when free ones are scarce, keeping
+ * gcBlocks free blocks for itself. Moving a page also rewrites the index page
+ * and file table page pointing to it, so blocks should be at least 16KB to
+ * use more than half of the flash. Blocks holding data that is never
+ * rewritten are periodically moved too, so their erase count follows the one
+ * of the other blocks.
+ *
+ * Mounting reads only the last commit record, the file table and the index
+ * pages, never the file data. The RAM footprint is 2 bits per page, 4 bytes
+ * per erase block, 1 byte per file in LOGFS_MAX_FILES, 1.5KB of buffers and
+ * about 700 bytes per open file.
+ *
+ * The commit records are written to the first two blocks, that are erased
+ * after (blockSize-16)/(LOGFS_MAX_FILES+16) commits, so they are the ones
+ * that wear out first if files are synced very often.
+ */
+class LogFs : public FilesystemBase
+{
+public:
+    /**
+     * Constructor, mounts the filesystem
+     * \param flash flash device on which the filesystem is stored
+     */
+    LogFs(intrusive_ref_ptr<Device> flash);
+
+    /**
+     * Create an empty filesystem on a flash device, erasing its content
+     * \param flash flash device
+     * \return 0 on success, or a negative number on failure
+     */
+    static int format(intrusive_ref_ptr<Device> flash);
+
+    /**
+     * Open a file
+     * \param file the file object will be stored here, if the call succeeds
+     * \param name the name of the file to open, relative to the local
+     * filesystem
+     * \param flags file flags (open for reading, writing, ...)
+     * \param mode file permissions
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int open(intrusive_ref_ptr<FileBase>& file, StringPart& name,
+            int flags, int mode);
+
+    /**
+     * Obtain information on a file, identified by a path name. Does not follow
+     * symlinks
+     * \param name path name, relative to the local filesystem
+     * \param pstat file information is stored here
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int lstat(StringPart& name, struct stat *pstat);
+
+    /**
+     * Remove a file or directory
+     * \param name path name of file or directory to remove
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int unlink(StringPart& name);
+
+    /**
+     * Rename a file or directory
+     * \param oldName old file name
+     * \param newName new file name
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int rename(StringPart& oldName, StringPart& newName);
+
+    /**
+     * Create a directory
+     * \param name directory name
+     * \param mode directory permissions
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int mkdir(StringPart& name, int mode);
+
+    /**
+     * Remove a directory if empty
+     * \param name directory name
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int rmdir(StringPart& name);
+
+    /**
+     * \return true if the filesystem failed to mount
+     */
+    bool mountFailed() const { return failed; }
+
+    /**
+     * \return the number of free bytes, including those held by pages that
+     * the garbage collector has yet to reclaim
+     */
+    unsigned long long freeBytes();
+
+    /**
+     * Destructor
+     */
+    ~LogFs();
+
+    static const unsigned int pageSize=512;    ///< Size of a page in bytes
+    static const unsigned int maxNameLen=51;   ///< Maximum file name length
+    static const unsigned int indexPages=16;   ///< Index pages per file
+    static const unsigned int gcBlocks=2; ///< Free blocks for the collector
+    ///Maximum size of a file
+    static const unsigned int maxFileSize=indexPages*(pageSize/4)*pageSize;
+
+private:
+    /**
+     * A file in the file table, 128 bytes on flash
+     */
+    struct Entry
+    {
+        unsigned int mode;              ///< st_mode, 0 if unused
+        unsigned int parent;            ///< Inode of the parent directory
+        unsigned int size;              ///< File size
+        unsigned int index[indexPages]; ///< Index pages, 128 pages each
+        char name[maxNameLen+1];        ///< File name
+
+        bool used() const { return mode!=0 && mode!=0xffffffff; }
+    };
+
+    /**
+     * State of an open file, shared by all the LogFsFile opened on it
+     */
+    struct OpenInode
+    {
+        unsigned int slot;         ///< Slot in the file table
+        unsigned int refcount;     ///< Number of LogFsFile opened on it
+        bool dirty;                ///< Entry differs from the one on flash
+        bool indexDirty;           ///< Index page differs from the one on flash
+        int indexNumber;           ///< Index page in indexBuf, or -1
+        Entry entry;               ///< File table entry
+        unsigned int indexBuf[pageSize/4]; ///< Cached index page
+    };
+
+    static const unsigned int entriesPerPage=pageSize/sizeof(Entry);
+    static const unsigned int noPage=0xffffffff; ///< Page address of holes
+    static const unsigned int rootInode=1;
+
+    //
+    // Used by LogFsFile
+    //
+
+    /**
+     * Read from a file
+     * \param oi open file
+     * \param data buffer where read data is stored
+     * \param pos file position
+     * \param len number of bytes to read, not past the end of file
+     * \return the number of bytes read or a negative number on failure
+     */
+    ssize_t readFile(OpenInode *oi, char *data, unsigned int pos,
+            unsigned int len);
+
+    /**
+     * Write to a file
+     * \param oi open file
+     * \param data data to write
+     * \param pos file position
+     * \param len number of bytes to write
+     * \return the number of bytes written or a negative number on failure
+     */
+    ssize_t writeFile(OpenInode *oi, const char *data, unsigned int pos,
+            unsigned int len);
+
+    /**
+     * Change the size of a file
+     * \param oi open file
+     * \param size new size
+     * \return 0 on success, or a negative number on failure
+     */
+    int truncateFile(OpenInode *oi, unsigned int size);
+
+    /**
+     * Called when a LogFsFile is closed, commits the changes to the file
+     * \param oi open file
+     * \return 0 on success, or a negative number on failure
+     */
+    int closeFile(OpenInode *oi);
+
+    //
+    // File table
+    //
+
+    /**
+     * Look up a path
+     * \param path path relative to the filesystem root, not empty
+     * \param slot slot of the file is returned here
+     * \param entry the file table entry is returned here
+     * \return 0 on success, or a negative number on failure
+     */
+    int lookup(const char *path, unsigned int& slot, Entry& entry);
+
+    /**
+     * Look up the directory containing a path
+     * \param path path relative to the filesystem root, not empty
+     * \param parent inode of the directory is returned here
+     * \param name pointer to the last path component is returned here
+     * \return 0 on success, or a negative number on failure
+     */
+    int lookupParent(const char *path, unsigned int& parent, const char*& name);
+
+    /**
+     * Find a file in a directory
+     * \param parent inode of the directory
+     * \param name file name, terminated by '\0' or '/'
+     * \param slot slot of the file is returned here
+     * \param entry the file table entry is returned here
+     * \return 0 on success, or a negative number on failure
+     */
+    int findInDir(unsigned int parent, const char *name, unsigned int& slot,
+            Entry& entry);
+
+    /**
+     * Find an unused slot in the file table
+     */
+    int allocSlot(unsigned int& slot);
+
+    /**
+     * Read a file table entry, including the changes not yet committed
+     */
+    int readEntry(unsigned int slot, Entry& entry);
+
+    /**
+     * Write a file table entry, the change is made persistent by commit()
+     */
+    int writeEntry(unsigned int slot, const Entry& entry);
+
+    /**
+     * Release the pages of a file, from the page number first onwards
+     */
+    int releaseFilePages(Entry& entry, unsigned int first);
+
+    /**
+     * \return the open file for a slot, or nullptr
+     */
+    OpenInode *findOpen(unsigned int slot);
+
+    /**
+     * Find the address of a page of a file, without changing oi->indexBuf
+     */
+    int pageAddress(OpenInode *oi, unsigned int number, unsigned int& page);
+
+    /**
+     * Make an index page of a file current in oi->indexBuf
+     */
+    int loadIndex(OpenInode *oi, unsigned int number);
+
+    /**
+     * Write oi->indexBuf to flash if it was modified
+     */
+    int flushIndex(OpenInode *oi, bool gc=false);
+
+    /**
+     * Write the changes to open files, and make all changes persistent with a
+     * commit record
+     * \param gc true if called by the garbage collector
+     * \return 0 on success, or a negative number on failure
+     */
+    int commit(bool gc=false);
+
+    int unlinkRmdirHelper(StringPart& name, bool delDir);
+
+    //
+    // Page allocation
+    //
+
+    /**
+     * Make sure that the given number of pages can be allocated, running the
+     * garbage collector if needed. Called before starting an operation, as
+     * the garbage collector moves pages used by files
+     * \param pages number of pages
+     * \return 0 on success, or a negative number on failure
+     */
+    int reserve(unsigned int pages);
+
+    /**
+     * \return the number of pages a commit may write
+     */
+    unsigned int commitPages() const { return 2*openInodes.size(); }
+
+    /**
+     * \return the number of pages that can be allocated without running the
+     * garbage collector
+     */
+    unsigned int availablePages() const;
+
+    /**
+     * Allocate a page at the head of the log
+     * \param page the allocated page is returned here
+     * \param gc true if called by the garbage collector, that can use the
+     * free blocks kept for it
+     * \return 0 on success, or a negative number on failure
+     */
+    int allocPage(unsigned int& page, bool gc=false);
+
+    /**
+     * Allocate a page and write data into it
+     */
+    int writePage(unsigned int& page, const void *data, bool gc=false);
+
+    /**
+     * Read a page, or part of it
+     */
+    int readPage(unsigned int page, void *data, unsigned int offset=0,
+            unsigned int size=pageSize);
+
+    /**
+     * Mark a page as no longer used. It becomes reusable after the next
+     * commit, as the last commit may still point to it
+     */
+    void releasePage(unsigned int page);
+
+    /**
+     * Erase a block and write its header
+     */
+    int eraseBlock(unsigned int block);
+
+    /**
+     * Move the used pages out of some blocks, so that they can be erased
+     * \param victims the blocks, moved together so that the index pages and
+     * file table pages pointing to their pages are rewritten only once
+     * \return 0 on success, or a negative number on failure
+     */
+    int collect(const std::vector<unsigned int>& victims);
+
+    /**
+     * \return the number of used or pinned pages in a block
+     */
+    unsigned int usedPages(unsigned int block) const;
+
+    /**
+     * \param count the number of free blocks is returned here
+     * \return the least erased block with no used pages that is not the head
+     * of the log, or -1 if there is none
+     */
+    int freeBlock(unsigned int& count) const;
+
+    /**
+     * \return the erase count of the most erased block, superblocks excluded
+     */
+    unsigned int maxEraseCount() const;
+
+    /**
+     * \return true if page is the address of a page that can hold data
+     */
+    bool isDataPage(unsigned int page) const;
+
+    static bool testBit(const std::vector<unsigned char>& map, unsigned int i)
+    {
+        return map[i/8] & (1<<(i%8));
+    }
+    static void setBit(std::vector<unsigned char>& map, unsigned int i)
+    {
+        map[i/8]|=1<<(i%8);
+    }
+    static void clearBit(std::vector<unsigned char>& map, unsigned int i)
+    {
+        map[i/8]&=~(1<<(i%8));
+    }
+
+    intrusive_ref_ptr<Device> flash;   ///< Flash device
+    FastMutex mutex;                   ///< Protects all the fields below
+    unsigned int blockSize;            ///< Erase block size
+    unsigned int blockCount;           ///< Number of erase blocks
+    unsigned int programSize;          ///< Programming granularity
+    unsigned int pagesPerBlock;        ///< Pages in a block, header included
+    unsigned int commitSize;           ///< Size of a commit record
+    std::vector<unsigned int> chunks;  ///< File table pages
+    std::vector<unsigned int> eraseCounts; ///< Erase count of each block
+    std::vector<unsigned char> usedMap;    ///< Pages in use
+    std::vector<unsigned char> pinnedMap;  ///< Pages used by the last commit
+    std::vector<OpenInode*> openInodes;    ///< Open files
+    unsigned int logBlock;             ///< Block at the head of the log
+    unsigned int logPage;              ///< Next free page in logBlock
+    unsigned int commitBlock;          ///< Superblock with the last commit
+    unsigned int commitOffset;         ///< Where to write the next commit
+    unsigned int sequence;             ///< Sequence number of the last commit
+    unsigned int pinnedCount;          ///< Number of pinned pages
+    bool wearCheck;                    ///< Static wear leveling may be needed
+    bool failed;                       ///< Failed to mount
+    Entry chunkBuf[entriesPerPage];    ///< Buffer for file table pages
+    unsigned int indexBuf[pageSize/4]; ///< Buffer for index pages
+    char pageBuf[pageSize];            ///< Buffer for data pages
+
+    friend class LogFsFile;
+    friend class LogFsDirectory;
+};
+
+#endif //WITH_FILESYSTEM
+
+} //namespace miosix
+
+#endif //LOGFS_H
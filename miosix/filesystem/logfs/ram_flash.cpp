@@ -0,0 +1,130 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "ram_flash.h"
+#include <errno.h>
+#include <cstring>
+#include <algorithm>
+#include "filesystem/ioctl.h"
+
+using namespace std;
+
+namespace miosix {
+
+RamFlash::RamFlash(unsigned int blockSize, unsigned int blockCount,
+        unsigned int programSize) : Device(Device::BLOCK),
+        memory(blockSize*blockCount,0xff), erases(blockCount,0),
+        programmed(0), blockSize(blockSize), programSize(programSize), countdown(-1),
+        failed(false) {}
+
+ssize_t RamFlash::readBlock(void *buffer, size_t size, off_t where)
+{
+    Lock<FastMutex> l(mutex);
+    if(where<0 || where+size>memory.size()) return -EFAULT;
+    memcpy(buffer,&memory[where],size);
+    return size;
+}
+
+ssize_t RamFlash::writeBlock(const void *buffer, size_t size, off_t where)
+{
+    Lock<FastMutex> l(mutex);
+    if(where<0 || where+size>memory.size()) return -EFAULT;
+    if(where % programSize || size % programSize) return -EINVAL;
+    const unsigned char *data=reinterpret_cast<const unsigned char*>(buffer);
+    for(size_t i=0;i<size;i++)
+        if((memory[where+i] & data[i])!=data[i]) return -EIO; //Not erased
+    if(failed) return -EIO;
+    bool fail=failNow();
+    if(fail) size=size/2/programSize*programSize;
+    for(size_t i=0;i<size;i++) memory[where+i]&=data[i];
+    programmed+=size;
+    return fail ? -EIO : static_cast<ssize_t>(size);
+}
+
+int RamFlash::ioctl(int cmd, void *arg)
+{
+    switch(cmd)
+    {
+        case IOCTL_FLASH_GET_INFO:
+        {
+            FlashInfo *info=reinterpret_cast<FlashInfo*>(arg);
+            info->blockSize=blockSize;
+            info->blockCount=erases.size();
+            info->programSize=programSize;
+            return 0;
+        }
+        case IOCTL_FLASH_ERASE:
+        {
+            Lock<FastMutex> l(mutex);
+            unsigned int block=*reinterpret_cast<unsigned int*>(arg);
+            if(block>=erases.size()) return -EINVAL;
+            if(failed) return -EIO;
+            bool fail=failNow();
+            auto begin=memory.begin()+block*blockSize;
+            fill(begin,begin+(fail ? blockSize/2 : blockSize),0xff);
+            erases[block]++;
+            return fail ? -EIO : 0;
+        }
+        default:
+            return -ENOTTY;
+    }
+}
+
+unsigned int RamFlash::eraseCount(unsigned int block) const
+{
+    Lock<FastMutex> l(mutex);
+    return erases.at(block);
+}
+
+unsigned long long RamFlash::programmedBytes() const
+{
+    Lock<FastMutex> l(mutex);
+    return programmed;
+}
+
+void RamFlash::setPowerFailure(int operations)
+{
+    Lock<FastMutex> l(mutex);
+    countdown=operations;
+    failed=false;
+}
+
+bool RamFlash::powerFailed() const
+{
+    Lock<FastMutex> l(mutex);
+    return failed;
+}
+
+bool RamFlash::failNow()
+{
+    if(countdown<0) return false;
+    if(countdown-->0) return false;
+    failed=true;
+    return true;
+}
+
+} //namespace miosix
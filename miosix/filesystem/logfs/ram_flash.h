@@ -0,0 +1,133 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef RAM_FLASH_H
+#define RAM_FLASH_H
+
+#include <vector>
+#include "filesystem/devfs/devfs.h"
+#include "kernel/sync.h"
+
+namespace miosix {
+
+/**
+ * A flash device emulated in RAM, with the same constraints of a NOR flash:
+ * writes can only change bits from one to zero, and a whole block has to be
+ * erased to set them to one again. Implements IOCTL_FLASH_GET_INFO and
+ * IOCTL_FLASH_ERASE, so that LogFs can be tested, also on a Linux host,
+ * without wearing out a real flash.
+ *
+ * It counts the erases of each block, and can simulate a power failure that
+ * interrupts a write or erase leaving it half done.
+ *
+ * It is not built with the kernel, it is built by _tools/fs_host_test, and
+ * applications that want it on a board add ram_flash.cpp to their sources.
+ */
+class RamFlash : public Device
+{
+public:
+    /**
+     * Constructor, the memory starts erased
+     * \param blockSize erase block size in bytes
+     * \param blockCount number of erase blocks
+     * \param programSize programming granularity in bytes
+     */
+    RamFlash(unsigned int blockSize, unsigned int blockCount,
+             unsigned int programSize=4);
+
+    /**
+     * Read a block of data
+     * \param buffer buffer where read data will be stored
+     * \param size buffer size
+     * \param where where to read from
+     * \return number of bytes read or a negative number on failure
+     */
+    virtual ssize_t readBlock(void *buffer, size_t size, off_t where);
+
+    /**
+     * Program a block of data
+     * \param buffer buffer where take data to write
+     * \param size buffer size, a multiple of the programming granularity
+     * \param where where to write to, a multiple of the programming granularity
+     * \return number of bytes written or a negative number on failure. Trying
+     * to change a bit from zero to one is an error
+     */
+    virtual ssize_t writeBlock(const void *buffer, size_t size, off_t where);
+
+    /**
+     * Performs device-specific operations
+     * \param cmd specifies the operation to perform
+     * \param arg optional argument that some operation require
+     * \return the exact return value depends on CMD, -1 is returned on error
+     */
+    virtual int ioctl(int cmd, void *arg);
+
+    /**
+     * \param block block number
+     * \return the number of times the block was erased
+     */
+    unsigned int eraseCount(unsigned int block) const;
+
+    /**
+     * \return the number of bytes programmed since the device was created
+     */
+    unsigned long long programmedBytes() const;
+
+    /**
+     * Simulate a power failure. After the given number of writes and erases,
+     * the next one is done only in part, and that one and all the following
+     * ones fail, until this function is called again
+     * \param operations number of writes and erases that succeed, or -1 to
+     * disable the simulated power failure
+     */
+    void setPowerFailure(int operations);
+
+    /**
+     * \return true if the simulated power failure happened
+     */
+    bool powerFailed() const;
+
+private:
+    /**
+     * Count down to the simulated power failure
+     * \return true if the operation has to be done in part and fail
+     */
+    bool failNow();
+
+    mutable FastMutex mutex;
+    std::vector<unsigned char> memory; ///< Flash content
+    std::vector<unsigned int> erases;  ///< Erase count of each block
+    unsigned long long programmed;     ///< Number of bytes programmed
+    unsigned int blockSize;            ///< Erase block size
+    unsigned int programSize;          ///< Programming granularity
+    int countdown;                     ///< Operations before power failure
+    bool failed;                       ///< Power failure happened
+};
+
+} //namespace miosix
+
+#endif //RAM_FLASH_H
@@ -0,0 +1,361 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "path_resolution.h"
+#include <string>
+#include <algorithm>
+
+using namespace std;
+
+#ifdef WITH_FILESYSTEM
+
+namespace miosix {
+
+/**
+ * Remove a node from the list of children of its parent
+ * \param node node to remove, must not be the root node
+ */
+static void detach(MountPoint *node)
+{
+    MountPoint **it=&node->parent->child;
+    while(*it!=node) it=&(*it)->sibling;
+    *it=node->sibling;
+    node->parent=0;
+    node->sibling=0;
+}
+
+//
+// class MountPoint
+//
+
+MountPoint *MountPoint::findOrAdd(const char *name, size_t len)
+{
+    if(MountPoint *result=find(name,len)) return result;
+    MountPoint *result=new MountPoint;
+    result->name=new char[len];
+    memcpy(result->name,name,len);
+    result->nameLen=len;
+    result->pathLen=pathLen+1+len;
+    result->parent=this;
+    result->sibling=child;
+    child=result;
+    return result;
+}
+
+void MountPoint::mountedBelow(vector<intrusive_ref_ptr<FilesystemBase> >& fsList)
+{
+    if(fs) fsList.push_back(fs);
+    for(MountPoint *it=child;it;it=it->sibling) it->mountedBelow(fsList);
+}
+
+void MountPoint::removeAll()
+{
+    if(parent==0)
+    {
+        //The root node is never deleted
+        while(child)
+        {
+            MountPoint *next=child;
+            detach(next);
+            delete next;
+        }
+        fs.reset();
+        return;
+    }
+    MountPoint *p=parent;
+    detach(this);
+    delete this;
+    //Nodes left with no filesystem and no children are no longer needed
+    while(p->parent && !p->fs && !p->child)
+    {
+        MountPoint *next=p->parent;
+        detach(p);
+        delete p;
+        p=next;
+    }
+}
+
+MountPoint::~MountPoint()
+{
+    while(child)
+    {
+        MountPoint *next=child->sibling;
+        delete child;
+        child=next;
+    }
+    delete[] name;
+}
+
+/**
+ * This class implements the path resolution logic
+ */
+class PathResolution
+{
+public:
+    /**
+     * Constructor
+     * \param path path to resolve, must start with a "/"
+     * \param size size of the buffer holding the path
+     * \param root root of the trie of mount points
+     */
+    PathResolution(char *path, size_t size, MountPoint *root)
+            : path(path), size(size), len(strlen(path)), root(root) {}
+    
+    /**
+     * The main purpose of this class, resolve a path
+     * \param followLastSymlink if true, follow last symlink
+     * \return a resolved path
+     */
+    ResolvedPath resolvePath(bool followLastSymlink);
+    
+private:
+    /**
+     * Handle a /../ in a path
+     * \return 0 on success, a negative number on error
+     */
+    int upPathComponent();
+    
+    /**
+     * Handle a normal path component in a path, i.e, a path component
+     * that is neither //, /./ or /../
+     * \param slash path[slash] is the / character after the path component,
+     * or the terminating null character
+     * \param followIfSymlink if true, follow symbolic links
+     * \return 0 on success, or a negative number on error
+     */
+    int normalPathComponent(size_t slash, bool followIfSymlink);
+    
+    /**
+     * Follow a symbolic link
+     * \param start path[start] is the first char of the last path component
+     * of the resolved part of the path, which must be a symbolic link
+     * (verified by the caller).
+     * \return 0 on success, a negative number on failure
+     */
+    int followSymlink(size_t start);
+    
+    /**
+     * Make the filesystem mounted on a node the current one
+     * \param mp node with a mounted filesystem
+     */
+    void setFs(MountPoint *mp)
+    {
+        fsNode=mp;
+        fs=mp->fs.get();
+        syms=fs->supportsSymlinks();
+        indexIntoFs=mp->pathLen+1;
+    }
+    
+    char *path;        ///< Path being resolved
+    const size_t size; ///< Size of the buffer holding the path
+    size_t len;        ///< Length of the path
+    
+    /// Root of the trie of mount points
+    MountPoint *root;
+    
+    /// Deepest node of the trie matched by the resolved part of the path
+    MountPoint *node;
+    
+    /// Node where the current filesystem is mounted
+    MountPoint *fsNode;
+    
+    /// Current filesystem while looking up path
+    FilesystemBase *fs;
+    
+    /// True if current filesystem supports symlinks
+    bool syms;
+    
+    /// path[index] is first unhandled char
+    size_t index;
+    
+    /// path[0] to path[out-1] is the resolved part of the path, ending with /
+    size_t out;
+    
+    /// path+indexIntoFs is the relative path to current filesystem
+    size_t indexIntoFs;
+    
+    /// How many components of the resolved path are below node
+    int offTrie;
+    
+    /// How many symlinks we've found so far
+    int linksFollowed;
+    
+    /// Maximum number of symbolic links to follow (to avoid endless loops)
+    static const int maxLinkToFollow=2;
+};
+
+ResolvedPath PathResolution::resolvePath(bool followLastSymlink)
+{
+    if(!root->fs) return ResolvedPath(-ENOENT); //should not happen
+    node=root;
+    setFs(root);
+    index=1; //Skip leading /, NOTE: caller must ensure path[0]=='/'
+    out=1;
+    offTrie=0;
+    linksFollowed=0;
+    //Path components are compacted towards the start of the buffer as they
+    //are resolved, so the path is scanned only once
+    while(index<len)
+    {
+        const void *end=memchr(path+index,'/',len-index);
+        //Last component (no trailing /)
+        size_t slash=end ? reinterpret_cast<const char*>(end)-path : len;
+        
+        int result=0;
+        if(slash==index || (slash-index==1 && path[index]=='.'))
+        {
+            //Path component is empty, caused by double slash, or ".", ignore
+            index=slash+1;
+        } else if(slash-index==2 && path[index]=='.' && path[index+1]=='.') {
+            index=slash+1;
+            result=upPathComponent();
+        } else {
+            // follow=followLastSymlink for "/link", but is true for "/link/"
+            bool follow=slash==len ? followLastSymlink : true;
+            result=normalPathComponent(slash,follow);
+        }
+        if(result<0) return ResolvedPath(result);
+    }
+    //Remove trailing /
+    if(out>1) out--;
+    path[out]='\0';
+    //indexIntoFs>out may happen if the last path component is a fs
+    return ResolvedPath(fsNode->fs,min(indexIntoFs,out));
+}
+
+int PathResolution::upPathComponent()
+{
+    if(out<=1) return -ENOENT; //root dir has no parent
+    out--;
+    while(path[out-1]!='/') out--;
+    if(offTrie>0)
+    {
+        offTrie--;
+        return 0;
+    }
+    //The removed path component was a node of the trie. If the current
+    //filesystem is mounted there, escape it
+    bool escape=node==fsNode;
+    node=node->parent;
+    if(escape) setFs(node->mounted());
+    return 0;
+}
+
+int PathResolution::normalPathComponent(size_t slash, bool followIfSymlink)
+{
+    bool last=slash==len;
+    size_t start=out;
+    if(out!=index) memmove(path+out,path+index,slash-index);
+    out+=slash-index;
+    index=slash+1; //NOTE: if(last) two past the last
+    
+    //No need to look for a mount point once a path component was not found
+    //in the trie, until a /../ goes back to a node of the trie
+    MountPoint *next=offTrie==0 ? node->find(path+start,out-start) : 0;
+    if(next)
+    {
+        node=next;
+        if(next->fs)
+        {
+            //Jumped to a new filesystem. Not stat-ing the path as we're
+            //relying on mount not allowing to mount a filesystem on anything
+            //but a directory.
+            setFs(next);
+            path[out++]='/';
+            return 0;
+        }
+    } else offTrie++;
+    if(syms && followIfSymlink)
+    {
+        struct stat st;
+        {
+            StringPart sp(path,out,indexIntoFs);
+            //If lstat fails, leave it to the caller to report the error, as
+            //the last path component may be a file that is about to be created
+            if(fs->lstat(sp,&st)<0) st.st_mode=0;
+        }
+        if(S_ISLNK(st.st_mode)) return followSymlink(start);
+        else if(!last && st.st_mode!=0 && !S_ISDIR(st.st_mode)) return -ENOTDIR;
+    }
+    path[out++]='/';
+    return 0;
+}
+
+int PathResolution::followSymlink(size_t start)
+{
+    if(++linksFollowed>=maxLinkToFollow) return -ELOOP;
+    string target;
+    {
+        StringPart sp(path,out,indexIntoFs);
+        int res=fs->readlink(sp,target);
+        if(res<0) return res;
+    }
+    if(target.empty()) return -ENOENT; //Should not happen
+    
+    //Replace the symlink with its target, if the symlink is absolute the whole
+    //resolved part of the path is replaced
+    bool absolute=target[0]=='/';
+    size_t dest=absolute ? 0 : start;
+    size_t rest=min(index-1,len); //Unresolved part of the path, including /
+    size_t newLen=dest+target.length()+len-rest;
+    if(newLen>=size) return -ENAMETOOLONG;
+    memmove(path+dest+target.length(),path+rest,len-rest+1);
+    memcpy(path+dest,target.data(),target.length());
+    len=newLen;
+    if(absolute)
+    {
+        node=root;
+        setFs(root);
+        index=1;
+        out=1;
+        offTrie=0;
+    } else {
+        //The symlink was not a mount point, so the filesystem is unchanged
+        if(offTrie>0) offTrie--;
+        else node=node->parent;
+        index=start;
+        out=start;
+    }
+    return 0;
+}
+
+//
+// Resolve path
+//
+
+ResolvedPath resolvePath(char *path, size_t size, MountPoint *root,
+        bool followLastSymlink)
+{
+    //see man path_resolution. This code supports arbitrarily mounted
+    //filesystems, symbolic links resolution, but no hardlinks to directories
+    PathResolution pr(path,size,root);
+    return pr.resolvePath(followLastSymlink);
+}
+
+} //namespace miosix
+
+#endif //WITH_FILESYSTEM
@@ -0,0 +1,177 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef PATH_RESOLUTION_H
+#define PATH_RESOLUTION_H
+
+#include <vector>
+#include <cstring>
+#include <errno.h>
+#include "file.h"
+#include "stringpart.h"
+#include "kernel/intrusive.h"
+#include "config/miosix_settings.h"
+
+#ifdef WITH_FILESYSTEM
+
+namespace miosix {
+
+/**
+ * The result of resolvePath().
+ */
+class ResolvedPath
+{
+public:
+    /**
+     * Constructor
+     */
+    ResolvedPath() : result(-EINVAL), fs(0), off(0) {}
+    
+    /**
+     * Constructor
+     * \param result error code
+     */
+    explicit ResolvedPath(int result) : result(result), fs(0), off(0) {}
+    
+    /**
+     * Constructor
+     * \param fs filesystem
+     * \param off offset into path where the subpath relative to the current
+     * filesystem starts
+     */
+    ResolvedPath(intrusive_ref_ptr<FilesystemBase> fs, size_t offset)
+            : result(0), fs(fs), off(offset) {}
+    
+    int result; ///< 0 on success, a negative number on failure
+    intrusive_ref_ptr<FilesystemBase> fs; ///< pointer to the filesystem to which the file belongs
+    /// path.c_str()+off is a string containing the relative path into the
+    /// filesystem for the looked up file
+    size_t off;
+};
+
+/**
+ * \internal
+ * A node of the trie of mount points kept by the FilesystemManager. Every
+ * node is a path component, the root node is "/". Nodes where a filesystem is
+ * mounted have a non null fs, the others are only there to reach mount points
+ * deeper in the directory tree, such as "/a" when the only mount point other
+ * than "/" is "/a/b".
+ */
+class MountPoint
+{
+public:
+    /**
+     * Constructor, makes a root node
+     */
+    MountPoint() : parent(0), child(0), sibling(0), name(0), nameLen(0),
+            pathLen(0) {}
+    
+    /**
+     * \param name a path component, not null terminated
+     * \param len length of the path component
+     * \return the child node with that name, or null if there is none
+     */
+    MountPoint *find(const char *name, size_t len) const
+    {
+        for(MountPoint *it=child;it;it=it->sibling)
+            if(it->nameLen==len && memcmp(it->name,name,len)==0) return it;
+        return 0;
+    }
+    
+    /**
+     * \param name a path component, not null terminated
+     * \param len length of the path component
+     * \return the child node with that name, which is added if there is none,
+     * or null if out of memory
+     */
+    MountPoint *findOrAdd(const char *name, size_t len);
+    
+    /**
+     * \return the nearest node where a filesystem is mounted, starting from
+     * this node and going up towards the root
+     */
+    MountPoint *mounted()
+    {
+        MountPoint *it=this;
+        while(!it->fs && it->parent) it=it->parent;
+        return it;
+    }
+    
+    /**
+     * \param fsList the filesystems mounted on this node and on all the
+     * nodes below it are added here
+     */
+    void mountedBelow(std::vector<intrusive_ref_ptr<FilesystemBase> >& fsList);
+    
+    /**
+     * Unmount the filesystem mounted on this node and on all the nodes below
+     * it, and delete the nodes that are no longer needed to reach a mount
+     * point. If this node is not the root node, it is deleted.
+     */
+    void removeAll();
+    
+    /**
+     * Destructor, deletes all the nodes below this one
+     */
+    ~MountPoint();
+    
+    MountPoint *parent;  ///< Parent node, null for the root node
+    MountPoint *child;   ///< First child node
+    MountPoint *sibling; ///< Next child node of the same parent
+    intrusive_ref_ptr<FilesystemBase> fs; ///< Mounted filesystem, or null
+    char *name;          ///< Path component, not null terminated
+    unsigned short nameLen; ///< Length of the path component
+    unsigned short pathLen; ///< Length of the full path, "/" has length zero
+    
+private:
+    MountPoint(const MountPoint&);
+    MountPoint& operator=(const MountPoint&);
+};
+
+/**
+ * \internal
+ * Resolve a path to identify the filesystem it belongs. The path is scanned
+ * once, handling "//", "/./" and "/../" in place, and looking up the mount
+ * points in the trie only as long as the path components match one of its
+ * nodes. No memory is allocated, unless a symlink is found.
+ * \param path an absolute path name, that must start with '/', in a buffer of
+ * size bytes. As with FilesystemManager::resolvePath(), this is an inout
+ * parameter that on success contains the canonical path name
+ * \param size size of the buffer holding path
+ * \param root root of the trie of mount points, "/" must be mounted
+ * \param followLastSymlink true if the symlink in the last path component
+ *(the one that does not end with a /, if it exists, has to be followed)
+ * \return the resolved path
+ */
+ResolvedPath resolvePath(char *path, size_t size, MountPoint *root,
+        bool followLastSymlink);
+
+} //namespace miosix
+
+#endif //WITH_FILESYSTEM
+
+#endif //PATH_RESOLUTION_H
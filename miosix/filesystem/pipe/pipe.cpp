@@ -0,0 +1,349 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "pipe.h"
+#include <cstring>
+#include <algorithm>
+#include <sys/stat.h>
+
+using namespace std;
+
+namespace miosix {
+
+#ifdef WITH_FILESYSTEM
+
+//
+// class PipeBuffer
+//
+
+PipeBuffer::PipeBuffer(unsigned int size) : buffer(new char[size]), size(size)
+{}
+
+void PipeBuffer::open(bool reader, bool writer)
+{
+    Lock<FastMutex> l(mutex);
+    if(reader)
+    {
+        readers++;
+        readerSeen=true;
+    }
+    if(writer)
+    {
+        writers++;
+        writerSeen=true;
+    }
+}
+
+void PipeBuffer::close(bool reader, bool writer)
+{
+    Lock<FastMutex> l(mutex);
+    if(reader) readers--;
+    if(writer) writers--;
+    if(readers==0 && writers==0)
+    {
+        //Last file closed, a FIFO opened again starts empty
+        head=count=0;
+        readerSeen=writerSeen=false;
+    }
+    notify();
+}
+
+ssize_t PipeBuffer::read(void *data, size_t len, bool nonblock)
+{
+    if(len==0) return 0;
+    Lock<FastMutex> rl(readMutex);
+    Lock<FastMutex> l(mutex);
+    int result=waitData(l,nonblock);
+    if(result<=0) return result;
+    //Up to two copies, if the data wraps around the end of the buffer
+    unsigned int n=min<size_t>(len,count);
+    unsigned int first=min(n,size-head);
+    memcpy(data,buffer+head,first);
+    memcpy(reinterpret_cast<char*>(data)+first,buffer,n-first);
+    head=(head+n)%size;
+    count-=n;
+    notify();
+    return n;
+}
+
+ssize_t PipeBuffer::write(const void *data, size_t len, bool nonblock)
+{
+    if(len==0) return 0;
+    const char *src=reinterpret_cast<const char*>(data);
+    Lock<FastMutex> wl(writeMutex);
+    Lock<FastMutex> l(mutex);
+    size_t written=0;
+    while(written<len)
+    {
+        //Writes that fit in the buffer are not split in nonblocking mode
+        unsigned int needed=nonblock && len<=size ? len : 1;
+        int result=waitSpace(l,needed,nonblock);
+        if(result<0) return written>0 ? written : result;
+        unsigned int tail=(head+count)%size;
+        unsigned int n=min<size_t>(len-written,size-count);
+        unsigned int first=min(n,size-tail);
+        memcpy(buffer+tail,src+written,first);
+        memcpy(buffer,src+written+first,n-first);
+        count+=n;
+        written+=n;
+        notify();
+    }
+    return written;
+}
+
+ssize_t PipeBuffer::spliceTo(FileBase *out, size_t len, bool nonblock)
+{
+    if(len==0) return 0;
+    Lock<FastMutex> rl(readMutex);
+    Lock<FastMutex> l(mutex);
+    int result=waitData(l,nonblock);
+    if(result<=0) return result;
+    //Only readers remove data, and they hold readMutex, so the data being
+    //written stays in the buffer while mutex is unlocked and writers add more
+    size_t moved=0;
+    while(moved<len && count>0)
+    {
+        unsigned int n=min<size_t>({len-moved,count,size-head});
+        ssize_t w;
+        {
+            Unlock<FastMutex> u(l);
+            w=out->write(buffer+head,n);
+        }
+        if(w<=0)
+        {
+            if(moved>0) break;
+            return w;
+        }
+        head=(head+w)%size;
+        count-=w;
+        moved+=w;
+        notify();
+        if(static_cast<size_t>(w)<n) break;
+    }
+    return moved;
+}
+
+ssize_t PipeBuffer::spliceFrom(FileBase *in, size_t len, bool nonblock)
+{
+    if(len==0) return 0;
+    Lock<FastMutex> wl(writeMutex);
+    Lock<FastMutex> l(mutex);
+    int result=waitSpace(l,1,nonblock);
+    if(result<0) return result;
+    //Only writers add data, and they hold writeMutex, so the free space
+    //being read into stays free while mutex is unlocked
+    size_t moved=0;
+    while(moved<len && count<size)
+    {
+        unsigned int tail=(head+count)%size;
+        unsigned int n=min<size_t>({len-moved,size-count,size-tail});
+        ssize_t r;
+        {
+            Unlock<FastMutex> u(l);
+            r=in->read(buffer+tail,n);
+        }
+        if(r<=0)
+        {
+            if(moved>0) break;
+            return r;
+        }
+        count+=r;
+        moved+=r;
+        notify();
+        if(static_cast<size_t>(r)<n) break;
+    }
+    return moved;
+}
+
+int PipeBuffer::poll(WaitQueueEntry *entry, bool reader, bool writer)
+{
+    //The state is checked with mutex locked, and notify() is called with
+    //mutex locked, so a change after the check always wakes the entry
+    Lock<FastMutex> l(mutex);
+    if(entry) pollers.add(entry);
+    int result=0;
+    if(reader)
+    {
+        if(count>0) result|=POLLIN;
+        if(writers==0 && writerSeen) result|=POLLHUP;
+    }
+    if(writer)
+    {
+        if(readers==0 && readerSeen) result|=POLLERR;
+        else if(count<size) result|=POLLOUT;
+    }
+    return result;
+}
+
+unsigned int PipeBuffer::available()
+{
+    Lock<FastMutex> l(mutex);
+    return count;
+}
+
+PipeBuffer::~PipeBuffer()
+{
+    delete[] buffer;
+}
+
+int PipeBuffer::waitData(Lock<FastMutex>& l, bool nonblock)
+{
+    for(;;)
+    {
+        if(count>0) return 1;
+        if(writers==0 && writerSeen) return 0; //End of file
+        if(nonblock) return -EAGAIN;
+        cond.wait(l);
+    }
+}
+
+int PipeBuffer::waitSpace(Lock<FastMutex>& l, unsigned int needed,
+        bool nonblock)
+{
+    for(;;)
+    {
+        if(readers==0 && readerSeen) return -EPIPE;
+        if(size-count>=needed) return 0;
+        if(nonblock) return -EAGAIN;
+        cond.wait(l);
+    }
+}
+
+void PipeBuffer::notify()
+{
+    cond.broadcast();
+    pollers.wakeAll();
+}
+
+//
+// class PipeFile
+//
+
+PipeFile::PipeFile(intrusive_ref_ptr<FilesystemBase> parent,
+        intrusive_ref_ptr<PipeBuffer> pipe, int flags) : FileBase(parent),
+        pipe(pipe), reader((flags & O_ACCMODE)!=O_WRONLY),
+        writer((flags & O_ACCMODE)!=O_RDONLY),
+        nonblock((flags & O_NONBLOCK)!=0)
+{
+    pipe->open(reader,writer);
+}
+
+ssize_t PipeFile::write(const void *data, size_t len)
+{
+    if(writer==false) return -EBADF;
+    return pipe->write(data,len,nonblock);
+}
+
+ssize_t PipeFile::read(void *data, size_t len)
+{
+    if(reader==false) return -EBADF;
+    return pipe->read(data,len,nonblock);
+}
+
+int PipeFile::poll(WaitQueueEntry *entry)
+{
+    return pipe->poll(entry,reader,writer);
+}
+
+off_t PipeFile::lseek(off_t pos, int whence)
+{
+    return -ESPIPE;
+}
+
+int PipeFile::fstat(struct stat *pstat) const
+{
+    memset(pstat,0,sizeof(struct stat));
+    pstat->st_mode=S_IFIFO | 0600; //prw-------
+    pstat->st_nlink=1;
+    pstat->st_size=pipe->available();
+    return 0;
+}
+
+int PipeFile::fcntl(int cmd, int opt)
+{
+    switch(cmd)
+    {
+        case F_GETFL:
+            return (reader ? (writer ? O_RDWR : O_RDONLY) : O_WRONLY)
+                 | (nonblock ? O_NONBLOCK : 0);
+        case F_SETFL:
+            nonblock=(opt & O_NONBLOCK)!=0;
+            return 0;
+        default:
+            return FileBase::fcntl(cmd,opt);
+    }
+}
+
+PipeFile *PipeFile::getPipe()
+{
+    return this;
+}
+
+ssize_t PipeFile::spliceTo(FileBase *out, size_t len, unsigned int flags)
+{
+    if(reader==false) return -EBADF;
+    return pipe->spliceTo(out,len,nonblock || (flags & SPLICE_F_NONBLOCK));
+}
+
+ssize_t PipeFile::spliceFrom(FileBase *in, size_t len, unsigned int flags)
+{
+    if(writer==false) return -EBADF;
+    return pipe->spliceFrom(in,len,nonblock || (flags & SPLICE_F_NONBLOCK));
+}
+
+PipeFile::~PipeFile()
+{
+    pipe->close(reader,writer);
+}
+
+#ifdef WITH_DEVFS
+
+//
+// class Fifo
+//
+
+Fifo::Fifo() : Device(Device::STREAM), pipe(new PipeBuffer) {}
+
+int Fifo::open(intrusive_ref_ptr<FileBase>& file,
+        intrusive_ref_ptr<FilesystemBase> fs, int flags, int mode)
+{
+    file=intrusive_ref_ptr<FileBase>(new PipeFile(fs,pipe,flags));
+    return 0;
+}
+
+int Fifo::fstat(struct stat *pstat) const
+{
+    Device::fstat(pstat);
+    pstat->st_mode=S_IFIFO | 0660; //prw-rw----
+    return 0;
+}
+
+#endif //WITH_DEVFS
+
+#endif //WITH_FILESYSTEM
+
+} //namespace miosix
@@ -0,0 +1,336 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef PIPE_H
+#define PIPE_H
+
+#include <fcntl.h>
+#include "filesystem/file.h"
+#include "filesystem/devfs/devfs.h"
+#include "kernel/sync.h"
+#include "config/miosix_settings.h"
+
+#ifndef SPLICE_F_NONBLOCK
+/// Do not block on the pipe in splice()
+#define SPLICE_F_NONBLOCK 0x02
+#endif //SPLICE_F_NONBLOCK
+
+namespace miosix {
+
+#ifdef WITH_FILESYSTEM
+
+/**
+ * The ring buffer shared by the two ends of a pipe, or by all the files that
+ * opened the same FIFO.
+ *
+ * Reads block while the buffer is empty, and return 0 when all the writers
+ * closed the pipe. Writes block while the buffer is full, and fail with
+ * EPIPE when all the readers closed the pipe. Reads are serialized, and so
+ * are writes, so the data of a write is never interleaved with the data of
+ * other writers. Readers and writers also have separate locks, so that a
+ * reader copies out data while a writer copies in more.
+ *
+ * Until the first reader and the first writer open a FIFO, writes are
+ * buffered and reads block, as if open() had waited for the other end.
+ * When all the files referring to a FIFO are closed, the buffered data is
+ * discarded.
+ */
+class PipeBuffer : public IntrusiveRefCounted
+{
+public:
+    /**
+     * Constructor
+     * \param size buffer size in bytes
+     */
+    explicit PipeBuffer(unsigned int size=PIPE_BUFFER_SIZE);
+
+    /**
+     * Called when a file referring to the pipe is opened
+     * \param reader true if the file is opened for reading
+     * \param writer true if the file is opened for writing
+     */
+    void open(bool reader, bool writer);
+
+    /**
+     * Called when a file referring to the pipe is closed
+     * \param reader true if the file was opened for reading
+     * \param writer true if the file was opened for writing
+     */
+    void close(bool reader, bool writer);
+
+    /**
+     * Read data from the pipe
+     * \param data buffer to store read data
+     * \param len the number of bytes to read
+     * \param nonblock if true, fail with EAGAIN instead of blocking
+     * \return the number of read bytes, 0 if all the writers closed the
+     * pipe, or a negative number in case of errors
+     */
+    ssize_t read(void *data, size_t len, bool nonblock);
+
+    /**
+     * Write data to the pipe
+     * \param data the data to write
+     * \param len the number of bytes to write
+     * \param nonblock if true, write only what fits in the buffer, and fail
+     * with EAGAIN if nothing does. Writes up to the buffer size are written
+     * entirely or not at all
+     * \return the number of written bytes, or a negative number in case of
+     * errors
+     */
+    ssize_t write(const void *data, size_t len, bool nonblock);
+
+    /**
+     * Move data from the pipe to a file, by writing to the file directly
+     * from the pipe buffer
+     * \param out the file to write to
+     * \param len maximum number of bytes to move
+     * \param nonblock if true, fail with EAGAIN instead of waiting for data
+     * \return the number of moved bytes, 0 if all the writers closed the
+     * pipe, or a negative number in case of errors
+     */
+    ssize_t spliceTo(FileBase *out, size_t len, bool nonblock);
+
+    /**
+     * Move data from a file to the pipe, by reading from the file directly
+     * into the pipe buffer
+     * \param in the file to read from
+     * \param len maximum number of bytes to move
+     * \param nonblock if true, fail with EAGAIN instead of waiting for space
+     * \return the number of moved bytes, 0 at the end of the file, or a
+     * negative number in case of errors
+     */
+    ssize_t spliceFrom(FileBase *in, size_t len, bool nonblock);
+
+    /**
+     * Check whether the pipe can be read or written without blocking
+     * \param entry if not nullptr, woken when the pipe state changes
+     * \param reader true to report POLLIN and POLLHUP
+     * \param writer true to report POLLOUT and POLLERR
+     * \return a combination of POLLIN, POLLOUT, POLLERR and POLLHUP
+     */
+    int poll(WaitQueueEntry *entry, bool reader, bool writer);
+
+    /**
+     * \return the number of bytes in the buffer
+     */
+    unsigned int available();
+
+    /**
+     * Destructor
+     */
+    ~PipeBuffer();
+
+    PipeBuffer(const PipeBuffer&)=delete;
+    PipeBuffer& operator= (const PipeBuffer&)=delete;
+
+private:
+    /**
+     * Wait until the buffer contains data
+     * \param l lock on mutex
+     * \param nonblock if true, fail with EAGAIN instead of blocking
+     * \return 1 if there is data, 0 if all the writers closed the pipe, or
+     * a negative number in case of errors
+     */
+    int waitData(Lock<FastMutex>& l, bool nonblock);
+
+    /**
+     * Wait until the buffer has free space
+     * \param l lock on mutex
+     * \param needed number of free bytes to wait for
+     * \param nonblock if true, fail with EAGAIN instead of blocking
+     * \return 0 on success, or a negative number in case of errors
+     */
+    int waitSpace(Lock<FastMutex>& l, unsigned int needed, bool nonblock);
+
+    /**
+     * Wake threads waiting for the pipe after its state changed
+     */
+    void notify();
+
+    FastMutex readMutex;     ///< Serializes readers
+    FastMutex writeMutex;    ///< Serializes writers
+    FastMutex mutex;         ///< Protects the members below
+    ConditionVariable cond;  ///< Readers and writers wait here
+    WaitQueue pollers;       ///< Threads in poll() wait here
+    char *buffer;            ///< Ring buffer
+    const unsigned int size; ///< Ring buffer size
+    unsigned int head=0;     ///< Index of the first byte to read
+    unsigned int count=0;    ///< Number of bytes in the buffer
+    int readers=0;           ///< Number of files open for reading
+    int writers=0;           ///< Number of files open for writing
+    bool readerSeen=false;   ///< A reader opened the pipe
+    bool writerSeen=false;   ///< A writer opened the pipe
+};
+
+/**
+ * One end of a pipe created with pipe(), or a file that opened a FIFO
+ */
+class PipeFile : public FileBase
+{
+public:
+    /**
+     * Constructor
+     * \param parent filesystem of the FIFO, or nullptr for pipes
+     * \param pipe the pipe buffer
+     * \param flags open flags, O_RDONLY, O_WRONLY or O_RDWR and O_NONBLOCK
+     */
+    PipeFile(intrusive_ref_ptr<FilesystemBase> parent,
+            intrusive_ref_ptr<PipeBuffer> pipe, int flags);
+
+    /**
+     * Write data to the pipe
+     * \param data the data to write
+     * \param len the number of bytes to write
+     * \return the number of written characters, or a negative number in case
+     * of errors
+     */
+    virtual ssize_t write(const void *data, size_t len);
+
+    /**
+     * Read data from the pipe
+     * \param data buffer to store read data
+     * \param len the number of bytes to read
+     * \return the number of read characters, or a negative number in case
+     * of errors
+     */
+    virtual ssize_t read(void *data, size_t len);
+
+    /**
+     * Check whether the pipe can be read or written without blocking
+     * \param entry if not nullptr, woken when the pipe state changes
+     * \return a combination of POLLIN, POLLOUT, POLLERR and POLLHUP
+     */
+    virtual int poll(WaitQueueEntry *entry);
+
+    /**
+     * Pipes are not seekable
+     * \return -ESPIPE
+     */
+    virtual off_t lseek(off_t pos, int whence);
+
+    /**
+     * Return file information.
+     * \param pstat pointer to stat struct
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int fstat(struct stat *pstat) const;
+
+    /**
+     * Perform various operations on a file descriptor. Supports F_GETFL and
+     * F_SETFL to set and clear O_NONBLOCK
+     * \param cmd specifies the operation to perform
+     * \param opt optional argument that some operation require
+     * \return the exact return value depends on CMD, -1 is returned on error
+     */
+    virtual int fcntl(int cmd, int opt);
+
+    /**
+     * \return this file
+     */
+    virtual PipeFile *getPipe();
+
+    /**
+     * Move data from the pipe to a file
+     * \param out the file to write to
+     * \param len maximum number of bytes to move
+     * \param flags SPLICE_F_NONBLOCK or 0
+     * \return the number of moved bytes, 0 if all the writers closed the
+     * pipe, or a negative number in case of errors
+     */
+    ssize_t spliceTo(FileBase *out, size_t len, unsigned int flags);
+
+    /**
+     * Move data from a file to the pipe
+     * \param in the file to read from
+     * \param len maximum number of bytes to move
+     * \param flags SPLICE_F_NONBLOCK or 0
+     * \return the number of moved bytes, 0 at the end of the file, or a
+     * negative number in case of errors
+     */
+    ssize_t spliceFrom(FileBase *in, size_t len, unsigned int flags);
+
+    /**
+     * \return true if the two files refer to the same pipe
+     */
+    bool samePipe(const PipeFile *other) const { return pipe==other->pipe; }
+
+    /**
+     * Destructor
+     */
+    ~PipeFile();
+
+private:
+    intrusive_ref_ptr<PipeBuffer> pipe; ///< The pipe buffer
+    const bool reader;                  ///< Opened for reading
+    const bool writer;                  ///< Opened for writing
+    volatile bool nonblock;             ///< O_NONBLOCK is set
+};
+
+#ifdef WITH_DEVFS
+
+/**
+ * A named pipe in DevFs, created by mkfifo(). Every open() returns a new
+ * PipeFile referring to the same PipeBuffer.
+ */
+class Fifo : public Device
+{
+public:
+    /**
+     * Constructor
+     */
+    Fifo();
+
+    /**
+     * Return a new file referring to the FIFO
+     * \param file the file object will be stored here, if the call succeeds
+     * \param fs pointer to the DevFs
+     * \param flags file flags (open for reading, writing, ...)
+     * \param mode file permissions
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int open(intrusive_ref_ptr<FileBase>& file,
+            intrusive_ref_ptr<FilesystemBase> fs, int flags, int mode);
+
+    /**
+     * Obtain information on the FIFO
+     * \param pstat file information is stored here
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int fstat(struct stat *pstat) const;
+
+private:
+    intrusive_ref_ptr<PipeBuffer> pipe; ///< The pipe buffer
+};
+
+#endif //WITH_DEVFS
+
+#endif //WITH_FILESYSTEM
+
+} //namespace miosix
+
+#endif //PIPE_H
@@ -0,0 +1,404 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "romfs.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <cstring>
+#include <algorithm>
+
+using namespace std;
+
+namespace miosix {
+
+#ifdef WITH_FILESYSTEM
+
+/**
+ * Directory class for RomFs
+ */
+class RomFsDirectory : public DirectoryBase
+{
+public:
+    /**
+     * \param parent parent filesystem
+     * \param dir the directory we're listing
+     * \param parentInode inode of the parent directory
+     */
+    RomFsDirectory(intrusive_ref_ptr<FilesystemBase> parent,
+            const RomFsInode *dir, int parentInode)
+            : DirectoryBase(parent), dir(dir), parentInode(parentInode),
+              index(0), first(true) {}
+
+    /**
+     * Also directories can be opened as files. In this case, this system call
+     * allows to retrieve directory entries.
+     * \param dp pointer to a memory buffer where one or more struct dirent
+     * will be placed. dp must be four words aligned.
+     * \param len memory buffer size.
+     * \return the number of bytes read on success, or a negative number on
+     * failure.
+     */
+    virtual int getdents(void *dp, int len);
+
+private:
+    const RomFsInode *dir; ///< Directory we're listing
+    int parentInode;       ///< Inode of ..
+    unsigned int index;    ///< First unhandled entry, size+1 when finished
+    bool first;            ///< True if first time getdents is called
+};
+
+int RomFsDirectory::getdents(void *dp, int len)
+{
+    if(len<minimumBufferSize) return -EINVAL;
+    if(index>dir->size) return 0;
+
+    RomFs *fs=static_cast<RomFs*>(getParent().get());
+    Lock<FastMutex> l(fs->mutex);
+    char *begin=reinterpret_cast<char*>(dp);
+    char *buffer=begin;
+    char *end=buffer+len;
+    if(first)
+    {
+        first=false;
+        addDefaultEntries(&buffer,fs->ino(dir),parentInode);
+    }
+    //Entries are listed in hash order, the image never changes so the index
+    //of the first entry not yet listed is enough to continue
+    const RomFsDirEntry *e=fs->entries(dir);
+    for(;index<dir->size;index++)
+    {
+        const RomFsInode *inode=fs->inodes+e[index].inode;
+        char type=S_ISDIR(inode->mode) ? DT_DIR : DT_REG;
+        StringPart name(fs->at(e[index].nameOffset));
+        if(addEntry(&buffer,end,fs->ino(inode),type,name)<0)
+            return buffer-begin; //Buffer finished
+    }
+    addTerminatingEntry(&buffer,end);
+    index++;
+    return buffer-begin;
+}
+
+/**
+ * Files of the RomFs filesystem
+ */
+class RomFsFile : public FileBase
+{
+public:
+    /**
+     * Constructor
+     * \param parent the filesystem to which this file belongs
+     * \param inode the file
+     */
+    RomFsFile(intrusive_ref_ptr<FilesystemBase> parent,
+            const RomFsInode *inode) : FileBase(parent), inode(inode), pos(0) {}
+
+    /**
+     * Write data to the file, if the file supports writing.
+     * \param data the data to write
+     * \param len the number of bytes to write
+     * \return -EBADF, as files are read-only
+     */
+    virtual ssize_t write(const void *data, size_t len);
+
+    /**
+     * Read data from the file, if the file supports reading.
+     * \param data buffer to store read data
+     * \param len the number of bytes to read
+     * \return the number of read characters, or a negative number in
+     * case of errors
+     */
+    virtual ssize_t read(void *data, size_t len);
+
+    /**
+     * Read data from a given position in the file, without changing the file
+     * pointer.
+     * \param data buffer to store read data
+     * \param len the number of bytes to read
+     * \param pos offset from the beginning of the file
+     * \return the number of read characters, or a negative number in case
+     * of errors
+     */
+    virtual ssize_t pread(void *data, size_t len, off_t pos);
+
+    /**
+     * Move file pointer, if the file supports random-access.
+     * \param pos offset to sum to the beginning of the file, current position
+     * or end of file, depending on whence
+     * \param whence SEEK_SET, SEEK_CUR or SEEK_END
+     * \return the offset from the beginning of the file if the operation
+     * completed, or a negative number in case of errors
+     */
+    virtual off_t lseek(off_t pos, int whence);
+
+    /**
+     * Return file information.
+     * \param pstat pointer to stat struct
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int fstat(struct stat *pstat) const;
+
+    /**
+     * Map a range of the file in memory. The mapping points to the image, so
+     * it remains valid as long as the filesystem exists.
+     * \param offset start of the range, from the beginning of the file
+     * \param len size of the range, greater than zero
+     * \param addr the address of the range is stored here
+     * \return 0 on success, -ENXIO if the range is past the end of the file
+     */
+    virtual int mmap(off_t offset, size_t len, const void **addr);
+
+private:
+    /**
+     * \return the filesystem this file belongs to
+     */
+    RomFs *fs() const { return static_cast<RomFs*>(getParent().get()); }
+
+    const RomFsInode *inode; ///< The file
+    off_t pos;               ///< File position
+};
+
+ssize_t RomFsFile::write(const void *data, size_t len)
+{
+    return -EBADF;
+}
+
+ssize_t RomFsFile::read(void *data, size_t len)
+{
+    RomFs *f=fs();
+    Lock<FastMutex> l(f->mutex);
+    if(pos>=inode->size) return 0;
+    len=min<off_t>(len,inode->size-pos);
+    memcpy(data,f->at(inode->offset)+pos,len);
+    pos+=len;
+    return len;
+}
+
+ssize_t RomFsFile::pread(void *data, size_t len, off_t pos)
+{
+    if(pos<0) return -EINVAL;
+    if(pos>=inode->size) return 0;
+    len=min<off_t>(len,inode->size-pos);
+    memcpy(data,fs()->at(inode->offset)+pos,len);
+    return len;
+}
+
+off_t RomFsFile::lseek(off_t pos, int whence)
+{
+    Lock<FastMutex> l(fs()->mutex);
+    off_t offset;
+    switch(whence)
+    {
+        case SEEK_CUR:
+            offset=this->pos+pos;
+            break;
+        case SEEK_SET:
+            offset=pos;
+            break;
+        case SEEK_END:
+            offset=static_cast<off_t>(inode->size)+pos;
+            break;
+        default:
+            return -EINVAL;
+    }
+    //Seek past the end of file is allowed, reading there returns 0
+    if(offset<0) return -EINVAL;
+    this->pos=offset;
+    return offset;
+}
+
+int RomFsFile::fstat(struct stat *pstat) const
+{
+    fs()->fillStat(inode,pstat);
+    return 0;
+}
+
+int RomFsFile::mmap(off_t offset, size_t len, const void **addr)
+{
+    if(offset<0 || offset>inode->size) return -ENXIO;
+    if(len>static_cast<size_t>(inode->size-offset)) return -ENXIO;
+    *addr=fs()->at(inode->offset)+offset;
+    return 0;
+}
+
+//
+// class RomFs
+//
+
+RomFs::RomFs(const void *image) : image(reinterpret_cast<const char*>(image)),
+        inodes(reinterpret_cast<const RomFsInode*>(
+            this->image+sizeof(RomFsHeader))), failed(true)
+{
+    if(reinterpret_cast<uintptr_t>(image) & 3) return;
+    auto header=reinterpret_cast<const RomFsHeader*>(image);
+    if(header->magic!=romFsMagic || header->version!=romFsVersion) return;
+    failed=!validate(header->imageSize);
+}
+
+int RomFs::open(intrusive_ref_ptr<FileBase>& file, StringPart& name,
+        int flags, int mode)
+{
+    if(failed) return -ENOENT;
+    flags++; //To convert from O_RDONLY, O_WRONLY, ... to _FREAD, _FWRITE, ...
+    const RomFsInode *inode;
+    int result=lookup(name,&inode);
+    if(result==-ENOENT && (flags & _FCREAT)) return -EROFS;
+    if(result) return result;
+    if((flags & (_FCREAT | _FEXCL))==(_FCREAT | _FEXCL)) return -EEXIST;
+
+    if(S_ISDIR(inode->mode))
+    {
+        if(flags & (_FWRITE | _FAPPEND | _FCREAT | _FTRUNC)) return -EISDIR;
+        int parent=inode==inodes ? parentFsMountpointInode
+                                 : ino(inodes+inode->parent);
+        file=intrusive_ref_ptr<FileBase>(
+            new RomFsDirectory(shared_from_this(),inode,parent));
+        return 0;
+    }
+    if(flags & (_FWRITE | _FAPPEND | _FTRUNC)) return -EROFS;
+    file=intrusive_ref_ptr<FileBase>(new RomFsFile(shared_from_this(),inode));
+    return 0;
+}
+
+int RomFs::lstat(StringPart& name, struct stat *pstat)
+{
+    if(failed) return -ENOENT;
+    const RomFsInode *inode;
+    if(int result=lookup(name,&inode)) return result;
+    fillStat(inode,pstat);
+    return 0;
+}
+
+int RomFs::unlink(StringPart& name)
+{
+    return -EROFS;
+}
+
+int RomFs::rename(StringPart& oldName, StringPart& newName)
+{
+    return -EROFS;
+}
+
+int RomFs::mkdir(StringPart& name, int mode)
+{
+    return -EROFS;
+}
+
+int RomFs::rmdir(StringPart& name)
+{
+    return -EROFS;
+}
+
+bool RomFs::validate(uint32_t size) const
+{
+    //Check everything the other member functions rely upon, so that they
+    //can access the image without further checks. Directory loops are not
+    //a problem, as lookups stop at the end of the path
+    auto header=reinterpret_cast<const RomFsHeader*>(image);
+    if(size<sizeof(RomFsHeader) || header->numInodes==0) return false;
+    uint32_t avail=size-sizeof(RomFsHeader);
+    if(header->numInodes>avail/sizeof(RomFsInode)) return false;
+    if(!S_ISDIR(inodes[0].mode)) return false;
+    for(uint32_t i=0;i<header->numInodes;i++)
+    {
+        const RomFsInode *inode=inodes+i;
+        if((inode->offset & 3) || inode->offset>size) return false;
+        if(S_ISREG(inode->mode))
+        {
+            if(inode->size>size-inode->offset) return false;
+            continue;
+        }
+        if(!S_ISDIR(inode->mode) || inode->parent>=header->numInodes)
+            return false;
+        if(inode->size>(size-inode->offset)/sizeof(RomFsDirEntry))
+            return false;
+        const RomFsDirEntry *e=entries(inode);
+        for(uint32_t j=0;j<inode->size;j++)
+        {
+            //The root can't be an entry, as its .. is the parent filesystem
+            if(e[j].inode==0 || e[j].inode>=header->numInodes) return false;
+            if(j>0 && e[j].hash<e[j-1].hash) return false;
+            if(e[j].nameLen==0 || e[j].nameOffset>=size
+                || e[j].nameLen>=size-e[j].nameOffset) return false;
+            const char *name=at(e[j].nameOffset);
+            if(name[e[j].nameLen]!='\0') return false;
+            if(memchr(name,'\0',e[j].nameLen) || memchr(name,'/',e[j].nameLen))
+                return false;
+            if(romFsHash(name,e[j].nameLen)!=e[j].hash) return false;
+        }
+    }
+    return true;
+}
+
+int RomFs::lookup(StringPart& name, const RomFsInode **inode) const
+{
+    *inode=inodes;
+    const char *path=name.c_str();
+    size_t start=0;
+    while(start<name.length())
+    {
+        if(!S_ISDIR((*inode)->mode)) return -ENOTDIR;
+        const char *slash=strchr(path+start,'/');
+        size_t end=slash ? slash-path : name.length();
+        const RomFsDirEntry *e=findEntry(*inode,path+start,end-start);
+        if(e==nullptr) return -ENOENT;
+        *inode=inodes+e->inode;
+        start=end+1;
+    }
+    return 0;
+}
+
+const RomFsDirEntry *RomFs::findEntry(const RomFsInode *dir, const char *name,
+        unsigned int len) const
+{
+    uint32_t hash=romFsHash(name,len);
+    const RomFsDirEntry *begin=entries(dir);
+    const RomFsDirEntry *end=begin+dir->size;
+    auto it=lower_bound(begin,end,hash,
+        [](const RomFsDirEntry& e, uint32_t h) { return e.hash<h; });
+    //Names are compared only in case of a hash collision
+    for(;it!=end && it->hash==hash;++it)
+        if(it->nameLen==len && memcmp(at(it->nameOffset),name,len)==0)
+            return it;
+    return nullptr;
+}
+
+void RomFs::fillStat(const RomFsInode *inode, struct stat *pstat) const
+{
+    memset(pstat,0,sizeof(struct stat));
+    pstat->st_dev=filesystemId;
+    pstat->st_ino=ino(inode);
+    pstat->st_mode=inode->mode;
+    pstat->st_nlink=1;
+    pstat->st_size=S_ISREG(inode->mode) ? inode->size : 0;
+    pstat->st_blksize=512;
+    pstat->st_blocks=(pstat->st_size+511)/512;
+}
+
+#endif //WITH_FILESYSTEM
+
+} //namespace miosix
@@ -0,0 +1,193 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef ROMFS_H
+#define ROMFS_H
+
+#include "filesystem/file.h"
+#include "filesystem/stringpart.h"
+#include "romfs_format.h"
+#include "kernel/sync.h"
+#include "config/miosix_settings.h"
+
+namespace miosix {
+
+#ifdef WITH_FILESYSTEM
+
+class RomFsFile;      //Forward declaration
+class RomFsDirectory; //Forward declaration
+
+/**
+ * RomFs is a read-only filesystem whose image, generated on a PC with the
+ * mkromfs tool, is accessed in place, for example in the microcontroller
+ * flash memory. Nothing is copied in RAM, opening a file only needs the
+ * file object, and files can be mapped with mmap to use their content
+ * without reading it.
+ *
+ * Directories are arrays of entries sorted by the hash of the name, so that
+ * looking up a path component is a binary search that compares names only
+ * if the hash matches. The image is validated when the filesystem is
+ * constructed, so that a corrupted image cannot make it access memory
+ * outside of the image.
+ */
+class RomFs : public FilesystemBase
+{
+public:
+    /**
+     * Constructor
+     * \param image pointer to the image, that must be 4 byte aligned and
+     * remain valid as long as the filesystem exists
+     */
+    explicit RomFs(const void *image);
+
+    /**
+     * Open a file
+     * \param file the file object will be stored here, if the call succeeds
+     * \param name the name of the file to open, relative to the local
+     * filesystem
+     * \param flags file flags (open for reading, writing, ...)
+     * \param mode file permissions
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int open(intrusive_ref_ptr<FileBase>& file, StringPart& name,
+            int flags, int mode);
+
+    /**
+     * Obtain information on a file, identified by a path name. Does not follow
+     * symlinks
+     * \param name path name, relative to the local filesystem
+     * \param pstat file information is stored here
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int lstat(StringPart& name, struct stat *pstat);
+
+    /**
+     * Remove a file or directory
+     * \param name path name of file or directory to remove
+     * \return -EROFS, as the filesystem is read-only
+     */
+    virtual int unlink(StringPart& name);
+
+    /**
+     * Rename a file or directory. If newName exists, it is replaced
+     * \param oldName old file name
+     * \param newName new file name
+     * \return -EROFS, as the filesystem is read-only
+     */
+    virtual int rename(StringPart& oldName, StringPart& newName);
+
+    /**
+     * Create a directory
+     * \param name directory name
+     * \param mode directory permissions
+     * \return -EROFS, as the filesystem is read-only
+     */
+    virtual int mkdir(StringPart& name, int mode);
+
+    /**
+     * Remove a directory if empty
+     * \param name directory name
+     * \return -EROFS, as the filesystem is read-only
+     */
+    virtual int rmdir(StringPart& name);
+
+    /**
+     * \return true if the filesystem failed to mount, because the image is
+     * not valid
+     */
+    bool mountFailed() const { return failed; }
+
+    static const unsigned int rootIno=1; ///< Inode number of root directory
+
+private:
+    friend class RomFsFile;
+    friend class RomFsDirectory;
+
+    /**
+     * Check that the image is valid
+     * \param size size of the image, from the header
+     * \return true if the image is valid
+     */
+    bool validate(uint32_t size) const;
+
+    /**
+     * Find a file or directory
+     * \param name path name, relative to the local filesystem
+     * \param inode the inode is returned here
+     * \return 0 on success, or a negative number on failure
+     */
+    int lookup(StringPart& name, const RomFsInode **inode) const;
+
+    /**
+     * Find a directory entry
+     * \param dir directory
+     * \param name name of the entry, not necessarily NUL terminated
+     * \param len length of the name
+     * \return the entry, or nullptr if not found
+     */
+    const RomFsDirEntry *findEntry(const RomFsInode *dir, const char *name,
+            unsigned int len) const;
+
+    /**
+     * \param offset offset in the image
+     * \return a pointer to that offset
+     */
+    const char *at(uint32_t offset) const { return image+offset; }
+
+    /**
+     * \param dir directory
+     * \return the entries of the directory
+     */
+    const RomFsDirEntry *entries(const RomFsInode *dir) const
+    {
+        return reinterpret_cast<const RomFsDirEntry*>(at(dir->offset));
+    }
+
+    /**
+     * \param inode a file or directory
+     * \return its inode number
+     */
+    int ino(const RomFsInode *inode) const { return inode-inodes+rootIno; }
+
+    /**
+     * Fill a stat struct
+     * \param inode file or directory
+     * \param pstat stat struct
+     */
+    void fillStat(const RomFsInode *inode, struct stat *pstat) const;
+
+    FastMutex mutex;           ///< Protects the position of open files
+    const char *image;         ///< The filesystem image
+    const RomFsInode *inodes;  ///< Inode table, in the image
+    bool failed;               ///< True if the image is not valid
+};
+
+#endif //WITH_FILESYSTEM
+
+} //namespace miosix
+
+#endif //ROMFS_H
@@ -0,0 +1,108 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef ROMFS_FORMAT_H
+#define ROMFS_FORMAT_H
+
+#include <stdint.h>
+
+/*
+ * On-flash format of RomFs images, shared between the filesystem and the
+ * mkromfs tool that generates them. All fields are little endian, and all
+ * structures start at offsets that are multiple of 4 bytes, so that an image
+ * at a 4 byte aligned address can be accessed in place.
+ *
+ * An image is made of
+ * - a RomFsHeader, at offset 0
+ * - an array of RomFsHeader::numInodes RomFsInode, inode 0 is the root
+ *   directory
+ * - the content of the directories, each one an array of RomFsDirEntry
+ *   sorted by hash, and by name if the hash is the same, so that names are
+ *   looked up with a binary search
+ * - the file names, each one terminated by a NUL
+ * - the content of the files, each one starting at a 4 byte aligned offset,
+ *   so that files can be used in place also as arrays of words, or code
+ */
+
+namespace miosix {
+
+const uint32_t romFsMagic=0x466d6f52; ///< "RomF"
+const uint32_t romFsVersion=1;        ///< Version of the image format
+
+/**
+ * Header at the beginning of a RomFs image
+ */
+struct RomFsHeader
+{
+    uint32_t magic;     ///< romFsMagic
+    uint32_t version;   ///< romFsVersion
+    uint32_t imageSize; ///< Size of the whole image in bytes
+    uint32_t numInodes; ///< Number of files and directories
+};
+
+/**
+ * A file or directory
+ */
+struct RomFsInode
+{
+    uint32_t mode;   ///< File type (S_IFREG or S_IFDIR) and permissions
+    uint32_t offset; ///< Offset in the image of the file or directory content
+    uint32_t size;   ///< Size of a file, or number of entries of a directory
+    uint32_t parent; ///< Inode of the parent directory, for directories
+};
+
+/**
+ * An entry of a directory
+ */
+struct RomFsDirEntry
+{
+    uint32_t hash;       ///< romFsHash() of the name
+    uint32_t inode;      ///< Inode of the file or directory
+    uint32_t nameOffset; ///< Offset in the image of the name
+    uint32_t nameLen;    ///< Length of the name, excluding the NUL
+};
+
+/**
+ * Hash function of the names in a directory (32 bit FNV-1a)
+ * \param name name, not necessarily NUL terminated
+ * \param len length of the name
+ * \return the hash
+ */
+inline uint32_t romFsHash(const char *name, unsigned int len)
+{
+    uint32_t result=2166136261u;
+    for(unsigned int i=0;i<len;i++)
+    {
+        result^=static_cast<unsigned char>(name[i]);
+        result*=16777619u;
+    }
+    return result;
+}
+
+} //namespace miosix
+
+#endif //ROMFS_FORMAT_H
@@ -26,7 +26,9 @@
  ***************************************************************************/
 
 //Makes memrchr available in newer GCCs
+#ifndef _GNU_SOURCE
 #define _GNU_SOURCE
+#endif //_GNU_SOURCE
 #include <string.h>
 
 #include "stringpart.h"
@@ -131,9 +133,9 @@ size_t StringPart::findLastOf(char c) const
 {
     const char *begin=c_str();
     //Not strrchr() to take advantage of knowing the string length
-    void *index=memrchr(begin,c,length());
+    const void *index=memrchr(begin,c,length());
     if(index==0) return std::string::npos;
-    return reinterpret_cast<char*>(index)-begin;
+    return reinterpret_cast<const char*>(index)-begin;
 }
 
 const char *StringPart::c_str() const
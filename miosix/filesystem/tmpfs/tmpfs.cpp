@@ -0,0 +1,611 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "tmpfs.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <cstring>
+#include <string>
+#include <algorithm>
+#include <new>
+#include "filesystem/ioctl.h"
+
+using namespace std;
+
+namespace miosix {
+
+#ifdef WITH_FILESYSTEM
+
+static const unsigned int minExtent=64;   ///< Size of the first extent
+static const unsigned int maxExtent=4096; ///< Maximum size of an extent
+
+/**
+ * Directory class for TmpFs
+ */
+class TmpFsDirectory : public DirectoryBase
+{
+public:
+    /**
+     * \param parent parent filesystem
+     * \param dir the directory we're listing
+     * \param parentInode inode of the parent directory
+     */
+    TmpFsDirectory(intrusive_ref_ptr<FilesystemBase> parent,
+            intrusive_ref_ptr<TmpFs::Inode> dir, int parentInode)
+            : DirectoryBase(parent), dir(dir), parentInode(parentInode),
+              first(true), last(false) {}
+
+    /**
+     * Also directories can be opened as files. In this case, this system call
+     * allows to retrieve directory entries.
+     * \param dp pointer to a memory buffer where one or more struct dirent
+     * will be placed. dp must be four words aligned.
+     * \param len memory buffer size.
+     * \return the number of bytes read on success, or a negative number on
+     * failure.
+     */
+    virtual int getdents(void *dp, int len);
+
+private:
+    intrusive_ref_ptr<TmpFs::Inode> dir; ///< Directory we're listing
+    string currentItem; ///< First unhandled item in directory
+    int parentInode;    ///< Inode of ..
+    bool first;         ///< True if first time getdents is called
+    bool last;          ///< True if directory has ended
+};
+
+int TmpFsDirectory::getdents(void *dp, int len)
+{
+    if(len<minimumBufferSize) return -EINVAL;
+    if(last) return 0;
+
+    TmpFs *fs=static_cast<TmpFs*>(getParent().get());
+    Lock<FastMutex> l(fs->mutex);
+    char *begin=reinterpret_cast<char*>(dp);
+    char *buffer=begin;
+    char *end=buffer+len;
+    if(first)
+    {
+        first=false;
+        addDefaultEntries(&buffer,dir->ino,parentInode);
+    }
+    //Entries may have been added or removed since the last call, so continue
+    //from the first name not smaller than the first one not yet listed
+    auto it=dir->entries.lower_bound(StringPart(currentItem.c_str()));
+    for(;it!=dir->entries.end();++it)
+    {
+        char type=S_ISDIR(it->second->mode) ? DT_DIR : DT_REG;
+        if(addEntry(&buffer,end,it->second->ino,type,it->first)>0) continue;
+        //Buffer finished
+        currentItem=it->first.c_str();
+        return buffer-begin;
+    }
+    addTerminatingEntry(&buffer,end);
+    last=true;
+    return buffer-begin;
+}
+
+/**
+ * Files of the TmpFs filesystem
+ */
+class TmpFsFile : public FileBase
+{
+public:
+    /**
+     * Constructor
+     * \param parent the filesystem to which this file belongs
+     * \param inode the file
+     * \param flags file open flags (_FREAD, _FWRITE, ...)
+     */
+    TmpFsFile(intrusive_ref_ptr<FilesystemBase> parent,
+            intrusive_ref_ptr<TmpFs::Inode> inode, int flags)
+            : FileBase(parent), inode(inode), pos(0), flags(flags) {}
+
+    /**
+     * Write data to the file, if the file supports writing.
+     * \param data the data to write
+     * \param len the number of bytes to write
+     * \return the number of written characters, or a negative number in
+     * case of errors
+     */
+    virtual ssize_t write(const void *data, size_t len);
+
+    /**
+     * Read data from the file, if the file supports reading.
+     * \param data buffer to store read data
+     * \param len the number of bytes to read
+     * \return the number of read characters, or a negative number in
+     * case of errors
+     */
+    virtual ssize_t read(void *data, size_t len);
+
+    /**
+     * Move file pointer, if the file supports random-access.
+     * \param pos offset to sum to the beginning of the file, current position
+     * or end of file, depending on whence
+     * \param whence SEEK_SET, SEEK_CUR or SEEK_END
+     * \return the offset from the beginning of the file if the operation
+     * completed, or a negative number in case of errors
+     */
+    virtual off_t lseek(off_t pos, int whence);
+
+    /**
+     * Return file information.
+     * \param pstat pointer to stat struct
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int fstat(struct stat *pstat) const;
+
+    /**
+     * Perform various operations on a file descriptor
+     * \param cmd specifies the operation to perform
+     * \param arg optional argument that some operation require
+     * \return the exact return value depends on CMD, -1 is returned on error
+     */
+    virtual int ioctl(int cmd, void *arg);
+
+    /**
+     * Truncate or extend the file to a given size. If the file is extended,
+     * the new part reads as zeros. The file pointer is not changed.
+     * \param size new file size
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int ftruncate(off_t size);
+
+    /**
+     * Allocate memory for a range of the file, so that subsequent writes to
+     * that range do not fail for lack of space. If the range extends past the
+     * end of file, the file is extended and the new part reads as zeros.
+     * \param offset start of the range
+     * \param len length of the range
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int fallocate(off_t offset, off_t len);
+
+    /**
+     * Destructor
+     */
+    ~TmpFsFile();
+
+private:
+    /**
+     * \return the filesystem this file belongs to
+     */
+    TmpFs *fs() const { return static_cast<TmpFs*>(getParent().get()); }
+
+    intrusive_ref_ptr<TmpFs::Inode> inode; ///< The file
+    off_t pos;                             ///< File position
+    int flags;                             ///< File open flags
+};
+
+ssize_t TmpFsFile::write(const void *data, size_t len)
+{
+    if((flags & _FWRITE)==0) return -EBADF;
+    TmpFs *f=fs();
+    Lock<FastMutex> l(f->mutex);
+    if(flags & _FAPPEND) pos=inode->size;
+    if(pos>=TmpFs::maxFileSize) return len>0 ? -EFBIG : 0;
+    len=min<off_t>(len,TmpFs::maxFileSize-pos);
+    ssize_t result=f->writeFile(inode.get(),
+        reinterpret_cast<const char*>(data),pos,len);
+    if(result>0) pos+=result;
+    return result;
+}
+
+ssize_t TmpFsFile::read(void *data, size_t len)
+{
+    if((flags & _FREAD)==0) return -EBADF;
+    TmpFs *f=fs();
+    Lock<FastMutex> l(f->mutex);
+    if(pos>=inode->size) return 0;
+    len=min<off_t>(len,inode->size-pos);
+    f->readFile(inode.get(),reinterpret_cast<char*>(data),pos,len);
+    pos+=len;
+    return len;
+}
+
+off_t TmpFsFile::lseek(off_t pos, int whence)
+{
+    TmpFs *f=fs();
+    Lock<FastMutex> l(f->mutex);
+    off_t offset;
+    switch(whence)
+    {
+        case SEEK_CUR:
+            offset=this->pos+pos;
+            break;
+        case SEEK_SET:
+            offset=pos;
+            break;
+        case SEEK_END:
+            offset=static_cast<off_t>(inode->size)+pos;
+            break;
+        default:
+            return -EINVAL;
+    }
+    //Seek past the end of file is allowed, writing there extends the file
+    if(offset<0) return -EINVAL;
+    if(offset>TmpFs::maxFileSize) return -EOVERFLOW;
+    this->pos=offset;
+    return offset;
+}
+
+int TmpFsFile::fstat(struct stat *pstat) const
+{
+    TmpFs *f=fs();
+    Lock<FastMutex> l(f->mutex);
+    f->fillStat(inode.get(),pstat);
+    return 0;
+}
+
+int TmpFsFile::ioctl(int cmd, void *arg)
+{
+    //Nothing to sync, data is already where it belongs
+    return cmd==IOCTL_SYNC ? 0 : -ENOTTY;
+}
+
+int TmpFsFile::ftruncate(off_t size)
+{
+    if((flags & _FWRITE)==0) return -EBADF;
+    if(size<0) return -EINVAL;
+    if(size>TmpFs::maxFileSize) return -EFBIG;
+    TmpFs *f=fs();
+    Lock<FastMutex> l(f->mutex);
+    f->truncateFile(inode.get(),size);
+    return 0;
+}
+
+int TmpFsFile::fallocate(off_t offset, off_t len)
+{
+    if((flags & _FWRITE)==0) return -EBADF;
+    if(offset<0 || len<=0) return -EINVAL;
+    if(offset>TmpFs::maxFileSize-len) return -EFBIG;
+    TmpFs *f=fs();
+    Lock<FastMutex> l(f->mutex);
+    if(int result=f->grow(inode.get(),offset+len)) return result;
+    inode->size=max<unsigned int>(inode->size,offset+len);
+    return 0;
+}
+
+TmpFsFile::~TmpFsFile()
+{
+    //If the file was removed while open, this frees its memory
+    TmpFs *f=fs();
+    Lock<FastMutex> l(f->mutex);
+    inode.reset();
+}
+
+//
+// class TmpFs
+//
+
+TmpFs::TmpFs(unsigned int maxSize) : mutex(FastMutex::RECURSIVE),
+        maxSize(maxSize), used(0), inodeCount(rootIno+1),
+        root(new Inode(this,rootIno,S_IFDIR | 0755,rootIno)) {}
+
+int TmpFs::open(intrusive_ref_ptr<FileBase>& file, StringPart& name,
+        int flags, int mode)
+{
+    flags++; //To convert from O_RDONLY, O_WRONLY, ... to _FREAD, _FWRITE, ...
+    Lock<FastMutex> l(mutex);
+    intrusive_ref_ptr<Inode> inode;
+    int result=lookup(name,inode);
+    if(result==-ENOENT && (flags & (_FWRITE | _FCREAT))==(_FWRITE | _FCREAT))
+    {
+        if(int result=create(name,S_IFREG | (mode & 0777),inode)) return result;
+    } else if(result) return result;
+    else if((flags & (_FCREAT | _FEXCL))==(_FCREAT | _FEXCL)) return -EEXIST;
+
+    if(S_ISDIR(inode->mode))
+    {
+        if(flags & (_FWRITE | _FAPPEND | _FCREAT | _FTRUNC)) return -EISDIR;
+        int parent=inode==root ? parentFsMountpointInode : inode->parent;
+        file=intrusive_ref_ptr<FileBase>(
+            new TmpFsDirectory(shared_from_this(),inode,parent));
+        return 0;
+    }
+    if((flags & (_FWRITE | _FTRUNC))==(_FWRITE | _FTRUNC))
+        truncateFile(inode.get(),0);
+    file=intrusive_ref_ptr<FileBase>(
+        new TmpFsFile(shared_from_this(),inode,flags));
+    return 0;
+}
+
+int TmpFs::lstat(StringPart& name, struct stat *pstat)
+{
+    Lock<FastMutex> l(mutex);
+    intrusive_ref_ptr<Inode> inode;
+    if(int result=lookup(name,inode)) return result;
+    fillStat(inode.get(),pstat);
+    return 0;
+}
+
+int TmpFs::unlink(StringPart& name)
+{
+    return unlinkRmdirHelper(name,false);
+}
+
+int TmpFs::rename(StringPart& oldName, StringPart& newName)
+{
+    if(oldName.empty() || newName.empty()) return -EBUSY; //Root directory
+    Lock<FastMutex> l(mutex);
+    intrusive_ref_ptr<Inode> oldDir, newDir;
+    size_t oldOff, newOff;
+    if(int result=lookupParent(oldName,oldDir,oldOff)) return result;
+    if(int result=lookupParent(newName,newDir,newOff)) return result;
+    StringPart oldLast(oldName,string::npos,oldOff);
+    StringPart newLast(newName,string::npos,newOff);
+    if(newLast.empty()) return -ENOENT;
+    if(newLast.length()>maxNameLen) return -ENAMETOOLONG;
+    auto it=oldDir->entries.find(oldLast);
+    if(it==oldDir->entries.end()) return -ENOENT;
+    intrusive_ref_ptr<Inode> inode=it->second;
+    //A directory can't be moved inside itself. Inodes only have the inode
+    //number of their parent, so the ancestors of newDir are found walking
+    //its path from the root
+    if(S_ISDIR(inode->mode) && newOff>0)
+    {
+        Inode *walk=root.get();
+        const char *path=newName.c_str();
+        size_t start=0;
+        while(start<newOff)
+        {
+            size_t end=strchr(path+start,'/')-path;
+            StringPart component(newName,end,start); //In place, no allocation
+            walk=walk->entries.find(component)->second.get();
+            if(walk==inode.get()) return -EINVAL;
+            start=end+1;
+        }
+    }
+    auto target=newDir->entries.find(newLast);
+    if(target!=newDir->entries.end())
+    {
+        //Like POSIX, the target is replaced if it is of the same type
+        if(target->second==inode) return 0;
+        if(S_ISDIR(inode->mode))
+        {
+            if(!S_ISDIR(target->second->mode)) return -ENOTDIR;
+            if(target->second->entries.empty()==false) return -ENOTEMPTY;
+        } else if(S_ISDIR(target->second->mode)) return -EISDIR;
+        target->second=inode;
+    } else newDir->entries.insert(make_pair(newLast,inode));
+    oldDir->entries.erase(it);
+    inode->parent=newDir->ino;
+    return 0;
+}
+
+int TmpFs::mkdir(StringPart& name, int mode)
+{
+    if(name.empty()) return -EEXIST;
+    Lock<FastMutex> l(mutex);
+    intrusive_ref_ptr<Inode> inode;
+    return create(name,S_IFDIR | (mode & 0777),inode);
+}
+
+int TmpFs::rmdir(StringPart& name)
+{
+    return unlinkRmdirHelper(name,true);
+}
+
+unsigned int TmpFs::usedBytes()
+{
+    Lock<FastMutex> l(mutex);
+    return used;
+}
+
+TmpFs::Inode::~Inode()
+{
+    for(auto& e : extents)
+    {
+        fs->used-=e.size;
+        delete[] e.data;
+    }
+}
+
+int TmpFs::lookup(StringPart& name, intrusive_ref_ptr<Inode>& inode)
+{
+    inode=root;
+    const char *path=name.c_str();
+    size_t start=0;
+    while(start<name.length())
+    {
+        if(!S_ISDIR(inode->mode)) return -ENOTDIR;
+        const char *slash=strchr(path+start,'/');
+        size_t end=slash ? slash-path : name.length();
+        StringPart component(name,end,start); //In place, no allocation
+        auto it=inode->entries.find(component);
+        if(it==inode->entries.end()) return -ENOENT;
+        inode=it->second;
+        start=end+1;
+    }
+    return 0;
+}
+
+int TmpFs::lookupParent(StringPart& name, intrusive_ref_ptr<Inode>& dir,
+        size_t& off)
+{
+    size_t slash=name.findLastOf('/');
+    if(slash==string::npos)
+    {
+        dir=root;
+        off=0;
+        return 0;
+    }
+    StringPart dirName(name,slash);
+    if(int result=lookup(dirName,dir)) return result;
+    if(!S_ISDIR(dir->mode)) return -ENOTDIR;
+    off=slash+1;
+    return 0;
+}
+
+int TmpFs::create(StringPart& name, int mode, intrusive_ref_ptr<Inode>& inode)
+{
+    intrusive_ref_ptr<Inode> dir;
+    size_t off;
+    if(int result=lookupParent(name,dir,off)) return result;
+    StringPart last(name,string::npos,off);
+    if(last.empty()) return -ENOENT;
+    if(last.length()>maxNameLen) return -ENAMETOOLONG;
+    if(dir->entries.find(last)!=dir->entries.end()) return -EEXIST;
+    inode=intrusive_ref_ptr<Inode>(new Inode(this,inodeCount++,mode,dir->ino));
+    dir->entries.insert(make_pair(last,inode));
+    return 0;
+}
+
+int TmpFs::unlinkRmdirHelper(StringPart& name, bool delDir)
+{
+    if(name.empty()) return -EBUSY; //Root directory
+    Lock<FastMutex> l(mutex);
+    intrusive_ref_ptr<Inode> dir;
+    size_t off;
+    if(int result=lookupParent(name,dir,off)) return result;
+    StringPart last(name,string::npos,off);
+    auto it=dir->entries.find(last);
+    if(it==dir->entries.end()) return -ENOENT;
+    Inode *inode=it->second.get();
+    if(delDir)
+    {
+        if(!S_ISDIR(inode->mode)) return -ENOTDIR;
+        if(inode->entries.empty()==false) return -ENOTEMPTY;
+    } else if(S_ISDIR(inode->mode)) return -EISDIR;
+    //Open files keep the inode alive, and its memory is freed on close
+    dir->entries.erase(it);
+    return 0;
+}
+
+void TmpFs::readFile(Inode *inode, char *data, unsigned int pos,
+        unsigned int len)
+{
+    auto& extents=inode->extents;
+    auto it=extents.end();
+    if(pos<inode->capacity()) it=findExtent(inode,pos);
+    for(;len>0 && it!=extents.end();++it)
+    {
+        unsigned int n=min(len,it->offset+it->size-pos);
+        memcpy(data,it->data+(pos-it->offset),n);
+        data+=n;
+        pos+=n;
+        len-=n;
+    }
+    //Past the allocated extents the file reads as zeros
+    memset(data,0,len);
+}
+
+ssize_t TmpFs::writeFile(Inode *inode, const char *data, unsigned int pos,
+        unsigned int len)
+{
+    if(len==0) return 0;
+    //If the filesystem is full, write what fits
+    int result=grow(inode,pos+len);
+    unsigned int capacity=inode->capacity();
+    if(capacity<=pos) return result;
+    len=min(len,capacity-pos);
+    auto it=findExtent(inode,pos);
+    for(unsigned int done=0;done<len;++it)
+    {
+        unsigned int n=min(len-done,it->offset+it->size-pos);
+        memcpy(it->data+(pos-it->offset),data+done,n);
+        pos+=n;
+        done+=n;
+    }
+    inode->size=max(inode->size,pos);
+    return len;
+}
+
+int TmpFs::grow(Inode *inode, unsigned int capacity)
+{
+    //Extents double the file capacity, so that a file of n bytes needs
+    //O(log(n)) extents up to maxExtent, and wastes less than half the memory
+    for(unsigned int current=inode->capacity();current<capacity;)
+    {
+        unsigned int size=min(maxExtent,max(minExtent,current));
+        size=min(size,maxSize-used);
+        if(size==0) return -ENOSPC;
+        char *data=new (nothrow) char[size];
+        if(data==nullptr) return -ENOSPC;
+        //Bytes past the end of file are kept zeroed, so that a file extended
+        //by writing past its end or with ftruncate reads as zeros there
+        memset(data,0,size);
+        Extent e;
+        e.offset=current;
+        e.size=size;
+        e.data=data;
+        inode->extents.push_back(e);
+        used+=size;
+        current+=size;
+    }
+    return 0;
+}
+
+void TmpFs::truncateFile(Inode *inode, unsigned int size)
+{
+    auto& extents=inode->extents;
+    if(size<inode->size)
+    {
+        //Free the extents past the new end of file, and zero the part of the
+        //last one past it
+        while(extents.empty()==false && extents.back().offset>=size)
+        {
+            used-=extents.back().size;
+            delete[] extents.back().data;
+            extents.pop_back();
+        }
+        unsigned int end=min(inode->size,inode->capacity());
+        if(size<end)
+        {
+            Extent& e=extents.back();
+            memset(e.data+(size-e.offset),0,end-size);
+        }
+    }
+    //Extending the file allocates no memory, the new part reads as zeros
+    inode->size=size;
+}
+
+vector<TmpFs::Extent>::iterator TmpFs::findExtent(Inode *inode,
+        unsigned int pos)
+{
+    //Binary search of the last extent starting at or before pos
+    return upper_bound(inode->extents.begin(),inode->extents.end(),pos,
+        [](unsigned int p, const Extent& e){ return p<e.offset; })-1;
+}
+
+void TmpFs::fillStat(const Inode *inode, struct stat *pstat) const
+{
+    memset(pstat,0,sizeof(struct stat));
+    pstat->st_dev=filesystemId;
+    pstat->st_ino=inode->ino;
+    pstat->st_mode=inode->mode;
+    pstat->st_nlink=1;
+    pstat->st_size=inode->size;
+    pstat->st_blksize=512;
+    pstat->st_blocks=(inode->capacity()+511)/512;
+}
+
+#endif //WITH_FILESYSTEM
+
+} //namespace miosix
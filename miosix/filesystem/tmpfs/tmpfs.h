@@ -0,0 +1,285 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#ifndef TMPFS_H
+#define TMPFS_H
+
+#include <map>
+#include <vector>
+#include "filesystem/file.h"
+#include "filesystem/stringpart.h"
+#include "kernel/sync.h"
+#include "config/miosix_settings.h"
+
+namespace miosix {
+
+#ifdef WITH_FILESYSTEM
+
+class TmpFsFile;      //Forward declaration
+class TmpFsDirectory; //Forward declaration
+
+/**
+ * TmpFs is a filesystem whose files are stored in RAM, for temporary files
+ * that are accessed at memory speed and don't wear the flash. Its content is
+ * lost at reboot.
+ *
+ * File data is stored in extents allocated from the heap, that grow in size
+ * with the file up to 4KB, so that small files waste little memory and large
+ * ones need few allocations. Bytes past the end of the allocated extents read
+ * as zeros, so extending a file with ftruncate does not allocate memory.
+ * Directories are maps from file names to inodes, inodes are reference
+ * counted so that files can be removed while they are open.
+ *
+ * The memory used by file data is limited to the size passed to the
+ * constructor, inodes and directory entries are not counted.
+ */
+class TmpFs : public FilesystemBase
+{
+public:
+    /**
+     * Constructor
+     * \param maxSize maximum number of bytes of file data
+     */
+    explicit TmpFs(unsigned int maxSize=TMPFS_MAX_SIZE);
+
+    /**
+     * Open a file
+     * \param file the file object will be stored here, if the call succeeds
+     * \param name the name of the file to open, relative to the local
+     * filesystem
+     * \param flags file flags (open for reading, writing, ...)
+     * \param mode file permissions
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int open(intrusive_ref_ptr<FileBase>& file, StringPart& name,
+            int flags, int mode);
+
+    /**
+     * Obtain information on a file, identified by a path name. Does not follow
+     * symlinks
+     * \param name path name, relative to the local filesystem
+     * \param pstat file information is stored here
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int lstat(StringPart& name, struct stat *pstat);
+
+    /**
+     * Remove a file or directory
+     * \param name path name of file or directory to remove
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int unlink(StringPart& name);
+
+    /**
+     * Rename a file or directory. If newName exists, it is replaced
+     * \param oldName old file name
+     * \param newName new file name
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int rename(StringPart& oldName, StringPart& newName);
+
+    /**
+     * Create a directory
+     * \param name directory name
+     * \param mode directory permissions
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int mkdir(StringPart& name, int mode);
+
+    /**
+     * Remove a directory if empty
+     * \param name directory name
+     * \return 0 on success, or a negative number on failure
+     */
+    virtual int rmdir(StringPart& name);
+
+    /**
+     * \return the number of bytes used by file data
+     */
+    unsigned int usedBytes();
+
+    /**
+     * \return the maximum number of bytes of file data
+     */
+    unsigned int maxBytes() const { return maxSize; }
+
+    static const unsigned int maxNameLen=255;        ///< Maximum name length
+    static const unsigned int maxFileSize=0x7fffffff; ///< Maximum file size
+
+private:
+    friend class TmpFsFile;
+    friend class TmpFsDirectory;
+
+    /**
+     * A contiguous part of the data of a file
+     */
+    struct Extent
+    {
+        unsigned int offset; ///< Offset within the file of the first byte
+        unsigned int size;   ///< Size of the extent
+        char *data;          ///< Extent data, allocated with new[]
+    };
+
+    /**
+     * A file or directory
+     */
+    class Inode : public IntrusiveRefCounted
+    {
+    public:
+        /**
+         * Constructor
+         * \param fs filesystem the inode belongs to
+         * \param ino inode number
+         * \param mode file type and permissions
+         * \param parent inode number of the parent directory
+         */
+        Inode(TmpFs *fs, unsigned int ino, int mode, unsigned int parent)
+                : fs(fs), ino(ino), mode(mode), parent(parent), size(0) {}
+
+        /**
+         * \return the number of bytes held by extents
+         */
+        unsigned int capacity() const
+        {
+            if(extents.empty()) return 0;
+            return extents.back().offset+extents.back().size;
+        }
+
+        /**
+         * Frees the extents
+         */
+        ~Inode();
+
+        TmpFs *fs;                ///< Filesystem the inode belongs to
+        const unsigned int ino;   ///< Inode number
+        const int mode;           ///< File type and permissions
+        unsigned int parent;      ///< Inode number of the parent directory
+        unsigned int size;        ///< File size
+        std::vector<Extent> extents; ///< File data, sorted by offset
+        /// Directory entries, if the inode is a directory
+        std::map<StringPart,intrusive_ref_ptr<Inode>> entries;
+    };
+
+    /**
+     * Find a file or directory
+     * \param name path name, relative to the local filesystem
+     * \param inode the inode is returned here
+     * \return 0 on success, or a negative number on failure
+     */
+    int lookup(StringPart& name, intrusive_ref_ptr<Inode>& inode);
+
+    /**
+     * Find the directory that contains a file or directory
+     * \param name path name, relative to the local filesystem
+     * \param dir the directory is returned here
+     * \param off the offset in name of the last path component is returned
+     * here
+     * \return 0 on success, or a negative number on failure
+     */
+    int lookupParent(StringPart& name, intrusive_ref_ptr<Inode>& dir,
+            size_t& off);
+
+    /**
+     * Add a file or directory
+     * \param name path name, relative to the local filesystem
+     * \param mode file type and permissions
+     * \param inode the new inode is returned here
+     * \return 0 on success, or a negative number on failure
+     */
+    int create(StringPart& name, int mode, intrusive_ref_ptr<Inode>& inode);
+
+    /**
+     * Implementation of unlink and rmdir
+     * \param name path name, relative to the local filesystem
+     * \param delDir true to remove a directory, false to remove a file
+     * \return 0 on success, or a negative number on failure
+     */
+    int unlinkRmdirHelper(StringPart& name, bool delDir);
+
+    /**
+     * Read data from a file
+     * \param inode file
+     * \param data buffer to store read data
+     * \param pos position within the file, must be less than the file size
+     * \param len number of bytes to read, pos+len must not exceed the file size
+     */
+    void readFile(Inode *inode, char *data, unsigned int pos, unsigned int len);
+
+    /**
+     * Write data to a file, extending it if needed
+     * \param inode file
+     * \param data data to write
+     * \param pos position within the file
+     * \param len number of bytes to write
+     * \return the number of bytes written, or a negative number on failure
+     */
+    ssize_t writeFile(Inode *inode, const char *data, unsigned int pos,
+            unsigned int len);
+
+    /**
+     * Allocate extents so that a file has at least the given capacity
+     * \param inode file
+     * \param capacity required capacity
+     * \return 0 on success, or -ENOSPC if the filesystem has not enough space.
+     * Some extents may have been allocated even on failure
+     */
+    int grow(Inode *inode, unsigned int capacity);
+
+    /**
+     * \param inode file
+     * \param pos position within the file, must be less than its capacity
+     * \return the extent holding the byte at pos
+     */
+    std::vector<Extent>::iterator findExtent(Inode *inode, unsigned int pos);
+
+    /**
+     * Truncate or extend a file
+     * \param inode file
+     * \param size new size
+     */
+    void truncateFile(Inode *inode, unsigned int size);
+
+    /**
+     * Fill a struct stat with the information about an inode
+     * \param inode file or directory
+     * \param pstat file information is stored here
+     */
+    void fillStat(const Inode *inode, struct stat *pstat) const;
+
+    FastMutex mutex;                ///< Protects the whole filesystem
+    const unsigned int maxSize;     ///< Maximum bytes of file data
+    unsigned int used;              ///< Bytes of file data
+    unsigned int inodeCount;        ///< Next inode number
+    intrusive_ref_ptr<Inode> root;  ///< Root directory
+    static const unsigned int rootIno=1; ///< Inode number of root directory
+};
+
+#endif //WITH_FILESYSTEM
+
+} //namespace miosix
+
+#endif //TMPFS_H
@@ -151,6 +151,15 @@ public:
      */
     unsigned int getThirdParameter() const;
     
+    /**
+     * \return the fourth syscall parameter. The returned result is meaningful
+     * only if the syscall (identified through its id) has four parameters.
+     * As the syscall id uses one of the argument registers, the fourth
+     * parameter is passed in a register that is not used by the calling
+     * convention, and userspace must put it there explicitly
+     */
+    unsigned int getFourthParameter() const;
+    
     /**
      * Set the value that will be returned by the syscall.
      * Invalidates parameters so must be called only after the syscall
@@ -35,6 +35,10 @@ using namespace miosix;
 Thread *CPUTimeCounter::head = nullptr;
 Thread *CPUTimeCounter::tail = nullptr;
 volatile unsigned int CPUTimeCounter::nThreads = 0;
+volatile unsigned int CPUTimeCounter::generation = 0;
+unsigned int CPUTimeCounter::irqNesting = 0;
+Thread *CPUTimeCounter::irqThread = nullptr;
+long long CPUTimeCounter::irqStart = 0;
 
 long long CPUTimeCounter::getActiveThreadTime()
 {
@@ -49,6 +53,73 @@ long long CPUTimeCounter::getActiveThreadTime()
     return usedTime + (curTime - lastAct);
 }
 
+long long CPUTimeCounter::snapshot(std::vector<Data>& data)
+{
+    // Attempts before collecting the data with the kernel paused for the
+    // whole list, so that terminating threads can't cause endless restarts
+    const int maxAttempts = 3;
+    for(int attempt = 1;; attempt++)
+    {
+        // The vector can't be expanded while the kernel is paused, so reserve
+        // some headroom for threads created while the snapshot is taken.
+        // Threads are appended at the tail of the list, so if they do not fit
+        // they were created after the snapshot started, and are left out
+        data.clear();
+        data.reserve(nThreads + 4);
+        if(attempt == maxAttempts)
+        {
+            {
+                PauseKernelLock pk;
+                for(Thread *cur = head; cur && data.size() < data.capacity();
+                    cur = cur->timeCounterData.next)
+                    data.push_back(PKgetData(cur));
+            }
+            return getTime();
+        }
+        unsigned int gen;
+        Thread *cur;
+        {
+            PauseKernelLock pk;
+            gen = generation;
+            cur = head;
+        }
+        bool restart = false;
+        while(cur)
+        {
+            {
+                PauseKernelLock pk;
+                // If threads were removed from the list, cur may point to a
+                // deallocated thread, so we need to start again. Threads added
+                // to the list are instead appended at the tail, which is safe
+                if(generation != gen)
+                {
+                    restart = true;
+                    break;
+                }
+                if(data.size() == data.capacity()) break;
+                data.push_back(PKgetData(cur));
+                cur = cur->timeCounterData.next;
+            }
+        }
+        if(restart) continue;
+        return getTime();
+    }
+}
+
+CPUTimeCounter::Data CPUTimeCounter::PKgetData(Thread *thread)
+{
+    Data res;
+    auto& d = thread->timeCounterData;
+    res.thread = thread;
+    res.usedCpuTime = d.usedCpuTime;
+    res.readyTime = d.readyTime;
+    res.irqTime = d.irqTime;
+    res.maxBurst = d.maxBurst;
+    res.voluntarySwitches = d.voluntarySwitches;
+    res.involuntarySwitches = d.involuntarySwitches;
+    return res;
+}
+
 void CPUTimeCounter::PKremoveDeadThreads()
 {
     Thread *prev = nullptr;
@@ -60,6 +131,7 @@ void CPUTimeCounter::PKremoveDeadThreads()
             if(prev) prev->timeCounterData.next = cur->timeCounterData.next;
             else head = cur->timeCounterData.next;
             nThreads--;
+            generation++;
         } else {
             prev = cur;
         }
@@ -29,6 +29,8 @@
 
 #include "kernel.h"
 #include "cpu_time_counter_types.h"
+#include <vector>
+#include <algorithm>
 
 #ifdef WITH_CPU_TIME_COUNTER
 
@@ -54,6 +56,21 @@ namespace miosix {
  *  - Time spent in an interrupt is accounted towards the thread that has been
  *    interrupted.
  * 
+ * Besides the CPU time, the following per-thread counters are collected:
+ *  - The number of voluntary context switches, where the thread was
+ *    descheduled because it blocked (sleep, wait, mutex, ...), and of
+ *    involuntary ones, where the thread was preempted while still ready.
+ *  - The time spent ready but not running, which is the scheduling latency
+ *    experienced by the thread. A thread that is starved has a high ready time
+ *    and a low CPU time.
+ *  - The time spent in interrupts that interrupted the thread. This is a
+ *    subset of the CPU time, and is only measured for the interrupt handlers
+ *    that call IRQtraceIrqEntry() and IRQtraceIrqExit() or declare a
+ *    TracedInterrupt, see KernelTrace. The time spent in other interrupt
+ *    handlers is not part of it, and is counted as CPU time of the thread.
+ *  - The longest run burst, that is, the longest time the thread ran without
+ *    being descheduled.
+ * 
  * Retrieving the time accounting data for all threads is performed through the
  * iterator returned by PKbegin(). To prevent the thread list from changing
  * because of a context switch, keep the kernel paused while you traverse the
@@ -70,6 +87,10 @@ namespace miosix {
  * These properties allow to compute the difference between two thread data
  * lists collected at different times in O(max(n,m)) complexity.
  * 
+ * As an alternative to the iterator, snapshot() collects the data of all
+ * threads pausing the kernel only for the time needed to copy the data of
+ * one thread at a time, and is thus preferable when there are many threads.
+ * 
  * \note This is a very low-level interface. For actual use, a more practical
  * alternative is miosix::CPUProfiler, which provides a top-like display of the
  * amount of CPU used by each thread in a given time interval.
@@ -86,6 +107,18 @@ public:
         Thread *thread;
         /// Cumulative amount of CPU time scheduled to the thread in ns
         long long usedCpuTime = 0; 
+        /// Cumulative amount of time the thread was ready but not running
+        /// in ns
+        long long readyTime = 0;
+        /// Cumulative amount of time spent in traced interrupts while the
+        /// thread was running in ns
+        long long irqTime = 0;
+        /// Longest time the thread ran without being descheduled in ns
+        long long maxBurst = 0;
+        /// Number of times the thread was descheduled because it blocked
+        unsigned int voluntarySwitches = 0;
+        /// Number of times the thread was preempted while still ready
+        unsigned int involuntarySwitches = 0;
     };
 
     /**
@@ -107,10 +140,7 @@ public:
         }
         inline Data operator*()
         {
-            Data res;
-            res.thread = cur;
-            res.usedCpuTime = cur->timeCounterData.usedCpuTime;
-            return res;
+            return PKgetData(cur);
         }
         inline bool operator==(const iterator& rhs) { return cur==rhs.cur; }
         inline bool operator!=(const iterator& rhs) { return cur!=rhs.cur; }
@@ -153,6 +183,50 @@ public:
      */
     static long long getActiveThreadTime();
 
+    /**
+     * Collect the data of all threads, with the same ordering guarantees of
+     * the iterator returned by PKbegin(). Contrary to the iterator, the kernel
+     * is not kept paused while walking the thread list, but only while the
+     * data of each thread is copied, so this function does not increase the
+     * scheduling latency of the system even with many threads.
+     * As a consequence, the data of different threads is not collected at
+     * exactly the same time, and threads created while the data is being
+     * collected may be left out. Threads terminating while the data is being
+     * collected cause the collection to be restarted, and after a few
+     * attempts the data is collected keeping the kernel paused for the whole
+     * thread list, so the time taken is bounded.
+     * Can't be called with the kernel paused.
+     * \param data the collected data is stored here, its previous content is
+     * discarded
+     * \returns the time (in nanoseconds) at which the collection was completed
+     */
+    static long long snapshot(std::vector<Data>& data);
+
+    /**
+     * \internal
+     * Called by interrupt handlers, through IRQtraceIrqEntry(), when an
+     * interrupt starts
+     */
+    static inline void IRQenterInterrupt()
+    {
+        if(irqNesting++ != 0) return;
+        irqThread = Thread::IRQgetCurrentThread();
+        irqStart = IRQgetTime();
+    }
+
+    /**
+     * \internal
+     * Called by interrupt handlers, through IRQtraceIrqExit(), when an
+     * interrupt ends. The interrupt time is accounted to the thread that was
+     * running when the interrupt started, even if the interrupt caused a
+     * context switch
+     */
+    static inline void IRQexitInterrupt()
+    {
+        if(--irqNesting != 0) return;
+        irqThread->timeCounterData.irqTime += IRQgetTime() - irqStart;
+    }
+
 private:
     // The following methods are called from basic_scheduler to notify
     // CPUTimeCounter of various events.
@@ -193,24 +267,60 @@ private:
      * threads.
      */
     static void PKremoveDeadThreads();
+
+    /**
+     * \internal
+     * Called every time a thread changes its running status, to record when
+     * a thread becomes ready.
+     * \param thread the thread whose status changed.
+     */
+    static inline void IRQwaitStatusHook(Thread *thread)
+    {
+        auto& data = thread->timeCounterData;
+        if(data.readySince < 0 && thread->flags.isReady()
+            && thread != Thread::IRQgetCurrentThread())
+            data.readySince = IRQgetTime();
+    }
+
+    /**
+     * \internal
+     * \returns the time counter data of a thread
+     */
+    static Data PKgetData(Thread *thread);
     
     static Thread *head; ///< Head of the thread list
     static Thread *tail; ///< Tail of the thread list
     static volatile unsigned int nThreads; ///< Number of threads in the list
+    /// Incremented every time threads are removed from the list
+    static volatile unsigned int generation;
+    static unsigned int irqNesting; ///< Interrupt nesting level
+    static Thread *irqThread; ///< Thread interrupted by the outermost interrupt
+    static long long irqStart; ///< Time when the outermost interrupt started
 };
 
 /**
  * Function to be called in the context switch code to profile threads
  * \param prev time count struct of previously running thread
- * \param prev time count struct of thread to be scheduled next
+ * \param prevReady true if the previously running thread is still ready
+ * \param next time count struct of thread to be scheduled next
  * \param t (approximate) current time, a time point taken somewhere during
  * the context switch code
  */
 static inline void IRQprofileContextSwitch(CPUTimeCounterPrivateThreadData& prev,
-    CPUTimeCounterPrivateThreadData& next, long long t)
+    bool prevReady, CPUTimeCounterPrivateThreadData& next, long long t)
 {
     prev.usedCpuTime += t - prev.lastActivation;
     next.lastActivation = t;
+    if(&prev == &next) return; //Thread continues running, no context switch
+    prev.maxBurst = std::max(prev.maxBurst, t - prev.burstStart);
+    if(prevReady)
+    {
+        prev.involuntarySwitches++;
+        prev.readySince = t;
+    } else prev.voluntarySwitches++;
+    if(next.readySince >= 0) next.readyTime += t - next.readySince;
+    next.readySince = -1;
+    next.burstStart = t;
 }
 
 /**
@@ -45,6 +45,23 @@ struct CPUTimeCounterPrivateThreadData
     long long lastActivation = 0;
     /// Cumulative amount of CPU time used by this thread
     long long usedCpuTime = 0;
+    /// Timestamp of the last time this thread was scheduled after having been
+    /// descheduled, used to compute the run burst
+    long long burstStart = 0;
+    /// Longest run burst of this thread
+    long long maxBurst = 0;
+    /// Timestamp of when the thread became ready, or -1 if the thread is
+    /// running, blocked or the time it became ready is unknown
+    long long readySince = -1;
+    /// Cumulative amount of time this thread was ready but not running
+    long long readyTime = 0;
+    /// Cumulative amount of time spent in interrupts that interrupted this
+    /// thread
+    long long irqTime = 0;
+    /// Number of times this thread was descheduled because it blocked
+    unsigned int voluntarySwitches = 0;
+    /// Number of times this thread was descheduled while still ready
+    unsigned int involuntarySwitches = 0;
     /// Next thread in the thread list used by CPUTimeCounter
     Thread *next = nullptr;
 };
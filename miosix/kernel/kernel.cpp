@@ -37,6 +37,7 @@
 #include "stdlib_integration/libc_integration.h"
 #include "interfaces/os_timer.h"
 #include "timeconversion.h"
+#include "kernel_trace.h"
 #include <stdexcept>
 #include <algorithm>
 #include <limits>
@@ -108,6 +109,13 @@ void *idleThread(void *argv)
             existDeleted=false;
             Scheduler::PKremoveDeadThreads();
         }
+        #ifdef WITH_STACK_PROFILER
+        //Scan thread stacks in small steps, so that higher priority threads
+        //can preempt the idle thread in between, then go to sleep. The number
+        //of steps is bounded, what remains is scanned the next time
+        for(unsigned int i=0;i<STACK_PROFILER_IDLE_STEPS;i++)
+            if(StackProfiler::scanStep()==false) break;
+        #endif //WITH_STACK_PROFILER
         #ifndef JTAG_DISABLE_SLEEP
         //JTAG debuggers lose communication with the device if it enters sleep
         //mode, so to use debugging it is necessary to remove this instruction
@@ -240,6 +248,10 @@ void startKernel()
     
     // Make the C standard library use per-thread reeentrancy structure
     setCReentrancyCallback(Thread::getCReent);
+
+    #ifdef WITH_KERNEL_TRACE
+    KernelTrace::IRQinit();
+    #endif //WITH_KERNEL_TRACE
     
     // Dispatch the task to the architecture-specific function
     kernelStarted=true;
@@ -615,6 +627,7 @@ int Thread::getStackSize()
 
 void Thread::IRQstackOverflowCheck()
 {
+    #ifndef WITH_MPU_STACK_GUARD
     const unsigned int watermarkSize=WATERMARK_LEN/sizeof(unsigned int);
     for(unsigned int i=0;i<watermarkSize;i++)
     {
@@ -623,7 +636,16 @@ void Thread::IRQstackOverflowCheck()
     if(runningThread->ctxsave[stackPtrOffsetInCtxsave] <
         reinterpret_cast<unsigned int>(runningThread->watermark+watermarkSize))
         errorHandler(STACK_OVERFLOW);
+    #endif //WITH_MPU_STACK_GUARD
+    //With the MPU stack guard overflows fault as soon as they happen
+}
+
+#ifdef WITH_MPU_STACK_GUARD
+void Thread::IRQupdateStackGuard()
+{
+    IRQsetStackGuard(runningThread->watermark);
 }
+#endif //WITH_MPU_STACK_GUARD
 
 #ifdef WITH_PROCESSES
 
@@ -884,18 +906,27 @@ struct _reent *Thread::getCReent()
 
 void Thread::ThreadFlags::IRQsetWait(bool waiting)
 {
-    if(waiting) flags |= WAIT; else flags &= ~WAIT;
+    if(waiting)
+    {
+        flags |= WAIT;
+        traceEvent(TraceEvent::Wait,this->t);
+    } else {
+        if(flags & WAIT) traceEvent(TraceEvent::Wakeup,this->t);
+        flags &= ~WAIT;
+    }
     Scheduler::IRQwaitStatusHook(this->t);
 }
 
 void Thread::ThreadFlags::IRQsetSleep()
 {
     flags |= SLEEP;
+    traceEvent(TraceEvent::Sleep,this->t);
     Scheduler::IRQwaitStatusHook(this->t);
 }
 
 void Thread::ThreadFlags::IRQclearSleepAndWait()
 {
+    if(flags & (WAIT | SLEEP)) traceEvent(TraceEvent::Wakeup,this->t);
     flags &= ~(WAIT | SLEEP);
     Scheduler::IRQwaitStatusHook(this->t);
 }
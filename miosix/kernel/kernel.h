@@ -33,6 +33,7 @@
 #include "stdlib_integration/libstdcpp_integration.h"
 #include "intrusive.h"
 #include "cpu_time_counter_types.h"
+#include "stack_profiler_types.h"
 
 /**
  * \namespace miosix
@@ -903,6 +904,15 @@ public:
      * being preempted has overflowed
      */
     static void IRQstackOverflowCheck();
+
+    #ifdef WITH_MPU_STACK_GUARD
+    /**
+     * \internal
+     * Used after every context switch to move the MPU stack guard below the
+     * stack of the thread that is about to run
+     */
+    static void IRQupdateStackGuard();
+    #endif //WITH_MPU_STACK_GUARD
     
     #ifdef WITH_PROCESSES
 
@@ -1225,6 +1235,9 @@ private:
     #ifdef WITH_CPU_TIME_COUNTER
     CPUTimeCounterPrivateThreadData timeCounterData;
     #endif //WITH_CPU_TIME_COUNTER
+    #ifdef WITH_STACK_PROFILER
+    StackProfilerPrivateThreadData stackProfilerData;
+    #endif //WITH_STACK_PROFILER
     
     //friend functions
     //Needs access to flags
@@ -1252,6 +1265,10 @@ private:
     //Needs access to timeCounterData
     friend class CPUTimeCounter;
     #endif //WITH_CPU_TIME_COUNTER
+    #ifdef WITH_STACK_PROFILER
+    //Needs access to stackProfilerData, watermark, stacksize
+    friend class StackProfiler;
+    #endif //WITH_STACK_PROFILER
 };
 
 /**
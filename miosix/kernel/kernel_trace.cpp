@@ -0,0 +1,107 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "kernel_trace.h"
+#include <algorithm>
+#include <unistd.h>
+
+#ifdef WITH_KERNEL_TRACE
+
+namespace miosix {
+
+/**
+ * \internal
+ * Header of a trace dump. All fields are little endian
+ */
+struct TraceDumpHeader
+{
+    unsigned int magic;     ///< Always 0x5254584d, "MXTR"
+    unsigned int version;   ///< Format version, currently 1
+    unsigned int frequency; ///< Frequency of the timestamp counter in Hz
+    unsigned int records;   ///< Number of records following the header
+    unsigned int lost;      ///< Number of records overwritten
+};
+
+KernelTrace::Record KernelTrace::buffer[KERNEL_TRACE_RECORDS];
+volatile int KernelTrace::writeIndex=0;
+volatile bool KernelTrace::enabled=false;
+
+void KernelTrace::clear()
+{
+    bool wasEnabled=enabled;
+    enabled=false;
+    writeIndex=0;
+    enabled=wasEnabled;
+}
+
+bool KernelTrace::dump(int fd)
+{
+    bool wasEnabled=enabled;
+    enabled=false;
+    //Records reserved but not yet filled by an interrupted writer may contain
+    //stale data. This is unavoidable with a lock-free writer, and the decoder
+    //will see them as out of order events
+    unsigned int written=writeIndex;
+    unsigned int count=std::min(written,KERNEL_TRACE_RECORDS);
+    TraceDumpHeader header;
+    header.magic=0x5254584d;
+    header.version=1;
+    header.frequency=SystemCoreClock;
+    header.records=count;
+    header.lost=written-count;
+    bool result=write(fd,&header,sizeof(header))==sizeof(header);
+    //Write the oldest records first, that is, the ones after writeIndex
+    unsigned int first=(written-count) & (KERNEL_TRACE_RECORDS-1);
+    unsigned int tail=std::min(count,KERNEL_TRACE_RECORDS-first);
+    if(result && tail>0)
+    {
+        int size=tail*sizeof(Record);
+        result=write(fd,&buffer[first],size)==size;
+    }
+    if(result && count>tail)
+    {
+        int size=(count-tail)*sizeof(Record);
+        result=write(fd,&buffer[0],size)==size;
+    }
+    enabled=wasEnabled;
+    return result;
+}
+
+void KernelTrace::IRQinit()
+{
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    #if __CORTEX_M == 7
+    DWT->LAR=0xc5acce55; //Cortex-M7 requires unlocking the DWT registers
+    #endif //__CORTEX_M == 7
+    DWT->CYCCNT=0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+    enabled=true;
+}
+
+} //namespace miosix
+
+#endif //WITH_KERNEL_TRACE
@@ -0,0 +1,264 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#pragma once
+
+#include "config/miosix_settings.h"
+#include "interfaces/atomic_ops.h"
+#include "cpu_time_counter.h"
+
+#ifdef WITH_KERNEL_TRACE
+#include "interfaces/arch_registers.h"
+
+#if !defined(__CORTEX_M) || (__CORTEX_M < 3)
+#error WITH_KERNEL_TRACE requires a CPU with the DWT cycle counter
+#endif
+#endif //WITH_KERNEL_TRACE
+
+namespace miosix {
+
+/**
+ * \addtogroup Kernel
+ * \{
+ */
+
+/**
+ * Kinds of events recorded by KernelTrace
+ */
+enum class TraceEvent : unsigned char
+{
+    ContextSwitch=0,   ///< Argument is the thread that starts running
+    IrqEntry=1,        ///< Argument is the interrupt number
+    IrqExit=2,         ///< Argument is the interrupt number
+    Wakeup=3,          ///< Argument is the thread being woken
+    Sleep=4,           ///< Argument is the thread going to sleep
+    Wait=5,            ///< Argument is the thread going in wait status
+    MutexContention=6, ///< Argument is the thread owning the contended mutex
+    User=7             ///< Argument is an user-defined integer
+};
+
+#ifdef WITH_KERNEL_TRACE
+
+/**
+ * KernelTrace is a ring buffer that records kernel events for the purpose of
+ * measuring latencies. It is enabled only if the symbol `WITH_KERNEL_TRACE`
+ * has been defined in config/miosix_settings.h.
+ *
+ * Each record is 8 bytes, a 32 bit timestamp taken from the DWT cycle counter,
+ * and a 32 bit word containing the event type in the 3 least significant bits
+ * and its argument in the remaining bits. Thread pointers are always aligned
+ * to 8 bytes, so they are stored as-is, while integers are shifted left by 3.
+ *
+ * Writing a record is lock-free and can be done from any context, including
+ * interrupts and with the kernel paused. When the buffer is full the oldest
+ * records are overwritten.
+ *
+ * Interrupts are recorded only for the handlers that call IRQtraceIrqEntry()
+ * and IRQtraceIrqExit(), or declare a TracedInterrupt. These are the OS timer
+ * and the STM32 serial port and SD card drivers, other drivers are not traced.
+ *
+ * The content of the buffer can be written to a file with dump() and then
+ * converted to the Chrome trace format with the decoder in
+ * _tools/kernel_trace.
+ */
+class KernelTrace
+{
+public:
+    /**
+     * Record an event whose argument is a thread.
+     * Can be called from any context.
+     * \param e event type
+     * \param t thread
+     */
+    static inline void record(TraceEvent e, const void *t)
+    {
+        doRecord(reinterpret_cast<unsigned int>(t) | static_cast<unsigned int>(e));
+    }
+
+    /**
+     * Record an event whose argument is an integer.
+     * Can be called from any context.
+     * \param e event type
+     * \param arg argument, must be less than 2^29
+     */
+    static inline void record(TraceEvent e, unsigned int arg)
+    {
+        doRecord(arg<<3 | static_cast<unsigned int>(e));
+    }
+
+    /**
+     * Start recording events. Recording is started automatically when the
+     * kernel is started.
+     */
+    static void start() { enabled=true; }
+
+    /**
+     * Stop recording events, freezing the content of the buffer.
+     */
+    static void stop() { enabled=false; }
+
+    /**
+     * Discard all recorded events
+     */
+    static void clear();
+
+    /**
+     * Write the content of the trace buffer to a file, oldest record first.
+     * Recording is paused while writing, and then restarted only if it was
+     * not stopped with stop() before the call.
+     * \param fd file descriptor where the trace is written
+     * \return true on success
+     */
+    static bool dump(int fd);
+
+    /**
+     * \internal
+     * Start the cycle counter and enable recording. Called by startKernel()
+     */
+    static void IRQinit();
+
+    KernelTrace() = delete;
+
+private:
+    /**
+     * \internal
+     * Reserve a record in the ring buffer and fill it
+     * \param payload event type and argument
+     */
+    static inline void doRecord(unsigned int payload)
+    {
+        if(enabled==false) return;
+        int i=atomicAddExchange(&writeIndex,1);
+        Record& r=buffer[i & (KERNEL_TRACE_RECORDS-1)];
+        r.timestamp=DWT->CYCCNT;
+        r.payload=payload;
+    }
+
+    /**
+     * \internal
+     * A trace record
+     */
+    struct Record
+    {
+        unsigned int timestamp; ///< Value of the cycle counter
+        unsigned int payload;   ///< Event type and argument
+    };
+
+    static_assert((KERNEL_TRACE_RECORDS & (KERNEL_TRACE_RECORDS-1))==0,
+                  "KERNEL_TRACE_RECORDS must be a power of two");
+
+    static Record buffer[KERNEL_TRACE_RECORDS]; ///< Ring buffer
+    static volatile int writeIndex; ///< Total number of records written
+    static volatile bool enabled;   ///< True if recording events
+};
+
+/**
+ * Record an event in the kernel trace. Does nothing if WITH_KERNEL_TRACE is
+ * not defined in config/miosix_settings.h.
+ * \param e event type
+ * \param arg event argument, either a thread or an integer
+ */
+template<typename T>
+inline void traceEvent(TraceEvent e, T arg) { KernelTrace::record(e,arg); }
+
+#else //WITH_KERNEL_TRACE
+
+template<typename T>
+inline void traceEvent(TraceEvent, T) {}
+
+#endif //WITH_KERNEL_TRACE
+
+/**
+ * Interrupt handlers that want to be accounted in the kernel trace and in the
+ * interrupt time of CPUTimeCounter should call this function as the first
+ * thing they do.
+ * \param irq interrupt number, used to identify the interrupt in the trace
+ */
+inline void IRQtraceIrqEntry(unsigned int irq)
+{
+    #ifdef WITH_CPU_TIME_COUNTER
+    CPUTimeCounter::IRQenterInterrupt();
+    #endif //WITH_CPU_TIME_COUNTER
+    traceEvent(TraceEvent::IrqEntry,irq);
+}
+
+/**
+ * Interrupt handlers that want to be accounted in the kernel trace and in the
+ * interrupt time of CPUTimeCounter should call this function as the last
+ * thing they do.
+ * \param irq interrupt number, used to identify the interrupt in the trace
+ */
+inline void IRQtraceIrqExit(unsigned int irq)
+{
+    traceEvent(TraceEvent::IrqExit,irq);
+    #ifdef WITH_CPU_TIME_COUNTER
+    CPUTimeCounter::IRQexitInterrupt();
+    #endif //WITH_CPU_TIME_COUNTER
+}
+
+/**
+ * Interrupt handlers with more than one return path can declare an object of
+ * this class as the first thing they do, instead of calling IRQtraceIrqEntry()
+ * and IRQtraceIrqExit(). The interrupt number is read from the CPU.
+ */
+class TracedInterrupt
+{
+public:
+    /**
+     * Constructor, calls IRQtraceIrqEntry()
+     */
+    TracedInterrupt() : irq(activeInterrupt()) { IRQtraceIrqEntry(irq); }
+
+    /**
+     * Destructor, calls IRQtraceIrqExit()
+     */
+    ~TracedInterrupt() { IRQtraceIrqExit(irq); }
+
+    TracedInterrupt(const TracedInterrupt&)=delete;
+    TracedInterrupt& operator= (const TracedInterrupt&)=delete;
+
+private:
+    /**
+     * \return the number of the interrupt being served
+     */
+    static unsigned int activeInterrupt()
+    {
+        #ifdef WITH_KERNEL_TRACE
+        return (SCB->ICSR & SCB_ICSR_VECTACTIVE_Msk)-16;
+        #else //WITH_KERNEL_TRACE
+        return 0; //Only used by the trace
+        #endif //WITH_KERNEL_TRACE
+    }
+
+    const unsigned int irq;
+};
+
+/**
+ * \}
+ */
+
+} //namespace miosix
@@ -0,0 +1,91 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "periodic_task.h"
+#include <algorithm>
+
+using namespace std;
+
+namespace miosix {
+
+//
+// class PeriodicTask
+//
+
+PeriodicTask::PeriodicTask(long long periodNs, OverrunPolicy policy,
+        long long firstReleaseNs, long long relativeDeadlineNs)
+    : period(max(periodNs,1LL)),
+      relativeDeadline(relativeDeadlineNs>0 ? relativeDeadlineNs : period),
+      policy(policy)
+{
+    reset(firstReleaseNs);
+}
+
+bool PeriodicTask::waitForNextRelease()
+{
+    bool result=true;
+    //The first activation can't overrun, as there was no previous release
+    if(activations>0)
+    {
+        long long now=getTime();
+        if(now>getCurrentDeadline())
+        {
+            result=false;
+            overruns++;
+        }
+        if(policy==OverrunPolicy::Skip && now>release)
+        {
+            //Jump to the first release in the future, keeping the phase
+            long long missed=(now-release)/period+1;
+            release+=missed*period;
+            skipped+=missed;
+        }
+    }
+    #ifdef SCHED_TYPE_EDF
+    //Set the deadline before sleeping, so that as soon as the thread is woken
+    //it is scheduled according to the deadline of the new release
+    Thread::setPriority(Priority(release+relativeDeadline));
+    #endif //SCHED_TYPE_EDF
+    Thread::nanoSleepUntil(release);
+    lastJitter=getTime()-release;
+    maxJitter=max(maxJitter,lastJitter);
+    activations++;
+    release+=period;
+    return result;
+}
+
+void PeriodicTask::reset(long long firstReleaseNs)
+{
+    release=firstReleaseNs<0 ? getTime() : firstReleaseNs;
+    lastJitter=0;
+    maxJitter=0;
+    activations=0;
+    overruns=0;
+    skipped=0;
+}
+
+} //namespace miosix
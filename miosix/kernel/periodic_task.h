@@ -0,0 +1,187 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#pragma once
+
+#include "kernel.h"
+
+namespace miosix {
+
+/**
+ * \addtogroup Kernel
+ * \{
+ */
+
+/**
+ * This class implements the common pattern of a thread that needs to perform
+ * some work periodically. Releases are computed as absolute times starting
+ * from a given start time, so that the period does not drift regardless of
+ * the time spent in the loop body, and overruns (the loop body taking longer
+ * than one period) are detected and counted.
+ *
+ * Example:
+ * \code
+ * void periodicThread()
+ * {
+ *     PeriodicTask task(90000000); //Run every 90 milliseconds
+ *     for(;;)
+ *     {
+ *         task.waitForNextRelease();
+ *         //Do work
+ *     }
+ * }
+ * \endcode
+ *
+ * When the EDF scheduler is selected, waitForNextRelease() also sets the
+ * deadline of the calling thread to the release time plus the relative
+ * deadline (by default, equal to the period) so that the thread is scheduled
+ * according to its periodic timing constraints without further intervention.
+ *
+ * A PeriodicTask object is meant to be used only by one thread, the one
+ * calling waitForNextRelease().
+ * \since Miosix 2.7
+ */
+class PeriodicTask
+{
+public:
+    /**
+     * What to do when the loop body takes longer than one period
+     */
+    enum class OverrunPolicy
+    {
+        /// Missed releases are skipped, the next release is the first one
+        /// that is still in the future. The phase of the releases is kept.
+        Skip,
+        /// Missed releases are not skipped, waitForNextRelease() returns
+        /// immediately until the task has caught up with the release times.
+        CatchUp
+    };
+
+    /**
+     * Constructor
+     * \param periodNs task period in nanoseconds, must be positive
+     * \param policy what to do in case of overruns
+     * \param firstReleaseNs absolute time of the first release. If negative,
+     * the first release is the current time, so the first call to
+     * waitForNextRelease() returns immediately
+     * \param relativeDeadlineNs relative deadline, only used by the EDF
+     * scheduler. If zero or negative, the deadline is equal to the period
+     */
+    PeriodicTask(long long periodNs, OverrunPolicy policy=OverrunPolicy::Skip,
+                 long long firstReleaseNs=-1, long long relativeDeadlineNs=0);
+
+    /**
+     * Wait until the next release time. Must be called by the thread that
+     * executes the task, once per iteration of its loop.
+     * \return false if an overrun was detected, that is, if the previous
+     * release was not completed before the following release time
+     *
+     * CANNOT be called when the kernel is paused.
+     */
+    bool waitForNextRelease();
+
+    /**
+     * Restart the task with a new first release time. Statistics are
+     * cleared as well.
+     * \param firstReleaseNs absolute time of the first release. If negative,
+     * the first release is the current time
+     */
+    void reset(long long firstReleaseNs=-1);
+
+    /**
+     * \return the task period in nanoseconds
+     */
+    long long getPeriod() const { return period; }
+
+    /**
+     * \return the absolute time of the last release, that is, the time when
+     * the last call to waitForNextRelease() should have returned
+     */
+    long long getLastRelease() const { return release-period; }
+
+    /**
+     * \return the absolute time of the next release
+     */
+    long long getNextRelease() const { return release; }
+
+    /**
+     * \return the absolute deadline of the current release
+     */
+    long long getCurrentDeadline() const
+    {
+        return getLastRelease()+relativeDeadline;
+    }
+
+    /**
+     * \return the number of times waitForNextRelease() returned
+     */
+    unsigned int getActivationCount() const { return activations; }
+
+    /**
+     * \return the number of detected overruns
+     */
+    unsigned int getOverrunCount() const { return overruns; }
+
+    /**
+     * \return the number of releases skipped due to the OverrunPolicy::Skip
+     * policy
+     */
+    unsigned int getSkippedCount() const { return skipped; }
+
+    /**
+     * \return the release jitter of the last activation, that is, the time
+     * between the release time and the time the thread actually resumed
+     * execution, in nanoseconds
+     */
+    long long getLastJitter() const { return lastJitter; }
+
+    /**
+     * \return the maximum release jitter since the task was (re)started,
+     * in nanoseconds
+     */
+    long long getMaxJitter() const { return maxJitter; }
+
+    PeriodicTask(const PeriodicTask&) = delete;
+    PeriodicTask& operator= (const PeriodicTask&) = delete;
+
+private:
+    const long long period;   ///< Task period
+    long long relativeDeadline; ///< Relative deadline, used by EDF
+    long long release;        ///< Absolute time of the next release
+    long long lastJitter;     ///< Jitter of the last activation
+    long long maxJitter;      ///< Maximum jitter
+    unsigned int activations; ///< Number of activations
+    unsigned int overruns;    ///< Number of overruns
+    unsigned int skipped;     ///< Number of skipped releases
+    const OverrunPolicy policy; ///< Overrun policy
+};
+
+/**
+ * \}
+ */
+
+} //namespace miosix
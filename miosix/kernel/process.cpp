@@ -54,6 +54,33 @@ namespace miosix {
  */
 static bool aligned(void *x) { return (reinterpret_cast<unsigned>(x) & 0b11)==0; }
 
+/**
+ * Copy the buffer list of readv() or writev() from userspace, so that the
+ * process can't change it after it has been validated
+ * \param mpu the process memory protection data
+ * \param list userspace pointer to the buffer list
+ * \param iovcnt number of buffers
+ * \param iov the list is copied here, must have room for IOV_MAX elements
+ * \param forWriting true if the buffers will be written (readv)
+ * \return 0 on success, or a negative number on failure
+ */
+static int copyIovec(const MPUConfiguration& mpu, void *list, int iovcnt,
+        struct iovec *iov, bool forWriting)
+{
+    if(iovcnt<0 || iovcnt>IOV_MAX) return -EINVAL;
+    size_t size=iovcnt*sizeof(struct iovec);
+    if(!mpu.withinForReading(list,size) || !aligned(list)) return -EFAULT;
+    memcpy(iov,list,size);
+    for(int i=0;i<iovcnt;i++)
+    {
+        if(iov[i].iov_len==0) continue;
+        bool ok=forWriting ? mpu.withinForWriting(iov[i].iov_base,iov[i].iov_len)
+                           : mpu.withinForReading(iov[i].iov_base,iov[i].iov_len);
+        if(!ok) return -EFAULT;
+    }
+    return 0;
+}
+
 /**
  * This class contains information on all the processes in the system
  */
@@ -95,11 +122,14 @@ Processes& Processes::instance()
 // class Process
 //
 
-pid_t Process::create(const ElfProgram& program)
+pid_t Process::create(const ElfProgram& program, bool inheritFiles)
 {
     Processes& p=Processes::instance();
     ProcessBase *parent=Thread::getCurrentThread()->proc;
     unique_ptr<Process> proc(new Process(program));
+    //The child inherits the open files, copied only when one of the two
+    //processes opens or closes a file
+    if(inheritFiles) proc->fileTable=parent->fileTable;
     {   
         Lock<Mutex> l(p.procMutex);
         proc->pid=getNewPid();
@@ -349,7 +379,7 @@ bool Process::handleSvc(miosix_private::SyscallParameters sp)
                     } else {
                         ElfProgram program(res.first,res.second);
                         int ret=0;
-                        pid_t child=Process::create(program);
+                        pid_t child=Process::create(program,true);
                         Process::waitpid(child,&ret,0);
                         sp.setReturnValue(WEXITSTATUS(ret));
                     }
@@ -491,6 +521,113 @@ bool Process::handleSvc(miosix_private::SyscallParameters sp)
                 } else sp.setReturnValue(-EFAULT);
                 break;
             }
+            case SYS_FTRUNCATE:
+            {
+                //Offsets are unsigned 32 bit, see the comment in process.h
+                off_t length=sp.getSecondParameter();
+                int result=fileTable.ftruncate(sp.getFirstParameter(),length);
+                sp.setReturnValue(result);
+                break;
+            }
+            case SYS_FALLOCATE:
+            {
+                off_t offset=sp.getSecondParameter();
+                off_t len=sp.getThirdParameter();
+                int result=fileTable.fallocate(sp.getFirstParameter(),
+                    offset,len);
+                sp.setReturnValue(result);
+                break;
+            }
+            case SYS_READV:
+            case SYS_WRITEV:
+            {
+                bool isRead=sp.getSyscallId()==SYS_READV;
+                struct iovec iov[IOV_MAX];
+                int iovcnt=sp.getThirdParameter();
+                int result=copyIovec(mpu,
+                    reinterpret_cast<void*>(sp.getSecondParameter()),
+                    iovcnt,iov,isRead);
+                if(result==0)
+                {
+                    int fd=sp.getFirstParameter();
+                    if(isRead) result=fileTable.readv(fd,iov,iovcnt);
+                    else result=fileTable.writev(fd,iov,iovcnt);
+                }
+                sp.setReturnValue(result);
+                break;
+            }
+            case SYS_PREAD:
+            {
+                int fd=sp.getFirstParameter();
+                void *ptr=reinterpret_cast<void*>(sp.getSecondParameter());
+                size_t size=sp.getThirdParameter();
+                off_t pos=sp.getFourthParameter(); //Zero extended
+                if(mpu.withinForWriting(ptr,size))
+                {
+                    ssize_t result=fileTable.pread(fd,ptr,size,pos);
+                    sp.setReturnValue(result);
+                } else sp.setReturnValue(-EFAULT);
+                break;
+            }
+            case SYS_PWRITE:
+            {
+                int fd=sp.getFirstParameter();
+                const void *ptr=reinterpret_cast<const void*>(sp.getSecondParameter());
+                size_t size=sp.getThirdParameter();
+                off_t pos=sp.getFourthParameter(); //Zero extended
+                if(mpu.withinForReading(ptr,size))
+                {
+                    ssize_t result=fileTable.pwrite(fd,ptr,size,pos);
+                    sp.setReturnValue(result);
+                } else sp.setReturnValue(-EFAULT);
+                break;
+            }
+            case SYS_POLL:
+            {
+                struct pollfd *fds=reinterpret_cast<struct pollfd*>(sp.getFirstParameter());
+                nfds_t nfds=sp.getSecondParameter();
+                int timeout=sp.getThirdParameter(); //In milliseconds
+                //Checked here as nfds*sizeof(pollfd) could overflow
+                if(nfds>MAX_OPEN_FILES) sp.setReturnValue(-EINVAL);
+                else if(mpu.withinForWriting(fds,nfds*sizeof(struct pollfd))
+                        && aligned(fds))
+                {
+                    long long timeoutNs=timeout<0 ? -1 : timeout*1000000LL;
+                    sp.setReturnValue(fileTable.poll(fds,nfds,timeoutNs));
+                } else sp.setReturnValue(-EFAULT);
+                break;
+            }
+            case SYS_PIPE:
+            {
+                int *fds=reinterpret_cast<int*>(sp.getFirstParameter());
+                if(mpu.withinForWriting(fds,2*sizeof(int)) && aligned(fds))
+                {
+                    int result=fileTable.pipe(fds);
+                    sp.setReturnValue(result);
+                } else sp.setReturnValue(-EFAULT);
+                break;
+            }
+            case SYS_SPLICE:
+            {
+                int fdIn=sp.getFirstParameter();
+                int fdOut=sp.getSecondParameter();
+                size_t len=sp.getThirdParameter();
+                unsigned int flags=sp.getFourthParameter();
+                ssize_t result=fileTable.splice(fdIn,fdOut,len,flags);
+                sp.setReturnValue(result);
+                break;
+            }
+            case SYS_MKFIFO:
+            {
+                const char *str;
+                str=reinterpret_cast<const char*>(sp.getFirstParameter());
+                if(mpu.withinForReading(str))
+                {
+                    int result=fileTable.mkfifo(str,sp.getSecondParameter());
+                    sp.setReturnValue(result);
+                } else sp.setReturnValue(-EFAULT);
+                break;
+            }
             default:
                 exitCode=SIGSYS; //Bad syscall
                 #ifdef WITH_ERRLOG
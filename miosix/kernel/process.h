@@ -60,6 +60,10 @@ enum Syscalls
     SYS_USERSPACE=1,
     
     // Standard unix syscalls. Use of these SVC by kernel threads is forbidden.
+    // The syscall number goes in r3 and parameters in r0-r2, a fourth one
+    // goes in r12 (SYS_PREAD/SYS_PWRITE offset, SYS_SPLICE flags). File
+    // offsets are passed as an unsigned 32 bit value: the userspace stubs in
+    // crt0.s reject 64 bit offsets with a nonzero upper word with EINVAL.
     SYS_EXIT=2,
     SYS_WRITE=3,
     SYS_READ=4,
@@ -80,7 +84,17 @@ enum Syscalls
     SYS_MKDIR=19,
     SYS_RMDIR=20,
     SYS_UNLINK=21,
-    SYS_RENAME=22
+    SYS_RENAME=22,
+    SYS_FTRUNCATE=23,
+    SYS_FALLOCATE=24,
+    SYS_READV=25,
+    SYS_WRITEV=26,
+    SYS_PREAD=27,
+    SYS_PWRITE=28,
+    SYS_POLL=29,
+    SYS_PIPE=30,
+    SYS_SPLICE=31,
+    SYS_MKFIFO=32
 };
 
 //Forware decl
@@ -126,13 +140,17 @@ class Process : public ProcessBase
 {
 public:
     /**
-     * Create a new process
+     * Create a new process. The process starts with stdin, stdout and stderr
+     * opened on the default console
      * \param program Program that the process will execute
      * \return the pid of the newly created process
      * \throws std::exception or a subclass in case of errors, including
      * not emough memory to spawn the process
      */
-    static pid_t create(const ElfProgram& program);
+    static pid_t create(const ElfProgram& program)
+    {
+        return create(program,false);
+    }
     
     /**
      * Given a process, returns the pid of its parent.
@@ -175,6 +193,17 @@ private:
      */
     Process(const ElfProgram& program);
     
+    /**
+     * Create a new process
+     * \param program Program that the process will execute
+     * \param inheritFiles if true the process shares the file descriptor
+     * table of the calling process, copied when one of the two opens or
+     * closes a file. Used by SYS_SYSTEM
+     * \return the pid of the newly created process
+     * \throws std::exception or a subclass in case of errors
+     */
+    static pid_t create(const ElfProgram& program, bool inheritFiles);
+    
     /**
      * Contains the process' main loop. 
      * \param argv the process pointer is passed here
@@ -34,6 +34,7 @@
 #include "kernel.h"
 #include "intrusive.h"
 #include "sync.h"
+#include "kernel_trace.h"
 
 namespace miosix {
 
@@ -65,6 +66,7 @@ static inline void IRQdoMutexLock(pthread_mutex_t *mutex,
         } else errorHandler(MUTEX_DEADLOCK); //Bad, deadlock
     }
 
+    traceEvent(TraceEvent::MutexContention,mutex->owner);
     WaitingList waiting; //Element of a linked list on stack
     waiting.thread=p;
     waiting.next=nullptr; //Putting this thread last on the list (lifo policy)
@@ -115,6 +117,7 @@ static inline void IRQdoMutexLockToDepth(pthread_mutex_t *mutex,
         } else errorHandler(MUTEX_DEADLOCK); //Bad, deadlock
     }
 
+    traceEvent(TraceEvent::MutexContention,mutex->owner);
     WaitingList waiting; //Element of a linked list on stack
     waiting.thread=p;
     waiting.next=nullptr; //Putting this thread last on the list (lifo policy)
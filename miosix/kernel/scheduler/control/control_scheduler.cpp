@@ -241,7 +241,7 @@ void ControlScheduler::IRQfindNextThread()
                 #endif
                 IRQsetNextPreemptionForIdle();
                 #ifdef WITH_CPU_TIME_COUNTER
-                IRQprofileContextSwitch(prev->timeCounterData,
+                IRQprofileContextSwitch(prev->timeCounterData,prev->flags.isReady(),
                                         idle->timeCounterData,burstStart);
                 #endif //WITH_CPU_TIME_COUNTER
                 return;
@@ -271,7 +271,7 @@ void ControlScheduler::IRQfindNextThread()
             #endif //WITH_PROCESSES
             IRQsetNextPreemption(curInRound->schedData.bo/multFactor);
             #ifdef WITH_CPU_TIME_COUNTER
-            IRQprofileContextSwitch(prev->timeCounterData,
+            IRQprofileContextSwitch(prev->timeCounterData,prev->flags.isReady(),
                                     curInRound->timeCounterData,burstStart);
             #endif //WITH_CPU_TIME_COUNTER
             return;
@@ -649,7 +649,7 @@ void ControlScheduler::IRQfindNextThread()
                 #endif
                 IRQsetNextPreemptionForIdle();
                 #ifdef WITH_CPU_TIME_COUNTER
-                IRQprofileContextSwitch(prev->timeCounterData,
+                IRQprofileContextSwitch(prev->timeCounterData,prev->flags.isReady(),
                                         idle->timeCounterData,burstStart);
                 #endif //WITH_CPU_TIME_COUNTER
                 return;
@@ -679,7 +679,7 @@ void ControlScheduler::IRQfindNextThread()
             #endif //WITH_PROCESSES
             IRQsetNextPreemption(runningThread->schedData.bo/multFactor);
             #ifdef WITH_CPU_TIME_COUNTER
-            IRQprofileContextSwitch(prev->timeCounterData,
+            IRQprofileContextSwitch(prev->timeCounterData,prev->flags.isReady(),
                                     (*curInRound)->t->timeCounterData,burstStart);
             #endif //WITH_CPU_TIME_COUNTER
             return;
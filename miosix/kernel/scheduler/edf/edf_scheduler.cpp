@@ -154,8 +154,8 @@ void EDFScheduler::IRQfindNextThread()
             #endif //WITH_PROCESSES
             IRQsetNextPreemption();
             #ifdef WITH_CPU_TIME_COUNTER
-            IRQprofileContextSwitch(prev->timeCounterData,walk->timeCounterData,
-                                    IRQgetTime());
+            IRQprofileContextSwitch(prev->timeCounterData,prev->flags.isReady(),
+                                    walk->timeCounterData,IRQgetTime());
             #endif //WITH_CPU_TIME_COUNTER
             return;
         }
@@ -255,7 +255,8 @@ void PriorityScheduler::IRQfindNextThread()
                 IRQsetNextPreemption(false);
                 #else //WITH_CPU_TIME_COUNTER
                 auto t=IRQsetNextPreemption(false);
-                IRQprofileContextSwitch(prev->timeCounterData,temp->timeCounterData,t);
+                IRQprofileContextSwitch(prev->timeCounterData,
+                        prev->flags.isReady(),temp->timeCounterData,t);
                 #endif //WITH_CPU_TIME_COUNTER
                 return;
             } else temp=temp->schedData.next;
@@ -272,7 +273,8 @@ void PriorityScheduler::IRQfindNextThread()
     IRQsetNextPreemption(true);
     #else //WITH_CPU_TIME_COUNTER
     auto t=IRQsetNextPreemption(true);
-    IRQprofileContextSwitch(prev->timeCounterData,idle->timeCounterData,t);
+    IRQprofileContextSwitch(prev->timeCounterData,prev->flags.isReady(),
+                            idle->timeCounterData,t);
     #endif //WITH_CPU_TIME_COUNTER
 }
 
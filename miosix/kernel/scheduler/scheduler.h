@@ -32,6 +32,8 @@
 #include "kernel/scheduler/control/control_scheduler.h"
 #include "kernel/scheduler/edf/edf_scheduler.h"
 #include "kernel/cpu_time_counter.h"
+#include "kernel/stack_profiler.h"
+#include "kernel/kernel_trace.h"
 
 namespace miosix {
 
@@ -70,6 +72,9 @@ public:
         #ifdef WITH_CPU_TIME_COUNTER
         if(res) CPUTimeCounter::PKaddThread(thread);
         #endif
+        #ifdef WITH_STACK_PROFILER
+        if(res) StackProfiler::PKaddThread(thread);
+        #endif
         return res;
     }
 
@@ -97,6 +102,9 @@ public:
         #ifdef WITH_CPU_TIME_COUNTER
         CPUTimeCounter::PKremoveDeadThreads();
         #endif
+        #ifdef WITH_STACK_PROFILER
+        StackProfiler::PKremoveDeadThreads();
+        #endif
         T::PKremoveDeadThreads();
     }
 
@@ -137,6 +145,9 @@ public:
         #ifdef WITH_CPU_TIME_COUNTER
         CPUTimeCounter::IRQaddIdleThread(idleThread);
         #endif
+        #ifdef WITH_STACK_PROFILER
+        StackProfiler::IRQaddIdleThread(idleThread);
+        #endif
         return T::IRQsetIdleThread(idleThread);
     }
 
@@ -148,6 +159,9 @@ public:
      */
     static void IRQwaitStatusHook(Thread *t)
     {
+        #ifdef WITH_CPU_TIME_COUNTER
+        CPUTimeCounter::IRQwaitStatusHook(t);
+        #endif
         T::IRQwaitStatusHook(t);
     }
 
@@ -165,7 +179,17 @@ public:
      */
     static void IRQfindNextThread()
     {
+        #ifndef WITH_KERNEL_TRACE
+        T::IRQfindNextThread();
+        #else //WITH_KERNEL_TRACE
+        Thread *prev=Thread::IRQgetCurrentThread();
         T::IRQfindNextThread();
+        Thread *next=Thread::IRQgetCurrentThread();
+        if(next!=prev) KernelTrace::record(TraceEvent::ContextSwitch,next);
+        #endif //WITH_KERNEL_TRACE
+        #ifdef WITH_MPU_STACK_GUARD
+        Thread::IRQupdateStackGuard();
+        #endif //WITH_MPU_STACK_GUARD
     }
     
     /**
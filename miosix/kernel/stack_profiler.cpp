@@ -0,0 +1,179 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#include "stack_profiler.h"
+#include "kernel/scheduler/scheduler.h"
+
+#ifdef WITH_STACK_PROFILER
+
+namespace miosix {
+
+Thread *StackProfiler::head = nullptr;
+Thread *StackProfiler::scanThread = nullptr;
+
+/**
+ * Scan a stack downwards, from the lowest word checked up to now, for words
+ * overwritten since the last scan
+ * \param bottom stack bottom
+ * \param boundary lowest overwritten word found, updated by the scan
+ * \param cursor lowest word checked, updated by the scan
+ * \param maxWords maximum number of words to check
+ * \return true if the scan is complete, that is it reached the stack bottom or
+ * STACK_PROFILER_MAX_HOLE consecutive words still containing STACK_FILL
+ */
+static bool scanDown(unsigned int *bottom, unsigned int *& boundary,
+                     unsigned int *& cursor, unsigned int maxWords)
+{
+    while(cursor > bottom &&
+          static_cast<unsigned int>(boundary - cursor) < STACK_PROFILER_MAX_HOLE)
+    {
+        if(maxWords-- == 0) return false;
+        cursor--;
+        if(*cursor != STACK_FILL) boundary = cursor;
+    }
+    return true;
+}
+
+bool StackProfiler::getStackInfo(Thread *thread, Data& data)
+{
+    if(thread == nullptr) return false;
+    PauseKernelLock lock;
+    if(Scheduler::PKexists(thread) == false) return false;
+    data = PKgetData(thread);
+    return true;
+}
+
+void StackProfiler::snapshot(std::vector<Data>& data)
+{
+    data.clear();
+    for(;;)
+    {
+        // Allocating memory with the kernel paused is not allowed, so count
+        // the threads first and retry if more threads were created meanwhile
+        unsigned int n = 0;
+        {
+            PauseKernelLock lock;
+            for(Thread *t = head; t; t = t->stackProfilerData.next) n++;
+        }
+        data.reserve(n + 4);
+        PauseKernelLock lock;
+        Thread *t;
+        for(t = head; t && data.size() < data.capacity();
+            t = t->stackProfilerData.next)
+        {
+            if(t->flags.isDeleted() == false) data.push_back(PKgetData(t));
+        }
+        if(t == nullptr) return;
+        data.clear();
+    }
+}
+
+unsigned int StackProfiler::getCurrentThreadAbsoluteFreeStack()
+{
+    Thread *self = Thread::getCurrentThread();
+    auto& d = self->stackProfilerData;
+    // The boundary can only move downwards, and only the current thread
+    // overwrites its stack, so the scan is done without keeping the kernel
+    // paused. Only the result is published atomically
+    unsigned int *bottom = stackBottom(self);
+    unsigned int *boundary;
+    {
+        PauseKernelLock lock;
+        boundary = d.boundary;
+    }
+    // Threads not yet added to the scheduler have never been scanned
+    if(boundary == nullptr) boundary = stackTop(self);
+    unsigned int *cursor = boundary;
+    scanDown(bottom, boundary, cursor, ~0u);
+    unsigned int *walk;
+    {
+        PauseKernelLock lock;
+        if(d.boundary == nullptr || boundary < d.boundary) d.boundary = boundary;
+        walk = d.boundary;
+    }
+    unsigned int count = (walk - bottom) * sizeof(unsigned int);
+    // This takes in account CTXSAVE_ON_STACK. It might underestimate the
+    // absolute free stack (by a maximum of CTXSAVE_ON_STACK) but it will
+    // never overestimate it
+    if(count <= CTXSAVE_ON_STACK) return 0;
+    return count - CTXSAVE_ON_STACK;
+}
+
+bool StackProfiler::scanStep()
+{
+    PauseKernelLock lock;
+    if(scanThread == nullptr)
+    {
+        scanThread = head;
+        if(scanThread == nullptr) return false;
+    }
+    auto& d = scanThread->stackProfilerData;
+    // The boundary may have been moved below the cursor by
+    // getCurrentThreadAbsoluteFreeStack(), in that case resume from it
+    if(d.cursor > d.boundary) d.cursor = d.boundary;
+    if(scanDown(stackBottom(scanThread), d.boundary, d.cursor,
+                STACK_PROFILER_SCAN_STEP) == false) return true;
+    // Completed a scan of this thread, the next one resumes from the boundary
+    d.cursor = d.boundary;
+    d.scans++;
+    scanThread = d.next;
+    return scanThread != nullptr;
+}
+
+void StackProfiler::PKremoveDeadThreads()
+{
+    Thread *prev = nullptr;
+    Thread *cur = head;
+    while(cur)
+    {
+        if(cur->flags.isDeleted())
+        {
+            if(prev) prev->stackProfilerData.next = cur->stackProfilerData.next;
+            else head = cur->stackProfilerData.next;
+            if(scanThread == cur) scanThread = cur->stackProfilerData.next;
+        } else {
+            prev = cur;
+        }
+        cur = cur->stackProfilerData.next;
+    }
+}
+
+StackProfiler::Data StackProfiler::PKgetData(Thread *thread)
+{
+    Data res;
+    auto& d = thread->stackProfilerData;
+    res.thread = thread;
+    res.stackSize = thread->stacksize;
+    unsigned int count = (d.boundary - stackBottom(thread)) * sizeof(int);
+    if(count > CTXSAVE_ON_STACK) res.absoluteFreeStack = count - CTXSAVE_ON_STACK;
+    res.scans = d.scans;
+    return res;
+}
+
+}
+
+#endif // WITH_STACK_PROFILER
@@ -0,0 +1,193 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#pragma once
+
+#include "kernel.h"
+#include "stack_profiler_types.h"
+#include <vector>
+
+#ifdef WITH_STACK_PROFILER
+
+namespace miosix {
+
+/**
+ * \addtogroup Kernel
+ * \{
+ */
+
+/**
+ * StackProfiler provides the stack high-water mark of all the threads in the
+ * system, to help choosing stack sizes. It is enabled only if the symbol
+ * `WITH_STACK_PROFILER` has been defined in config/miosix_settings.h.
+ *
+ * Stacks are filled with STACK_FILL when a thread is created, and the
+ * high-water mark is the lowest stack word that has been overwritten. Instead
+ * of scanning the stack every time the high-water mark is requested, the idle
+ * thread scans the stacks in the background, in steps of at most
+ * STACK_PROFILER_SCAN_STEP words with the kernel paused. The lowest
+ * overwritten word found is cached per thread, and each scan starts from
+ * the cached boundary and proceeds downwards, stopping after
+ * STACK_PROFILER_MAX_HOLE consecutive words still containing STACK_FILL,
+ * so its cost depends on how much the stack grew since the last scan and
+ * not on its size. Querying the high-water mark of a thread is O(1).
+ *
+ * Due to the background scan, the returned values lag behind the actual stack
+ * usage until the idle thread gets to run again, and may thus underestimate
+ * the used stack of a thread that recently reached a new maximum. The scans
+ * field of Data allows to tell whether the stack has been scanned after a
+ * given point in time. Only the kernel-side stacks of threads are profiled,
+ * the userspace stacks of processes are not.
+ */
+class StackProfiler
+{
+public:
+    /**
+     * Stack information for a thread
+     */
+    struct Data
+    {
+        /// The thread this data belongs to
+        Thread *thread = nullptr;
+        /// The stack size of the thread, as requested when it was created
+        unsigned int stackSize = 0;
+        /// Absolute free stack, the minimum free stack since the thread was
+        /// created, as of the last scan
+        unsigned int absoluteFreeStack = 0;
+        /// Number of complete scans of the stack of the thread, zero if the
+        /// stack has not yet been completely scanned and absoluteFreeStack
+        /// may still be overestimated
+        unsigned int scans = 0;
+    };
+
+    /**
+     * Get the stack information of a thread. This function does not scan the
+     * stack and is O(1).
+     * \param thread the thread
+     * \param data the stack information is returned here
+     * \return false if the thread does not exist
+     */
+    static bool getStackInfo(Thread *thread, Data& data);
+
+    /**
+     * Get the stack information of all threads. This function does not scan
+     * the stacks, and takes O(1) per thread.
+     * \param data the stack information is returned here, one element per
+     * thread, in no particular order. The previous content is discarded.
+     */
+    static void snapshot(std::vector<Data>& data);
+
+    /**
+     * Scan the stack of the current thread downwards from the cached boundary
+     * and return its absolute free stack. Unlike getStackInfo() the returned
+     * value is up to date, at the cost of scanning the part of the stack used
+     * since the last scan.
+     * \return the absolute free stack of the current thread
+     */
+    static unsigned int getCurrentThreadAbsoluteFreeStack();
+
+    /**
+     * \internal
+     * Called by the idle thread to perform a bounded step of the background
+     * scan.
+     * \return true if there is more to scan, false if a complete scan of all
+     * threads was just completed
+     */
+    static bool scanStep();
+
+private:
+    /**
+     * \internal
+     * Add the idle thread to the list of threads tracked by StackProfiler.
+     * \param thread The idle thread.
+     */
+    static void IRQaddIdleThread(Thread *thread)
+    {
+        PKaddThread(thread);
+    }
+
+    /**
+     * \internal
+     * Add an item to the list of threads tracked by StackProfiler.
+     * \param thread The thread to be added.
+     */
+    static void PKaddThread(Thread *thread)
+    {
+        auto& data = thread->stackProfilerData;
+        data.boundary = stackTop(thread);
+        data.cursor = data.boundary;
+        data.next = head;
+        head = thread;
+    }
+
+    /**
+     * \internal
+     * Update the list of threads tracked by StackProfiler to remove dead
+     * threads.
+     */
+    static void PKremoveDeadThreads();
+
+    /**
+     * \internal
+     * \return the first word of the stack of a thread, just above the
+     * watermark
+     */
+    static unsigned int *stackBottom(Thread *thread)
+    {
+        return thread->watermark + WATERMARK_LEN / sizeof(unsigned int);
+    }
+
+    /**
+     * \internal
+     * \return one past the last word of the stack of a thread. The Thread
+     * class is allocated right after the stack
+     */
+    static unsigned int *stackTop(Thread *thread)
+    {
+        return reinterpret_cast<unsigned int*>(thread);
+    }
+
+    /**
+     * \internal
+     * \returns the stack information of a thread
+     */
+    static Data PKgetData(Thread *thread);
+
+    static Thread *head; ///< Head of the thread list
+    static Thread *scanThread; ///< Thread being scanned in the background
+
+    // Needs access to PKaddThread, PKremoveDeadThreads, IRQaddIdleThread
+    template<typename> friend class basic_scheduler;
+};
+
+/**
+ * \}
+ */
+
+}
+
+#endif // WITH_STACK_PROFILER
@@ -0,0 +1,60 @@
+/***************************************************************************
+ *   Copyright (C) 2026 by Terraneo Federico                               *
+ *                                                                         *
+ *   This program is free software; you can redistribute it and/or modify  *
+ *   it under the terms of the GNU General Public License as published by  *
+ *   the Free Software Foundation; either version 2 of the License, or     *
+ *   (at your option) any later version.                                   *
+ *                                                                         *
+ *   This program is distributed in the hope that it will be useful,       *
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of        *
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the         *
+ *   GNU General Public License for more details.                          *
+ *                                                                         *
+ *   As a special exception, if other files instantiate templates or use   *
+ *   macros or inline functions from this file, or you compile this file   *
+ *   and link it with other works to produce a work based on this file,    *
+ *   this file does not by itself cause the resulting work to be covered   *
+ *   by the GNU General Public License. However the source code for this   *
+ *   file must still be made available in accordance with the GNU General  *
+ *   Public License. This exception does not invalidate any other reasons  *
+ *   why a work based on this file might be covered by the GNU General     *
+ *   Public License.                                                       *
+ *                                                                         *
+ *   You should have received a copy of the GNU General Public License     *
+ *   along with this program; if not, see <http://www.gnu.org/licenses/>   *
+ ***************************************************************************/
+
+#pragma once
+
+#include "config/miosix_settings.h"
+
+#ifdef WITH_STACK_PROFILER
+
+namespace miosix {
+
+class Thread;
+
+/**
+ * \internal
+ * Thread-local data structure used by the implementation of StackProfiler
+ */
+struct StackProfilerPrivateThreadData
+{
+    /// Lowest stack word found overwritten up to now. The stack grows
+    /// downwards, so every word below this is known to still contain
+    /// STACK_FILL, at least as of the last time it was scanned
+    unsigned int *boundary = nullptr;
+    /// Lowest word checked by the background scan, which proceeds downwards
+    /// from the boundary. All words between the cursor and the boundary
+    /// still contain STACK_FILL
+    unsigned int *cursor = nullptr;
+    /// Number of complete scans of the stack of this thread
+    unsigned int scans = 0;
+    /// Next thread in the thread list used by StackProfiler
+    Thread *next = nullptr;
+};
+
+}
+
+#endif // WITH_STACK_PROFILER
@@ -30,6 +30,7 @@
 #include "kernel/scheduler/scheduler.h"
 #include "error.h"
 #include "pthread_private.h"
+#include "kernel_trace.h"
 #include <algorithm>
 
 using namespace std;
@@ -84,6 +85,7 @@ void Mutex::PKlock(PauseKernelLock& dLock)
     }
 
     //Add thread to mutex' waiting queue
+    traceEvent(TraceEvent::MutexContention,owner);
     waiting.push_back(p);
     push_heap(waiting.begin(),waiting.end(),PKlowerPriority);
 
@@ -136,6 +138,7 @@ void Mutex::PKlockToDepth(PauseKernelLock& dLock, unsigned int depth)
     }
 
     //Add thread to mutex' waiting queue
+    traceEvent(TraceEvent::MutexContention,owner);
     waiting.push_back(p);
     push_heap(waiting.begin(),waiting.end(),PKlowerPriority);
 
@@ -507,4 +510,47 @@ TimedWaitResult Semaphore::timedWait(long long absTime)
     return TimedWaitResult::NoTimeout;
 }
 
+//
+// class WaitQueue
+//
+
+void WaitQueue::remove(WaitQueueEntry *entry)
+{
+    FastInterruptDisableLock dLock;
+    if(entry->queue==nullptr) return;
+    entry->queue->waiting.removeFast(entry);
+    entry->queue=nullptr;
+}
+
+bool WaitQueue::IRQwakeAllNoPreempt()
+{
+    //Entries stay in the queue, if the thread goes back to waiting it does
+    //not need to add them again
+    bool hppw=false;
+    Thread *cur=Thread::IRQgetCurrentThread();
+    for(auto entry : waiting)
+    {
+        *entry->woken=true;
+        entry->thread->IRQwakeup();
+        if(cur->IRQgetPriority()<entry->thread->IRQgetPriority()) hppw=true;
+    }
+    return hppw;
+}
+
+void WaitQueue::IRQwakeAll()
+{
+    if(IRQwakeAllNoPreempt()) Scheduler::IRQfindNextThread();
+}
+
+void WaitQueue::wakeAll()
+{
+    bool hppw;
+    {
+        //Global interrupt lock because WaitQueue is IRQ-safe
+        FastInterruptDisableLock dLock;
+        hppw=IRQwakeAllNoPreempt();
+    }
+    if(hppw) Thread::yield();
+}
+
 } //namespace miosix
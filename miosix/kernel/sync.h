@@ -659,6 +659,94 @@ private:
     IntrusiveList<WaitToken> fifo; ///< List of waiting threads
 };
 
+class WaitQueue;
+
+/**
+ * \internal
+ * Links a thread waiting in poll() to the WaitQueue of one of the files it
+ * waits for. All the entries of a poll() share the thread and woken flag.
+ */
+class WaitQueueEntry : public IntrusiveListItem
+{
+public:
+    WaitQueueEntry() : thread(nullptr), woken(nullptr), queue(nullptr) {}
+
+    Thread *thread;       ///< Waiting thread
+    volatile bool *woken; ///< Set when one of the files becomes ready
+    WaitQueue *queue;     ///< Queue the entry is in, or nullptr
+};
+
+/**
+ * A list of threads waiting for a file to become ready, used to implement
+ * poll() and select(). A file that can block keeps a WaitQueue, adds the
+ * waiting threads to it when its poll() member function is called, and wakes
+ * them when data can be read or written without blocking. The waiting
+ * threads remove themselves from the queue.
+ *
+ * Like Semaphore, it is possible to wake the waiting threads from an interrupt
+ * handler by using the APIs prefixed by `IRQ'.
+ */
+class WaitQueue
+{
+public:
+    /**
+     * Constructor
+     */
+    WaitQueue() {}
+
+    /**
+     * Add a waiting thread.
+     * \param entry entry of the waiting thread, not already in a queue
+     */
+    void add(WaitQueueEntry *entry)
+    {
+        FastInterruptDisableLock dLock;
+        IRQadd(entry);
+    }
+
+    /**
+     * Add a waiting thread. Only for use with interrupts disabled.
+     * \param entry entry of the waiting thread, not already in a queue
+     */
+    void IRQadd(WaitQueueEntry *entry)
+    {
+        entry->queue=this;
+        waiting.push_back(entry);
+    }
+
+    /**
+     * Remove a waiting thread from the queue it is in, if any.
+     * \param entry entry of the waiting thread
+     */
+    static void remove(WaitQueueEntry *entry);
+
+    /**
+     * Wake all the waiting threads. Only for use in IRQ handlers.
+     * \warning Use in a thread context with interrupts disabled or with the
+     * kernel paused is forbidden.
+     */
+    void IRQwakeAll();
+
+    /**
+     * Wake all the waiting threads.
+     */
+    void wakeAll();
+
+    // Disallow copies
+    WaitQueue(const WaitQueue&) = delete;
+    WaitQueue& operator= (const WaitQueue&) = delete;
+
+private:
+    /**
+     * \internal
+     * Wake all the waiting threads without triggering a rescheduling.
+     * \return true if a woken thread has higher priority than the current one
+     */
+    bool IRQwakeAllNoPreempt();
+
+    IntrusiveList<WaitQueueEntry> waiting; ///< List of waiting threads
+};
+
 /**
  * \}
  */
@@ -39,6 +39,9 @@
 #include <kernel/sync.h>
 #include <kernel/queue.h>
 #include <kernel/cpu_time_counter.h>
+#include <kernel/periodic_task.h>
+#include <kernel/kernel_trace.h>
+#include <kernel/stack_profiler.h>
 /* Utilities */
 #include <util/util.h>
 /* Settings */
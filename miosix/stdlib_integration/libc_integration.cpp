@@ -27,8 +27,11 @@
 
 #include "libc_integration.h"
 #include <stdexcept>
+#include <algorithm>
+#include <memory>
 #include <stdio.h>
 #include <string.h>
+#include <limits.h>
 #include <stdarg.h>
 #include <unistd.h>
 #include <dirent.h>
@@ -36,10 +39,14 @@
 #include <sys/stat.h>
 #include <sys/fcntl.h>
 #include <sys/times.h>
+#if __has_include(<sys/select.h>)
+#include <sys/select.h>
+#endif //__has_include(<sys/select.h>)
 //// Settings
 #include "config/miosix_settings.h"
 //// Filesystem
 #include "filesystem/file_access.h"
+#include "filesystem/ioctl.h"
 //// Console
 #include "kernel/logging.h"
 //// kernel interface
@@ -425,6 +432,473 @@ off_t lseek(int fd, off_t pos, int whence)
     return _lseek_r(miosix::getReent(),fd,pos,whence);
 }
 
+/**
+ * \internal
+ * writev, write to a file from multiple buffers
+ */
+ssize_t writev(int fd, const struct iovec *iov, int iovcnt)
+{
+    #ifdef WITH_FILESYSTEM
+
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        ssize_t result=miosix::getFileDescriptorTable().writev(fd,iov,iovcnt);
+        if(result>=0) return result;
+        miosix::getReent()->_errno=-result;
+        return -1;
+    #ifndef __NO_EXCEPTIONS
+    } catch(exception& e) {
+        miosix::getReent()->_errno=ENOMEM;
+        return -1;
+    }
+    #endif //__NO_EXCEPTIONS
+    
+    #else //WITH_FILESYSTEM
+    if(fd==STDOUT_FILENO || fd==STDERR_FILENO)
+    {
+        ssize_t result=miosix::DefaultConsole::instance().getTerminal()->writev(
+            iov,iovcnt);
+        if(result>=0) return result;
+        miosix::getReent()->_errno=-result;
+        return -1;
+    } else {
+        miosix::getReent()->_errno=EBADF;
+        return -1;
+    }
+    #endif //WITH_FILESYSTEM
+}
+
+/**
+ * \internal
+ * readv, read from a file into multiple buffers
+ */
+ssize_t readv(int fd, const struct iovec *iov, int iovcnt)
+{
+    #ifdef WITH_FILESYSTEM
+
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        ssize_t result=miosix::getFileDescriptorTable().readv(fd,iov,iovcnt);
+        if(result>=0) return result;
+        miosix::getReent()->_errno=-result;
+        return -1;
+    #ifndef __NO_EXCEPTIONS
+    } catch(exception& e) {
+        miosix::getReent()->_errno=ENOMEM;
+        return -1;
+    }
+    #endif //__NO_EXCEPTIONS
+    
+    #else //WITH_FILESYSTEM
+    if(fd==STDIN_FILENO)
+    {
+        ssize_t result=miosix::DefaultConsole::instance().getTerminal()->readv(
+            iov,iovcnt);
+        if(result>=0) return result;
+        miosix::getReent()->_errno=-result;
+        return -1;
+    } else {
+        miosix::getReent()->_errno=EBADF;
+        return -1;
+    }
+    #endif //WITH_FILESYSTEM
+}
+
+/**
+ * \internal
+ * pwrite, write to a given position in a file
+ */
+ssize_t pwrite(int fd, const void *buf, size_t cnt, off_t pos)
+{
+    #ifdef WITH_FILESYSTEM
+
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        ssize_t result=miosix::getFileDescriptorTable().pwrite(fd,buf,cnt,pos);
+        if(result>=0) return result;
+        miosix::getReent()->_errno=-result;
+        return -1;
+    #ifndef __NO_EXCEPTIONS
+    } catch(exception& e) {
+        miosix::getReent()->_errno=ENOMEM;
+        return -1;
+    }
+    #endif //__NO_EXCEPTIONS
+    
+    #else //WITH_FILESYSTEM
+    miosix::getReent()->_errno=ESPIPE;
+    return -1;
+    #endif //WITH_FILESYSTEM
+}
+
+/**
+ * \internal
+ * pread, read from a given position in a file
+ */
+ssize_t pread(int fd, void *buf, size_t cnt, off_t pos)
+{
+    #ifdef WITH_FILESYSTEM
+
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        ssize_t result=miosix::getFileDescriptorTable().pread(fd,buf,cnt,pos);
+        if(result>=0) return result;
+        miosix::getReent()->_errno=-result;
+        return -1;
+    #ifndef __NO_EXCEPTIONS
+    } catch(exception& e) {
+        miosix::getReent()->_errno=ENOMEM;
+        return -1;
+    }
+    #endif //__NO_EXCEPTIONS
+    
+    #else //WITH_FILESYSTEM
+    miosix::getReent()->_errno=ESPIPE;
+    return -1;
+    #endif //WITH_FILESYSTEM
+}
+
+/**
+ * \internal
+ * poll, wait until one of a set of files is ready
+ */
+int poll(struct pollfd *fds, nfds_t nfds, int timeout)
+{
+    #ifdef WITH_FILESYSTEM
+
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        long long timeoutNs=timeout<0 ? -1 : timeout*1000000LL;
+        int result=miosix::getFileDescriptorTable().poll(fds,nfds,timeoutNs);
+        if(result>=0) return result;
+        miosix::getReent()->_errno=-result;
+        return -1;
+    #ifndef __NO_EXCEPTIONS
+    } catch(exception& e) {
+        miosix::getReent()->_errno=ENOMEM;
+        return -1;
+    }
+    #endif //__NO_EXCEPTIONS
+    
+    #else //WITH_FILESYSTEM
+    miosix::getReent()->_errno=ENOSYS;
+    return -1;
+    #endif //WITH_FILESYSTEM
+}
+
+#if __has_include(<sys/select.h>)
+/**
+ * \internal
+ * select, wait until one of a set of files is ready. Implemented on top of
+ * poll, so it has the same limit of MAX_OPEN_FILES file descriptors
+ */
+int select(int nfds, fd_set *readfds, fd_set *writefds, fd_set *exceptfds,
+           struct timeval *timeout)
+{
+    #ifdef WITH_FILESYSTEM
+    if(nfds<0 || nfds>FD_SETSIZE)
+    {
+        miosix::getReent()->_errno=EINVAL;
+        return -1;
+    }
+    auto events=[=](int i) {
+        short result=0;
+        if(readfds && FD_ISSET(i,readfds)) result|=POLLIN;
+        if(writefds && FD_ISSET(i,writefds)) result|=POLLOUT;
+        if(exceptfds && FD_ISSET(i,exceptfds)) result|=POLLPRI;
+        return result;
+    };
+    //Most calls wait for a few files, so only larger ones allocate memory
+    nfds_t numFds=0;
+    for(int i=0;i<nfds;i++)
+    {
+        if(events(i)==0) continue;
+        if(i>=miosix::MAX_OPEN_FILES)
+        {
+            miosix::getReent()->_errno=EBADF;
+            return -1;
+        }
+        numFds++;
+    }
+    struct pollfd stackFds[miosix::FD_TABLE_CHUNK];
+    std::unique_ptr<struct pollfd[]> heapFds;
+    struct pollfd *fds=stackFds;
+    if(numFds>miosix::FD_TABLE_CHUNK)
+    {
+        #ifndef __NO_EXCEPTIONS
+        try {
+        #endif //__NO_EXCEPTIONS
+            heapFds.reset(new struct pollfd[numFds]);
+        #ifndef __NO_EXCEPTIONS
+        } catch(exception& e) {
+            miosix::getReent()->_errno=ENOMEM;
+            return -1;
+        }
+        #endif //__NO_EXCEPTIONS
+        fds=heapFds.get();
+    }
+    numFds=0;
+    for(int i=0;i<nfds;i++)
+    {
+        short ev=events(i);
+        if(ev==0) continue;
+        fds[numFds].fd=i;
+        fds[numFds].events=ev;
+        numFds++;
+    }
+    int ms=-1;
+    if(timeout)
+    {
+        long long t=timeout->tv_sec*1000LL+(timeout->tv_usec+999)/1000;
+        ms=min<long long>(t,INT_MAX);
+    }
+    int result=poll(fds,numFds,ms);
+    if(result<0) return result;
+    for(nfds_t i=0;i<numFds;i++)
+        if(fds[i].revents & POLLNVAL)
+        {
+            miosix::getReent()->_errno=EBADF;
+            return -1;
+        }
+    if(readfds) FD_ZERO(readfds);
+    if(writefds) FD_ZERO(writefds);
+    if(exceptfds) FD_ZERO(exceptfds);
+    result=0;
+    for(nfds_t i=0;i<numFds;i++)
+    {
+        //Errors and hangups make the file readable and writable, as the
+        //read or write then returns without blocking
+        short ev=fds[i].revents;
+        if(ev & (POLLERR | POLLHUP)) ev|=fds[i].events & (POLLIN | POLLOUT);
+        if((ev & POLLIN) && (fds[i].events & POLLIN))
+        {
+            FD_SET(fds[i].fd,readfds);
+            result++;
+        }
+        if((ev & POLLOUT) && (fds[i].events & POLLOUT))
+        {
+            FD_SET(fds[i].fd,writefds);
+            result++;
+        }
+        if((ev & POLLPRI) && (fds[i].events & POLLPRI))
+        {
+            FD_SET(fds[i].fd,exceptfds);
+            result++;
+        }
+    }
+    return result;
+    
+    #else //WITH_FILESYSTEM
+    miosix::getReent()->_errno=ENOSYS;
+    return -1;
+    #endif //WITH_FILESYSTEM
+}
+#endif //__has_include(<sys/select.h>)
+
+/**
+ * \internal
+ * pipe, create a pipe
+ */
+int pipe(int fds[2])
+{
+    #ifdef WITH_FILESYSTEM
+
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        int result=miosix::getFileDescriptorTable().pipe(fds);
+        if(result>=0) return result;
+        miosix::getReent()->_errno=-result;
+        return -1;
+    #ifndef __NO_EXCEPTIONS
+    } catch(exception& e) {
+        miosix::getReent()->_errno=ENOMEM;
+        return -1;
+    }
+    #endif //__NO_EXCEPTIONS
+    
+    #else //WITH_FILESYSTEM
+    miosix::getReent()->_errno=ENFILE;
+    return -1;
+    #endif //WITH_FILESYSTEM
+}
+
+/**
+ * \internal
+ * splice, move data between a pipe and a file without copying it to an
+ * intermediate buffer. Offsets are not supported, the file pointer is used
+ */
+ssize_t splice(int fdIn, off_t *offIn, int fdOut, off_t *offOut, size_t len,
+               unsigned int flags)
+{
+    if(offIn || offOut)
+    {
+        miosix::getReent()->_errno=EINVAL;
+        return -1;
+    }
+    #ifdef WITH_FILESYSTEM
+
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        ssize_t result=miosix::getFileDescriptorTable().splice(fdIn,fdOut,len,flags);
+        if(result>=0) return result;
+        miosix::getReent()->_errno=-result;
+        return -1;
+    #ifndef __NO_EXCEPTIONS
+    } catch(exception& e) {
+        miosix::getReent()->_errno=ENOMEM;
+        return -1;
+    }
+    #endif //__NO_EXCEPTIONS
+    
+    #else //WITH_FILESYSTEM
+    miosix::getReent()->_errno=EBADF;
+    return -1;
+    #endif //WITH_FILESYSTEM
+}
+
+/**
+ * \internal
+ * mmap, map a range of a file in memory. Only read-only mappings of files
+ * whose storage is memory addressable are supported, and addr is ignored
+ */
+void *mmap(void *addr, size_t len, int prot, int flags, int fd, off_t offset)
+{
+    #ifdef WITH_FILESYSTEM
+    const void *result;
+    int error=miosix::getFileDescriptorTable().mmap(&result,len,prot,flags,
+                                                    fd,offset);
+    if(error==0) return const_cast<void*>(result);
+    miosix::getReent()->_errno=-error;
+    return MAP_FAILED;
+    
+    #else //WITH_FILESYSTEM
+    miosix::getReent()->_errno=EBADF;
+    return MAP_FAILED;
+    #endif //WITH_FILESYSTEM
+}
+
+/**
+ * \internal
+ * munmap, remove a mapping
+ */
+int munmap(void *addr, size_t len)
+{
+    //Mappings point directly into the storage, there is nothing to release
+    if(len==0)
+    {
+        miosix::getReent()->_errno=EINVAL;
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * \internal
+ * ftruncate, truncate or extend a file
+ */
+int ftruncate(int fd, off_t length)
+{
+    #ifdef WITH_FILESYSTEM
+
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        int result=miosix::getFileDescriptorTable().ftruncate(fd,length);
+        if(result>=0) return result;
+        miosix::getReent()->_errno=-result;
+        return -1;
+    #ifndef __NO_EXCEPTIONS
+    } catch(exception& e) {
+        miosix::getReent()->_errno=ENOMEM;
+        return -1;
+    }
+    #endif //__NO_EXCEPTIONS
+    
+    #else //WITH_FILESYSTEM
+    miosix::getReent()->_errno=EBADF;
+    return -1;
+    #endif //WITH_FILESYSTEM
+}
+
+/**
+ * \internal
+ * posix_fallocate, allocate storage for a range of a file. Unlike most
+ * functions, it returns the error code instead of setting errno
+ */
+int posix_fallocate(int fd, off_t offset, off_t len)
+{
+    #ifdef WITH_FILESYSTEM
+
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        return -miosix::getFileDescriptorTable().fallocate(fd,offset,len);
+    #ifndef __NO_EXCEPTIONS
+    } catch(exception& e) {
+        return ENOMEM;
+    }
+    #endif //__NO_EXCEPTIONS
+    
+    #else //WITH_FILESYSTEM
+    return EBADF;
+    #endif //WITH_FILESYSTEM
+}
+
+/**
+ * \internal
+ * posix_fadvise, declare the access pattern of a file. Sequential access
+ * enables streaming mode on files that support it. Like posix_fallocate, it
+ * returns the error code instead of setting errno
+ */
+int posix_fadvise(int fd, off_t offset, off_t len, int advice)
+{
+    #ifdef WITH_FILESYSTEM
+
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        //Streaming applies to the whole file, so offset and len are ignored
+        unsigned int disable=0;
+        int result;
+        switch(advice)
+        {
+            case POSIX_FADV_SEQUENTIAL:
+                result=miosix::getFileDescriptorTable().ioctl(fd,
+                        miosix::IOCTL_STREAMING,nullptr);
+                break;
+            case POSIX_FADV_NORMAL:
+            case POSIX_FADV_RANDOM:
+                result=miosix::getFileDescriptorTable().ioctl(fd,
+                        miosix::IOCTL_STREAMING,&disable);
+                break;
+            case POSIX_FADV_WILLNEED:
+            case POSIX_FADV_DONTNEED:
+            case POSIX_FADV_NOREUSE:
+                return 0;
+            default:
+                return EINVAL;
+        }
+        //Advice is only a hint, files that do not support it ignore it
+        if(result>=0 || result==-ENOTTY) return 0;
+        return -result;
+    #ifndef __NO_EXCEPTIONS
+    } catch(exception& e) {
+        return ENOMEM;
+    }
+    #endif //__NO_EXCEPTIONS
+    
+    #else //WITH_FILESYSTEM
+    return EBADF;
+    #endif //WITH_FILESYSTEM
+}
+
 /**
  * \internal
  * _fstat_r, return file info
@@ -729,6 +1203,34 @@ int mkdir(const char *path, mode_t mode)
     return _mkdir_r(miosix::getReent(),path,mode);
 }
 
+/**
+ * \internal
+ * mkfifo, create a FIFO
+ */
+int mkfifo(const char *path, mode_t mode)
+{
+    #ifdef WITH_FILESYSTEM
+
+    #ifndef __NO_EXCEPTIONS
+    try {
+    #endif //__NO_EXCEPTIONS
+        int result=miosix::getFileDescriptorTable().mkfifo(path,mode);
+        if(result>=0) return result;
+        miosix::getReent()->_errno=-result;
+        return -1;
+    #ifndef __NO_EXCEPTIONS
+    } catch(exception& e) {
+        miosix::getReent()->_errno=ENOMEM;
+        return -1;
+    }
+    #endif //__NO_EXCEPTIONS
+    
+    #else //WITH_FILESYSTEM
+    miosix::getReent()->_errno=ENOENT;
+    return -1;
+    #endif //WITH_FILESYSTEM
+}
+
 /**
  * \internal
  * _rmdir_r, remove a directory if empty
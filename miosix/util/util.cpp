@@ -33,6 +33,7 @@
 #include <malloc.h>
 #include "util.h"
 #include "kernel/kernel.h"
+#include "kernel/stack_profiler.h"
 #include "stdlib_integration/libc_integration.h"
 #include "config/miosix_settings.h" //For WATERMARK_FILL and STACK_FILL
 
@@ -74,6 +75,10 @@ unsigned int MemoryProfiling::getStackSize()
 
 unsigned int MemoryProfiling::getAbsoluteFreeStack()
 {
+    #ifdef WITH_STACK_PROFILER
+    //Only scan up to the boundary cached by the stack profiler
+    return StackProfiler::getCurrentThreadAbsoluteFreeStack();
+    #else //WITH_STACK_PROFILER
     const unsigned int *walk=miosix::Thread::getStackBottom();
     const unsigned int stackSize=miosix::Thread::getStackSize();
     unsigned int count=0;
@@ -89,6 +94,7 @@ unsigned int MemoryProfiling::getAbsoluteFreeStack()
     //member function can be used to select stack sizes.
     if(count<=CTXSAVE_ON_STACK) return 0;
     return count-CTXSAVE_ON_STACK;
+    #endif //WITH_STACK_PROFILER
 }
 
 unsigned int MemoryProfiling::getCurrentFreeStack()
@@ -163,18 +169,23 @@ void memDump(const void *start, int len)
 
 #ifdef WITH_CPU_TIME_COUNTER
 
-static void printSingleThreadInfo(Thread *self, Thread *thread,
-    int approxDt, long long newTime, long long oldTime, bool isIdleThread,
-    bool isNewThread)
+static void printSingleThreadInfo(Thread *self, int approxDt,
+    const CPUTimeCounter::Data& newData, const CPUTimeCounter::Data& oldData,
+    bool isIdleThread, bool isNewThread)
 {
-    long long threadDt = newTime - oldTime;
+    long long threadDt = newData.usedCpuTime - oldData.usedCpuTime;
     int perc = static_cast<int>(threadDt >> 16) * 100 / approxDt;
-    iprintf("%p %10lld ns (%2d.%1d%%)", thread, threadDt, perc / 10, perc % 10);
+    iprintf("%p %10lld ns (%2d.%1d%%) rdy %10lld ns irq %9lld ns sw %4u/%-4u",
+        newData.thread, threadDt, perc / 10, perc % 10,
+        newData.readyTime - oldData.readyTime,
+        newData.irqTime - oldData.irqTime,
+        newData.voluntarySwitches - oldData.voluntarySwitches,
+        newData.involuntarySwitches - oldData.involuntarySwitches);
     if(isIdleThread)
     {
         iprintf(" (idle)");
         isIdleThread = false;
-    } else if(thread == self) {
+    } else if(newData.thread == self) {
         iprintf(" (cur)");
     }
     if(isNewThread) iprintf(" new");
@@ -203,6 +214,8 @@ void CPUProfiler::print()
     Thread *self = Thread::getCurrentThread();
 
     iprintf("%d threads, last interval %lld ns\n", newInfo.size(), dt);
+    iprintf("thread     cpu time                 ready time       "
+            "irq time         switches (vol/invol)\n");
 
     // Compute the difference between oldInfo and newInfo
     auto oldIt = oldInfo.begin();
@@ -218,8 +231,8 @@ void CPUProfiler::print()
             oldIt++;
         }
         // Found a thread that exists in both lists
-        printSingleThreadInfo(self, newIt->thread, approxDt, newIt->usedCpuTime,
-            oldIt->usedCpuTime, isIdleThread, false);
+        printSingleThreadInfo(self, approxDt, *newIt, *oldIt, isIdleThread,
+            false);
         isIdleThread = false;
         newIt++;
         oldIt++;
@@ -234,8 +247,8 @@ void CPUProfiler::print()
     // Print info about newly created threads
     while(newIt != newInfo.end())
     {
-        printSingleThreadInfo(self, newIt->thread, approxDt, newIt->usedCpuTime,
-            0, isIdleThread, true);
+        printSingleThreadInfo(self, approxDt, *newIt, CPUTimeCounter::Data(),
+            isIdleThread, true);
         isIdleThread = false;
         newIt++;
     }
@@ -243,40 +256,11 @@ void CPUProfiler::print()
 
 void CPUProfiler::Snapshot::collect()
 {
-    // We cannot expand the threadData vector while the kernel is paused.
-    //   Therefore we need to expand the vector earlier, pause the kernel, and
-    // then check if the number of threads stayed the same. If it didn't,
-    // we must unpause the kernel and try again. Otherwise we can fill the
-    // vector.
-    bool success = false;
-    do {
-        // Resize the vector with the current number of threads
-        unsigned int nThreads = CPUTimeCounter::getThreadCount();
-        threadData.resize(nThreads);
-        {
-            // Pause the kernel!
-            PauseKernelLock pLock;
-
-            // If the number of threads changed, try again
-            unsigned int nThreads2 = CPUTimeCounter::getThreadCount();
-            if(nThreads2 != nThreads)
-                continue;
-            // Otherwise, stop trying
-            success = true;
-
-            // Get the current time now. This makes the time accurate with
-            // respect to the data collected, at the cost of making the
-            // update interval imprecise (if this timestamp is then used
-            // to mantain the update interval)
-            time = getTime();
-            // Fetch the CPU time data for all threads
-            auto i1 = threadData.begin();
-            auto i2 = CPUTimeCounter::PKbegin();
-            do
-                *i1++ = *i2++;
-            while(i2 != CPUTimeCounter::PKend());
-        }
-    } while(!success);
+    // The time is taken when the collection is completed. This makes the time
+    // accurate with respect to the data collected, at the cost of making the
+    // update interval imprecise (if this timestamp is then used to mantain
+    // the update interval)
+    time = CPUTimeCounter::snapshot(threadData);
 }
 
 void CPUProfiler::thread(long long nsInterval)